@@ -0,0 +1,93 @@
+#include "clar.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <git2.h>
+
+#include "hash.h"
+
+#define BENCHMARK_HASH_SIZE (64 * 1024 * 1024)
+#define BENCHMARK_SMALL_COUNT 8192
+#define BENCHMARK_SMALL_SIZE 512
+
+static unsigned char *data;
+
+void benchmark_hash__initialize(void)
+{
+	size_t i;
+
+	data = malloc(BENCHMARK_HASH_SIZE);
+	cl_assert(data != NULL);
+
+	for (i = 0; i < BENCHMARK_HASH_SIZE; i++)
+		data[i] = (unsigned char)(i * 31 + 7);
+}
+
+void benchmark_hash__cleanup(void)
+{
+	free(data);
+}
+
+static void hash_buf(git_hash_algorithm_t algorithm, unsigned int flags)
+{
+	unsigned char out[GIT_HASH_MAX_SIZE];
+
+	cl_assert(git_hash_buf_ext(out, data, BENCHMARK_HASH_SIZE,
+		algorithm, flags) == 0);
+}
+
+void benchmark_hash__sha1(void)
+{
+	hash_buf(GIT_HASH_ALGORITHM_SHA1, 0);
+}
+
+void benchmark_hash__sha1_trusted(void)
+{
+	hash_buf(GIT_HASH_ALGORITHM_SHA1, GIT_HASH_TRUSTED);
+}
+
+void benchmark_hash__sha256(void)
+{
+	hash_buf(GIT_HASH_ALGORITHM_SHA256, 0);
+}
+
+/* Many small, object-sized inputs, each with a separate header */
+static void hash_small(git_hash_algorithm_t algorithm, bool multi)
+{
+	static unsigned char out[BENCHMARK_SMALL_COUNT * GIT_HASH_MAX_SIZE];
+	static git_str_vec vec[BENCHMARK_SMALL_COUNT * 2];
+	size_t hash_size = git_hash_size(algorithm), i;
+
+	for (i = 0; i < BENCHMARK_SMALL_COUNT; i++) {
+		vec[i * 2].data = "blob 512";
+		vec[i * 2].len = 9;
+		vec[i * 2 + 1].data = data + (i * BENCHMARK_SMALL_SIZE);
+		vec[i * 2 + 1].len = BENCHMARK_SMALL_SIZE - (i % 64);
+	}
+
+	if (multi) {
+		cl_assert(git_hash_vec_multi(out, vec, 2, BENCHMARK_SMALL_COUNT,
+			algorithm, 0) == 0);
+		return;
+	}
+
+	for (i = 0; i < BENCHMARK_SMALL_COUNT; i++)
+		cl_assert(git_hash_vec(out + (i * hash_size), &vec[i * 2], 2,
+			algorithm) == 0);
+}
+
+void benchmark_hash__sha1_small(void)
+{
+	hash_small(GIT_HASH_ALGORITHM_SHA1, false);
+}
+
+void benchmark_hash__sha256_small(void)
+{
+	hash_small(GIT_HASH_ALGORITHM_SHA256, false);
+}
+
+void benchmark_hash__sha256_small_multi(void)
+{
+	hash_small(GIT_HASH_ALGORITHM_SHA256, true);
+}
@@ -0,0 +1,97 @@
+#include "clar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <git2.h>
+
+#define BENCHMARK_INDEX_COUNT 1000000
+#define BENCHMARK_INDEX_DIRS 500
+
+static git_index *g_index;
+
+static void index_path(char *out, size_t out_len, size_t i)
+{
+	snprintf(out, out_len, "src/module-%03u/component/file-%06u.c",
+		(unsigned int)(i % BENCHMARK_INDEX_DIRS), (unsigned int)i);
+}
+
+void benchmark_index__initialize(void)
+{
+	git_index_entry entry;
+	char path[128];
+	size_t i;
+
+	cl_assert(git_libgit2_init() > 0);
+	cl_assert(git_index_open(&g_index, "bench.index") == 0);
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+	entry.file_size = 1024;
+	entry.mtime.seconds = 1700000000;
+	entry.ctime.seconds = 1700000000;
+	cl_assert(git_oid_fromstr(&entry.id,
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750") == 0);
+
+	for (i = 0; i < BENCHMARK_INDEX_COUNT; i++) {
+		index_path(path, sizeof(path), i);
+		entry.path = path;
+		entry.ino = (uint32_t)i;
+
+		cl_assert(git_index_add(g_index, &entry) == 0);
+	}
+
+	cl_assert(git_index_write(g_index) == 0);
+}
+
+void benchmark_index__reset(void)
+{
+}
+
+void benchmark_index__cleanup(void)
+{
+	git_index_free(g_index);
+	g_index = NULL;
+
+	git_libgit2_shutdown();
+}
+
+void benchmark_index__read(void)
+/* [clar]: description="read an index with 1M entries" */
+{
+	cl_assert(git_index_read(g_index, 1) == 0);
+	cl_assert(git_index_entrycount(g_index) == BENCHMARK_INDEX_COUNT);
+}
+
+void benchmark_index__read_lookup(void)
+/* [clar]: description="read an index and look up 1k paths" */
+{
+	char path[128];
+	size_t i;
+
+	cl_assert(git_index_read(g_index, 1) == 0);
+
+	for (i = 0; i < 1000; i++) {
+		index_path(path, sizeof(path), i * 487);
+		cl_assert(git_index_get_bypath(g_index, path, 0) != NULL);
+	}
+}
+
+void benchmark_index__lookup(void)
+/* [clar]: description="look up 1M paths" */
+{
+	char path[128];
+	size_t i;
+
+	for (i = 0; i < BENCHMARK_INDEX_COUNT; i++) {
+		index_path(path, sizeof(path), i);
+		cl_assert(git_index_get_bypath(g_index, path, 0) != NULL);
+	}
+}
+
+void benchmark_index__write(void)
+/* [clar]: description="write an index with 1M entries" */
+{
+	cl_assert(git_index_write(g_index) == 0);
+}
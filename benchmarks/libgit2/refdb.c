@@ -0,0 +1,211 @@
+#include "clar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <git2.h>
+
+#define BENCHMARK_REFDB_COUNT 10000
+#define BENCHMARK_REFDB_DELETE 1000
+
+static git_repository *repo;
+static git_oid blobs[2];
+static unsigned int generation;
+
+static void refdb_setup(git_refdb_t refdb_type)
+{
+	git_repository_init_options opts = GIT_REPOSITORY_INIT_OPTIONS_INIT;
+	char name[64];
+	size_t i;
+
+	cl_assert(git_libgit2_init() > 0);
+
+	opts.flags = GIT_REPOSITORY_INIT_MKPATH | GIT_REPOSITORY_INIT_BARE;
+	opts.refdb_type = refdb_type;
+
+	cl_assert(git_repository_init_ext(&repo, "refdb.git", &opts) == 0);
+	cl_assert(git_blob_create_from_buffer(&blobs[0], repo, "one\n", 4) == 0);
+	cl_assert(git_blob_create_from_buffer(&blobs[1], repo, "two\n", 4) == 0);
+
+	for (i = 0; i < BENCHMARK_REFDB_COUNT; i++) {
+		git_reference *ref;
+
+		snprintf(name, sizeof(name), "refs/heads/branch-%05u", (unsigned int)i);
+		cl_assert(git_reference_create(&ref, repo, name, &blobs[0], 0, NULL) == 0);
+		git_reference_free(ref);
+	}
+
+	/* Start from packed refs and a compacted stack, respectively */
+	{
+		git_refdb *refdb;
+
+		cl_assert(git_repository_refdb(&refdb, repo) == 0);
+		cl_assert(git_refdb_compress(refdb) == 0);
+		git_refdb_free(refdb);
+	}
+
+	generation = 0;
+}
+
+void benchmark_refdb__initialize_files(void)
+{
+	refdb_setup(GIT_REFDB_FILES);
+}
+
+void benchmark_refdb__initialize_reftable(void)
+{
+	refdb_setup(GIT_REFDB_REFTABLE);
+}
+
+void benchmark_refdb__reset(void)
+{
+}
+
+void benchmark_refdb__cleanup(void)
+{
+	git_repository_free(repo);
+	repo = NULL;
+
+	git_libgit2_shutdown();
+}
+
+static void refdb_lookup(void)
+{
+	char name[64];
+	size_t i;
+
+	for (i = 0; i < BENCHMARK_REFDB_COUNT; i++) {
+		git_reference *ref;
+
+		snprintf(name, sizeof(name), "refs/heads/branch-%05u", (unsigned int)i);
+		cl_assert(git_reference_lookup(&ref, repo, name) == 0);
+		git_reference_free(ref);
+	}
+}
+
+static int count_cb(const char *name, void *payload)
+{
+	size_t *count = payload;
+
+	(void)name;
+	(*count)++;
+
+	return 0;
+}
+
+static void refdb_iterate(const char *glob, size_t expected)
+{
+	size_t count = 0;
+
+	if (glob)
+		cl_assert(git_reference_foreach_glob(repo, glob, count_cb, &count) == 0);
+	else
+		cl_assert(git_reference_foreach_name(repo, count_cb, &count) == 0);
+
+	cl_assert(count == expected);
+}
+
+/* Point every reference at the other blob, one update at a time */
+static void refdb_update(void)
+{
+	const git_oid *id = &blobs[++generation % 2];
+	char name[64];
+	size_t i;
+
+	for (i = 0; i < BENCHMARK_REFDB_COUNT; i++) {
+		git_reference *ref;
+
+		snprintf(name, sizeof(name), "refs/heads/branch-%05u", (unsigned int)i);
+		cl_assert(git_reference_create(&ref, repo, name, id, 1, NULL) == 0);
+		git_reference_free(ref);
+	}
+}
+
+/* Point every reference at the other blob in a single transaction */
+static void refdb_transaction(void)
+{
+	const git_oid *id = &blobs[++generation % 2];
+	git_transaction *tx;
+	char name[64];
+	size_t i;
+
+	cl_assert(git_transaction_new(&tx, repo) == 0);
+
+	for (i = 0; i < BENCHMARK_REFDB_COUNT; i++) {
+		snprintf(name, sizeof(name), "refs/heads/branch-%05u", (unsigned int)i);
+		cl_assert(git_transaction_lock_ref(tx, name) == 0);
+		cl_assert(git_transaction_set_target(tx, name, id, NULL, NULL) == 0);
+	}
+
+	cl_assert(git_transaction_commit(tx) == 0);
+	git_transaction_free(tx);
+}
+
+static void refdb_delete(int transaction)
+{
+	git_transaction *tx = NULL;
+	char name[64];
+	size_t i;
+
+	if (transaction)
+		cl_assert(git_transaction_new(&tx, repo) == 0);
+
+	for (i = 0; i < BENCHMARK_REFDB_DELETE; i++) {
+		snprintf(name, sizeof(name), "refs/heads/branch-%05u", (unsigned int)(i * 7));
+
+		if (transaction) {
+			cl_assert(git_transaction_lock_ref(tx, name) == 0);
+			cl_assert(git_transaction_remove(tx, name) == 0);
+		} else {
+			cl_assert(git_reference_remove(repo, name) == 0);
+		}
+	}
+
+	if (transaction) {
+		cl_assert(git_transaction_commit(tx) == 0);
+		git_transaction_free(tx);
+	}
+}
+
+void benchmark_refdb__lookup(void)
+/* [clar]: description="look up 10k refs" */
+{
+	refdb_lookup();
+}
+
+void benchmark_refdb__iterate(void)
+/* [clar]: description="iterate 10k refs" */
+{
+	refdb_iterate(NULL, BENCHMARK_REFDB_COUNT);
+}
+
+void benchmark_refdb__iterate_prefix(void)
+/* [clar]: description="iterate 100 refs by prefix" */
+{
+	refdb_iterate("refs/heads/branch-012*", 100);
+}
+
+void benchmark_refdb__update(void)
+/* [clar]: description="update 10k refs", runs=3 */
+{
+	refdb_update();
+}
+
+void benchmark_refdb__transaction(void)
+/* [clar]: description="update 10k refs in a transaction", runs=3 */
+{
+	refdb_transaction();
+}
+
+void benchmark_refdb__delete(void)
+/* [clar]: description="delete 1k refs", runs=1 */
+{
+	refdb_delete(0);
+}
+
+void benchmark_refdb__transaction_delete(void)
+/* [clar]: description="delete 1k refs in a transaction", runs=1 */
+{
+	refdb_delete(1);
+}
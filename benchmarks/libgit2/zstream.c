@@ -0,0 +1,77 @@
+#include "clar.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <git2.h>
+
+#include "zstream.h"
+
+#define BENCHMARK_ZSTREAM_COUNT 4096
+#define BENCHMARK_ZSTREAM_SIZE 4096
+
+static char *data;
+static unsigned char *deflated[BENCHMARK_ZSTREAM_COUNT];
+static size_t deflated_len[BENCHMARK_ZSTREAM_COUNT];
+
+void benchmark_zstream__initialize(void)
+{
+	size_t i, j;
+
+	data = malloc(BENCHMARK_ZSTREAM_SIZE);
+	cl_assert(data != NULL);
+
+	/* compressible, object-like contents */
+	for (i = 0; i < BENCHMARK_ZSTREAM_COUNT; i++) {
+		uLongf len = compressBound(BENCHMARK_ZSTREAM_SIZE);
+
+		for (j = 0; j < BENCHMARK_ZSTREAM_SIZE; j++)
+			data[j] = "abcdefgh\n"[(i + j * 7 + j / 64) % 9];
+
+		deflated[i] = malloc(len);
+		cl_assert(deflated[i] != NULL);
+
+		cl_assert(compress(deflated[i], &len, (const Bytef *)data,
+			BENCHMARK_ZSTREAM_SIZE) == Z_OK);
+		deflated_len[i] = len;
+	}
+}
+
+void benchmark_zstream__cleanup(void)
+{
+	size_t i;
+
+	for (i = 0; i < BENCHMARK_ZSTREAM_COUNT; i++)
+		free(deflated[i]);
+
+	free(data);
+}
+
+void benchmark_zstream__inflate_stream(void)
+{
+	size_t i;
+
+	for (i = 0; i < BENCHMARK_ZSTREAM_COUNT; i++) {
+		git_zstream zs = GIT_ZSTREAM_INIT;
+		size_t out_len = BENCHMARK_ZSTREAM_SIZE;
+
+		cl_assert(git_zstream_init(&zs, GIT_ZSTREAM_INFLATE) == 0);
+		cl_assert(git_zstream_set_input(&zs, deflated[i], deflated_len[i]) == 0);
+		cl_assert(git_zstream_get_output(data, &out_len, &zs) == 0);
+		cl_assert(git_zstream_done(&zs));
+		git_zstream_free(&zs);
+	}
+}
+
+void benchmark_zstream__inflate_oneshot(void)
+{
+	size_t i;
+
+	for (i = 0; i < BENCHMARK_ZSTREAM_COUNT; i++) {
+		size_t out_len = BENCHMARK_ZSTREAM_SIZE, in_len = deflated_len[i];
+
+		cl_assert(git_zstream_inflate_oneshot(data, &out_len,
+			deflated[i], &in_len) == 0);
+		cl_assert(out_len == BENCHMARK_ZSTREAM_SIZE);
+	}
+}
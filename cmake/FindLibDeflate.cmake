@@ -0,0 +1,27 @@
+# - Find libdeflate
+# Find the libdeflate headers and library.
+#
+# LIBDEFLATE_INCLUDE_DIRS	- where to find libdeflate.h
+# LIBDEFLATE_LIBRARIES		- List of libraries when using libdeflate.
+# LIBDEFLATE_FOUND		- True if libdeflate was found.
+
+# Look for the header file.
+find_path(LIBDEFLATE_INCLUDE_DIR NAMES libdeflate.h)
+
+# Look for the library.
+find_library(LIBDEFLATE_LIBRARY NAMES deflate libdeflate)
+
+# Handle the QUIETLY and REQUIRED arguments and set LIBDEFLATE_FOUND to TRUE if all listed variables are TRUE.
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LibDeflate DEFAULT_MSG LIBDEFLATE_LIBRARY LIBDEFLATE_INCLUDE_DIR)
+
+# Copy the results to the output variables.
+if(LIBDEFLATE_FOUND)
+	set(LIBDEFLATE_LIBRARIES ${LIBDEFLATE_LIBRARY})
+	set(LIBDEFLATE_INCLUDE_DIRS ${LIBDEFLATE_INCLUDE_DIR})
+else()
+	set(LIBDEFLATE_LIBRARIES)
+	set(LIBDEFLATE_INCLUDE_DIRS)
+endif()
+
+mark_as_advanced(LIBDEFLATE_INCLUDE_DIR LIBDEFLATE_LIBRARY)
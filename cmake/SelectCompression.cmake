@@ -53,3 +53,26 @@ elseif(GIT_COMPRESSION_BUILTIN)
 else()
 	message(FATAL_ERROR "unknown compression backend")
 endif()
+
+# The one-shot decompressor, used when the inflated size of an object is
+# known in advance; the streaming interfaces always use zlib.
+SanitizeInput(USE_INFLATE)
+
+if(NOT USE_INFLATE OR USE_INFLATE STREQUAL "zlib")
+	set(GIT_INFLATE_ZLIB 1)
+	add_feature_info("Inflate" ON "using zlib")
+elseif(USE_INFLATE STREQUAL "libdeflate")
+	find_package(LibDeflate)
+
+	if(NOT LIBDEFLATE_FOUND)
+		message(FATAL_ERROR "libdeflate was requested but not found")
+	endif()
+
+	set(GIT_INFLATE_LIBDEFLATE 1)
+	list(APPEND LIBGIT2_SYSTEM_INCLUDES ${LIBDEFLATE_INCLUDE_DIRS})
+	list(APPEND LIBGIT2_SYSTEM_LIBS ${LIBDEFLATE_LIBRARIES})
+	list(APPEND LIBGIT2_PC_LIBS "-ldeflate")
+	add_feature_info("Inflate" ON "using libdeflate")
+else()
+	message(FATAL_ERROR "unknown inflate backend: ${USE_INFLATE}")
+endif()
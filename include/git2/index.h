@@ -479,6 +479,11 @@ GIT_EXTERN(int) git_index_write_tree_to(git_oid *out, git_index *index, git_repo
 /**
  * Get the count of entries currently in the index
  *
+ * The sparse directories of a sparse index are single entries, with
+ * the mode `GIT_FILEMODE_TREE`, until they are expanded.  Iterate
+ * with `git_index_iterator` to see the entries of the files beneath
+ * them instead.
+ *
  * @param index an existing index object
  * @return integer of count of current entries
  */
@@ -226,6 +226,19 @@ GIT_EXTERN(int) git_object_peel(
  */
 GIT_EXTERN(int) git_object_dup(git_object **dest, git_object *source);
 
+/**
+ * Flags for calculating object IDs from raw content.
+ */
+typedef enum {
+	/**
+	 * The content is trusted (it was produced locally, and not
+	 * received from a remote) so SHA1 collision detection may be
+	 * skipped.  This allows the use of hardware accelerated SHA1
+	 * implementations.
+	 */
+	GIT_OBJECT_ID_TRUSTED = (1u << 0)
+} git_object_id_flag_t;
+
 /**
  * Options for calculating object IDs from raw content.
  *
@@ -252,6 +265,9 @@ typedef struct {
 	 * unless the given raw object data is a blob.
 	 */
 	git_filter_list *filters;
+
+	/** A combination of `git_object_id_flag_t` values. */
+	unsigned int flags;
 } git_object_id_options;
 
 /** Current version for the `git_object_id_options` structure */
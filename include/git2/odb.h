@@ -500,6 +500,80 @@ GIT_EXTERN(int) git_odb_write_pack(
 GIT_EXTERN(int) git_odb_write_multi_pack_index(
 	git_odb *db);
 
+/**
+ * Begin a bulk write session on the object database.
+ *
+ * While a session is in progress, objects written to the object
+ * database (for example with `git_odb_write` or `git_blob_create_from_disk`)
+ * are appended to a single, temporary packfile instead of being
+ * written as individual loose objects. They can be read back while
+ * the session is in progress.
+ *
+ * This is useful when writing a large number of objects, for example
+ * when importing history from another system: it avoids creating (and
+ * optionally synchronizing to disk) one file per object.
+ *
+ * The session must be ended with `git_odb_bulk_commit` to make the
+ * objects permanent, or with `git_odb_bulk_abort` to discard them. Any
+ * write streams must be freed before the session is ended.
+ *
+ * @param db object database on disk to begin the session on
+ * @return 0 or an error code.
+ */
+GIT_EXTERN(int) git_odb_bulk_begin(git_odb *db);
+
+/**
+ * Commit a bulk write session.
+ *
+ * The temporary packfile is finalized and its index is written, so
+ * that the objects written during the session become part of the
+ * object database.
+ *
+ * @param db object database with a bulk write session in progress
+ * @return 0 or an error code.
+ */
+GIT_EXTERN(int) git_odb_bulk_commit(git_odb *db);
+
+/**
+ * Abort a bulk write session, discarding the objects written during it.
+ *
+ * @param db object database with a bulk write session in progress
+ * @return 0 or an error code.
+ */
+GIT_EXTERN(int) git_odb_bulk_abort(git_odb *db);
+
+/**
+ * Begin an fsync batch on the object database.
+ *
+ * When the object database is configured to synchronize objects to
+ * disk (with `GIT_OPT_ENABLE_FSYNC_GITDIR` or `core.fsyncObjectFiles`),
+ * every loose object is normally flushed to disk, along with its
+ * parent directory, as it is written.  While an fsync batch is in
+ * progress, loose objects are instead written to temporary files and
+ * made durable together when the batch is committed, with a single
+ * barrier per filesystem where the platform supports it.
+ *
+ * Objects written during the batch can be read back while it is in
+ * progress, but are not visible to other processes, nor to prefix
+ * lookups, until it is committed.
+ *
+ * When the object database is not configured to synchronize objects,
+ * objects are written as usual and the batch has no effect.
+ *
+ * @param db object database to begin the batch on
+ * @return 0 or an error code.
+ */
+GIT_EXTERN(int) git_odb_fsync_batch_begin(git_odb *db);
+
+/**
+ * Commit an fsync batch, making the loose objects written during the
+ * batch durable and moving them into place.
+ *
+ * @param db object database with an fsync batch in progress
+ * @return 0 or an error code.
+ */
+GIT_EXTERN(int) git_odb_fsync_batch_commit(git_odb *db);
+
 /**
  * Create a copy of an odb_object
  *
@@ -64,6 +64,79 @@ GIT_EXTERN(int) git_refdb_open(git_refdb **out, git_repository *repo);
  */
 GIT_EXTERN(int) git_refdb_compress(git_refdb *refdb);
 
+/**
+ * Flags which can be passed to `git_refdb_pack_refs` to alter its
+ * behavior.
+ */
+typedef enum {
+	/** Pack all references, not only tags */
+	GIT_REFDB_PACK_ALL = (1u << 0),
+
+	/** Keep the loose files of the references that were packed */
+	GIT_REFDB_PACK_NO_PRUNE = (1u << 1)
+} git_refdb_pack_t;
+
+/**
+ * Reference packing options structure
+ *
+ * Initialize with `GIT_REFDB_PACK_OPTIONS_INIT`. Alternatively, you can
+ * use `git_refdb_pack_options_init`.
+ */
+typedef struct git_refdb_pack_options {
+	unsigned int version;
+
+	/** A combination of `git_refdb_pack_t` */
+	uint32_t flags;
+
+	/**
+	 * Additional reference name prefixes (eg "refs/remotes/") whose
+	 * references should be packed along with the tags.  Ignored when
+	 * `GIT_REFDB_PACK_ALL` is given.
+	 */
+	git_strarray prefixes;
+} git_refdb_pack_options;
+
+/** Current version for the `git_refdb_pack_options` structure */
+#define GIT_REFDB_PACK_OPTIONS_VERSION 1
+
+/** Static constructor for `git_refdb_pack_options` */
+#define GIT_REFDB_PACK_OPTIONS_INIT {GIT_REFDB_PACK_OPTIONS_VERSION}
+
+/**
+ * Initialize git_refdb_pack_options structure
+ *
+ * Initializes a `git_refdb_pack_options` with default values. Equivalent to
+ * creating an instance with `GIT_REFDB_PACK_OPTIONS_INIT`.
+ *
+ * @param opts The `git_refdb_pack_options` struct to initialize.
+ * @param version The struct version; pass `GIT_REFDB_PACK_OPTIONS_VERSION`.
+ * @return Zero on success; -1 on failure.
+ */
+GIT_EXTERN(int) git_refdb_pack_options_init(
+	git_refdb_pack_options *opts,
+	unsigned int version);
+
+/**
+ * Pack the loose references of the given refdb.
+ *
+ * Like `git pack-refs`, only tags (and the references under the
+ * given prefixes) are packed by default; pass `GIT_REFDB_PACK_ALL` to
+ * pack every reference.  Backends that do not have loose references
+ * treat this like `git_refdb_compress`.
+ *
+ * Packing may also happen automatically when a transaction is
+ * committed: if the "gc.autoPackRefs" configuration is set to a
+ * positive number, the files backend packs all references once the
+ * number of loose references exceeds it.
+ *
+ * @param refdb The reference database to pack.
+ * @param opts The packing options, or NULL for the defaults.
+ * @return 0 or an error code.
+ */
+GIT_EXTERN(int) git_refdb_pack_refs(
+	git_refdb *refdb,
+	const git_refdb_pack_options *opts);
+
 /**
  * Close an open reference database.
  *
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_sys_git_fsmonitor_h__
+#define INCLUDE_sys_git_fsmonitor_h__
+
+#include "git2/common.h"
+#include "git2/types.h"
+#include "git2/buffer.h"
+
+/**
+ * @file git2/sys/fsmonitor.h
+ * @brief Filesystem monitor providers
+ * @defgroup git_fsmonitor Filesystem monitor providers
+ * @ingroup Git
+ * @{
+ *
+ * A filesystem monitor reports the paths in the working directory that
+ * changed since a point in time, identified by an opaque token.  With
+ * one configured, the entries of the index that were unchanged the last
+ * time they were examined and that the monitor did not report since
+ * are not examined again, and their files are not `lstat`ed.
+ *
+ * By default, when `core.fsmonitor` names a hook executable, it is run
+ * using git's fsmonitor hook protocol (version 2, falling back to
+ * version 1; `core.fsmonitorHookVersion` may select one).  When it is
+ * `true`, the builtin daemon (see `git_fsmonitor_daemon_new`) is asked.
+ */
+GIT_BEGIN_DECL
+
+/**
+ * The changes reported by a filesystem monitor, which are filled in
+ * with `git_fsmonitor_changes_add` and `git_fsmonitor_changes_set_token`.
+ */
+typedef struct git_fsmonitor_changes git_fsmonitor_changes;
+
+/** Current version for the `git_fsmonitor` structure */
+#define GIT_FSMONITOR_VERSION 1
+
+/** Static constructor for `git_fsmonitor` */
+#define GIT_FSMONITOR_INIT { GIT_FSMONITOR_VERSION }
+
+typedef struct git_fsmonitor git_fsmonitor;
+
+/**
+ * A filesystem monitor.  Embed this as the first member of your own
+ * structure and fill in the callbacks.
+ */
+struct git_fsmonitor {
+	/** The `version` field should be set to `GIT_FSMONITOR_VERSION`. */
+	unsigned int version;
+
+	/**
+	 * Report the paths that changed since `token` (which is `NULL`
+	 * when there is none) with `git_fsmonitor_changes_add`, and the
+	 * token for the current point in time with
+	 * `git_fsmonitor_changes_set_token`.
+	 *
+	 * Return `GIT_PASSTHROUGH` when the changes cannot be determined,
+	 * in which case every path is considered changed; any other
+	 * error aborts the operation.
+	 */
+	int GIT_CALLBACK(query)(
+		git_fsmonitor *fsmonitor,
+		const char *token,
+		git_fsmonitor_changes *changes);
+
+	/** Free the filesystem monitor (optional). */
+	void GIT_CALLBACK(free)(git_fsmonitor *fsmonitor);
+};
+
+/**
+ * Initializes a `git_fsmonitor` with default values. Equivalent to
+ * creating an instance with GIT_FSMONITOR_INIT.
+ *
+ * @param fsmonitor the `git_fsmonitor` struct to initialize.
+ * @param version Version the struct; pass `GIT_FSMONITOR_VERSION`
+ * @return Zero on success; -1 on failure.
+ */
+GIT_EXTERN(int) git_fsmonitor_init(
+	git_fsmonitor *fsmonitor,
+	unsigned int version);
+
+/**
+ * Report a path that changed, relative to the working directory.  A
+ * directory (which may be given with a trailing slash) stands for
+ * everything beneath it; the path "/" stands for everything.
+ *
+ * @param changes the changes being reported
+ * @param path the path that changed
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_fsmonitor_changes_add(
+	git_fsmonitor_changes *changes,
+	const char *path);
+
+/**
+ * Set the token identifying the point in time the changes were
+ * reported at, to be given to the next query.
+ *
+ * @param changes the changes being reported
+ * @param token the new token
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_fsmonitor_changes_set_token(
+	git_fsmonitor_changes *changes,
+	const char *token);
+
+/**
+ * Set the filesystem monitor for a repository, instead of the one
+ * configured with `core.fsmonitor`.
+ *
+ * The repository takes ownership of the monitor and frees it when it
+ * is replaced or when the repository is freed.  Pass `NULL` to return
+ * to the configured monitor.
+ *
+ * @param repo the repository
+ * @param fsmonitor the filesystem monitor, or NULL
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_repository_set_fsmonitor(
+	git_repository *repo,
+	git_fsmonitor *fsmonitor);
+
+/**
+ * A builtin filesystem monitor daemon, which watches the working
+ * directory of a repository and answers the queries of the processes
+ * that use it when `core.fsmonitor` is set to `true`.
+ *
+ * It speaks git's `fsmonitor--daemon` protocol over the socket
+ * `fsmonitor--daemon.ipc` in the repository's git directory, so it can
+ * serve git as well.  It is only available on Linux (using inotify).
+ */
+typedef struct git_fsmonitor_daemon git_fsmonitor_daemon;
+
+/**
+ * Create a filesystem monitor daemon for the working directory of a
+ * repository.  This starts watching the working directory and listens
+ * on the repository's socket, but does not answer queries until
+ * `git_fsmonitor_daemon_run` is called.
+ *
+ * @param out pointer to store the daemon in
+ * @param repo the repository to watch
+ * @return 0, GIT_EEXISTS if a daemon is already listening for the
+ *         repository, or an error code
+ */
+GIT_EXTERN(int) git_fsmonitor_daemon_new(
+	git_fsmonitor_daemon **out,
+	git_repository *repo);
+
+/**
+ * Answer queries until `git_fsmonitor_daemon_stop` is called, or a
+ * client asks the daemon to quit.
+ *
+ * @param daemon the daemon
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_fsmonitor_daemon_run(git_fsmonitor_daemon *daemon);
+
+/**
+ * Stop a running daemon.  This may be called from another thread or
+ * from a signal handler.
+ *
+ * @param daemon the daemon
+ */
+GIT_EXTERN(void) git_fsmonitor_daemon_stop(git_fsmonitor_daemon *daemon);
+
+/**
+ * Free a daemon, removing its socket.
+ *
+ * @param daemon the daemon
+ */
+GIT_EXTERN(void) git_fsmonitor_daemon_free(git_fsmonitor_daemon *daemon);
+
+/**
+ * Send a request to the daemon that is listening for a repository: a
+ * token, or one of the commands "quit" or "flush" (which discards the
+ * changes that were recorded and starts over).
+ *
+ * @param out the buffer to store the response in
+ * @param repo the repository
+ * @param request the request
+ * @return 0, GIT_ENOTFOUND if no daemon is listening, or an error code
+ */
+GIT_EXTERN(int) git_fsmonitor_daemon_send(
+	git_buf *out,
+	git_repository *repo,
+	const char *request);
+
+/** @} */
+GIT_END_DECL
+
+#endif
@@ -10,6 +10,7 @@
 #include "git2/common.h"
 #include "git2/types.h"
 #include "git2/oid.h"
+#include "git2/refdb.h"
 
 /**
  * @file git2/sys/refdb_backend.h
@@ -56,6 +57,16 @@ struct git_reference_iterator {
 		git_reference_iterator *iter);
 };
 
+/**
+ * Callback for the `reflog_foreach` function of a refdb backend.  It is
+ * called with the entries of a reflog from the most recent to the
+ * oldest one; the entry is only valid for the duration of the call.
+ * Return a non-zero value to stop the iteration.
+ */
+typedef int GIT_CALLBACK(git_refdb_reflog_foreach_cb)(
+	const git_reflog_entry *entry,
+	void *payload);
+
 typedef enum {
 	/**
 	 * The refdb that is to be initialized is for a worktree.
@@ -348,6 +359,30 @@ struct git_refdb_backend {
 	 */
 	int GIT_CALLBACK(unlock)(git_refdb_backend *backend, void *payload, int success, int update_reflog,
 		      const git_reference *ref, const git_signature *sig, const char *message);
+
+	/**
+	 * Pack the loose references selected by the given options.
+	 *
+	 * A refdb implementation may provide this function; if it is not
+	 * provided, `compress` will be called instead.
+	 *
+	 * @param opts The packing options; never NULL.
+	 * @return `0` on success a negative error code otherwise
+	 */
+	int GIT_CALLBACK(pack_refs)(git_refdb_backend *backend, const git_refdb_pack_options *opts);
+
+	/**
+	 * Iterate over the reflog for the given reference name, starting
+	 * from its most recent entry, without reading all of it first.
+	 *
+	 * A refdb implementation may provide this function; if it is not
+	 * provided, the whole reflog will be read with `reflog_read`.
+	 *
+	 * @return `0` on success, the non-zero value returned by the
+	 *         callback, or a negative error code
+	 */
+	int GIT_CALLBACK(reflog_foreach)(git_refdb_backend *backend, const char *name,
+		git_refdb_reflog_foreach_cb cb, void *payload);
 };
 
 /** Current version for the `git_refdb_backend_options` structure */
@@ -29,6 +29,7 @@ extern int cmd_blame(int argc, char **argv);
 extern int cmd_cat_file(int argc, char **argv);
 extern int cmd_clone(int argc, char **argv);
 extern int cmd_config(int argc, char **argv);
+extern int cmd_fsmonitor_daemon(int argc, char **argv);
 extern int cmd_hash_object(int argc, char **argv);
 extern int cmd_help(int argc, char **argv);
 extern int cmd_index_pack(int argc, char **argv);
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include <git2.h>
+#include <git2/sys/fsmonitor.h>
+#include "common.h"
+#include "cmd.h"
+#include "sighandler.h"
+
+#define COMMAND_NAME "fsmonitor--daemon"
+
+static char *action;
+
+static git_fsmonitor_daemon *daemon_running;
+
+static const cli_opt_spec opts[] = {
+	CLI_COMMON_OPT,
+
+	{ CLI_OPT_TYPE_ARG,       "action",  0, &action,  0,
+	  CLI_OPT_USAGE_REQUIRED, "action", "one of 'run', 'stop' or 'status'" },
+	{ 0 },
+};
+
+static void print_help(void)
+{
+	cli_opt_usage_fprint(stdout, PROGRAM_NAME, COMMAND_NAME, opts, 0);
+	printf("\n");
+
+	printf("Monitor the working directory for changes, so that commands that\n");
+	printf("use it (with `core.fsmonitor` set to `true`) do not examine the\n");
+	printf("files that did not change.\n");
+	printf("\n");
+
+	printf("Actions:\n");
+	printf("  run     monitor the working directory until interrupted\n");
+	printf("  stop    stop the monitor of the working directory\n");
+	printf("  status  show whether the working directory is monitored\n");
+	printf("\n");
+
+	printf("Options:\n");
+
+	cli_opt_help_fprint(stdout, opts);
+}
+
+static void interrupt_daemon(void)
+{
+	git_fsmonitor_daemon_stop(daemon_running);
+}
+
+static int run_daemon(git_repository *repo)
+{
+	int ret = 0;
+
+	if (git_fsmonitor_daemon_new(&daemon_running, repo) < 0)
+		return cli_error_git();
+
+	cli_sighandler_set_interrupt(interrupt_daemon);
+
+	if (git_fsmonitor_daemon_run(daemon_running) < 0)
+		ret = cli_error_git();
+
+	cli_sighandler_set_interrupt(NULL);
+
+	git_fsmonitor_daemon_free(daemon_running);
+	daemon_running = NULL;
+	return ret;
+}
+
+static int send_request(git_repository *repo, const char *request)
+{
+	git_buf response = GIT_BUF_INIT;
+	int error;
+
+	error = git_fsmonitor_daemon_send(&response, repo, request);
+	git_buf_dispose(&response);
+
+	if (error == GIT_ENOTFOUND) {
+		printf("fsmonitor-daemon is not watching '%s'\n",
+			git_repository_workdir(repo));
+		return 1;
+	} else if (error < 0) {
+		return cli_error_git();
+	}
+
+	if (strcmp(request, "quit") != 0)
+		printf("fsmonitor-daemon is watching '%s'\n",
+			git_repository_workdir(repo));
+
+	return 0;
+}
+
+int cmd_fsmonitor_daemon(int argc, char **argv)
+{
+	cli_repository_open_options open_opts = { argv + 1, argc - 1 };
+	git_repository *repo = NULL;
+	cli_opt invalid_opt;
+	int ret = 0;
+
+	if (cli_opt_parse(&invalid_opt, opts, argv + 1, argc - 1, CLI_OPT_PARSE_GNU))
+		return cli_opt_usage_error(COMMAND_NAME, opts, &invalid_opt);
+
+	if (cli_opt__show_help) {
+		print_help();
+		return 0;
+	}
+
+	if (cli_repository_open(&repo, &open_opts) < 0)
+		return cli_error_git();
+
+	if (git_repository_is_bare(repo)) {
+		ret = cli_error("cannot monitor a bare repository");
+		goto done;
+	}
+
+	if (!strcmp(action, "run"))
+		ret = run_daemon(repo);
+	else if (!strcmp(action, "stop"))
+		ret = send_request(repo, "quit");
+	else if (!strcmp(action, "status"))
+		ret = send_request(repo, "builtin:fake");
+	else
+		ret = cli_error_usage("unknown action '%s'", action);
+
+done:
+	git_repository_free(repo);
+	return ret;
+}
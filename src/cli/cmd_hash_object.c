@@ -74,6 +74,7 @@ static int hash_buf(
 			return cli_error_git();
 	} else {
 		id_opts.object_type = object_type;
+		id_opts.flags = GIT_OBJECT_ID_TRUSTED;
 
 		if (git_object_id_from_buffer(&oid, buf->ptr, buf->size, &id_opts) < 0)
 			return cli_error_git();
@@ -30,15 +30,16 @@ const cli_opt_spec cli_common_opts[] = {
 };
 
 const cli_cmd_spec cli_cmds[] = {
-	{ "blame",       cmd_blame,       "Show the origin of each line of a file" },
-	{ "cat-file",    cmd_cat_file,    "Display an object in the repository" },
-	{ "clone",       cmd_clone,       "Clone a repository into a new directory" },
-	{ "config",      cmd_config,      "View or set configuration values " },
-	{ "hash-object", cmd_hash_object, "Hash a raw object and product its object ID" },
-	{ "help",        cmd_help,        "Display help information" },
-	{ "index-pack",  cmd_index_pack,  "Create an index for a packfile" },
-	{ "init",        cmd_init,        "Create a new git repository" },
-	{ "version",     cmd_version,     "Show application version information" },
+	{ "blame",             cmd_blame,            "Show the origin of each line of a file" },
+	{ "cat-file",          cmd_cat_file,         "Display an object in the repository" },
+	{ "clone",             cmd_clone,            "Clone a repository into a new directory" },
+	{ "config",            cmd_config,           "View or set configuration values " },
+	{ "fsmonitor--daemon", cmd_fsmonitor_daemon, "Monitor the working directory for changes" },
+	{ "hash-object",       cmd_hash_object,      "Hash a raw object and product its object ID" },
+	{ "help",              cmd_help,             "Display help information" },
+	{ "index-pack",        cmd_index_pack,       "Create an index for a packfile" },
+	{ "init",              cmd_init,             "Create a new git repository" },
+	{ "version",           cmd_version,          "Show application version information" },
 	{ NULL }
 };
 
@@ -763,6 +763,9 @@ static int git_apply__to_index(
 	}
 
 	/* Then add the changes back to the index. */
+	if ((error = git_index__ensure_full(postimage)) < 0)
+		goto done;
+
 	for (i = 0; i < git_index_entrycount(postimage); i++) {
 		entry = git_index_get_byindex(postimage, i);
 
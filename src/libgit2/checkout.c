@@ -32,9 +32,21 @@
 #include "pool.h"
 #include "path.h"
 #include "hashmap_str.h"
+#include "sparse.h"
+#include "tree.h"
+#include "config.h"
 
 /* See docs/checkout-internals.md for more information */
 
+/*
+ * Blobs at least this large are streamed from the object database into
+ * the working directory rather than being loaded into memory whole.
+ */
+#define CHECKOUT_STREAM_THRESHOLD (16 * 1024 * 1024)
+
+/* The size of a blob that has not been looked up. */
+#define CHECKOUT_SIZE_UNKNOWN ((git_object_size_t)-1)
+
 enum {
 	CHECKOUT_ACTION__NONE = 0,
 	CHECKOUT_ACTION__REMOVE = 1,
@@ -43,7 +55,8 @@ enum {
 	CHECKOUT_ACTION__CONFLICT = 8,
 	CHECKOUT_ACTION__REMOVE_CONFLICT = 16,
 	CHECKOUT_ACTION__UPDATE_CONFLICT = 32,
-	CHECKOUT_ACTION__MAX = 32,
+	CHECKOUT_ACTION__SKIP_WORKTREE = 64,
+	CHECKOUT_ACTION__MAX = 64,
 	CHECKOUT_ACTION__REMOVE_AND_UPDATE =
 		(CHECKOUT_ACTION__UPDATE_BLOB | CHECKOUT_ACTION__REMOVE)
 };
@@ -74,6 +87,7 @@ typedef struct {
 	git_checkout_perfdata perfdata;
 	git_hashset_str mkdir_pathcache;
 	git_attr_session attr_session;
+	git_sparse *sparse;
 } checkout_data;
 
 typedef struct {
@@ -248,6 +262,32 @@ static bool checkout_is_workdir_modified(
 	return !is_workdir_base_or_new(&oid, baseitem, newitem);
 }
 
+/* Whether the file is outside of the cone of a sparse checkout. */
+static bool checkout_is_sparse_excluded(
+	checkout_data *data,
+	const git_diff_delta *delta)
+{
+	if (!data->sparse ||
+	    (!S_ISREG(delta->new_file.mode) && !S_ISLNK(delta->new_file.mode)))
+		return false;
+
+	return !git_sparse__includes(data->sparse, delta->new_file.path);
+}
+
+static bool checkout_is_skip_worktree(
+	checkout_data *data,
+	const git_diff_delta *delta)
+{
+	const git_index_entry *ie;
+
+	if (!data->index)
+		return false;
+
+	ie = git_index_get_bypath(data->index, delta->new_file.path, 0);
+
+	return (ie && (ie->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE) != 0);
+}
+
 #define CHECKOUT_ACTION_IF(FLAG,YES,NO) \
 	((data->strategy & GIT_CHECKOUT_##FLAG) ? CHECKOUT_ACTION__##YES : CHECKOUT_ACTION__##NO)
 
@@ -259,6 +299,18 @@ static int checkout_action_common(
 {
 	git_checkout_notify_t notify = GIT_CHECKOUT_NOTIFY_NONE;
 
+	/* rather than writing a file outside of the sparse checkout, mark
+	 * it "skip worktree" (and remove what is on disk)
+	 */
+	if ((*action & CHECKOUT_ACTION__UPDATE_BLOB) != 0 &&
+	    checkout_is_sparse_excluded(data, delta)) {
+		*action = (*action & ~CHECKOUT_ACTION__UPDATE_BLOB) |
+			CHECKOUT_ACTION__SKIP_WORKTREE;
+
+		if (wd)
+			*action |= CHECKOUT_ACTION__REMOVE;
+	}
+
 	if ((data->strategy & GIT_CHECKOUT_UPDATE_ONLY) != 0)
 		*action = (*action & ~CHECKOUT_ACTION__REMOVE);
 
@@ -297,6 +349,24 @@ static int checkout_action_no_wd(
 	if ((data->strategy & GIT_CHECKOUT_NONE))
 		return 0;
 
+	/* the files outside of a sparse checkout are not expected on disk,
+	 * and the ones that were and now are inside of it are recreated
+	 */
+	if (data->sparse && delta->status != GIT_DELTA_DELETED) {
+		if (checkout_is_sparse_excluded(data, delta)) {
+			if (delta->status != GIT_DELTA_UNMODIFIED ||
+			    !checkout_is_skip_worktree(data, delta))
+				*action = CHECKOUT_ACTION__SKIP_WORKTREE;
+
+			return checkout_action_common(action, data, delta, NULL);
+		}
+
+		if (checkout_is_skip_worktree(data, delta)) {
+			*action = CHECKOUT_ACTION__UPDATE_BLOB;
+			return checkout_action_common(action, data, delta, NULL);
+		}
+	}
+
 	switch (delta->status) {
 	case GIT_DELTA_UNMODIFIED: /* case 12 */
 		error = checkout_notify(data, GIT_CHECKOUT_NOTIFY_DIRTY, delta, NULL);
@@ -506,6 +576,10 @@ static int checkout_action_with_wd(
 			GIT_ERROR_CHECK_ERROR(
 				checkout_notify(data, GIT_CHECKOUT_NOTIFY_DIRTY, delta, wd) );
 			*action = CHECKOUT_ACTION_IF(FORCE, UPDATE_BLOB, NONE);
+		} else if (checkout_is_sparse_excluded(data, delta) ||
+		           (data->sparse && checkout_is_skip_worktree(data, delta))) {
+			/* updated to (un)mark it "skip worktree" */
+			*action = CHECKOUT_ACTION__UPDATE_BLOB;
 		}
 		break;
 	case GIT_DELTA_ADDED: /* case 3, 4 or 6 */
@@ -1187,6 +1261,9 @@ static int checkout_conflicts_mark_directoryfile(
 	if ((index = git_iterator_index(data->target)) == NULL)
 		return 0;
 
+	if ((error = git_index__ensure_full(index)) < 0)
+		return error;
+
 	len = git_index_entrycount(index);
 
 	/* Find d/f conflicts */
@@ -1361,6 +1438,8 @@ static int checkout_get_actions(
 			counts[CHECKOUT_ACTION__UPDATE_SUBMODULE]++;
 		if (act & CHECKOUT_ACTION__CONFLICT)
 			counts[CHECKOUT_ACTION__CONFLICT]++;
+		if (act & CHECKOUT_ACTION__SKIP_WORKTREE)
+			counts[CHECKOUT_ACTION__SKIP_WORKTREE]++;
 	}
 
 	error = checkout_remaining_wd_items(data, workdir, wditem, &pathspec);
@@ -1517,20 +1596,71 @@ static void checkout_stream_free(git_writestream *s)
 	GIT_UNUSED(s);
 }
 
+/* Write the filtered blob (or blob stream) to `fd`, which is closed. */
+static int checkout_stream_to_file(
+	int fd,
+	const char *path,
+	git_filter_list *fl,
+	git_blob *blob,
+	git_odb_stream *blob_stream,
+	const git_oid *blob_id,
+	size_t blob_size)
+{
+	struct checkout_stream writer;
+	int error;
+
+	memset(&writer, 0, sizeof(struct checkout_stream));
+	writer.base.write = checkout_stream_write;
+	writer.base.close = checkout_stream_close;
+	writer.base.free = checkout_stream_free;
+	writer.path = path;
+	writer.fd = fd;
+	writer.open = 1;
+
+	if (blob)
+		error = git_filter_list_stream_blob(fl, blob, &writer.base);
+	else
+		error = git_filter_list__stream_odb(fl, blob_stream,
+			blob_size, blob_id, &writer.base);
+
+	GIT_ASSERT(writer.open == 0);
+
+	return error;
+}
+
+static int checkout_open_file(
+	checkout_data *data,
+	const char *path,
+	mode_t entry_filemode)
+{
+	int flags = data->opts.file_open_flags;
+	mode_t mode = data->opts.file_mode ?
+		data->opts.file_mode : entry_filemode;
+	int fd;
+
+	if (flags <= 0)
+		flags = O_CREAT | O_TRUNC | O_WRONLY;
+	if (!mode)
+		mode = GIT_FILEMODE_BLOB;
+
+	if ((fd = p_open(path, flags, mode)) < 0)
+		git_error_set(GIT_ERROR_OS, "could not open '%s' for writing", path);
+
+	return fd;
+}
+
 static int blob_content_to_file(
 	checkout_data *data,
 	struct stat *st,
 	git_blob *blob,
+	git_odb_stream *blob_stream,
+	const git_oid *blob_id,
+	size_t blob_size,
 	const char *path,
 	const char *hint_path,
 	mode_t entry_filemode)
 {
-	int flags = data->opts.file_open_flags;
-	mode_t file_mode = data->opts.file_mode ?
-		data->opts.file_mode : entry_filemode;
 	git_filter_session filter_session = GIT_FILTER_SESSION_INIT;
-	struct checkout_stream writer;
-	mode_t mode;
 	git_filter_list *fl = NULL;
 	int fd;
 	int error = 0;
@@ -1540,15 +1670,8 @@ static int blob_content_to_file(
 	if ((error = mkpath2file(data, path, data->opts.dir_mode)) < 0)
 		return error;
 
-	if (flags <= 0)
-		flags = O_CREAT | O_TRUNC | O_WRONLY;
-	if (!(mode = file_mode))
-		mode = GIT_FILEMODE_BLOB;
-
-	if ((fd = p_open(path, flags, mode)) < 0) {
-		git_error_set(GIT_ERROR_OS, "could not open '%s' for writing", path);
+	if ((fd = checkout_open_file(data, path, entry_filemode)) < 0)
 		return fd;
-	}
 
 	filter_session.attr_session = &data->attr_session;
 	filter_session.temp_buf = &data->tmp;
@@ -1561,18 +1684,8 @@ static int blob_content_to_file(
 		return error;
 	}
 
-	/* setup the writer */
-	memset(&writer, 0, sizeof(struct checkout_stream));
-	writer.base.write = checkout_stream_write;
-	writer.base.close = checkout_stream_close;
-	writer.base.free = checkout_stream_free;
-	writer.path = path;
-	writer.fd = fd;
-	writer.open = 1;
-
-	error = git_filter_list_stream_blob(fl, blob, &writer.base);
-
-	GIT_ASSERT(writer.open == 0);
+	error = checkout_stream_to_file(fd, path, fl,
+		blob, blob_stream, blob_id, blob_size);
 
 	git_filter_list_free(fl);
 
@@ -1647,6 +1760,25 @@ static int checkout_update_index(
 	return git_index_add(data->index, &entry);
 }
 
+static int checkout_skip_worktree(
+	checkout_data *data,
+	const git_diff_file *file)
+{
+	git_index_entry entry;
+
+	if (!data->index || (data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) != 0)
+		return 0;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.path = (char *)file->path; /* cast to prevent warning */
+	entry.mode = file->mode;
+	entry.file_size = (uint32_t)file->size;
+	entry.flags_extended = GIT_INDEX_ENTRY_SKIP_WORKTREE;
+	git_oid_cpy(&entry.id, &file->id);
+
+	return git_index_add(data->index, &entry);
+}
+
 static int checkout_submodule_update_index(
 	checkout_data *data,
 	const git_diff_file *file)
@@ -1748,34 +1880,124 @@ static int checkout_safe_for_update_only(
 	return 0;
 }
 
+/*
+ * Find the size of a blob without reading it: packed blobs have their
+ * size (and location, which orders the reads) looked up in the pack,
+ * without resolving a delta chain.  Loose blobs have their header read,
+ * unless `size` is already known.
+ */
+static int checkout_blob_size(
+	git_object_size_t *size,
+	struct git_pack_file **pack,
+	off64_t *offset,
+	git_odb *odb,
+	const git_oid *oid)
+{
+	git_object_t type;
+	size_t len;
+	int error;
+
+	*pack = NULL;
+	*offset = 0;
+
+	if ((error = git_odb__pack_location(pack, offset, &len, odb, oid)) == GIT_ENOTFOUND) {
+		*pack = NULL;
+		*offset = 0;
+
+		if (*size != CHECKOUT_SIZE_UNKNOWN)
+			return 0;
+
+		error = git_odb_read_header(&len, &type, odb, oid);
+	}
+
+	if (error < 0) {
+		*pack = NULL;
+		*offset = 0;
+		return error;
+	}
+
+	*size = len;
+	return 0;
+}
+
+/*
+ * Open a read stream for a blob that is too large to be loaded into
+ * memory. Leaves `out` NULL when the blob is small enough to be looked
+ * up normally, or when no backend can stream it.
+ */
+static void checkout_open_large_blob(
+	git_odb_stream **out,
+	size_t *size_out,
+	checkout_data *data,
+	const git_oid *oid,
+	git_object_size_t size)
+{
+	struct git_pack_file *pack;
+	off64_t offset;
+	git_odb *odb;
+	git_object_t type;
+
+	*out = NULL;
+
+	if (git_repository_odb__weakptr(&odb, data->repo) < 0 ||
+	    (size == CHECKOUT_SIZE_UNKNOWN &&
+	     checkout_blob_size(&size, &pack, &offset, odb, oid) < 0) ||
+	    size < CHECKOUT_STREAM_THRESHOLD)
+		goto fallback;
+
+	if (git_odb_open_rstream(out, size_out, &type, odb, oid) < 0 ||
+	    type != GIT_OBJECT_BLOB)
+		goto fallback;
+
+	return;
+
+fallback:
+	/* let the regular blob lookup report any errors */
+	git_odb_stream_free(*out);
+	*out = NULL;
+	git_error_clear();
+}
+
+/* if we try to create the blob and an existing directory blocks it from
+ * being written, then there must have been a typechange conflict in a
+ * parent directory - suppress the error and try to continue.
+ */
+static bool checkout_write_blocked(checkout_data *data, int error)
+{
+	return (data->strategy & GIT_CHECKOUT_ALLOW_CONFLICTS) != 0 &&
+		(error == GIT_ENOTFOUND || error == GIT_EEXISTS);
+}
+
 static int checkout_write_content(
 	checkout_data *data,
 	const git_oid *oid,
+	git_object_size_t blob_size,
 	const char *full_path,
 	const char *hint_path,
 	unsigned int mode,
 	struct stat *st)
 {
 	int error = 0;
-	git_blob *blob;
+	git_odb_stream *stream = NULL;
+	git_blob *blob = NULL;
+	size_t size = 0;
+
+	if (!S_ISLNK(mode))
+		checkout_open_large_blob(&stream, &size, data, oid, blob_size);
 
-	if ((error = git_blob_lookup(&blob, data->repo, oid)) < 0)
+	if (!stream && (error = git_blob_lookup(&blob, data->repo, oid)) < 0)
 		return error;
 
 	if (S_ISLNK(mode))
 		error = blob_content_to_link(data, st, blob, full_path);
 	else
-		error = blob_content_to_file(data, st, blob, full_path, hint_path, mode);
+		error = blob_content_to_file(data, st, blob, stream, oid, size,
+			full_path, hint_path, mode);
 
+	git_odb_stream_free(stream);
 	git_blob_free(blob);
 
-	/* if we try to create the blob and an existing directory blocks it from
-	 * being written, then there must have been a typechange conflict in a
-	 * parent directory - suppress the error and try to continue.
-	 */
-	if ((data->strategy & GIT_CHECKOUT_ALLOW_CONFLICTS) != 0 &&
-		(error == GIT_ENOTFOUND || error == GIT_EEXISTS))
-	{
+	if (checkout_write_blocked(data, error)) {
 		git_error_clear();
 		error = 0;
 	}
@@ -1802,8 +2024,10 @@ static int checkout_blob(
 			return rval;
 	}
 
-	error = checkout_write_content(
-		data, &file->id, fullpath->ptr, file->path, file->mode, &st);
+	error = checkout_write_content(data, &file->id,
+		(file->flags & GIT_DIFF_FLAG_VALID_SIZE) ?
+			file->size : CHECKOUT_SIZE_UNKNOWN,
+		fullpath->ptr, file->path, file->mode, &st);
 
 	/* update the index unless prevented */
 	if (!error && (data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0)
@@ -1875,6 +2099,408 @@ static int checkout_remove_the_old(
 	return 0;
 }
 
+/*
+ * Files are written in batches of up to this many.  Each batch is read
+ * in pack order, then the index is updated and progress is reported in
+ * the order of the diff.
+ */
+#define CHECKOUT_BATCH_FILES 1024
+
+typedef struct {
+	const git_diff_file *file;
+	char *path;
+	git_filter_list *filters;
+	struct git_pack_file *pack;
+	off64_t offset;
+	git_object_size_t size;
+	struct stat st;
+	int error;
+	git_error *error_state;
+	unsigned int skip : 1,
+	             serial : 1;
+} checkout_job;
+
+typedef struct {
+#ifdef GIT_THREADS
+	git_thread thread;
+#endif
+	checkout_data *data;
+	checkout_job **jobs;
+	size_t jobs_len;
+	unsigned int started : 1;
+} checkout_worker;
+
+/*
+ * Like git, the files are written on "checkout.workers" threads (one per
+ * core when that is less than one) once there are at least
+ * "checkout.thresholdForParallelism" of them.  Files that may collide on
+ * a case-insensitive or normalizing filesystem must be written in order,
+ * so they are not batched at all; this returns 0 then.
+ */
+static size_t checkout_workers(unsigned int *actions, checkout_data *data)
+{
+	int ignorecase, precompose;
+#ifdef GIT_THREADS
+	git_config *config;
+	git_diff_delta *delta;
+	size_t files = 0, i;
+	int workers, threshold;
+#endif
+
+	if (git_repository__configmap_lookup(&ignorecase, data->repo, GIT_CONFIGMAP_IGNORECASE) < 0 ||
+	    git_repository__configmap_lookup(&precompose, data->repo, GIT_CONFIGMAP_PRECOMPOSE) < 0) {
+		git_error_clear();
+		return 0;
+	}
+
+	if (ignorecase || precompose)
+		return 0;
+
+#ifdef GIT_THREADS
+	if (git_repository_config__weakptr(&config, data->repo) < 0) {
+		git_error_clear();
+		return 1;
+	}
+
+	workers = git_config__get_int_force(config, "checkout.workers", 1);
+	threshold = git_config__get_int_force(config,
+		"checkout.thresholdforparallelism", 100);
+
+	if (workers < 1)
+		workers = git__online_cpus();
+
+	if (workers < 2)
+		return 1;
+
+	git_vector_foreach(&data->diff->deltas, i, delta) {
+		if (actions[i] & CHECKOUT_ACTION__UPDATE_BLOB && !S_ISLNK(delta->new_file.mode))
+			files++;
+	}
+
+	if (threshold > 0 && files < (size_t)threshold)
+		return 1;
+
+	return min((size_t)workers, max(files, 1));
+#else
+	GIT_UNUSED(actions);
+	return 1;
+#endif
+}
+
+/*
+ * Everything that must happen in order - creating the directories and
+ * examining the attributes - is done before the file is written.
+ */
+static int checkout_job_prepare(
+	checkout_job *job,
+	checkout_data *data,
+	git_odb *odb,
+	const git_diff_file *file)
+{
+	git_filter_session filter_session = GIT_FILTER_SESSION_INIT;
+	git_str *fullpath;
+	size_t builtin;
+	int error;
+
+	job->file = file;
+
+	if (checkout_target_fullpath(&fullpath, data, file->path) < 0)
+		return -1;
+
+	if ((data->strategy & GIT_CHECKOUT_UPDATE_ONLY) != 0) {
+		if ((error = checkout_safe_for_update_only(
+				data, fullpath->ptr, file->mode)) <= 0) {
+			job->skip = 1;
+			return error;
+		}
+	}
+
+	job->path = git__strdup(fullpath->ptr);
+	GIT_ERROR_CHECK_ALLOC(job->path);
+
+	if ((error = mkpath2file(data, job->path, data->opts.dir_mode)) < 0) {
+		if (!checkout_write_blocked(data, error))
+			return error;
+
+		git_error_clear();
+		job->error = error;
+		return 0;
+	}
+
+	/* the temporary buffer is per-checkout, the workers use their own */
+	filter_session.attr_session = &data->attr_session;
+
+	if (!data->opts.disable_filters &&
+	    (error = git_filter_list__load(&job->filters, data->repo, NULL,
+			file->path, GIT_FILTER_TO_WORKTREE, &filter_session)) < 0)
+		return error;
+
+	/* only the builtin filters are known to be safe to run concurrently */
+	builtin = (size_t)git_filter_list_contains(job->filters, GIT_FILTER_CRLF) +
+		(size_t)git_filter_list_contains(job->filters, GIT_FILTER_IDENT);
+
+	if (git_filter_list_length(job->filters) > builtin)
+		job->serial = 1;
+
+	/* a loose (or missing) blob is simply read after the packed ones */
+	job->size = (file->flags & GIT_DIFF_FLAG_VALID_SIZE) ?
+		file->size : CHECKOUT_SIZE_UNKNOWN;
+
+	if (checkout_blob_size(&job->size, &job->pack, &job->offset,
+			odb, &file->id) < 0)
+		git_error_clear();
+
+	return 0;
+}
+
+/*
+ * Order the files by the location of their blobs, so that the packfiles
+ * are read sequentially rather than in path order; since deltas are
+ * written close to their bases, this also keeps the delta base cache
+ * warm.  The sort is stable, so the loose blobs stay in diff order.
+ */
+static int checkout_job_location_cmp(const void *a_, const void *b_)
+{
+	const checkout_job *a = a_, *b = b_;
+
+	if (a->pack != b->pack) {
+		if (!a->pack || !b->pack)
+			return a->pack ? -1 : 1;
+
+		return (uintptr_t)a->pack < (uintptr_t)b->pack ? -1 : 1;
+	}
+
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+
+	return 0;
+}
+
+static void checkout_job_write(checkout_job *job, checkout_data *data)
+{
+	git_odb_stream *stream = NULL;
+	git_blob *blob = NULL;
+	size_t size = 0;
+	int fd;
+
+	checkout_open_large_blob(&stream, &size, data, &job->file->id, job->size);
+
+	if (!stream &&
+	    (job->error = git_blob_lookup(&blob, data->repo, &job->file->id)) < 0)
+		goto done;
+
+	if ((fd = checkout_open_file(data, job->path, job->file->mode)) < 0) {
+		job->error = fd;
+		goto done;
+	}
+
+	if ((job->error = checkout_stream_to_file(fd, job->path, job->filters,
+			blob, stream, &job->file->id, size)) < 0)
+		goto done;
+
+	if ((job->error = p_stat(job->path, &job->st)) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to stat '%s'", job->path);
+		goto done;
+	}
+
+	job->st.st_mode = job->file->mode;
+
+done:
+	if (job->error)
+		git_error_save(&job->error_state);
+
+	git_odb_stream_free(stream);
+	git_blob_free(blob);
+}
+
+static void *checkout_worker_run(void *arg)
+{
+	checkout_worker *worker = arg;
+	checkout_job *job;
+	size_t i;
+
+	for (i = 0; i < worker->jobs_len; i++) {
+		job = worker->jobs[i];
+
+		if (!job->skip && !job->serial && !job->error)
+			checkout_job_write(job, worker->data);
+	}
+
+	return NULL;
+}
+
+/* Update the index for a file once it has been written. */
+static int checkout_job_finish(checkout_job *job, checkout_data *data)
+{
+	int error = job->error;
+
+	if (job->serial)
+		return checkout_blob(data, job->file);
+
+	if (job->skip)
+		return 0;
+
+	if (checkout_write_blocked(data, error)) {
+		git_error_free(job->error_state);
+		memset(&job->st, 0, sizeof(struct stat));
+		job->st.st_mode = job->file->mode;
+		error = 0;
+	} else if (error < 0) {
+		git_error_restore(job->error_state);
+	} else {
+		data->perfdata.stat_calls++;
+	}
+
+	job->error_state = NULL;
+
+	if (!error && (data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0)
+		error = checkout_update_index(data, job->file, &job->st);
+
+	if (!error && strcmp(job->file->path, ".gitmodules") == 0)
+		data->reload_submodules = true;
+
+	return error;
+}
+
+static void checkout_jobs_clear(checkout_job *jobs, size_t jobs_len)
+{
+	size_t i;
+
+	for (i = 0; i < jobs_len; i++) {
+		git__free(jobs[i].path);
+		git_filter_list_free(jobs[i].filters);
+		git_error_free(jobs[i].error_state);
+	}
+
+	memset(jobs, 0, jobs_len * sizeof(checkout_job));
+}
+
+/*
+ * Write a batch of files in pack order, with each worker taking a
+ * contiguous run of them, then update the index and report the
+ * progress in diff order.
+ */
+static int checkout_jobs_run(
+	checkout_data *data,
+	checkout_worker *workers,
+	size_t workers_len,
+	checkout_job *jobs,
+	checkout_job **order,
+	size_t *jobs_len)
+{
+	size_t len = *jobs_len, i;
+	int error = 0;
+
+	for (i = 0; i < len; i++)
+		order[i] = &jobs[i];
+
+	git__tsort((void **)order, len, checkout_job_location_cmp);
+
+	for (i = 0; i < workers_len; i++) {
+		size_t start = (size_t)((uint64_t)len * i / workers_len);
+		size_t end = (size_t)((uint64_t)len * (i + 1) / workers_len);
+
+		workers[i].data = data;
+		workers[i].jobs = order + start;
+		workers[i].jobs_len = end - start;
+		workers[i].started = 0;
+
+		if (!workers[i].jobs_len)
+			continue;
+
+#ifdef GIT_THREADS
+		/* a run that gets no thread is written on this one */
+		if (workers_len > 1 &&
+		    git_thread_create(&workers[i].thread,
+				checkout_worker_run, &workers[i]) == 0) {
+			workers[i].started = 1;
+			continue;
+		}
+#endif
+
+		checkout_worker_run(&workers[i]);
+	}
+
+#ifdef GIT_THREADS
+	for (i = 0; i < workers_len; i++) {
+		if (workers[i].started)
+			git_thread_join(&workers[i].thread, NULL);
+	}
+#endif
+
+	for (i = 0; i < len; i++) {
+		if ((error = checkout_job_finish(&jobs[i], data)) < 0)
+			break;
+
+		data->completed_steps++;
+		report_progress(data, jobs[i].file->path);
+	}
+
+	checkout_jobs_clear(jobs, len);
+	*jobs_len = 0;
+
+	return error;
+}
+
+/*
+ * Write the (non-symlink) files in batches: the blobs of each batch are
+ * read in the order that they are stored in, run through the filters,
+ * written out and examined, on several worker threads when configured.
+ */
+static int checkout_create_the_new_batched(
+	unsigned int *actions,
+	checkout_data *data)
+{
+	checkout_worker *workers = NULL;
+	checkout_job *jobs = NULL, **order = NULL;
+	git_diff_delta *delta;
+	git_odb *odb;
+	size_t workers_len, jobs_len = 0, i;
+	int error = 0;
+
+	if ((workers_len = checkout_workers(actions, data)) < 1)
+		return GIT_PASSTHROUGH;
+
+	if ((error = git_repository_odb__weakptr(&odb, data->repo)) < 0)
+		return error;
+
+	workers = git__calloc(workers_len, sizeof(checkout_worker));
+	jobs = git__calloc(CHECKOUT_BATCH_FILES, sizeof(checkout_job));
+	order = git__calloc(CHECKOUT_BATCH_FILES, sizeof(checkout_job *));
+
+	if (!workers || !jobs || !order) {
+		error = -1;
+		goto done;
+	}
+
+	git_vector_foreach(&data->diff->deltas, i, delta) {
+		if (!(actions[i] & CHECKOUT_ACTION__UPDATE_BLOB) ||
+		    S_ISLNK(delta->new_file.mode))
+			continue;
+
+		if ((error = checkout_job_prepare(&jobs[jobs_len++],
+				data, odb, &delta->new_file)) < 0)
+			goto done;
+
+		if (jobs_len == CHECKOUT_BATCH_FILES &&
+		    (error = checkout_jobs_run(data, workers, workers_len,
+				jobs, order, &jobs_len)) < 0)
+			goto done;
+	}
+
+	error = checkout_jobs_run(data, workers, workers_len,
+		jobs, order, &jobs_len);
+
+done:
+	if (jobs)
+		checkout_jobs_clear(jobs, jobs_len);
+
+	git__free(workers);
+	git__free(jobs);
+	git__free(order);
+	return error;
+}
+
 static int checkout_create_the_new(
 	unsigned int *actions,
 	checkout_data *data)
@@ -1883,8 +2509,21 @@ static int checkout_create_the_new(
 	git_diff_delta *delta;
 	size_t i;
 
+	if ((error = checkout_create_the_new_batched(actions, data)) == GIT_PASSTHROUGH) {
+		git_vector_foreach(&data->diff->deltas, i, delta) {
+			if (actions[i] & CHECKOUT_ACTION__UPDATE_BLOB && !S_ISLNK(delta->new_file.mode)) {
+				if ((error = checkout_blob(data, &delta->new_file)) < 0)
+					return error;
+				data->completed_steps++;
+				report_progress(data, delta->new_file.path);
+			}
+		}
+	} else if (error < 0) {
+		return error;
+	}
+
 	git_vector_foreach(&data->diff->deltas, i, delta) {
-		if (actions[i] & CHECKOUT_ACTION__UPDATE_BLOB && !S_ISLNK(delta->new_file.mode)) {
+		if (actions[i] & CHECKOUT_ACTION__UPDATE_BLOB && S_ISLNK(delta->new_file.mode)) {
 			if ((error = checkout_blob(data, &delta->new_file)) < 0)
 				return error;
 			data->completed_steps++;
@@ -1892,12 +2531,21 @@ static int checkout_create_the_new(
 		}
 	}
 
+	return 0;
+}
+
+static int checkout_skip_the_new(
+	unsigned int *actions,
+	checkout_data *data)
+{
+	git_diff_delta *delta;
+	size_t i;
+
 	git_vector_foreach(&data->diff->deltas, i, delta) {
-		if (actions[i] & CHECKOUT_ACTION__UPDATE_BLOB && S_ISLNK(delta->new_file.mode)) {
-			if ((error = checkout_blob(data, &delta->new_file)) < 0)
+		if (actions[i] & CHECKOUT_ACTION__SKIP_WORKTREE) {
+			int error = checkout_skip_worktree(data, &delta->new_file);
+			if (error < 0)
 				return error;
-			data->completed_steps++;
-			report_progress(data, delta->new_file.path);
 		}
 	}
 
@@ -2021,8 +2669,8 @@ static int checkout_write_entry(
 		return error;
 
 	if (!S_ISGITLINK(side->mode))
-		return checkout_write_content(data,
-					      &side->id, fullpath->ptr, hint_path, side->mode, &st);
+		return checkout_write_content(data, &side->id, CHECKOUT_SIZE_UNKNOWN,
+					      fullpath->ptr, hint_path, side->mode, &st);
 
 	return 0;
 }
@@ -2348,6 +2996,9 @@ static void checkout_data_clear(checkout_data *data)
 	git_hashset_str_dispose(&data->mkdir_pathcache);
 
 	git_attr_session__free(&data->attr_session);
+
+	git_sparse__free(data->sparse);
+	data->sparse = NULL;
 }
 
 static int validate_target_directory(checkout_data *data)
@@ -2473,6 +3124,11 @@ static int checkout_data_init(
 			 &data->respect_filemode, repo, GIT_CONFIGMAP_FILEMODE)) < 0)
 		goto cleanup;
 
+	/* a checkout into another directory is not sparse */
+	if ((!proposed || !proposed->target_directory) &&
+	    (error = git_sparse__load(&data->sparse, repo)) < 0)
+		goto cleanup;
+
 	if (!data->opts.baseline && !data->opts.baseline_index) {
 		data->opts_free_baseline = true;
 		error = 0;
@@ -2663,6 +3319,10 @@ int git_checkout_iterator(
 		(error = checkout_create_the_new(actions, &data)) < 0)
 		goto cleanup;
 
+	if (counts[CHECKOUT_ACTION__SKIP_WORKTREE] > 0 &&
+		(error = checkout_skip_the_new(actions, &data)) < 0)
+		goto cleanup;
+
 	if (counts[CHECKOUT_ACTION__UPDATE_SUBMODULE] > 0 &&
 		(error = checkout_create_submodules(actions, &data)) < 0)
 		goto cleanup;
@@ -2675,6 +3335,12 @@ int git_checkout_iterator(
 		(error = checkout_extensions_update_index(&data)) < 0)
 		goto cleanup;
 
+	/* keep the tree cache valid, so that the tree can be written cheaply */
+	if (data.index != NULL &&
+	    (data.strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0 &&
+	    git_tree__update_index_cache(data.index, data.repo) < 0)
+		git_error_clear();
+
 	GIT_ASSERT(data.completed_steps == data.total_steps);
 
 	if (data.opts.perfdata_cb)
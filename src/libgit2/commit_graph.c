@@ -353,7 +353,7 @@ int git_commit_graph_validate(git_commit_graph *cgraph) {
 	if (cgraph->file->graph_map.len < checksum_size)
 		return commit_graph_error("map length too small");
 
-	if (git_hash_buf(checksum, cgraph->file->graph_map.data, trailer_offset, checksum_type) < 0)
+	if (git_hash_buf_ext(checksum, cgraph->file->graph_map.data, trailer_offset, checksum_type, GIT_HASH_TRUSTED) < 0)
 		return commit_graph_error("could not calculate signature");
 	if (memcmp(checksum, cgraph->file->checksum, checksum_size) != 0)
 		return commit_graph_error("index signature mismatch");
@@ -1103,7 +1103,7 @@ static int commit_graph_write(
 	checksum_type = git_oid_algorithm(w->oid_type);
 	checksum_size = git_hash_size(checksum_type);
 
-	error = git_hash_ctx_init(&ctx, checksum_type);
+	error = git_hash_ctx_init_ext(&ctx, checksum_type, GIT_HASH_TRUSTED);
 	if (error < 0)
 		return error;
 	cb_data = &hash_cb_data;
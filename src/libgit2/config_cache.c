@@ -70,6 +70,18 @@ static git_configmap _configmap_abbrev[] = {
 	{GIT_CONFIGMAP_STRING, "auto", GIT_ABBREV_DEFAULT}
 };
 
+/*
+ *	core.untrackedCache
+ *		Whether to record the untracked files of each directory in the
+ *	index.  When set to "keep" (the default), an existing cache is used
+ *	and kept up to date but no new cache is created.
+ */
+static git_configmap _configmap_untrackedcache[] = {
+	{GIT_CONFIGMAP_FALSE, NULL, GIT_UNTRACKEDCACHE_FALSE},
+	{GIT_CONFIGMAP_TRUE, NULL, GIT_UNTRACKEDCACHE_TRUE},
+	{GIT_CONFIGMAP_STRING, "keep", GIT_UNTRACKEDCACHE_KEEP}
+};
+
 static struct map_data _configmaps[] = {
 	{"core.autocrlf", _configmap_autocrlf, ARRAY_SIZE(_configmap_autocrlf), GIT_AUTO_CRLF_DEFAULT},
 	{"core.eol", _configmap_eol, ARRAY_SIZE(_configmap_eol), GIT_EOL_DEFAULT},
@@ -86,6 +98,7 @@ static struct map_data _configmaps[] = {
 	{"core.protectntfs", NULL, 0, GIT_PROTECTNTFS_DEFAULT },
 	{"core.fsyncobjectfiles", NULL, 0, GIT_FSYNCOBJECTFILES_DEFAULT },
 	{"core.longpaths", NULL, 0, GIT_LONGPATHS_DEFAULT },
+	{"core.untrackedcache", _configmap_untrackedcache, ARRAY_SIZE(_configmap_untrackedcache), GIT_UNTRACKEDCACHE_DEFAULT },
 };
 
 int git_config__configmap_lookup(int *out, git_config *config, git_configmap_item item)
@@ -17,6 +17,7 @@
 #include "index.h"
 #include "odb.h"
 #include "submodule.h"
+#include "tree.h"
 
 #define DIFF_FLAG_IS_SET(DIFF,FLAG) \
 	(((DIFF)->base.opts.flags & (FLAG)) != 0)
@@ -907,6 +908,12 @@ static int maybe_modified(
 			modified_uncertain = true;
 		}
 
+		/* the file matches the index; the fsmonitor need not report it */
+		if (status == GIT_DELTA_UNMODIFIED && !S_ISGITLINK(nmode) &&
+			index && info->old_iter->type == GIT_ITERATOR_INDEX &&
+			git_iterator_index(info->old_iter) == index)
+			git_index__fsmonitor_mark_valid(index, oitem);
+
 	/* if mode is GITLINK and submodules are ignored, then skip */
 	} else if (S_ISGITLINK(nmode) &&
 			 DIFF_FLAG_IS_SET(diff, GIT_DIFF_IGNORE_SUBMODULES)) {
@@ -1214,6 +1221,11 @@ static int handle_unmatched_old_item(
 	if (git_index_entry_is_conflict(info->oitem))
 		delta_type = GIT_DELTA_CONFLICTED;
 
+	/* a "skip worktree" file is not expected in the working directory */
+	else if (info->new_iter->type == GIT_ITERATOR_WORKDIR &&
+	         (info->oitem->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE) != 0)
+		return iterator_advance(&info->oitem, info->old_iter);
+
 	if ((error = diff_delta__from_one(diff, delta_type, info->oitem, NULL)) < 0)
 		return error;
 
@@ -1419,6 +1431,66 @@ static int diff_load_index(git_index **index, git_repository *repo)
 	return error;
 }
 
+/*
+ * Collect the sparse directory entries of the index that need not be
+ * expanded to be compared: those that match the tree (when unmodified
+ * files are not reported), or that are not in the working directory.
+ */
+static int diff_sparse_skip(
+	git_hashset_str *out,
+	git_repository *repo,
+	git_index *index,
+	git_tree *tree,
+	const git_diff_options *opts)
+{
+	git_index_entry *entry;
+	git_tree_entry *tree_entry;
+	git_str path = GIT_STR_INIT;
+	size_t i;
+	int error = 0;
+
+	if (!index->sparse ||
+	    (tree && opts && (opts->flags & GIT_DIFF_INCLUDE_UNMODIFIED)))
+		return 0;
+
+	git_vector_foreach(&index->entries, i, entry) {
+		bool skip;
+
+		if (!git_index_entry__is_sparse_dir(entry))
+			continue;
+
+		if (!tree) {
+			if ((error = git_repository_workdir_path(&path, repo, entry->path)) < 0)
+				break;
+
+			skip = !git_fs_path_isdir(path.ptr);
+		} else {
+			git_str_clear(&path);
+
+			if ((error = git_str_put(&path, entry->path, strlen(entry->path) - 1)) < 0)
+				break;
+
+			if ((error = git_tree_entry_bypath(&tree_entry, tree, path.ptr)) == GIT_ENOTFOUND) {
+				git_error_clear();
+				error = 0;
+				continue;
+			} else if (error < 0) {
+				break;
+			}
+
+			skip = git_tree_entry__is_tree(tree_entry) &&
+				git_oid_equal(git_tree_entry_id(tree_entry), &entry->id);
+			git_tree_entry_free(tree_entry);
+		}
+
+		if (skip && (error = git_hashset_str_add(out, entry->path)) < 0)
+			break;
+	}
+
+	git_str_dispose(&path);
+	return error;
+}
+
 int git_diff_tree_to_index(
 	git_diff **out,
 	git_repository *repo,
@@ -1431,6 +1503,7 @@ int git_diff_tree_to_index(
 	git_iterator_options a_opts = GIT_ITERATOR_OPTIONS_INIT,
 		b_opts = GIT_ITERATOR_OPTIONS_INIT;
 	git_iterator *a = NULL, *b = NULL;
+	git_hashset_str sparse_skip = GIT_HASHSET_INIT;
 	git_diff *diff = NULL;
 	char *prefix = NULL;
 	bool index_ignore_case = false;
@@ -1446,8 +1519,16 @@ int git_diff_tree_to_index(
 
 	index_ignore_case = index->ignore_case;
 
-	if ((error = diff_prepare_iterator_opts(&prefix, &a_opts, iflag, &b_opts, iflag, opts)) < 0 ||
-	    (error = git_iterator_for_tree(&a, old_tree, &a_opts)) < 0 ||
+	if ((error = diff_prepare_iterator_opts(&prefix, &a_opts, iflag, &b_opts, iflag, opts)) < 0)
+		goto out;
+
+	if (old_tree &&
+	    (error = diff_sparse_skip(&sparse_skip, repo, index, old_tree, opts)) < 0)
+		goto out;
+
+	a_opts.sparse_skip = b_opts.sparse_skip = &sparse_skip;
+
+	if ((error = git_iterator_for_tree(&a, old_tree, &a_opts)) < 0 ||
 	    (error = git_iterator_for_index(&b, repo, index, &b_opts)) < 0 ||
 	    (error = git_diff__from_iterators(&diff, repo, a, b, opts)) < 0)
 		goto out;
@@ -1461,6 +1542,7 @@ int git_diff_tree_to_index(
 out:
 	git_iterator_free(a);
 	git_iterator_free(b);
+	git_hashset_str_dispose(&sparse_skip);
 	git_diff_free(diff);
 	git__free(prefix);
 
@@ -1476,6 +1558,7 @@ int git_diff_index_to_workdir(
 	git_iterator_options a_opts = GIT_ITERATOR_OPTIONS_INIT,
 		b_opts = GIT_ITERATOR_OPTIONS_INIT;
 	git_iterator *a = NULL, *b = NULL;
+	git_hashset_str sparse_skip = GIT_HASHSET_INIT;
 	git_diff *diff = NULL;
 	char *prefix = NULL;
 	int error = 0;
@@ -1490,12 +1573,20 @@ int git_diff_index_to_workdir(
 
 	if ((error = diff_prepare_iterator_opts(&prefix, &a_opts, GIT_ITERATOR_INCLUDE_CONFLICTS,
 						&b_opts, GIT_ITERATOR_DONT_AUTOEXPAND, opts)) < 0 ||
-	    (error = git_iterator_for_index(&a, repo, index, &a_opts)) < 0 ||
+	    (error = diff_sparse_skip(&sparse_skip, repo, index, NULL, opts)) < 0)
+		goto out;
+
+	a_opts.sparse_skip = &sparse_skip;
+
+	if ((error = git_iterator_for_index(&a, repo, index, &a_opts)) < 0 ||
 	    (error = git_iterator_for_workdir(&b, repo, index, NULL, &b_opts)) < 0 ||
 	    (error = git_diff__from_iterators(&diff, repo, a, b, opts)) < 0)
 		goto out;
 
-	if ((diff->opts.flags & GIT_DIFF_UPDATE_INDEX) && ((git_diff_generated *)diff)->index_updated)
+	/* also write the untracked cache and fsmonitor state when they changed */
+	if ((diff->opts.flags & GIT_DIFF_UPDATE_INDEX) &&
+	    (((git_diff_generated *)diff)->index_updated ||
+	     git_index__extensions_changed(index)))
 		if ((error = git_index_write(index)) < 0)
 			goto out;
 
@@ -1504,6 +1595,7 @@ int git_diff_index_to_workdir(
 out:
 	git_iterator_free(a);
 	git_iterator_free(b);
+	git_hashset_str_dispose(&sparse_skip);
 	git_diff_free(diff);
 	git__free(prefix);
 
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "ewah.h"
+
+/*
+ * A serialized bitmap is the number of bits, the number of 64-bit
+ * words that follow, the words themselves and the position of the
+ * last marker word; everything is in network byte order.
+ *
+ * The words are a series of markers, each followed by the literal
+ * words it describes.  A marker holds a bit that is repeated for a
+ * run of words (bit 0), the length of that run (bits 1-32) and the
+ * number of literal words that follow it (bits 33-63).
+ */
+
+#define EWAH_RUN_BITS        32
+#define EWAH_LITERAL_BITS    31
+#define EWAH_MAX_RUN         ((((uint64_t)1) << EWAH_RUN_BITS) - 1)
+#define EWAH_MAX_LITERALS    ((((uint64_t)1) << EWAH_LITERAL_BITS) - 1)
+
+#define EWAH_MARKER(bit, run, literals) \
+	((uint64_t)(bit) | ((uint64_t)(run) << 1) | \
+	 ((uint64_t)(literals) << (1 + EWAH_RUN_BITS)))
+
+GIT_INLINE(uint32_t) ewah_get32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+GIT_INLINE(uint64_t) ewah_get64(const unsigned char *p)
+{
+	return ((uint64_t)ewah_get32(p) << 32) | ewah_get32(p + 4);
+}
+
+GIT_INLINE(void) ewah_put32(unsigned char *p, uint32_t value)
+{
+	p[0] = (unsigned char)(value >> 24);
+	p[1] = (unsigned char)(value >> 16);
+	p[2] = (unsigned char)(value >> 8);
+	p[3] = (unsigned char)value;
+}
+
+GIT_INLINE(void) ewah_put64(unsigned char *p, uint64_t value)
+{
+	ewah_put32(p, (uint32_t)(value >> 32));
+	ewah_put32(p + 4, (uint32_t)value);
+}
+
+GIT_INLINE(uint64_t) ewah_bitvec_word(git_bitvec *bits, size_t nbits, size_t i)
+{
+	uint64_t word = bits->length ? bits->u.words[i] : bits->u.bits;
+	size_t remain = nbits - (i * 64);
+
+	/* ignore anything past the requested length */
+	if (remain < 64)
+		word &= (((uint64_t)1) << remain) - 1;
+
+	return word;
+}
+
+static int ewah_set_word(git_bitvec *out, size_t nbits, size_t pos, uint64_t word)
+{
+	size_t bit;
+
+	for (bit = 0; word; bit++, word >>= 1) {
+		if (!(word & 1))
+			continue;
+
+		if (pos >= nbits || bit >= nbits - pos) {
+			git_error_set(GIT_ERROR_INDEX, "bitmap is out of range");
+			return -1;
+		}
+
+		git_bitvec_set(out, pos + bit, true);
+	}
+
+	return 0;
+}
+
+int git_ewah_read(
+	git_bitvec *out,
+	size_t *read_len,
+	const char *data,
+	size_t len,
+	size_t nbits)
+{
+	const unsigned char *ptr = (const unsigned char *)data;
+	size_t word_count, total, i, pos = 0;
+	uint64_t marker, run, literals, n;
+
+	if (git_bitvec_init(out, nbits) < 0)
+		return -1;
+
+	if (len < 8)
+		goto truncated;
+
+	word_count = ewah_get32(ptr + 4);
+
+	if (GIT_MULTIPLY_SIZET_OVERFLOW(&total, word_count, 8) ||
+	    GIT_ADD_SIZET_OVERFLOW(&total, total, 12) ||
+	    total > len)
+		goto truncated;
+
+	ptr += 8;
+
+	for (i = 0; i < word_count; ) {
+		marker = ewah_get64(ptr + (i++ * 8));
+		run = (marker >> 1) & EWAH_MAX_RUN;
+		literals = marker >> (1 + EWAH_RUN_BITS);
+
+		if (literals > word_count - i)
+			goto invalid;
+
+		if (run > (SIZE_MAX - pos) / 64)
+			goto invalid;
+
+		if (!(marker & 1)) {
+			pos += (size_t)run * 64;
+		} else {
+			for (n = 0; n < run; n++, pos += 64) {
+				if (ewah_set_word(out, nbits, pos, UINT64_MAX) < 0)
+					goto on_error;
+			}
+		}
+
+		for (n = 0; n < literals; n++, pos += 64) {
+			if (ewah_set_word(out, nbits, pos,
+					ewah_get64(ptr + (i++ * 8))) < 0)
+				goto on_error;
+		}
+	}
+
+	*read_len = total;
+	return 0;
+
+truncated:
+	git_error_set(GIT_ERROR_INDEX, "bitmap is truncated");
+	goto on_error;
+
+invalid:
+	git_error_set(GIT_ERROR_INDEX, "bitmap is corrupted");
+
+on_error:
+	git_bitvec_free(out);
+	memset(out, 0x0, sizeof(*out));
+	return -1;
+}
+
+int git_ewah_write(git_str *out, git_bitvec *bits, size_t nbits)
+{
+	git_str words = GIT_STR_INIT;
+	unsigned char buf[8] = {0};
+	size_t word_count = 0, last_marker = 0, i, used = 0, bit_size = 0;
+	size_t run, literals;
+	uint64_t word;
+	int error = -1;
+
+	/* only write the words up to the last bit that is set */
+	for (i = (nbits + 63) / 64; i > 0; i--) {
+		if ((word = ewah_bitvec_word(bits, nbits, i - 1)) != 0) {
+			for (used = i, bit_size = (i - 1) * 64; word; word >>= 1)
+				bit_size++;
+			break;
+		}
+	}
+
+	/* an empty bitmap is a single marker without any words */
+	if (!used) {
+		ewah_put64(buf, 0);
+		git_str_put(&words, (const char *)buf, 8);
+		word_count = 1;
+	}
+
+	for (i = 0; i < used; ) {
+		size_t marker_pos = words.size;
+
+		for (run = 0; i < used && run < EWAH_MAX_RUN &&
+		     ewah_bitvec_word(bits, nbits, i) == 0; run++, i++)
+			;
+
+		git_str_put(&words, (const char *)buf, 8);
+		last_marker = word_count++;
+
+		for (literals = 0; i < used && literals < EWAH_MAX_LITERALS &&
+		     ewah_bitvec_word(bits, nbits, i) != 0; literals++, i++) {
+			ewah_put64(buf, ewah_bitvec_word(bits, nbits, i));
+			git_str_put(&words, (const char *)buf, 8);
+			word_count++;
+		}
+
+		if (git_str_oom(&words))
+			goto done;
+
+		ewah_put64((unsigned char *)words.ptr + marker_pos,
+			EWAH_MARKER(0, run, literals));
+	}
+
+	if (bit_size > UINT32_MAX || word_count > UINT32_MAX) {
+		git_error_set(GIT_ERROR_INDEX, "bitmap is too large");
+		goto done;
+	}
+
+	ewah_put32(buf, (uint32_t)bit_size);
+	ewah_put32(buf + 4, (uint32_t)word_count);
+	git_str_put(out, (const char *)buf, 8);
+	git_str_put(out, words.ptr, words.size);
+	ewah_put32(buf, (uint32_t)last_marker);
+	git_str_put(out, (const char *)buf, 4);
+
+	error = git_str_oom(out) ? -1 : 0;
+
+done:
+	git_str_dispose(&words);
+	return error;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_ewah_h__
+#define INCLUDE_ewah_h__
+
+#include "common.h"
+
+#include "bitvec.h"
+#include "str.h"
+
+/*
+ * Serialization of bit vectors in git's EWAH ("enhanced word-aligned
+ * hybrid") compressed format, as used by the split index.
+ */
+
+/**
+ * Decode an EWAH bitmap of at most `nbits` bits into `out`, which will
+ * be initialized.  The number of bytes consumed is stored in `read_len`.
+ */
+extern int git_ewah_read(
+	git_bitvec *out,
+	size_t *read_len,
+	const char *data,
+	size_t len,
+	size_t nbits);
+
+/**
+ * Append the first `nbits` bits of `bits` to `out` in EWAH format.
+ */
+extern int git_ewah_write(git_str *out, git_bitvec *bits, size_t nbits);
+
+#endif
@@ -11,6 +11,7 @@
 #include "common.h"
 #include "futils.h"
 #include "hash.h"
+#include "odb.h"
 #include "repository.h"
 #include "runtime.h"
 #include "git2/sys/filter.h"
@@ -1155,6 +1156,77 @@ done:
 	return error;
 }
 
+int git_filter_list__stream_odb(
+	git_filter_list *filters,
+	git_odb_stream *odb_stream,
+	size_t len,
+	const git_oid *id,
+	git_writestream *target)
+{
+	char buf[GIT_BUFSIZE_FILTERIO];
+	git_vector filter_streams = GIT_VECTOR_INIT;
+	git_writestream *stream_start;
+	git_hash_ctx hash;
+	unsigned char raw[GIT_HASH_MAX_SIZE];
+	git_oid hashed;
+	size_t total = 0, header_len;
+	bool verify = git_odb__strict_hash_verification;
+	int readlen, error;
+
+	if (filters)
+		git_oid_cpy(&filters->source.oid, id);
+
+	/*
+	 * The contents never reach the object database's own verification,
+	 * so hash them as they are read, as a blob lookup would.
+	 */
+	if (verify) {
+		if ((error = git_hash_ctx_init(&hash,
+				git_oid_algorithm(git_oid_type(id)))) < 0)
+			return error;
+
+		if ((error = git_odb__format_object_header(&header_len, buf,
+				sizeof(buf), len, GIT_OBJECT_BLOB)) < 0 ||
+		    (error = git_hash_update(&hash, buf, header_len)) < 0)
+			goto done;
+	}
+
+	if ((error = stream_list_init(
+			&stream_start, &filter_streams, filters, target)) < 0)
+		goto done;
+
+	while ((readlen = git_odb_stream_read(odb_stream, buf, sizeof(buf))) > 0) {
+		if (verify && (error = git_hash_update(&hash, buf, readlen)) < 0)
+			break;
+
+		if ((error = stream_start->write(stream_start, buf, readlen)) < 0)
+			break;
+
+		total += readlen;
+	}
+
+	if (!error && readlen < 0) {
+		error = readlen;
+	} else if (!error && total != len) {
+		git_error_set(GIT_ERROR_ODB, "short read from object stream");
+		error = -1;
+	} else if (!error && verify) {
+		if ((error = git_hash_final(raw, &hash)) == 0 &&
+		    (error = git_oid_from_raw(&hashed, raw, git_oid_type(id))) == 0 &&
+		    !git_oid_equal(id, &hashed))
+			error = git_odb__error_mismatch(id, &hashed);
+	}
+
+	error |= stream_start->close(stream_start);
+
+done:
+	if (verify)
+		git_hash_ctx_cleanup(&hash);
+
+	filter_streams_free(&filter_streams);
+	return error;
+}
+
 int git_filter_list_stream_buffer(
 	git_filter_list *filters,
 	const char *buffer,
@@ -51,6 +51,18 @@ int git_filter_list__apply_to_blob(
 	git_filter_list *filters,
 	git_blob *blob);
 
+/*
+ * Stream the contents of the blob `id`, of size `len`, through the
+ * filters, reading it from an open object database stream in chunks
+ * rather than loading it into memory.
+ */
+int git_filter_list__stream_odb(
+	git_filter_list *filters,
+	git_odb_stream *odb_stream,
+	size_t len,
+	const git_oid *id,
+	git_writestream *target);
+
 /*
  * The given input buffer will be converted to the given output buffer.
  * The input buffer will be freed (_if_ it was allocated).
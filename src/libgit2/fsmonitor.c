@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "fsmonitor.h"
+
+#include "config.h"
+#include "fsmonitor_daemon.h"
+#include "process.h"
+#include "repository.h"
+
+typedef enum {
+	FSMONITOR_HOOK = 1,
+	FSMONITOR_BUILTIN = 2
+} fsmonitor_t;
+
+/*
+ * `core.fsmonitor` names a hook, or is `true` to ask the builtin
+ * daemon.  Returns GIT_ENOTFOUND when there is no monitor.
+ */
+static int fsmonitor_config(
+	fsmonitor_t *out,
+	git_str *hook,
+	git_repository *repo)
+{
+	git_config *config;
+	git_str value = GIT_STR_INIT;
+	int is_bool, error;
+
+	if ((error = git_repository_config__weakptr(&config, repo)) < 0 ||
+	    (error = git_config__get_string_buf(&value, config, "core.fsmonitor")) < 0)
+		goto done;
+
+	if (git__parse_bool(&is_bool, value.ptr) == 0) {
+		if (is_bool)
+			*out = FSMONITOR_BUILTIN;
+		else
+			error = GIT_ENOTFOUND;
+	} else if (!value.size) {
+		error = GIT_ENOTFOUND;
+	} else {
+		*out = FSMONITOR_HOOK;
+		error = git_config__get_path(hook, config, "core.fsmonitor");
+	}
+
+done:
+	git_str_dispose(&value);
+	return error;
+}
+
+static int changes_add(git_fsmonitor_changes *changes, const char *path, size_t len)
+{
+	char *dup;
+
+	while (len && path[len - 1] == '/')
+		len--;
+
+	/* the root stands for everything beneath it */
+	if (!len) {
+		changes->all = 1;
+		return 0;
+	}
+
+	dup = git_pool_strndup(&changes->pool, path, len);
+	GIT_ERROR_CHECK_ALLOC(dup);
+
+	return git_vector_insert(&changes->paths, dup);
+}
+
+/*
+ * Parses the changed paths, which may be preceded by the new token;
+ * all are NUL-terminated.
+ */
+static int parse_changes(
+	git_fsmonitor_changes *changes,
+	const char *data,
+	size_t len,
+	bool with_token)
+{
+	const char *path = data, *end = data + len;
+	int error;
+
+	if (with_token) {
+		if ((path = memchr(data, '\0', len)) == NULL) {
+			git_error_set(GIT_ERROR_OS, "fsmonitor did not return a token");
+			return -1;
+		}
+
+		if ((error = git_str_put(&changes->token, data, path - data)) < 0)
+			return error;
+
+		path++;
+	}
+
+	while (path < end) {
+		const char *nul = memchr(path, '\0', end - path);
+		size_t path_len = nul ? (size_t)(nul - path) : (size_t)(end - path);
+
+		if (path_len && (error = changes_add(changes, path, path_len)) < 0)
+			return error;
+
+		path += path_len + 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Runs the hook with the given protocol version and token.  With version
+ * 2 its output is the new token followed by the changed paths, with
+ * version 1 it is only the changed paths; all are NUL-terminated.
+ */
+static int hook_run(
+	git_fsmonitor_changes *changes,
+	git_repository *repo,
+	const char *command,
+	int version,
+	const char *token)
+{
+	git_process_options opts = GIT_PROCESS_OPTIONS_INIT;
+	git_process_result result = GIT_PROCESS_RESULT_INIT;
+	git_process *process = NULL;
+	git_str output = GIT_STR_INIT;
+	const char *args[3];
+	char version_str[2], buf[4096];
+	ssize_t ret;
+	int error;
+
+	version_str[0] = '0' + version;
+	version_str[1] = '\0';
+
+	args[0] = command;
+	args[1] = version_str;
+	args[2] = token;
+
+	opts.use_shell = 1;
+	opts.capture_out = 1;
+	opts.cwd = repo->workdir;
+
+	if ((error = git_process_new(&process, args, ARRAY_SIZE(args), NULL, 0, &opts)) < 0 ||
+	    (error = git_process_start(process)) < 0)
+		goto done;
+
+	while ((ret = git_process_read(process, buf, sizeof(buf))) > 0) {
+		if ((error = git_str_put(&output, buf, (size_t)ret)) < 0)
+			goto done;
+	}
+
+	if ((error = git_process_wait(&result, process)) < 0 || ret < 0)
+		goto done;
+
+	if (result.status != GIT_PROCESS_STATUS_NORMAL || result.exitcode != 0) {
+		git_error_set(GIT_ERROR_OS, "fsmonitor hook '%s' failed", command);
+		error = -1;
+		goto done;
+	}
+
+	error = parse_changes(changes, output.ptr, output.size, (version == 2));
+
+done:
+	if (error < 0) {
+		git_str_clear(&changes->token);
+		git_vector_clear(&changes->paths);
+	}
+
+	git_process_free(process);
+	git_str_dispose(&output);
+	return error;
+}
+
+static int hook_query(
+	git_fsmonitor_changes *changes,
+	git_repository *repo,
+	const char *command,
+	const char *token)
+{
+	git_config *config;
+	char now[32];
+	int64_t timestamp;
+	int version, error;
+
+	if (!repo->workdir) {
+		git_error_set(GIT_ERROR_REPOSITORY, "cannot monitor a bare repository");
+		return -1;
+	}
+
+	/* version 1 tokens are timestamps in nanoseconds */
+	p_snprintf(now, sizeof(now), "%" PRId64, (int64_t)time(NULL) * 1000000000);
+
+	if ((error = git_repository_config__weakptr(&config, repo)) < 0)
+		return error;
+
+	version = git_config__get_int_force(config, "core.fsmonitorhookversion", 0);
+
+	/* there is nothing to compare against yet */
+	if (!token)
+		goto all;
+
+	if (version != 1 && hook_run(changes, repo, command, 2, token) == 0)
+		return 0;
+
+	if (version != 2) {
+		/* the version 2 token may not be a timestamp */
+		if (git__strntol64(&timestamp, token, strlen(token), NULL, 10) < 0) {
+			git_error_clear();
+			goto all;
+		}
+
+		if (hook_run(changes, repo, command, 1, token) == 0)
+			return git_str_puts(&changes->token, now);
+	}
+
+	git_error_clear();
+
+all:
+	changes->all = 1;
+	return git_str_puts(&changes->token, now);
+}
+
+/*
+ * Asks the builtin daemon, with a token that it did not hand out when
+ * there is none yet.  When no daemon is running, everything changed.
+ */
+static int builtin_query(
+	git_fsmonitor_changes *changes,
+	git_repository *repo,
+	const char *token)
+{
+	git_str response = GIT_STR_INIT;
+	int error;
+
+	if ((error = git_fsmonitor_daemon__send(&response, repo,
+			token ? token : "builtin:fake")) == 0)
+		error = parse_changes(changes, response.ptr, response.size, true);
+
+	if (error < 0) {
+		git_error_clear();
+		git_str_clear(&changes->token);
+		git_vector_clear(&changes->paths);
+		changes->all = 1;
+		error = 0;
+	}
+
+	git_str_dispose(&response);
+	return error;
+}
+
+int git_fsmonitor__query(
+	git_fsmonitor_changes *changes,
+	git_repository *repo,
+	const char *token)
+{
+	git_fsmonitor *fsmonitor = repo->fsmonitor;
+	git_str command = GIT_STR_INIT;
+	fsmonitor_t type;
+	int error;
+
+	memset(changes, 0, sizeof(*changes));
+
+	if ((error = git_vector_init(&changes->paths, 16, git__strcmp_cb)) < 0 ||
+	    (error = git_pool_init(&changes->pool, 1)) < 0)
+		return error;
+
+	if (fsmonitor) {
+		error = fsmonitor->query(fsmonitor, token, changes);
+
+		if (error == GIT_PASSTHROUGH) {
+			changes->all = 1;
+			git_str_clear(&changes->token);
+			error = 0;
+		} else if (error < 0) {
+			git_error_set_after_callback_function(error, "git_fsmonitor query");
+		}
+
+		/* without a token, the next query cannot be answered */
+		if (!error && !changes->token.size)
+			changes->all = 1;
+	} else if ((error = fsmonitor_config(&type, &command, repo)) == 0) {
+		if (type == FSMONITOR_BUILTIN)
+			error = builtin_query(changes, repo, token);
+		else
+			error = hook_query(changes, repo, command.ptr, token);
+	}
+
+	if (!error) {
+		git_vector_sort(&changes->paths);
+		git_vector_uniq(&changes->paths, NULL);
+	}
+
+	git_str_dispose(&command);
+	return error;
+}
+
+bool git_fsmonitor__enabled(git_repository *repo)
+{
+	git_str command = GIT_STR_INIT;
+	fsmonitor_t type;
+	bool enabled;
+
+	if (repo->fsmonitor)
+		return true;
+
+	enabled = (fsmonitor_config(&type, &command, repo) == 0);
+
+	git_error_clear();
+	git_str_dispose(&command);
+	return enabled;
+}
+
+void git_fsmonitor_changes_dispose(git_fsmonitor_changes *changes)
+{
+	if (!changes)
+		return;
+
+	git_str_dispose(&changes->token);
+	git_vector_dispose(&changes->paths);
+	git_pool_clear(&changes->pool);
+}
+
+int git_fsmonitor_changes_add(git_fsmonitor_changes *changes, const char *path)
+{
+	GIT_ASSERT_ARG(changes);
+	GIT_ASSERT_ARG(path);
+
+	return changes_add(changes, path, strlen(path));
+}
+
+int git_fsmonitor_changes_set_token(git_fsmonitor_changes *changes, const char *token)
+{
+	GIT_ASSERT_ARG(changes);
+	GIT_ASSERT_ARG(token);
+
+	git_str_clear(&changes->token);
+	return git_str_puts(&changes->token, token);
+}
+
+int git_fsmonitor_init(git_fsmonitor *fsmonitor, unsigned int version)
+{
+	GIT_INIT_STRUCTURE_FROM_TEMPLATE(fsmonitor, version,
+		git_fsmonitor, GIT_FSMONITOR_INIT);
+	return 0;
+}
+
+void git_fsmonitor__free(git_fsmonitor *fsmonitor)
+{
+	if (fsmonitor && fsmonitor->free)
+		fsmonitor->free(fsmonitor);
+}
+
+int git_repository_set_fsmonitor(git_repository *repo, git_fsmonitor *fsmonitor)
+{
+	GIT_ASSERT_ARG(repo);
+	GIT_ERROR_CHECK_VERSION(fsmonitor, GIT_FSMONITOR_VERSION, "git_fsmonitor");
+
+	if (fsmonitor && !fsmonitor->query) {
+		git_error_set(GIT_ERROR_INVALID, "filesystem monitor has no query callback");
+		return -1;
+	}
+
+	git_fsmonitor__free(repo->fsmonitor);
+	repo->fsmonitor = fsmonitor;
+	return 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_fsmonitor_h__
+#define INCLUDE_fsmonitor_h__
+
+#include "common.h"
+
+#include "git2/sys/fsmonitor.h"
+#include "pool.h"
+#include "str.h"
+#include "vector.h"
+
+struct git_fsmonitor_changes {
+	git_str token;
+	git_vector paths; /* without trailing slashes */
+	git_pool pool;
+	unsigned int all:1; /* everything changed */
+};
+
+/**
+ * Query the filesystem monitor of the repository (the one that was set
+ * with `git_repository_set_fsmonitor`, or the hook or builtin daemon
+ * configured with `core.fsmonitor`) for the changes since `token`.
+ *
+ * Returns GIT_ENOTFOUND when there is no filesystem monitor.  When the
+ * monitor cannot determine the changes, `changes->all` is set.
+ */
+extern int git_fsmonitor__query(
+	git_fsmonitor_changes *changes,
+	git_repository *repo,
+	const char *token);
+
+/** Whether the repository has a filesystem monitor. */
+extern bool git_fsmonitor__enabled(git_repository *repo);
+
+extern void git_fsmonitor_changes_dispose(git_fsmonitor_changes *changes);
+
+extern void git_fsmonitor__free(git_fsmonitor *fsmonitor);
+
+#endif
@@ -0,0 +1,898 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "fsmonitor_daemon.h"
+
+#include "array.h"
+#include "buf.h"
+#include "fs_path.h"
+#include "hashmap_str.h"
+#include "pool.h"
+#include "posix.h"
+#include "repository.h"
+
+#ifndef GIT_WIN32
+# include <sys/socket.h>
+# include <sys/un.h>
+#endif
+
+#ifdef GIT_FSMONITOR_INOTIFY
+# include <sys/inotify.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+/* the largest payload of a pkt-line */
+#define IPC_PKT_MAX 65516
+
+/*
+ * The largest message that is read: a request is a token or a command,
+ * and a response is well past a full journal of changed paths.
+ */
+#define IPC_REQUEST_MAX IPC_PKT_MAX
+#define IPC_RESPONSE_MAX (64 * 1024 * 1024)
+
+/* seconds to wait for the other end of a connection */
+#define IPC_TIMEOUT 30
+
+#ifndef GIT_WIN32
+
+static int ipc_socket_path(
+	struct sockaddr_un *addr,
+	git_str *path,
+	git_repository *repo)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+
+	if (git_str_joinpath(path, repo->gitdir, GIT_FSMONITOR_DAEMON_SOCKET) < 0)
+		return -1;
+
+	if (path->size >= sizeof(addr->sun_path)) {
+		git_error_set(GIT_ERROR_OS, "path to fsmonitor socket '%s' is too long", path->ptr);
+		return -1;
+	}
+
+	memcpy(addr->sun_path, path->ptr, path->size + 1);
+	return 0;
+}
+
+static int ipc_connect(int *out, const struct sockaddr_un *addr)
+{
+	int fd, error;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		git_error_set(GIT_ERROR_OS, "could not create fsmonitor socket");
+		return -1;
+	}
+
+	if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+		/* a socket that refuses connections was left behind */
+		error = (errno == ENOENT || errno == ECONNREFUSED) ? GIT_ENOTFOUND : -1;
+
+		git_error_set(GIT_ERROR_OS, "could not connect to fsmonitor daemon at '%s'", addr->sun_path);
+		p_close(fd);
+		return error;
+	}
+
+	*out = fd;
+	return 0;
+}
+
+static int ipc_set_timeout(int fd)
+{
+	struct timeval timeout = { IPC_TIMEOUT, 0 };
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0 ||
+	    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0) {
+		git_error_set(GIT_ERROR_OS, "could not set fsmonitor socket timeout");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int ipc_send(int fd, const char *data, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		if ((ret = send(fd, data, len, MSG_NOSIGNAL)) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			git_error_set(GIT_ERROR_OS, "could not write to fsmonitor socket");
+			return -1;
+		}
+
+		data += ret;
+		len -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+static int ipc_recv(int fd, char *data, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		if ((ret = recv(fd, data, len, 0)) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			git_error_set(GIT_ERROR_OS, "could not read from fsmonitor socket");
+			return -1;
+		} else if (ret == 0) {
+			git_error_set(GIT_ERROR_OS, "unexpected end of fsmonitor message");
+			return -1;
+		}
+
+		data += ret;
+		len -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+/* a message is sent as pkt-lines followed by a flush packet */
+static int ipc_write(int fd, const char *data, size_t len)
+{
+	char header[5];
+	size_t chunk;
+
+	while (len) {
+		chunk = min(len, IPC_PKT_MAX);
+		p_snprintf(header, sizeof(header), "%04x", (unsigned int)(chunk + 4));
+
+		if (ipc_send(fd, header, 4) < 0 ||
+		    ipc_send(fd, data, chunk) < 0)
+			return -1;
+
+		data += chunk;
+		len -= chunk;
+	}
+
+	return ipc_send(fd, "0000", 4);
+}
+
+static int ipc_read(git_str *out, int fd, size_t max)
+{
+	char header[4];
+	size_t len, i;
+	int digit;
+
+	while (true) {
+		if (ipc_recv(fd, header, sizeof(header)) < 0)
+			return -1;
+
+		for (len = 0, i = 0; i < sizeof(header); i++) {
+			if ((digit = git__fromhex(header[i])) < 0)
+				goto invalid;
+
+			len = (len << 4) | (size_t)digit;
+		}
+
+		if (len == 0)
+			return 0;
+		else if (len < 4)
+			goto invalid;
+
+		len -= 4;
+
+		if (len > max - out->size) {
+			git_error_set(GIT_ERROR_OS,
+				"fsmonitor message is larger than %" PRIuZ " bytes", max);
+			return -1;
+		}
+
+		if (git_str_grow_by(out, len + 1) < 0 ||
+		    ipc_recv(fd, out->ptr + out->size, len) < 0)
+			return -1;
+
+		out->size += len;
+		out->ptr[out->size] = '\0';
+	}
+
+invalid:
+	git_error_set(GIT_ERROR_OS, "invalid fsmonitor message");
+	return -1;
+}
+
+int git_fsmonitor_daemon__send(
+	git_str *out,
+	git_repository *repo,
+	const char *request)
+{
+	struct sockaddr_un addr;
+	git_str path = GIT_STR_INIT;
+	int fd = -1, error;
+
+	if ((error = ipc_socket_path(&addr, &path, repo)) < 0 ||
+	    (error = ipc_connect(&fd, &addr)) < 0 ||
+	    (error = ipc_set_timeout(fd)) < 0 ||
+	    (error = ipc_write(fd, request, strlen(request))) < 0 ||
+	    (error = ipc_read(out, fd, IPC_RESPONSE_MAX)) < 0)
+		goto done;
+
+done:
+	if (fd >= 0)
+		p_close(fd);
+
+	git_str_dispose(&path);
+	return error;
+}
+
+#else
+
+int git_fsmonitor_daemon__send(
+	git_str *out,
+	git_repository *repo,
+	const char *request)
+{
+	GIT_UNUSED(out);
+	GIT_UNUSED(repo);
+	GIT_UNUSED(request);
+
+	git_error_set(GIT_ERROR_INVALID, "the builtin filesystem monitor is not supported on this platform");
+	return GIT_ENOTFOUND;
+}
+
+#endif
+
+int git_fsmonitor_daemon_send(
+	git_buf *out,
+	git_repository *repo,
+	const char *request)
+{
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(repo);
+	GIT_ASSERT_ARG(request);
+
+	GIT_BUF_WRAP_PRIVATE(out, git_fsmonitor_daemon__send, repo, request);
+}
+
+#ifdef GIT_FSMONITOR_INOTIFY
+
+#define WATCH_MASK \
+	(IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+	 IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | \
+	 IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+/* when more paths than this changed, start over */
+#define JOURNAL_MAX 100000
+
+#define watch_hash(wd) ((uint32_t)(wd))
+#define watch_equal(a, b) ((a) == (b))
+
+typedef struct {
+	uint64_t seq;
+	char path[GIT_FLEX_ARRAY];
+} journal_entry;
+
+GIT_HASHMAP_SETUP(git_fsmonitor_daemon_watchmap, int, char *, watch_hash, watch_equal);
+GIT_HASHMAP_STR_SETUP(git_fsmonitor_daemon_journal, journal_entry *);
+
+struct git_fsmonitor_daemon {
+	git_str workdir;
+	git_str socket_path;
+	git_str path;
+
+	int inotify_fd;
+	int listen_fd;
+	int stop_fds[2];
+
+	/* the watched directories, relative to the working directory */
+	git_fsmonitor_daemon_watchmap watches;
+
+	/* the paths that changed, with the sequence number they did at */
+	git_fsmonitor_daemon_journal journal;
+	git_pool journal_pool;
+
+	/*
+	 * Tokens are "builtin:<token_id>:<seq>"; the token id changes
+	 * whenever the journal is reset, so that older tokens cannot be
+	 * answered.
+	 */
+	char token_id[64];
+	unsigned int resets;
+	uint64_t seq;
+
+	unsigned int bound : 1,
+	             quit : 1;
+};
+
+static void daemon_reset(git_fsmonitor_daemon *daemon)
+{
+	git_fsmonitor_daemon_journal_clear(&daemon->journal);
+	git_pool_clear(&daemon->journal_pool);
+
+	p_snprintf(daemon->token_id, sizeof(daemon->token_id),
+		"%u.%d.%" PRId64, ++daemon->resets, (int)getpid(),
+		(int64_t)time(NULL));
+	daemon->seq = 0;
+}
+
+static int daemon_record(git_fsmonitor_daemon *daemon, const char *path)
+{
+	journal_entry *entry;
+	size_t len = strlen(path), alloc_len;
+
+	if (git_fsmonitor_daemon_journal_get(&entry, &daemon->journal, path) == 0) {
+		entry->seq = daemon->seq;
+		return 0;
+	}
+
+	if (git_fsmonitor_daemon_journal_size(&daemon->journal) >= JOURNAL_MAX) {
+		daemon_reset(daemon);
+		return 0;
+	}
+
+	GIT_ERROR_CHECK_ALLOC_ADD3(&alloc_len, sizeof(journal_entry), len, 1);
+	entry = git_pool_malloc(&daemon->journal_pool, alloc_len);
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	entry->seq = daemon->seq;
+	memcpy(entry->path, path, len + 1);
+
+	return git_fsmonitor_daemon_journal_put(&daemon->journal, entry->path, entry);
+}
+
+/* Watches a directory and the directories beneath it. */
+static int daemon_watch_tree(git_fsmonitor_daemon *daemon, const char *path)
+{
+	git_fs_path_diriter diriter = GIT_FS_PATH_DIRITER_INIT;
+	git_str full = GIT_STR_INIT, child = GIT_STR_INIT;
+	const char *name;
+	size_t name_len;
+	struct stat st;
+	char *dup = NULL, *old;
+	int wd, error;
+
+	if ((error = git_str_joinpath(&full, daemon->workdir.ptr, path)) < 0)
+		goto done;
+
+	if ((wd = inotify_add_watch(daemon->inotify_fd, full.ptr, WATCH_MASK)) < 0) {
+		/* the directory went away already */
+		if (errno == ENOENT || errno == ENOTDIR || errno == EACCES)
+			goto done;
+
+		git_error_set(GIT_ERROR_OS, "could not watch '%s'", full.ptr);
+		error = -1;
+		goto done;
+	}
+
+	if ((dup = git__strdup(path)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	if (git_fsmonitor_daemon_watchmap_get(&old, &daemon->watches, wd) == 0)
+		git__free(old);
+
+	if ((error = git_fsmonitor_daemon_watchmap_put(&daemon->watches, wd, dup)) < 0) {
+		git_fsmonitor_daemon_watchmap_remove(&daemon->watches, wd);
+		git__free(dup);
+		goto done;
+	}
+
+	if ((error = git_fs_path_diriter_init(&diriter, full.ptr, 0)) < 0) {
+		if (error == GIT_ENOTFOUND) {
+			git_error_clear();
+			error = 0;
+		}
+
+		goto done;
+	}
+
+	while ((error = git_fs_path_diriter_next(&diriter)) == 0) {
+		if ((error = git_fs_path_diriter_filename(&name, &name_len, &diriter)) < 0)
+			goto done;
+
+		/* the repository is not part of the working directory */
+		if (!*path && name_len == CONST_STRLEN(DOT_GIT) &&
+		    !memcmp(name, DOT_GIT, name_len))
+			continue;
+
+		if (git_fs_path_diriter_stat(&st, &diriter) < 0) {
+			git_error_clear();
+			continue;
+		}
+
+		if (!S_ISDIR(st.st_mode))
+			continue;
+
+		git_str_clear(&child);
+
+		if ((error = git_str_joinpath(&child, path, name)) < 0 ||
+		    (error = daemon_watch_tree(daemon, child.ptr)) < 0)
+			goto done;
+	}
+
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+done:
+	git_fs_path_diriter_free(&diriter);
+	git_str_dispose(&child);
+	git_str_dispose(&full);
+	return error;
+}
+
+/* Stops watching a directory and the directories beneath it. */
+static int daemon_unwatch_tree(git_fsmonitor_daemon *daemon, const char *path)
+{
+	git_hashmap_iter_t iter = GIT_HASHMAP_ITER_INIT;
+	git_array_t(int) wds = GIT_ARRAY_INIT;
+	size_t len = strlen(path), i;
+	char *dir;
+	int wd, *entry;
+
+	while (git_fsmonitor_daemon_watchmap_iterate(&iter, &wd, &dir, &daemon->watches) == 0) {
+		if (strncmp(dir, path, len) != 0 || (dir[len] && dir[len] != '/'))
+			continue;
+
+		entry = git_array_alloc(wds);
+		GIT_ERROR_CHECK_ALLOC(entry);
+		*entry = wd;
+	}
+
+	git_array_foreach(wds, i, entry) {
+		wd = *entry;
+
+		if (git_fsmonitor_daemon_watchmap_get(&dir, &daemon->watches, wd) == 0) {
+			git_fsmonitor_daemon_watchmap_remove(&daemon->watches, wd);
+			git__free(dir);
+		}
+
+		inotify_rm_watch(daemon->inotify_fd, wd);
+	}
+
+	git_array_clear(wds);
+	return 0;
+}
+
+static void daemon_unwatch_all(git_fsmonitor_daemon *daemon)
+{
+	git_hashmap_iter_t iter = GIT_HASHMAP_ITER_INIT;
+	char *dir;
+	int wd;
+
+	while (git_fsmonitor_daemon_watchmap_iterate(&iter, &wd, &dir, &daemon->watches) == 0) {
+		if (daemon->inotify_fd >= 0)
+			inotify_rm_watch(daemon->inotify_fd, wd);
+
+		git__free(dir);
+	}
+
+	git_fsmonitor_daemon_watchmap_clear(&daemon->watches);
+}
+
+/*
+ * Starts over when events were lost: every client has to examine the
+ * whole working directory again, since its token is no longer valid.
+ */
+static int daemon_rescan(git_fsmonitor_daemon *daemon)
+{
+	daemon_unwatch_all(daemon);
+	daemon_reset(daemon);
+
+	return daemon_watch_tree(daemon, "");
+}
+
+static int daemon_handle_event(
+	git_fsmonitor_daemon *daemon,
+	const struct inotify_event *event)
+{
+	char *dir;
+	int error = 0;
+
+	if (event->mask & IN_Q_OVERFLOW)
+		return daemon_rescan(daemon);
+
+	if (git_fsmonitor_daemon_watchmap_get(&dir, &daemon->watches, event->wd) < 0)
+		return 0;
+
+	if (event->mask & IN_IGNORED) {
+		git_fsmonitor_daemon_watchmap_remove(&daemon->watches, event->wd);
+		git__free(dir);
+		return 0;
+	}
+
+	/* changes to a directory itself are reported by its parent */
+	if (!event->len) {
+		if (!*dir && (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)))
+			return daemon_rescan(daemon);
+
+		return 0;
+	}
+
+	if (!*dir && !strcmp(event->name, DOT_GIT))
+		return 0;
+
+	git_str_clear(&daemon->path);
+
+	if ((error = git_str_joinpath(&daemon->path, dir, event->name)) < 0)
+		return error;
+
+	/* a directory stands for everything beneath it */
+	if (event->mask & IN_ISDIR) {
+		if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+			error = daemon_unwatch_tree(daemon, daemon->path.ptr);
+		else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+			error = daemon_watch_tree(daemon, daemon->path.ptr);
+
+		if (error < 0 || (error = git_str_putc(&daemon->path, '/')) < 0)
+			return error;
+	}
+
+	return daemon_record(daemon, daemon->path.ptr);
+}
+
+static int daemon_read_events(git_fsmonitor_daemon *daemon)
+{
+	union {
+		struct inotify_event event;
+		char data[4096];
+	} buf;
+	const struct inotify_event *event;
+	ssize_t len, pos;
+	int error;
+
+	while (true) {
+		if ((len = read(daemon->inotify_fd, buf.data, sizeof(buf.data))) < 0) {
+			if (errno == EINTR)
+				continue;
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+
+			git_error_set(GIT_ERROR_OS, "could not read filesystem events");
+			return -1;
+		}
+
+		for (pos = 0; pos < len; pos += sizeof(*event) + event->len) {
+			event = (const struct inotify_event *)(buf.data + pos);
+
+			if ((error = daemon_handle_event(daemon, event)) < 0)
+				return error;
+		}
+	}
+}
+
+static bool daemon_parse_token(
+	uint64_t *out,
+	git_fsmonitor_daemon *daemon,
+	const char *token)
+{
+	size_t id_len = strlen(daemon->token_id);
+	const char *end;
+	int64_t seq;
+
+	if (git__prefixcmp(token, "builtin:") != 0)
+		return false;
+
+	token += CONST_STRLEN("builtin:");
+
+	if (strncmp(token, daemon->token_id, id_len) != 0 || token[id_len] != ':')
+		return false;
+
+	token += id_len + 1;
+
+	if (git__strntol64(&seq, token, strlen(token), &end, 10) < 0 ||
+	    *end || seq < 0 || (uint64_t)seq > daemon->seq) {
+		git_error_clear();
+		return false;
+	}
+
+	*out = (uint64_t)seq;
+	return true;
+}
+
+/*
+ * The response is the new token followed by the paths that changed
+ * since the given one, all NUL-terminated.  When the given token
+ * cannot be answered, the only path is "/", which stands for
+ * everything.
+ */
+static int daemon_respond(
+	git_str *out,
+	git_fsmonitor_daemon *daemon,
+	const char *token)
+{
+	git_hashmap_iter_t iter = GIT_HASHMAP_ITER_INIT;
+	journal_entry *entry;
+	uint64_t since;
+	int error;
+
+	if ((error = git_str_printf(out, "builtin:%s:%" PRIu64,
+			daemon->token_id, daemon->seq)) < 0 ||
+	    (error = git_str_putc(out, '\0')) < 0)
+		return error;
+
+	if (!daemon_parse_token(&since, daemon, token)) {
+		error = git_str_put(out, "/", 2);
+	} else {
+		while (git_fsmonitor_daemon_journal_iterate(&iter, NULL, &entry, &daemon->journal) == 0) {
+			if (entry->seq > since &&
+			    (error = git_str_put(out, entry->path, strlen(entry->path) + 1)) < 0)
+				break;
+		}
+	}
+
+	/* changes from now on are newer than the token */
+	daemon->seq++;
+	return error;
+}
+
+static int daemon_serve(git_fsmonitor_daemon *daemon)
+{
+	git_str request = GIT_STR_INIT, response = GIT_STR_INIT;
+	int fd, error = 0;
+
+	if ((fd = accept(daemon->listen_fd, NULL, NULL)) < 0) {
+		if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED)
+			return 0;
+
+		git_error_set(GIT_ERROR_OS, "could not accept fsmonitor connection");
+		return -1;
+	}
+
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0 ||
+	    ipc_set_timeout(fd) < 0 ||
+	    ipc_read(&request, fd, IPC_REQUEST_MAX) < 0)
+		goto client_error;
+
+	if (!strcmp(request.ptr, "quit")) {
+		daemon->quit = 1;
+	} else {
+		/* the changes that happened before the query are included */
+		if (!strcmp(request.ptr, "flush"))
+			error = daemon_rescan(daemon);
+		else
+			error = daemon_read_events(daemon);
+
+		if (error < 0 ||
+		    (error = daemon_respond(&response, daemon, request.ptr)) < 0)
+			goto done;
+	}
+
+	if (ipc_write(fd, response.ptr, response.size) < 0)
+		goto client_error;
+
+	goto done;
+
+client_error:
+	/* a client that went away or misbehaved does not stop the daemon */
+	git_error_clear();
+
+done:
+	p_close(fd);
+	git_str_dispose(&request);
+	git_str_dispose(&response);
+	return error;
+}
+
+static int daemon_listen(git_fsmonitor_daemon *daemon, git_repository *repo)
+{
+	struct sockaddr_un addr;
+	int fd, error;
+
+	if ((error = ipc_socket_path(&addr, &daemon->socket_path, repo)) < 0)
+		return error;
+
+	if ((error = ipc_connect(&fd, &addr)) == 0) {
+		p_close(fd);
+
+		git_error_set(GIT_ERROR_INVALID,
+			"a filesystem monitor is already running for '%s'",
+			daemon->workdir.ptr);
+		return GIT_EEXISTS;
+	} else if (error != GIT_ENOTFOUND) {
+		return error;
+	}
+
+	git_error_clear();
+
+	if (p_unlink(daemon->socket_path.ptr) < 0 && errno != ENOENT) {
+		git_error_set(GIT_ERROR_OS, "could not remove stale fsmonitor socket '%s'",
+			daemon->socket_path.ptr);
+		return -1;
+	}
+
+	if ((daemon->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		git_error_set(GIT_ERROR_OS, "could not create fsmonitor socket");
+		return -1;
+	}
+
+	if (bind(daemon->listen_fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		git_error_set(GIT_ERROR_OS, "could not bind fsmonitor socket '%s'",
+			daemon->socket_path.ptr);
+		return -1;
+	}
+
+	daemon->bound = 1;
+
+	if (listen(daemon->listen_fd, 16) < 0) {
+		git_error_set(GIT_ERROR_OS, "could not listen on fsmonitor socket '%s'",
+			daemon->socket_path.ptr);
+		return -1;
+	}
+
+	return 0;
+}
+
+int git_fsmonitor_daemon_new(
+	git_fsmonitor_daemon **out,
+	git_repository *repo)
+{
+	git_fsmonitor_daemon *daemon;
+	int error;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(repo);
+
+	*out = NULL;
+
+	if ((error = git_repository__ensure_not_bare(repo, "monitor the working directory")) < 0)
+		return error;
+
+	daemon = git__calloc(1, sizeof(git_fsmonitor_daemon));
+	GIT_ERROR_CHECK_ALLOC(daemon);
+
+	daemon->inotify_fd = -1;
+	daemon->listen_fd = -1;
+	daemon->stop_fds[0] = daemon->stop_fds[1] = -1;
+
+	if ((error = git_pool_init(&daemon->journal_pool, 1)) < 0 ||
+	    (error = git_str_sets(&daemon->workdir, repo->workdir)) < 0)
+		goto done;
+
+	if (pipe2(daemon->stop_fds, O_CLOEXEC) < 0) {
+		git_error_set(GIT_ERROR_OS, "could not create fsmonitor pipe");
+		error = -1;
+		goto done;
+	}
+
+	if ((daemon->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+		git_error_set(GIT_ERROR_OS, "could not initialize inotify");
+		error = -1;
+		goto done;
+	}
+
+	daemon_reset(daemon);
+
+	if ((error = daemon_watch_tree(daemon, "")) < 0 ||
+	    (error = daemon_listen(daemon, repo)) < 0)
+		goto done;
+
+	*out = daemon;
+
+done:
+	if (error < 0)
+		git_fsmonitor_daemon_free(daemon);
+
+	return error;
+}
+
+int git_fsmonitor_daemon_run(git_fsmonitor_daemon *daemon)
+{
+	struct pollfd fds[3];
+	size_t i;
+	char c;
+	int error = 0;
+
+	GIT_ASSERT_ARG(daemon);
+
+	fds[0].fd = daemon->stop_fds[0];
+	fds[1].fd = daemon->inotify_fd;
+	fds[2].fd = daemon->listen_fd;
+
+	daemon->quit = 0;
+
+	while (!daemon->quit) {
+		for (i = 0; i < ARRAY_SIZE(fds); i++) {
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+
+		if (p_poll(fds, ARRAY_SIZE(fds), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			git_error_set(GIT_ERROR_OS, "could not wait for filesystem events");
+			return -1;
+		}
+
+		if (fds[0].revents) {
+			p_read(daemon->stop_fds[0], &c, 1);
+			break;
+		}
+
+		if ((fds[1].revents && (error = daemon_read_events(daemon)) < 0) ||
+		    (fds[2].revents && (error = daemon_serve(daemon)) < 0))
+			break;
+	}
+
+	return error;
+}
+
+void git_fsmonitor_daemon_stop(git_fsmonitor_daemon *daemon)
+{
+	ssize_t ret;
+
+	if (!daemon)
+		return;
+
+	/* only async-signal-safe functions may be used here */
+	ret = write(daemon->stop_fds[1], "", 1);
+	GIT_UNUSED(ret);
+}
+
+void git_fsmonitor_daemon_free(git_fsmonitor_daemon *daemon)
+{
+	if (!daemon)
+		return;
+
+	if (daemon->bound)
+		p_unlink(daemon->socket_path.ptr);
+
+	daemon_unwatch_all(daemon);
+	git_fsmonitor_daemon_watchmap_dispose(&daemon->watches);
+	git_fsmonitor_daemon_journal_dispose(&daemon->journal);
+	git_pool_clear(&daemon->journal_pool);
+
+	if (daemon->listen_fd >= 0)
+		p_close(daemon->listen_fd);
+	if (daemon->inotify_fd >= 0)
+		p_close(daemon->inotify_fd);
+	if (daemon->stop_fds[0] >= 0)
+		p_close(daemon->stop_fds[0]);
+	if (daemon->stop_fds[1] >= 0)
+		p_close(daemon->stop_fds[1]);
+
+	git_str_dispose(&daemon->workdir);
+	git_str_dispose(&daemon->socket_path);
+	git_str_dispose(&daemon->path);
+	git__free(daemon);
+}
+
+#else
+
+int git_fsmonitor_daemon_new(
+	git_fsmonitor_daemon **out,
+	git_repository *repo)
+{
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(repo);
+
+	*out = NULL;
+
+	git_error_set(GIT_ERROR_INVALID, "the builtin filesystem monitor is not supported on this platform");
+	return -1;
+}
+
+int git_fsmonitor_daemon_run(git_fsmonitor_daemon *daemon)
+{
+	GIT_UNUSED(daemon);
+
+	git_error_set(GIT_ERROR_INVALID, "the builtin filesystem monitor is not supported on this platform");
+	return -1;
+}
+
+void git_fsmonitor_daemon_stop(git_fsmonitor_daemon *daemon)
+{
+	GIT_UNUSED(daemon);
+}
+
+void git_fsmonitor_daemon_free(git_fsmonitor_daemon *daemon)
+{
+	GIT_UNUSED(daemon);
+}
+
+#endif
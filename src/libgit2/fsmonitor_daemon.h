@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_fsmonitor_daemon_h__
+#define INCLUDE_fsmonitor_daemon_h__
+
+#include "common.h"
+
+#include "git2/sys/fsmonitor.h"
+#include "str.h"
+
+/** The socket the daemon listens on, in the git directory. */
+#define GIT_FSMONITOR_DAEMON_SOCKET "fsmonitor--daemon.ipc"
+
+/**
+ * Send a request to the daemon that is listening for the repository,
+ * and read its response.  Returns GIT_ENOTFOUND when no daemon is
+ * listening.
+ */
+extern int git_fsmonitor_daemon__send(
+	git_str *out,
+	git_repository *repo,
+	const char *request);
+
+#endif
@@ -20,7 +20,13 @@
 #include "diff.h"
 #include "varint.h"
 #include "path.h"
+#include "config.h"
 #include "index_map.h"
+#include "ewah.h"
+#include "date.h"
+#include "untracked_cache.h"
+#include "fsmonitor.h"
+#include "sparse.h"
 
 #include "git2/odb.h"
 #include "git2/oid.h"
@@ -44,6 +50,22 @@ static const unsigned int INDEX_HEADER_SIG = 0x44495243;
 static const char INDEX_EXT_TREECACHE_SIG[] = {'T', 'R', 'E', 'E'};
 static const char INDEX_EXT_UNMERGED_SIG[] = {'R', 'E', 'U', 'C'};
 static const char INDEX_EXT_CONFLICT_NAME_SIG[] = {'N', 'A', 'M', 'E'};
+static const char INDEX_EXT_ENTRY_OFFSETS_SIG[] = {'I', 'E', 'O', 'T'};
+static const char INDEX_EXT_END_OF_ENTRIES_SIG[] = {'E', 'O', 'I', 'E'};
+static const char INDEX_EXT_LINK_SIG[] = {'l', 'i', 'n', 'k'};
+static const char INDEX_EXT_UNTRACKED_SIG[] = {'U', 'N', 'T', 'R'};
+static const char INDEX_EXT_FSMONITOR_SIG[] = {'F', 'S', 'M', 'N'};
+static const char INDEX_EXT_SPARSE_DIRS_SIG[] = {'s', 'd', 'i', 'r'};
+
+#define INDEX_SHARED_FILE "sharedindex"
+
+static const uint32_t INDEX_IEOT_VERSION = 1;
+
+/* Number of entries in each block of the entry offset table we write */
+#define INDEX_IEOT_BLOCK_ENTRIES 4096
+
+/* Number of entries that make it worthwhile to start another reader */
+#define INDEX_THREAD_ENTRIES 10000
 
 #define INDEX_OWNER(idx) ((git_repository *)(GIT_REFCOUNT_OWNER(idx)))
 
@@ -58,6 +80,53 @@ struct index_extension {
 	uint32_t extension_size;
 };
 
+struct index_entry_block {
+	uint32_t offset;
+	uint32_t nr;
+};
+
+/* The "link" extension of a split index */
+struct index_link {
+	git_oid shared_id;
+	const char *bitmaps;
+	size_t bitmaps_len;
+	unsigned int present:1;
+};
+
+/* The bitmap of the "FSMN" extension */
+struct index_fsmonitor {
+	const char *bitmap;
+	size_t bitmap_len;
+	unsigned int present:1;
+};
+
+/* Extensions that refer to the entries by their position */
+struct index_deferred {
+	struct index_link link;
+	struct index_fsmonitor fsmonitor;
+	unsigned int sparse_dirs:1;
+};
+
+/*
+ * An index whose entries are left in the mapped file: the offset of
+ * each entry in `buffer` is recorded when the index is parsed, entries
+ * that are looked up by path are decoded into `decoded`, and the rest
+ * are only decoded when a caller needs the `entries` vector.  At that
+ * point the index is materialized and the file is unmapped.  (The map
+ * is only owned once the index has been parsed.)
+ */
+struct index_lazy {
+	git_map map;
+	const char *buffer;
+	size_t buffer_size;
+	uint32_t *offsets;
+	git_index_entry **decoded;
+	size_t count;
+	size_t checksum_size;
+	git_bitvec fsmonitor_dirty;
+	unsigned int fsmonitor:1;
+};
+
 struct entry_time {
 	uint32_t seconds;
 	uint32_t nanoseconds;
@@ -123,15 +192,21 @@ struct reuc_entry_internal {
 bool git_index__enforce_unsaved_safety = false;
 
 /* local declarations */
-static int read_extension(size_t *read_len, git_index *index, size_t checksum_size, const char *buffer, size_t buffer_size);
+static int read_extension(size_t *read_len, git_index *index, struct index_deferred *deferred, size_t checksum_size, const char *buffer, size_t buffer_size);
 static int read_header(struct index_header *dest, const void *buffer);
 
-static int parse_index(git_index *index, const char *buffer, size_t buffer_size);
+static int parse_index(git_index *index, git_map *map);
 static bool is_index_extended(git_index *index);
 static int write_index(unsigned char checksum[GIT_HASH_MAX_SIZE], size_t *checksum_size, git_index *index, git_filebuf *file);
 
 static void index_entry_free(git_index_entry *entry);
 static void index_entry_reuc_free(git_index_reuc_entry *reuc);
+static int index_sparse_expand_path(git_index *index, const char *path, size_t path_len);
+static void index_lazy_free(git_index *index);
+static int index_lazy_decode(git_index_entry **out, git_index *index, size_t pos);
+static int index_lazy_find(size_t *out, git_index *index, const char *path, int stage);
+static bool index_lazy_has_conflicts(const git_index *index);
+static int index_materialize(git_index *index);
 
 int git_index_entry_srch(const void *key, const void *array_member)
 {
@@ -361,11 +436,65 @@ GIT_INLINE(int) index_find(
 		out, &index->entries, index->entries_search, path, path_len, stage);
 }
 
+/*
+ * The path map is only an accelerator for `git_index_get_bypath`; when
+ * an index is read from disk (or replaced wholesale) we leave it empty
+ * and answer lookups by binary searching the sorted entries instead.
+ * Callers that look up a significant share of the entries will build
+ * the map on demand.
+ */
+#define INDEX_ENTRYMAP_BUILD_RATIO 4
+
+static void index_map_invalidate(git_index *index)
+{
+	git_index_entrymap_clear(&index->entries_map);
+	index->entries_map_lazy = 1;
+	index->entries_map_misses = 0;
+}
+
+static int index_map_build(git_index *index)
+{
+	git_index_entry *entry;
+	size_t i;
+
+	if (git_index_entrymap_resize(&index->entries_map,
+			(size_t)(index->entries.length * 1.3)) < 0)
+		return -1;
+
+	git_vector_foreach(&index->entries, i, entry) {
+		if (git_index_entrymap_put(&index->entries_map, entry) < 0) {
+			git_index_entrymap_clear(&index->entries_map);
+			return -1;
+		}
+	}
+
+	index->entries_map_lazy = 0;
+	return 0;
+}
+
+GIT_INLINE(int) index_map_put(git_index *index, git_index_entry *entry)
+{
+	if (index->entries_map_lazy)
+		return 0;
+
+	return git_index_entrymap_put(&index->entries_map, entry);
+}
+
+GIT_INLINE(void) index_map_remove(git_index *index, git_index_entry *entry)
+{
+	if (!index->entries_map_lazy)
+		git_index_entrymap_remove(&index->entries_map, entry);
+}
+
 void git_index__set_ignore_case(git_index *index, bool ignore_case)
 {
 	index->ignore_case = ignore_case;
 	index->entries_map.ignore_case = ignore_case;
 
+	/* the map was hashed with the previous case sensitivity */
+	if (index->entries.length)
+		index_map_invalidate(index);
+
 	if (ignore_case) {
 		index->entries_cmp_path    = git__strcasecmp_cb;
 		index->entries_search      = git_index_entry_isrch;
@@ -475,6 +604,7 @@ static void index_free(git_index *index)
 	git_vector_dispose(&index->reuc);
 	git_vector_dispose(&index->deleted);
 
+	git_index_free(index->shared);
 	git__free(index->index_file_path);
 
 	git__memzero(index, sizeof(*index));
@@ -514,7 +644,8 @@ static int index_remove_entry(git_index *index, size_t pos)
 
 	if (entry != NULL) {
 		git_tree_cache_invalidate_path(index->tree, entry->path);
-		git_index_entrymap_remove(&index->entries_map, entry);
+		git_untracked_cache_invalidate_path(index->untracked, entry->path);
+		index_map_remove(index, entry);
 	}
 
 	error = git_vector_remove(&index->entries, pos);
@@ -542,7 +673,18 @@ int git_index_clear(git_index *index)
 	index->tree = NULL;
 	git_pool_clear(&index->tree_pool);
 
+	git_untracked_cache_free(index->untracked);
+	index->untracked = NULL;
+
+	git__free(index->fsmonitor_token);
+	index->fsmonitor_token = NULL;
+	index->fsmonitor_changed = 0;
+
 	git_index_entrymap_clear(&index->entries_map);
+	index->entries_map_lazy = 0;
+	index->sparse = 0;
+
+	index_lazy_free(index);
 
 	while (!error && index->entries.length > 0)
 		error = index_remove_entry(index, index->entries.length - 1);
@@ -646,10 +788,37 @@ static int compare_checksum(git_index *index)
 	return !!memcmp(checksum, index->checksum, checksum_size);
 }
 
+static int index_map_file(git_map *out, const char *path)
+{
+	git_file fd;
+	uint64_t len;
+	int error;
+
+	if ((fd = git_futils_open_ro(path)) < 0)
+		return fd;
+
+	if ((error = git_futils_filesize(&len, fd)) < 0)
+		goto done;
+
+	if (!git__is_sizet(len)) {
+		git_error_set(GIT_ERROR_INDEX, "index file '%s' is too large", path);
+		error = -1;
+		goto done;
+	}
+
+	/* an empty index is left unmapped and rejected by the parser */
+	if (len)
+		error = git_futils_mmap_ro(out, fd, 0, (size_t)len);
+
+done:
+	p_close(fd);
+	return error;
+}
+
 int git_index_read(git_index *index, int force)
 {
 	int error = 0, updated;
-	git_str buffer = GIT_STR_INIT;
+	git_map map = {0};
 	git_futils_filestamp stamp = index->stamp;
 
 	if (!index->index_file_path)
@@ -678,8 +847,12 @@ int git_index_read(git_index *index, int force)
 	if (!updated && !force)
 		return 0;
 
-	error = git_futils_readbuffer(&buffer, index->index_file_path);
-	if (error < 0)
+	/*
+	 * Map the file rather than reading it; the parser may keep the
+	 * map to decode entries from as they're needed, otherwise it is
+	 * unmapped as soon as it's parsed.
+	 */
+	if ((error = index_map_file(&map, index->index_file_path)) < 0)
 		return error;
 
 	index->tree = NULL;
@@ -688,14 +861,16 @@ int git_index_read(git_index *index, int force)
 	error = git_index_clear(index);
 
 	if (!error)
-		error = parse_index(index, buffer.ptr, buffer.size);
+		error = parse_index(index, &map);
 
 	if (!error) {
 		git_futils_filestamp_set(&index->stamp, &stamp);
 		index->dirty = 0;
 	}
 
-	git_str_dispose(&buffer);
+	if (map.data)
+		git_futils_mmap_free(&map);
+
 	return error;
 }
 
@@ -767,6 +942,7 @@ static int truncate_racily_clean(git_index *index)
 		 */
 		if (entry) {
 			entry->file_size = 0;
+			entry->flags_extended &= ~GIT_INDEX_ENTRY_FSMONITOR_VALID;
 			index->dirty = 1;
 		}
 	}
@@ -794,6 +970,10 @@ int git_index_set_version(git_index *index, unsigned int version)
 		return -1;
 	}
 
+	/* mapped entries are decoded according to the version they're in */
+	if (index_materialize(index) < 0)
+		return -1;
+
 	index->version = version;
 
 	return 0;
@@ -804,12 +984,21 @@ int git_index_write(git_index *index)
 	git_indexwriter writer = GIT_INDEXWRITER_INIT;
 	int error;
 
+	if ((error = index_materialize(index)) < 0)
+		return error;
+
 	truncate_racily_clean(index);
 
 	if ((error = git_indexwriter_init(&writer, index)) == 0 &&
-		(error = git_indexwriter_commit(&writer)) == 0)
+		(error = git_indexwriter_commit(&writer)) == 0) {
 		index->dirty = 0;
 
+		if (index->untracked)
+			index->untracked->changed = 0;
+
+		index->fsmonitor_changed = 0;
+	}
+
 	git_indexwriter_cleanup(&writer);
 
 	return error;
@@ -834,6 +1023,9 @@ int git_index_write_tree(git_oid *oid, git_index *index)
 		return create_index_error(-1, "Failed to write tree. "
 		  "the index file is not backed up by an existing repository");
 
+	if (index_materialize(index) < 0)
+		return -1;
+
 	return git_tree__write_index(oid, index, repo);
 }
 
@@ -844,14 +1036,16 @@ int git_index_write_tree_to(
 	GIT_ASSERT_ARG(index);
 	GIT_ASSERT_ARG(repo);
 
+	if (index_materialize(index) < 0)
+		return -1;
+
 	return git_tree__write_index(oid, index, repo);
 }
 
 size_t git_index_entrycount(const git_index *index)
 {
 	GIT_ASSERT_ARG(index);
-
-	return index->entries.length;
+	return index->lazy ? index->lazy->count : index->entries.length;
 }
 
 const git_index_entry *git_index_get_byindex(
@@ -859,6 +1053,9 @@ const git_index_entry *git_index_get_byindex(
 {
 	GIT_ASSERT_ARG_WITH_RETVAL(index, NULL);
 
+	if (index_materialize(index) < 0)
+		return NULL;
+
 	git_vector_sort(&index->entries);
 	return git_vector_get(&index->entries, n);
 }
@@ -868,18 +1065,42 @@ const git_index_entry *git_index_get_bypath(
 {
 	git_index_entry key = {{ 0 }};
 	git_index_entry *value;
+	size_t pos;
 
 	GIT_ASSERT_ARG_WITH_RETVAL(index, NULL);
 
-	key.path = path;
-	GIT_INDEX_ENTRY_STAGE_SET(&key, stage);
+	/* an index that's still mapped is searched in place */
+	if (index->lazy && !index->ignore_case) {
+		if (index_lazy_find(&pos, index, path, stage) < 0)
+			goto notfound;
+
+		return index_lazy_decode(&value, index, pos) < 0 ? NULL : value;
+	}
 
-	if (git_index_entrymap_get(&value, &index->entries_map, &key) != 0) {
-		git_error_set(GIT_ERROR_INDEX, "index does not contain '%s'", path);
+	if (index_materialize(index) < 0 ||
+	    index_sparse_expand_path(index, path, 0) < 0)
 		return NULL;
+
+	if (index->entries_map_lazy &&
+	    (++index->entries_map_misses < index->entries.length / INDEX_ENTRYMAP_BUILD_RATIO ||
+	     index_map_build(index) < 0)) {
+		if (index_find(&pos, index, path, 0, stage) < 0)
+			goto notfound;
+
+		return git_vector_get(&index->entries, pos);
 	}
 
+	key.path = path;
+	GIT_INDEX_ENTRY_STAGE_SET(&key, stage);
+
+	if (git_index_entrymap_get(&value, &index->entries_map, &key) != 0)
+		goto notfound;
+
 	return value;
+
+notfound:
+	git_error_set(GIT_ERROR_INDEX, "index does not contain '%s'", path);
+	return NULL;
 }
 
 void git_index_entry__init_from_stat(
@@ -918,6 +1139,27 @@ static void index_entry_adjust_namemask(
  * function will *always* prevent `.git` and directory traversal `../` from
  * being added to the index.
  */
+static int index_entry_alloc(
+	git_index_entry **out,
+	const char *path,
+	size_t pathlen)
+{
+	struct entry_internal *entry;
+	size_t alloclen;
+
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, sizeof(struct entry_internal), pathlen);
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, alloclen, 1);
+	entry = git__calloc(1, alloclen);
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	entry->pathlen = pathlen;
+	memcpy(entry->path, path, pathlen);
+	entry->entry.path = entry->path;
+
+	*out = (git_index_entry *)entry;
+	return 0;
+}
+
 static int index_entry_create(
 	git_index_entry **out,
 	git_repository *repo,
@@ -925,8 +1167,7 @@ static int index_entry_create(
 	struct stat *st,
 	bool from_workdir)
 {
-	size_t pathlen = strlen(path), alloclen;
-	struct entry_internal *entry;
+	size_t pathlen = strlen(path);
 	unsigned int path_valid_flags = GIT_PATH_REJECT_INDEX_DEFAULTS;
 	uint16_t mode = 0;
 
@@ -944,17 +1185,28 @@ static int index_entry_create(
 		return -1;
 	}
 
-	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, sizeof(struct entry_internal), pathlen);
-	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, alloclen, 1);
-	entry = git__calloc(1, alloclen);
-	GIT_ERROR_CHECK_ALLOC(entry);
+	return index_entry_alloc(out, path, pathlen);
+}
 
-	entry->pathlen = pathlen;
-	memcpy(entry->path, path, pathlen);
-	entry->entry.path = entry->path;
+/*
+ * Create a sparse directory entry; its path is validated without the
+ * trailing slash.
+ */
+static int index_entry_create_sparse_dir(
+	git_index_entry **out,
+	git_repository *repo,
+	const char *path)
+{
+	size_t pathlen = strlen(path);
+	git_str dir = GIT_STR_INIT_CONST(path, pathlen - 1);
 
-	*out = (git_index_entry *)entry;
-	return 0;
+	if (pathlen < 2 || path[pathlen - 1] != '/' ||
+	    !git_path_str_is_valid(repo, &dir, 0, GIT_PATH_REJECT_INDEX_DEFAULTS)) {
+		git_error_set(GIT_ERROR_INDEX, "invalid sparse directory: '%s'", path);
+		return -1;
+	}
+
+	return index_entry_alloc(out, path, pathlen);
 }
 
 static int index_entry_init(
@@ -1074,12 +1326,23 @@ static void index_entry_cpy(
 	tgt->path = tgt_path;
 }
 
+GIT_INLINE(int) index_entry_create_from(
+	git_index_entry **out,
+	git_index *index,
+	const git_index_entry *src)
+{
+	if (git_index_entry__is_sparse_dir(src))
+		return index_entry_create_sparse_dir(out, INDEX_OWNER(index), src->path);
+
+	return index_entry_create(out, INDEX_OWNER(index), src->path, NULL, false);
+}
+
 static int index_entry_dup(
 	git_index_entry **out,
 	git_index *index,
 	const git_index_entry *src)
 {
-	if (index_entry_create(out, INDEX_OWNER(index), src->path, NULL, false) < 0)
+	if (index_entry_create_from(out, index, src) < 0)
 		return -1;
 
 	index_entry_cpy(*out, src);
@@ -1101,13 +1364,203 @@ static int index_entry_dup_nocache(
 	git_index *index,
 	const git_index_entry *src)
 {
-	if (index_entry_create(out, INDEX_OWNER(index), src->path, NULL, false) < 0)
+	if (index_entry_create_from(out, index, src) < 0)
 		return -1;
 
 	index_entry_cpy_nocache(*out, src);
 	return 0;
 }
 
+typedef struct {
+	git_index *index;
+	git_vector *entries;
+	const git_index_entry *dir;
+	git_str path;
+} sparse_expand_data;
+
+static int sparse_expand_cb(
+	const char *root, const git_tree_entry *tentry, void *payload)
+{
+	sparse_expand_data *data = payload;
+	git_index_entry *entry;
+
+	if (git_tree_entry__is_tree(tentry))
+		return 0;
+
+	git_str_clear(&data->path);
+
+	if (git_str_puts(&data->path, data->dir->path) < 0 ||
+	    git_str_puts(&data->path, root) < 0 ||
+	    git_str_puts(&data->path, tentry->filename) < 0 ||
+	    index_entry_create(&entry, INDEX_OWNER(data->index), data->path.ptr, NULL, false) < 0)
+		return -1;
+
+	entry->mode = tentry->attr;
+	entry->flags_extended = GIT_INDEX_ENTRY_SKIP_WORKTREE;
+	git_oid_cpy(&entry->id, &tentry->oid);
+	index_entry_adjust_namemask(entry, data->path.size);
+
+	if (git_vector_insert(data->entries, entry) < 0) {
+		index_entry_free(entry);
+		return -1;
+	}
+
+	return 0;
+}
+
+int git_index__sparse_entries(
+	git_vector *out, git_index *index, const git_index_entry *dir)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	sparse_expand_data data = { index, out, dir, GIT_STR_INIT };
+	git_tree *tree = NULL;
+	int error;
+
+	if (!repo) {
+		git_error_set(GIT_ERROR_INDEX,
+			"cannot expand a sparse index without a repository");
+		return -1;
+	}
+
+	if ((error = git_tree_lookup(&tree, repo, &dir->id)) == 0)
+		error = git_tree_walk(tree, GIT_TREEWALK_PRE, sparse_expand_cb, &data);
+
+	git_str_dispose(&data.path);
+	git_tree_free(tree);
+	return error;
+}
+
+void git_index__sparse_entries_free(git_vector *entries)
+{
+	git_index_entry *entry;
+	size_t i;
+
+	git_vector_foreach(entries, i, entry)
+		index_entry_free(entry);
+
+	git_vector_dispose(entries);
+}
+
+/*
+ * Replace the sparse directory entry at `pos` with the entries of the
+ * files beneath it; this is not a change to the index's contents.
+ */
+static int index_sparse_expand_entry(git_index *index, size_t pos)
+{
+	git_vector expanded = GIT_VECTOR_INIT;
+	git_index_entry *dir = git_vector_get(&index->entries, pos), *entry;
+	size_t i;
+	int error;
+
+	if ((error = git_index__sparse_entries(&expanded, index, dir)) < 0 ||
+	    (error = git_vector_size_hint(&index->entries,
+			index->entries.length + expanded.length)) < 0)
+		goto done;
+
+	index_map_remove(index, dir);
+	git_vector_remove(&index->entries, pos);
+
+	if (git_atomic32_get(&index->readers) > 0)
+		error = git_vector_insert(&index->deleted, dir);
+	else
+		index_entry_free(dir);
+
+	git_vector_foreach(&expanded, i, entry) {
+		if (!error)
+			error = git_vector_insert(&index->entries, entry);
+
+		if (!error)
+			error = index_map_put(index, entry);
+		else
+			index_entry_free(entry);
+	}
+
+	git_vector_clear(&expanded);
+	git_vector_sort(&index->entries);
+
+done:
+	git_index__sparse_entries_free(&expanded);
+	return error;
+}
+
+/* Expand the sparse directory entry that `path` is beneath, if any. */
+static int index_sparse_expand_path(git_index *index, const char *path, size_t path_len)
+{
+	const char *slash;
+	git_index_entry *entry;
+	size_t pos;
+
+	if (!index->sparse)
+		return 0;
+
+	if (!path_len)
+		path_len = strlen(path);
+
+	for (slash = memchr(path, '/', path_len);
+	     slash != NULL;
+	     slash = memchr(slash + 1, '/', path_len - (slash + 1 - path))) {
+		if (index_find(&pos, index, path, (slash - path) + 1, 0) == 0 &&
+		    (entry = git_vector_get(&index->entries, pos)) != NULL &&
+		    git_index_entry__is_sparse_dir(entry))
+			return index_sparse_expand_entry(index, pos);
+	}
+
+	return 0;
+}
+
+int git_index__ensure_full(git_index *index)
+{
+	git_vector entries = GIT_VECTOR_INIT, expanded = GIT_VECTOR_INIT;
+	git_index_entry *entry;
+	size_t i;
+	int error = 0;
+
+	if ((error = index_materialize(index)) < 0 || !index->sparse)
+		return error;
+
+	if ((error = git_vector_init(&entries, index->entries.length,
+			index->entries._cmp)) < 0)
+		return error;
+
+	git_vector_foreach(&index->entries, i, entry) {
+		if (git_index_entry__is_sparse_dir(entry))
+			error = git_index__sparse_entries(&expanded, index, entry);
+		else
+			error = git_vector_insert(&entries, entry);
+
+		if (error < 0)
+			goto done;
+	}
+
+	git_vector_foreach(&expanded, i, entry) {
+		if ((error = git_vector_insert(&entries, entry)) < 0)
+			goto done;
+	}
+
+	git_vector_clear(&expanded);
+
+	/* the sparse directories are all that's left to free */
+	git_vector_foreach(&index->entries, i, entry) {
+		if (!git_index_entry__is_sparse_dir(entry))
+			continue;
+
+		if (git_atomic32_get(&index->readers) > 0)
+			error = git_vector_insert(&index->deleted, entry);
+		else
+			index_entry_free(entry);
+	}
+
+	git_vector_sort(&entries);
+	git_vector_swap(&entries, &index->entries);
+	index_map_invalidate(index);
+	index->sparse = 0;
+
+done:
+	git_vector_dispose(&entries);
+	git_index__sparse_entries_free(&expanded);
+	return error;
+}
+
 static int has_file_name(git_index *index,
 	 const git_index_entry *entry, size_t pos, int ok_to_replace)
 {
@@ -1365,7 +1818,13 @@ static int index_insert(
 	/* This entry is now up-to-date and should not be checked for raciness */
 	entry->flags_extended |= GIT_INDEX_ENTRY_UPTODATE;
 
-	git_vector_sort(&index->entries);
+	if ((error = index_materialize(index)) < 0)
+		goto out;
+
+	git_vector_sort(&index->entries);
+
+	if ((error = index_sparse_expand_path(index, entry->path, path_length)) < 0)
+		goto out;
 
 	/*
 	 * Look if an entry with this path already exists, either staged, or (if
@@ -1418,8 +1877,10 @@ static int index_insert(
 		 * check for dups, this is actually cheaper in the long run.)
 		 */
 		if ((error = git_vector_insert_sorted(&index->entries, entry, index_no_dups)) < 0 ||
-		    (error = git_index_entrymap_put(&index->entries_map, entry)) < 0)
+		    (error = index_map_put(index, entry)) < 0)
 			goto out;
+
+		git_untracked_cache_invalidate_path(index->untracked, entry->path);
 	}
 
 	index->dirty = 1;
@@ -1646,8 +2107,10 @@ int git_index__fill(git_index *index, const git_vector *source_entries)
 	if (!source_entries->length)
 		return 0;
 
-	if (git_vector_size_hint(&index->entries, source_entries->length) < 0 ||
-	    git_index_entrymap_resize(&index->entries_map, (size_t)(source_entries->length * 1.3)) < 0)
+	if (index_materialize(index) < 0 ||
+	    git_vector_size_hint(&index->entries, source_entries->length) < 0 ||
+	    (!index->entries_map_lazy &&
+	     git_index_entrymap_resize(&index->entries_map, (size_t)(source_entries->length * 1.3)) < 0))
 		return -1;
 
 	git_vector_foreach(source_entries, i, source_entry) {
@@ -1658,12 +2121,17 @@ int git_index__fill(git_index *index, const git_vector *source_entries)
 
 		index_entry_adjust_namemask(entry, ((struct entry_internal *)entry)->pathlen);
 		entry->flags_extended |= GIT_INDEX_ENTRY_UPTODATE;
-		entry->mode = git_index__create_mode(entry->mode);
+
+		if (git_index_entry__is_sparse_dir(entry))
+			index->sparse = 1;
+		else
+			entry->mode = git_index__create_mode(entry->mode);
 
 		if ((error = git_vector_insert(&index->entries, entry)) < 0 ||
-		    (error = git_index_entrymap_put(&index->entries_map, entry)) < 0)
+		    (error = index_map_put(index, entry)) < 0)
 			break;
 
+		git_untracked_cache_invalidate_path(index->untracked, entry->path);
 		index->dirty = 1;
 	}
 
@@ -1704,7 +2172,11 @@ int git_index_remove(git_index *index, const char *path, int stage)
 	remove_key.path = path;
 	GIT_INDEX_ENTRY_STAGE_SET(&remove_key, stage);
 
-	git_index_entrymap_remove(&index->entries_map, &remove_key);
+	if ((error = index_materialize(index)) < 0 ||
+	    (error = index_sparse_expand_path(index, path, 0)) < 0)
+		return error;
+
+	index_map_remove(index, &remove_key);
 
 	if (index_find(&position, index, path, 0, stage) < 0) {
 		git_error_set(
@@ -1725,7 +2197,9 @@ int git_index_remove_directory(git_index *index, const char *dir, int stage)
 	git_index_entry *entry;
 
 	if (!(error = git_str_sets(&pfx, dir)) &&
-		!(error = git_fs_path_to_dir(&pfx)))
+		!(error = git_fs_path_to_dir(&pfx)) &&
+		!(error = index_materialize(index)) &&
+		!(error = index_sparse_expand_path(index, dir, 0)))
 		index_find(&pos, index, pfx.ptr, pfx.size, GIT_INDEX_STAGE_ANY);
 
 	while (!error) {
@@ -1754,6 +2228,10 @@ int git_index_find_prefix(size_t *at_pos, git_index *index, const char *prefix)
 	size_t pos;
 	const git_index_entry *entry;
 
+	if ((error = index_materialize(index)) < 0 ||
+	    (error = index_sparse_expand_path(index, prefix, 0)) < 0)
+		return error;
+
 	index_find(&pos, index, prefix, strlen(prefix), GIT_INDEX_STAGE_ANY);
 	entry = git_vector_get(&index->entries, pos);
 	if (!entry || git__prefixcmp(entry->path, prefix) != 0)
@@ -1770,6 +2248,11 @@ int git_index__find_pos(
 {
 	GIT_ASSERT_ARG(index);
 	GIT_ASSERT_ARG(path);
+
+	if (index_materialize(index) < 0 ||
+	    index_sparse_expand_path(index, path, path_len) < 0)
+		return -1;
+
 	return index_find(out, index, path, path_len, stage);
 }
 
@@ -1780,6 +2263,10 @@ int git_index_find(size_t *at_pos, git_index *index, const char *path)
 	GIT_ASSERT_ARG(index);
 	GIT_ASSERT_ARG(path);
 
+	if (index_materialize(index) < 0 ||
+	    index_sparse_expand_path(index, path, 0) < 0)
+		return -1;
+
 	if (git_vector_bsearch2(
 			&pos, &index->entries, index->entries_search_path, path) < 0) {
 		git_error_set(GIT_ERROR_INDEX, "index does not contain %s", path);
@@ -1959,6 +2446,9 @@ static int index_conflict_remove(git_index *index, const char *path)
 	git_index_entry *conflict_entry;
 	int error = 0;
 
+	if (path == NULL && (error = index_materialize(index)) < 0)
+		return error;
+
 	if (path != NULL && git_index_find(&pos, index, path) < 0)
 		return GIT_ENOTFOUND;
 
@@ -2000,6 +2490,9 @@ int git_index_has_conflicts(const git_index *index)
 
 	GIT_ASSERT_ARG(index);
 
+	if (index->lazy)
+		return index_lazy_has_conflicts(index);
+
 	git_vector_foreach(&index->entries, i, entry) {
 		if (GIT_INDEX_ENTRY_STAGE(entry) > 0)
 			return 1;
@@ -2018,6 +2511,9 @@ int git_index_iterator_new(
 	GIT_ASSERT_ARG(iterator_out);
 	GIT_ASSERT_ARG(index);
 
+	if ((error = git_index__ensure_full(index)) < 0)
+		return error;
+
 	it = git__calloc(1, sizeof(git_index_iterator));
 	GIT_ERROR_CHECK_ALLOC(it);
 
@@ -2064,6 +2560,9 @@ int git_index_conflict_iterator_new(
 	GIT_ASSERT_ARG(iterator_out);
 	GIT_ASSERT_ARG(index);
 
+	if (index_materialize(index) < 0)
+		return -1;
+
 	it = git__calloc(1, sizeof(git_index_conflict_iterator));
 	GIT_ERROR_CHECK_ALLOC(it);
 
@@ -2598,7 +3097,7 @@ static int read_entry(
 		if (path_length == 0xFFF) {
 			const char *path_end;
 
-			path_end = memchr(path_ptr, '\0', buffer_size);
+			path_end = memchr(path_ptr, '\0', buffer_size - path_offset);
 			if (path_end == NULL)
 				return index_error_invalid("invalid path name");
 
@@ -2609,16 +3108,29 @@ static int read_entry(
 		entry.path = (char *)path_ptr;
 	} else {
 		size_t varint_len, last_len, prefix_len, suffix_len, path_len;
+		const char *suffix_end;
 		uintmax_t strip_len;
 
 		strip_len = git_decode_varint((const unsigned char *)path_ptr, &varint_len);
-		last_len = strlen(last);
+		last_len = last ? strlen(last) : 0;
 
-		if (varint_len == 0 || last_len < strip_len)
+		if (varint_len == 0 || varint_len >= buffer_size - path_offset ||
+		    (last && last_len < strip_len))
 			return index_error_invalid("incorrect prefix length");
 
-		prefix_len = last_len - (size_t)strip_len;
-		suffix_len = strlen(path_ptr + varint_len);
+		/*
+		 * The first entry of an offset table block has no previous
+		 * entry; its full path is stored and the strip length is
+		 * only meaningful to readers that parse sequentially.
+		 */
+		prefix_len = last ? last_len - (size_t)strip_len : 0;
+
+		suffix_end = memchr(path_ptr + varint_len, '\0',
+			buffer_size - path_offset - varint_len);
+		if (suffix_end == NULL)
+			return index_error_invalid("invalid path name");
+
+		suffix_len = suffix_end - (path_ptr + varint_len);
 
 		GIT_ERROR_CHECK_ALLOC_ADD(&path_len, prefix_len, suffix_len);
 		GIT_ERROR_CHECK_ALLOC_ADD(&path_len, path_len, 1);
@@ -2629,7 +3141,8 @@ static int read_entry(
 		tmp_path = git__malloc(path_len);
 		GIT_ERROR_CHECK_ALLOC(tmp_path);
 
-		memcpy(tmp_path, last, prefix_len);
+		if (prefix_len)
+			memcpy(tmp_path, last, prefix_len);
 		memcpy(tmp_path + prefix_len, path_ptr + varint_len, suffix_len + 1);
 
 		entry_size = index_entry_size(suffix_len, varint_len, index->oid_type, entry.flags);
@@ -2644,6 +3157,13 @@ static int read_entry(
 		return -1;
 	}
 
+	/* only validating the entry and measuring its size */
+	if (!out) {
+		git__free(tmp_path);
+		*out_size = entry_size;
+		return 0;
+	}
+
 	if (index_entry_dup(out, index, &entry) < 0) {
 		git__free(tmp_path);
 		return -1;
@@ -2671,7 +3191,104 @@ static int read_header(struct index_header *dest, const void *buffer)
 	return 0;
 }
 
-static int read_extension(size_t *read_len, git_index *index, size_t checksum_size, const char *buffer, size_t buffer_size)
+/*
+ * The "link" extension names the shared index that a split index is
+ * based on, followed by the bitmaps of the shared entries that are
+ * deleted and replaced; those are decoded once the shared index has
+ * been loaded and its size is known.
+ */
+static int read_link(struct index_link *link, git_index *index, const char *buffer, size_t size)
+{
+	size_t oid_size = git_oid_size(index->oid_type);
+
+	if (size < oid_size)
+		return index_error_invalid("link extension is truncated");
+
+	if (git_oid_from_raw(&link->shared_id, (const unsigned char *)buffer,
+			index->oid_type) < 0)
+		return -1;
+
+	link->bitmaps = buffer + oid_size;
+	link->bitmaps_len = size - oid_size;
+	link->present = 1;
+
+	return 0;
+}
+
+/*
+ * The "FSMN" extension holds the token of the last filesystem monitor
+ * query (a timestamp in version 1) and a bitmap of the entries that
+ * were not known to be unchanged at that point; the bitmap is applied
+ * once all the entries are loaded.
+ */
+static int read_fsmonitor(struct index_fsmonitor *fsmonitor, git_index *index, const char *buffer, size_t size)
+{
+	const char *end = buffer + size, *token_end;
+	git_str token = GIT_STR_INIT;
+	uint32_t version, bitmap_len;
+	uint64_t timestamp;
+	size_t i;
+	int error = -1;
+
+	if (size < 4)
+		goto invalid;
+
+	memcpy(&version, buffer, 4);
+	version = ntohl(version);
+	buffer += 4;
+
+	if (version == 1) {
+		if ((size_t)(end - buffer) < 8)
+			goto invalid;
+
+		for (timestamp = 0, i = 0; i < 8; i++)
+			timestamp = (timestamp << 8) | (unsigned char)buffer[i];
+
+		buffer += 8;
+
+		git_str_printf(&token, "%" PRId64, (int64_t)timestamp);
+	} else if (version == 2) {
+		if ((token_end = memchr(buffer, '\0', end - buffer)) == NULL)
+			goto invalid;
+
+		git_str_put(&token, buffer, token_end - buffer);
+		buffer = token_end + 1;
+	} else {
+		git_error_set(GIT_ERROR_INDEX, "unsupported fsmonitor extension version %u", version);
+		goto done;
+	}
+
+	if (git_str_oom(&token))
+		goto done;
+
+	if ((size_t)(end - buffer) < 4)
+		goto invalid;
+
+	memcpy(&bitmap_len, buffer, 4);
+	bitmap_len = ntohl(bitmap_len);
+	buffer += 4;
+
+	if ((size_t)(end - buffer) < bitmap_len)
+		goto invalid;
+
+	git__free(index->fsmonitor_token);
+	index->fsmonitor_token = git_str_detach(&token);
+
+	fsmonitor->bitmap = buffer;
+	fsmonitor->bitmap_len = bitmap_len;
+	fsmonitor->present = 1;
+
+	error = 0;
+	goto done;
+
+invalid:
+	index_error_invalid("fsmonitor extension is truncated");
+done:
+	git_str_dispose(&token);
+	return error;
+}
+
+static int read_extension(size_t *read_len, git_index *index, struct index_deferred *deferred, size_t checksum_size, const char *buffer, size_t buffer_size)
 {
 	struct index_extension dest;
 	size_t total_size;
@@ -2689,8 +3306,17 @@ static int read_extension(size_t *read_len, git_index *index, size_t checksum_si
 		return -1;
 	}
 
+	/* split index */
+	if (memcmp(dest.signature, INDEX_EXT_LINK_SIG, 4) == 0) {
+		if (read_link(&deferred->link, index, buffer + 8, dest.extension_size) < 0)
+			return -1;
+	}
+	/* sparse index; the sparse directories are told apart by their mode */
+	else if (memcmp(dest.signature, INDEX_EXT_SPARSE_DIRS_SIG, 4) == 0) {
+		deferred->sparse_dirs = 1;
+	}
 	/* optional extension */
-	if (dest.signature[0] >= 'A' && dest.signature[0] <= 'Z') {
+	else if (dest.signature[0] >= 'A' && dest.signature[0] <= 'Z') {
 		/* tree cache */
 		if (memcmp(dest.signature, INDEX_EXT_TREECACHE_SIG, 4) == 0) {
 			if (git_tree_cache_read(&index->tree, buffer + 8, dest.extension_size, index->oid_type, &index->tree_pool) < 0)
@@ -2701,6 +3327,16 @@ static int read_extension(size_t *read_len, git_index *index, size_t checksum_si
 		} else if (memcmp(dest.signature, INDEX_EXT_CONFLICT_NAME_SIG, 4) == 0) {
 			if (read_conflict_names(index, buffer + 8, dest.extension_size) < 0)
 				return -1;
+		} else if (memcmp(dest.signature, INDEX_EXT_UNTRACKED_SIG, 4) == 0) {
+			/* the cache is only an optimization; drop it if it's unreadable */
+			git_untracked_cache_free(index->untracked);
+
+			if (git_untracked_cache_read(&index->untracked, buffer + 8, dest.extension_size, index->oid_type) < 0)
+				git_error_clear();
+		} else if (memcmp(dest.signature, INDEX_EXT_FSMONITOR_SIG, 4) == 0) {
+			/* likewise, without it everything is examined */
+			if (read_fsmonitor(&deferred->fsmonitor, index, buffer + 8, dest.extension_size) < 0)
+				git_error_clear();
 		}
 		/* else, unsupported extension. We cannot parse this, but we can skip
 		 * it by returning `total_size */
@@ -2716,14 +3352,371 @@ static int read_extension(size_t *read_len, git_index *index, size_t checksum_si
 	return 0;
 }
 
-static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
+/*
+ * The number of threads to work on the entries with: "index.threads"
+ * may be set to a number, or to true (or zero) to pick one for each
+ * `entries_per_thread` entries, up to the number of CPUs.
+ */
+size_t git_index__threads(
+	git_index *index,
+	size_t entries,
+	size_t entries_per_thread)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	git_config *config;
+	char *value = NULL;
+	int32_t threads = 0;
+	int enabled;
+
+	if (repo &&
+	    git_repository_config__weakptr(&config, repo) == 0 &&
+	    (value = git_config__get_string_force(config, "index.threads", NULL)) != NULL &&
+	    git_config_parse_int32(&threads, value) < 0)
+		threads = (git_config_parse_bool(&enabled, value) == 0 && !enabled) ? 1 : 0;
+
+	git__free(value);
+	git_error_clear();
+
+	if (threads > 0)
+		return (size_t)threads;
+
+	threads = git__online_cpus();
+	return min((size_t)threads, entries / entries_per_thread);
+}
+
+typedef git_array_t(struct index_entry_block) index_entry_block_array;
+
+#ifdef GIT_THREADS
+
+/*
+ * The "end of index entries" extension is the last one in the file
+ * and records where the extensions begin, along with a hash of their
+ * headers; this lets a reader find the extensions (and the entry offset
+ * table among them) without parsing the entries first.
+ */
+static int read_eoie(
+	size_t *out,
+	git_index *index,
+	const char *buffer,
+	size_t buffer_size,
+	size_t checksum_size)
+{
+	struct index_extension ext;
+	unsigned char hash[GIT_HASH_MAX_SIZE];
+	size_t eoie_size = sizeof(uint32_t) + checksum_size;
+	const char *eoie, *ptr;
+	git_hash_ctx ctx;
+	uint32_t offset;
+	int error;
+
+	if (buffer_size < INDEX_HEADER_SIZE + sizeof(ext) + eoie_size + checksum_size)
+		return GIT_ENOTFOUND;
+
+	eoie = buffer + buffer_size - checksum_size - eoie_size - sizeof(ext);
+	memcpy(&ext, eoie, sizeof(ext));
+
+	if (memcmp(ext.signature, INDEX_EXT_END_OF_ENTRIES_SIG, 4) != 0 ||
+	    ntohl(ext.extension_size) != eoie_size)
+		return GIT_ENOTFOUND;
+
+	memcpy(&offset, eoie + sizeof(ext), sizeof(offset));
+	offset = ntohl(offset);
+
+	if (offset < INDEX_HEADER_SIZE || offset > (size_t)(eoie - buffer))
+		return GIT_ENOTFOUND;
+
+	if ((error = git_hash_ctx_init(&ctx, git_oid_algorithm(index->oid_type))) < 0)
+		return error;
+
+	for (ptr = buffer + offset; ptr < eoie; ptr += sizeof(ext) + ext.extension_size) {
+		if ((size_t)(eoie - ptr) < sizeof(ext)) {
+			error = GIT_ENOTFOUND;
+			goto done;
+		}
+
+		memcpy(&ext, ptr, sizeof(ext));
+		ext.extension_size = ntohl(ext.extension_size);
+
+		if (ext.extension_size > (size_t)(eoie - ptr) - sizeof(ext)) {
+			error = GIT_ENOTFOUND;
+			goto done;
+		}
+
+		if ((error = git_hash_update(&ctx, ptr, sizeof(ext))) < 0)
+			goto done;
+	}
+
+	if ((error = git_hash_final(hash, &ctx)) < 0)
+		goto done;
+
+	if (memcmp(hash, eoie + sizeof(ext) + sizeof(offset), checksum_size) != 0) {
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	*out = offset;
+
+done:
+	git_hash_ctx_cleanup(&ctx);
+	return error;
+}
+
+/*
+ * Read the "index entry offset table", which splits the entries into
+ * blocks that can be parsed independently of each other.  The extension
+ * headers have already been validated by `read_eoie`.
+ */
+static int read_ieot(
+	index_entry_block_array *out,
+	const struct index_header *header,
+	const char *buffer,
+	size_t entries_end,
+	size_t extensions_end)
+{
+	struct index_extension ext;
+	struct index_entry_block *block, *prev = NULL;
+	size_t pos, total = 0;
+	uint32_t version;
+
+	for (pos = entries_end; pos < extensions_end; pos += sizeof(ext) + ext.extension_size) {
+		memcpy(&ext, buffer + pos, sizeof(ext));
+		ext.extension_size = ntohl(ext.extension_size);
+
+		if (memcmp(ext.signature, INDEX_EXT_ENTRY_OFFSETS_SIG, 4) == 0)
+			break;
+	}
+
+	if (pos >= extensions_end ||
+	    ext.extension_size < sizeof(version) ||
+	    (ext.extension_size - sizeof(version)) % (sizeof(uint32_t) * 2) != 0)
+		return GIT_ENOTFOUND;
+
+	pos += sizeof(ext);
+	memcpy(&version, buffer + pos, sizeof(version));
+
+	if (ntohl(version) != INDEX_IEOT_VERSION)
+		return GIT_ENOTFOUND;
+
+	for (extensions_end = pos + ext.extension_size, pos += sizeof(version);
+	     pos < extensions_end;
+	     pos += sizeof(uint32_t) * 2) {
+		GIT_ERROR_CHECK_ALLOC((block = git_array_alloc(*out)));
+
+		memcpy(&block->offset, buffer + pos, sizeof(uint32_t));
+		memcpy(&block->nr, buffer + pos + sizeof(uint32_t), sizeof(uint32_t));
+		block->offset = ntohl(block->offset);
+		block->nr = ntohl(block->nr);
+
+		/* blocks must cover the entries in order */
+		if ((prev ? block->offset <= prev->offset : block->offset != INDEX_HEADER_SIZE) ||
+		    block->offset >= entries_end || !block->nr)
+			goto invalid;
+
+		total += block->nr;
+		prev = block;
+	}
+
+	if (total != header->entry_count)
+		goto invalid;
+
+	return 0;
+
+invalid:
+	git_array_clear(*out);
+	return GIT_ENOTFOUND;
+}
+
+typedef struct {
+	git_thread thread;
+	git_index *index;
+	const char *buffer;
+	size_t checksum_size;
+	const struct index_entry_block *blocks;
+	size_t blocks_len;
+	size_t end;
+	git_index_entry **entries;
+	git_error *error_state;
+	int error;
+	unsigned int started:1;
+} index_entries_reader;
+
+static void *read_entry_blocks(void *payload)
+{
+	index_entries_reader *reader = payload;
+	bool compressed = reader->index->version >= INDEX_VERSION_NUMBER_COMP;
+	size_t b, i, pos, end, n = 0;
+
+	for (b = 0; b < reader->blocks_len; b++) {
+		const char *last = NULL;
+
+		pos = reader->blocks[b].offset;
+		end = (b + 1 < reader->blocks_len) ?
+			reader->blocks[b + 1].offset : reader->end;
+
+		for (i = 0; i < reader->blocks[b].nr; i++) {
+			git_index_entry *entry;
+			size_t entry_size;
+
+			if (pos >= end ||
+			    read_entry(&entry, &entry_size, reader->index,
+					reader->checksum_size, reader->buffer + pos,
+					end - pos + reader->checksum_size, last) < 0) {
+				reader->error = index_error_invalid("invalid entry");
+				goto done;
+			}
+
+			reader->entries[n++] = entry;
+			pos += entry_size;
+
+			if (compressed)
+				last = entry->path;
+		}
+
+		if (pos != end) {
+			reader->error = index_error_invalid(
+				"entry offset table does not match the entries");
+			goto done;
+		}
+	}
+
+done:
+	if (reader->error)
+		git_error_save(&reader->error_state);
+
+	return NULL;
+}
+
+/*
+ * Parse a large index that has an entry offset table by handing out its
+ * blocks to reader threads; the extensions are parsed and the checksum
+ * is calculated on this thread in the meantime.
+ */
+static int parse_index_threaded(
+	git_index *index,
+	unsigned char *checksum,
+	const struct index_header *header,
+	struct index_deferred *deferred,
+	const char *buffer,
+	size_t buffer_size,
+	size_t checksum_size)
+{
+	index_entry_block_array blocks = GIT_ARRAY_INIT;
+	index_entries_reader *readers = NULL, *failed = NULL;
+	git_index_entry **entries;
+	size_t entries_end, extensions_end = buffer_size - checksum_size;
+	size_t threads, extension_size, pos, i, b, n;
+	bool spawned = true;
+	int error;
+
+	if ((threads = git_index__threads(index,
+			header->entry_count, INDEX_THREAD_ENTRIES)) < 2)
+		return GIT_PASSTHROUGH;
+
+	if ((error = read_eoie(&entries_end, index, buffer, buffer_size, checksum_size)) < 0 ||
+	    (error = read_ieot(&blocks, header, buffer, entries_end, extensions_end)) < 0)
+		goto done;
+
+	threads = min(threads, git_array_size(blocks));
+	readers = git__calloc(threads, sizeof(index_entries_reader));
+	if (!readers) {
+		error = -1;
+		goto done;
+	}
+
+	entries = (git_index_entry **)index->entries.contents;
+	memset(entries, 0, header->entry_count * sizeof(git_index_entry *));
+
+	/* give each thread a run of blocks with a similar number of entries */
+	for (i = 0, b = 0, n = 0; i < threads; i++) {
+		size_t goal = (size_t)((uint64_t)header->entry_count * (i + 1) / threads);
+
+		readers[i].index = index;
+		readers[i].buffer = buffer;
+		readers[i].checksum_size = checksum_size;
+		readers[i].blocks = git_array_get(blocks, b);
+		readers[i].entries = entries + n;
+
+		while (b < git_array_size(blocks) && (n < goal || !readers[i].blocks_len)) {
+			n += blocks.ptr[b++].nr;
+			readers[i].blocks_len++;
+		}
+
+		readers[i].end = b < git_array_size(blocks) ?
+			blocks.ptr[b].offset : entries_end;
+	}
+
+	for (i = 0; i < threads; i++) {
+		if (!readers[i].blocks_len)
+			continue;
+
+		if (git_thread_create(&readers[i].thread, read_entry_blocks, &readers[i]) != 0) {
+			spawned = false;
+			break;
+		}
+
+		readers[i].started = 1;
+	}
+
+	if (spawned) {
+		git_hash_buf_ext(checksum, buffer, extensions_end,
+			git_oid_algorithm(index->oid_type), GIT_HASH_TRUSTED);
+
+		for (pos = entries_end; pos < extensions_end; pos += extension_size) {
+			if ((error = read_extension(&extension_size, index, deferred,
+					checksum_size, buffer + pos, buffer_size - pos)) < 0)
+				break;
+		}
+	}
+
+	for (i = 0; i < threads; i++) {
+		if (readers[i].started)
+			git_thread_join(&readers[i].thread, NULL);
+
+		if (readers[i].error && !failed)
+			failed = &readers[i];
+		else
+			git_error_free(readers[i].error_state);
+	}
+
+	if (!error && failed) {
+		git_error_restore(failed->error_state);
+		error = failed->error;
+	} else if (failed) {
+		git_error_free(failed->error_state);
+	}
+
+	/* if we could not start every thread, parse sequentially instead */
+	if (!spawned && !error)
+		error = GIT_PASSTHROUGH;
+
+	if (error < 0) {
+		for (i = 0; i < header->entry_count; i++)
+			index_entry_free(entries[i]);
+	} else {
+		index->entries.length = header->entry_count;
+	}
+
+done:
+	git_array_clear(blocks);
+	git__free(readers);
+	return error == GIT_ENOTFOUND ? GIT_PASSTHROUGH : error;
+}
+
+#else
+# define parse_index_threaded(i, c, h, l, b, s, cs) GIT_PASSTHROUGH
+#endif
+
+static int parse_index_sequential(
+	git_index *index,
+	unsigned char *checksum,
+	const struct index_header *header,
+	struct index_deferred *deferred,
+	const char *buffer,
+	size_t buffer_size,
+	size_t checksum_size)
 {
 	int error = 0;
 	unsigned int i;
-	struct index_header header = { 0 };
-	unsigned char checksum[GIT_HASH_MAX_SIZE];
-	unsigned char zero_checksum[GIT_HASH_MAX_SIZE] = { 0 };
-	size_t checksum_size = git_hash_size(git_oid_algorithm(index->oid_type));
 	const char *last = NULL;
 	const char *empty = "";
 
@@ -2735,33 +3728,20 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 	buffer_size -= _increase;\
 }
 
-	if (buffer_size < INDEX_HEADER_SIZE + checksum_size)
-		return index_error_invalid("insufficient buffer space");
-
 	/*
 	 * Precalculate the hash of the files's contents -- we'll match
 	 * it to the provided checksum in the footer.
 	 */
-	git_hash_buf(checksum, buffer, buffer_size - checksum_size,
-		git_oid_algorithm(index->oid_type));
+	git_hash_buf_ext(checksum, buffer, buffer_size - checksum_size,
+		git_oid_algorithm(index->oid_type), GIT_HASH_TRUSTED);
 
-	/* Parse header */
-	if ((error = read_header(&header, buffer)) < 0)
-		return error;
-
-	index->version = header.version;
 	if (index->version >= INDEX_VERSION_NUMBER_COMP)
 		last = empty;
 
 	seek_forward(INDEX_HEADER_SIZE);
 
-	GIT_ASSERT(!index->entries.length);
-
-	if ((error = git_index_entrymap_resize(&index->entries_map, header.entry_count)) < 0)
-		return error;
-
 	/* Parse all the entries */
-	for (i = 0; i < header.entry_count && buffer_size > checksum_size; ++i) {
+	for (i = 0; i < header->entry_count && buffer_size > checksum_size; ++i) {
 		git_index_entry *entry = NULL;
 		size_t entry_size;
 
@@ -2775,19 +3755,13 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 			goto done;
 		}
 
-		if ((error = git_index_entrymap_put(&index->entries_map, entry)) < 0) {
-			index_entry_free(entry);
-			goto done;
-		}
-		error = 0;
-
 		if (index->version >= INDEX_VERSION_NUMBER_COMP)
 			last = entry->path;
 
 		seek_forward(entry_size);
 	}
 
-	if (i != header.entry_count) {
+	if (i != header->entry_count) {
 		error = index_error_invalid("header entries changed while parsing");
 		goto done;
 	}
@@ -2796,7 +3770,7 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 	while (buffer_size > checksum_size) {
 		size_t extension_size;
 
-		if ((error = read_extension(&extension_size, index, checksum_size, buffer, buffer_size)) < 0) {
+		if ((error = read_extension(&extension_size, index, deferred, checksum_size, buffer, buffer_size)) < 0) {
 			goto done;
 		}
 
@@ -2809,398 +3783,1881 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 		goto done;
 	}
 
-	/*
-	 * SHA-1 or SHA-256 (depending on the repository's object format)
-	 * over the content of the index file before this checksum.
-	 * Note: checksum may be 0 if the index was written by a client
-	 * where index.skipHash was set to true.
-	 */
-	if (memcmp(zero_checksum, buffer, checksum_size) != 0 &&
-	    memcmp(checksum, buffer, checksum_size) != 0) {
-		error = index_error_invalid(
-			"calculated checksum does not match expected");
-		goto done;
-	}
-
-	memcpy(index->checksum, checksum, checksum_size);
-
 #undef seek_forward
 
-	/* Entries are stored case-sensitively on disk, so re-sort now if
-	 * in-memory index is supposed to be case-insensitive
-	 */
-	git_vector_set_sorted(&index->entries, !index->ignore_case);
-	git_vector_sort(&index->entries);
-
-	index->dirty = 0;
 done:
 	return error;
 }
 
-static bool is_index_extended(git_index *index)
+/*
+ * Entries can only be searched in place when their paths are not
+ * prefix compressed and the index is case-sensitive, like the order
+ * they're stored in.  Windows does not let a mapped file be replaced,
+ * so the index is never left mapped there.
+ */
+static bool index_lazy_supported(
+	git_index *index,
+	const struct index_header *header,
+	size_t buffer_size)
+{
+#ifdef GIT_WIN32
+	GIT_UNUSED(index);
+	GIT_UNUSED(header);
+	GIT_UNUSED(buffer_size);
+	return false;
+#else
+	return header->version < INDEX_VERSION_NUMBER_COMP &&
+	       header->entry_count > 0 &&
+	       buffer_size <= UINT32_MAX &&
+	       !index->ignore_case;
+#endif
+}
+
+GIT_INLINE(uint16_t) index_lazy_flags(const git_index *index, const char *entry)
 {
-	size_t i, extended;
+	uint16_t flags;
+	size_t offset = index_entry_flags_offset(index->oid_type) - sizeof(flags);
+
+	memcpy(&flags, entry + offset, sizeof(flags));
+	return ntohs(flags);
+}
+
+GIT_INLINE(const char *) index_lazy_path(const git_index *index, size_t pos, uint16_t *flags)
+{
+	const char *entry = index->lazy->buffer + index->lazy->offsets[pos];
+
+	*flags = index_lazy_flags(index, entry);
+	return entry + index_entry_path_offset(index->oid_type, *flags);
+}
+
+static void index_lazy_free(git_index *index)
+{
+	struct index_lazy *lazy = index->lazy;
+	size_t i;
+
+	if (!lazy)
+		return;
+
+	if (lazy->decoded) {
+		for (i = 0; i < lazy->count; i++)
+			index_entry_free(lazy->decoded[i]);
+
+		git__free(lazy->decoded);
+	}
+
+	if (lazy->map.data)
+		git_futils_mmap_free(&lazy->map);
+
+	git_bitvec_free(&lazy->fsmonitor_dirty);
+	git__free(lazy->offsets);
+	git__free(lazy);
+
+	index->lazy = NULL;
+}
+
+static int index_lazy_decode(git_index_entry **out, git_index *index, size_t pos)
+{
+	struct index_lazy *lazy = index->lazy;
 	git_index_entry *entry;
+	size_t offset = lazy->offsets[pos], entry_size;
 
-	extended = 0;
+	if (!lazy->decoded) {
+		lazy->decoded = git__calloc(lazy->count, sizeof(git_index_entry *));
+		GIT_ERROR_CHECK_ALLOC(lazy->decoded);
+	}
 
-	git_vector_foreach(&index->entries, i, entry) {
-		entry->flags &= ~GIT_INDEX_ENTRY_EXTENDED;
-		if (entry->flags_extended & GIT_INDEX_ENTRY_EXTENDED_FLAGS) {
-			extended++;
-			entry->flags |= GIT_INDEX_ENTRY_EXTENDED;
+	if ((entry = lazy->decoded[pos]) == NULL) {
+		if (read_entry(&entry, &entry_size, index, lazy->checksum_size,
+				lazy->buffer + offset, lazy->buffer_size - offset, NULL) < 0)
+			return -1;
+
+		entry->flags_extended &= ~GIT_INDEX_ENTRY_FSMONITOR_VALID;
+
+		if (lazy->fsmonitor && !git_bitvec_get(&lazy->fsmonitor_dirty, pos))
+			entry->flags_extended |= GIT_INDEX_ENTRY_FSMONITOR_VALID;
+
+		lazy->decoded[pos] = entry;
+	}
+
+	*out = entry;
+	return 0;
+}
+
+static int index_lazy_find(size_t *out, git_index *index, const char *path, int stage)
+{
+	const char *entry_path;
+	size_t lo = 0, hi = index->lazy->count, mid;
+	uint16_t flags;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		entry_path = index_lazy_path(index, mid, &flags);
+
+		if ((cmp = strcmp(path, entry_path)) == 0 && stage != GIT_INDEX_STAGE_ANY)
+			cmp = stage - ((flags & GIT_INDEX_ENTRY_STAGEMASK) >> GIT_INDEX_ENTRY_STAGESHIFT);
+
+		if (cmp < 0) {
+			hi = mid;
+		} else if (cmp > 0) {
+			lo = mid + 1;
+		} else {
+			*out = mid;
+			return 0;
 		}
 	}
 
-	return (extended > 0);
+	return GIT_ENOTFOUND;
 }
 
-static int write_disk_entry(
-	git_index *index,
-	git_filebuf *file,
-	git_index_entry *entry,
-	const char *last)
+static bool index_lazy_has_conflicts(const git_index *index)
 {
-	void *mem = NULL;
-	struct entry_common *ondisk_common = NULL;
-	size_t path_len, path_offset, disk_size;
-	int varint_len = 0;
-	char *path;
-	const char *path_start = entry->path;
-	size_t same_len = 0;
+	uint16_t flags;
+	size_t i;
 
-	index_entry_short_sha1 ondisk_sha1;
-	index_entry_long_sha1 ondisk_ext_sha1;
-#ifdef GIT_EXPERIMENTAL_SHA256
-	index_entry_short_sha256 ondisk_sha256;
-	index_entry_long_sha256 ondisk_ext_sha256;
-#endif
+	for (i = 0; i < index->lazy->count; i++) {
+		index_lazy_path(index, i, &flags);
 
-	switch (index->oid_type) {
-	case GIT_OID_SHA1:
-		ondisk_common = &ondisk_sha1.common;
-		break;
-#ifdef GIT_EXPERIMENTAL_SHA256
-	case GIT_OID_SHA256:
-		ondisk_common = &ondisk_sha256.common;
-		break;
-#endif
-	default:
-		GIT_ASSERT(!"invalid oid type");
+		if (flags & GIT_INDEX_ENTRY_STAGEMASK)
+			return true;
 	}
 
-	path_len = ((struct entry_internal *)entry)->pathlen;
+	return false;
+}
 
-	if (last) {
-		const char *last_c = last;
+/*
+ * Decode the entries that are left in the mapped file into the
+ * `entries` vector; the entries that were already looked up are kept,
+ * so the pointers handed out for them stay valid.
+ */
+static int index_materialize(git_index *index)
+{
+	struct index_lazy *lazy = index->lazy;
+	git_index_entry *entry;
+	size_t i;
+	int error;
 
-		while (*path_start == *last_c) {
-			if (!*path_start || !*last_c)
-				break;
-			++path_start;
-			++last_c;
-			++same_len;
+	if (!lazy)
+		return 0;
+
+	GIT_ASSERT(!index->entries.length);
+
+	if ((error = git_vector_size_hint(&index->entries, lazy->count)) < 0)
+		return error;
+
+	for (i = 0; i < lazy->count; i++) {
+		if ((error = index_lazy_decode(&entry, index, i)) < 0 ||
+		    (error = git_vector_insert(&index->entries, entry)) < 0) {
+			/* the decoded entries are still owned by `lazy` */
+			git_vector_clear(&index->entries);
+			return error;
 		}
-		path_len -= same_len;
-		varint_len = git_encode_varint(NULL, 0, strlen(last) - same_len);
 	}
 
-	disk_size = index_entry_size(path_len, varint_len, index->oid_type, entry->flags);
+	git__free(lazy->decoded);
+	lazy->decoded = NULL;
+	index_lazy_free(index);
 
-	if (!disk_size || git_filebuf_reserve(file, &mem, disk_size) < 0)
-		return -1;
+	git_vector_set_sorted(&index->entries, !index->ignore_case);
+	git_vector_sort(&index->entries);
 
-	memset(mem, 0x0, disk_size);
+	return 0;
+}
 
-	/**
-	 * Yes, we have to truncate.
-	 *
-	 * The on-disk format for Index entries clearly defines
-	 * the time and size fields to be 4 bytes each -- so even if
-	 * we store these values with 8 bytes on-memory, they must
-	 * be truncated to 4 bytes before writing to disk.
-	 *
-	 * In 2038 I will be either too dead or too rich to care about this
-	 */
-	ondisk_common->ctime.seconds = htonl((uint32_t)entry->ctime.seconds);
-	ondisk_common->mtime.seconds = htonl((uint32_t)entry->mtime.seconds);
-	ondisk_common->ctime.nanoseconds = htonl(entry->ctime.nanoseconds);
-	ondisk_common->mtime.nanoseconds = htonl(entry->mtime.nanoseconds);
-	ondisk_common->dev = htonl(entry->dev);
-	ondisk_common->ino = htonl(entry->ino);
-	ondisk_common->mode = htonl(entry->mode);
-	ondisk_common->uid = htonl(entry->uid);
-	ondisk_common->gid = htonl(entry->gid);
-	ondisk_common->file_size = htonl((uint32_t)entry->file_size);
+int git_index__materialize(git_index *index)
+{
+	return index_materialize(index);
+}
 
-	switch (index->oid_type) {
-	case GIT_OID_SHA1:
-		git_oid_raw_cpy(ondisk_sha1.oid, entry->id.id, GIT_OID_SHA1_SIZE);
-		ondisk_sha1.flags = htons(entry->flags);
-		break;
-#ifdef GIT_EXPERIMENTAL_SHA256
-	case GIT_OID_SHA256:
-		git_oid_raw_cpy(ondisk_sha256.oid, entry->id.id, GIT_OID_SHA256_SIZE);
-		ondisk_sha256.flags = htons(entry->flags);
-		break;
-#endif
-	default:
-		GIT_ASSERT(!"invalid oid type");
+/*
+ * Record where each entry starts instead of decoding it.  Anything
+ * unusual -- an invalid entry or one out of order -- is left for the
+ * sequential parser, which knows how to report it.
+ */
+static int parse_index_lazy(
+	git_index *index,
+	unsigned char *checksum,
+	const struct index_header *header,
+	struct index_deferred *deferred,
+	const char *buffer,
+	size_t buffer_size,
+	size_t checksum_size)
+{
+	struct index_lazy *lazy;
+	const char *path, *last_path = NULL;
+	size_t entries_end = buffer_size - checksum_size;
+	size_t pos = INDEX_HEADER_SIZE, entry_size, path_len, extension_size, i;
+	uint16_t flags, last_flags = 0;
+	int cmp, error = 0;
+
+	lazy = git__calloc(1, sizeof(struct index_lazy));
+	GIT_ERROR_CHECK_ALLOC(lazy);
+
+	lazy->count = header->entry_count;
+	lazy->checksum_size = checksum_size;
+	lazy->offsets = git__mallocarray(lazy->count, sizeof(uint32_t));
+
+	if (!lazy->offsets) {
+		error = -1;
+		goto done;
 	}
 
-	path_offset = index_entry_path_offset(index->oid_type, entry->flags);
+	for (i = 0; i < lazy->count; i++) {
+		if (pos >= entries_end ||
+		    read_entry(NULL, &entry_size, index, checksum_size,
+				buffer + pos, buffer_size - pos, NULL) < 0) {
+			error = GIT_PASSTHROUGH;
+			goto done;
+		}
 
-	if (entry->flags & GIT_INDEX_ENTRY_EXTENDED) {
-		struct entry_common *ondisk_ext = NULL;
-		uint16_t flags_extended = htons(entry->flags_extended &
-			GIT_INDEX_ENTRY_EXTENDED_FLAGS);
+		flags = index_lazy_flags(index, buffer + pos);
+		path = buffer + pos + index_entry_path_offset(index->oid_type, flags);
+		path_len = flags & GIT_INDEX_ENTRY_NAMEMASK;
 
-		switch (index->oid_type) {
-		case GIT_OID_SHA1:
-			memcpy(&ondisk_ext_sha1, &ondisk_sha1,
-				sizeof(index_entry_short_sha1));
-			ondisk_ext_sha1.flags_extended = flags_extended;
-			ondisk_ext = &ondisk_ext_sha1.common;
-			break;
-#ifdef GIT_EXPERIMENTAL_SHA256
-		case GIT_OID_SHA256:
-			memcpy(&ondisk_ext_sha256, &ondisk_sha256,
-				sizeof(index_entry_short_sha256));
-			ondisk_ext_sha256.flags_extended = flags_extended;
-			ondisk_ext = &ondisk_ext_sha256.common;
-			break;
-#endif
-		default:
-			GIT_ASSERT(!"invalid oid type");
+		/* lookups compare the paths in place */
+		if (path_len < GIT_INDEX_ENTRY_NAMEMASK && path[path_len] != '\0') {
+			error = GIT_PASSTHROUGH;
+			goto done;
 		}
 
-		memcpy(mem, ondisk_ext, path_offset);
-	} else {
-		switch (index->oid_type) {
-		case GIT_OID_SHA1:
-			memcpy(mem, &ondisk_sha1, path_offset);
-			break;
-#ifdef GIT_EXPERIMENTAL_SHA256
-		case GIT_OID_SHA256:
-			memcpy(mem, &ondisk_sha256, path_offset);
-			break;
-#endif
-		default:
-			GIT_ASSERT(!"invalid oid type");
+		if (last_path &&
+		    ((cmp = strcmp(last_path, path)) > 0 ||
+		     (cmp == 0 && (last_flags & GIT_INDEX_ENTRY_STAGEMASK) >=
+				(flags & GIT_INDEX_ENTRY_STAGEMASK)))) {
+			error = GIT_PASSTHROUGH;
+			goto done;
 		}
+
+		lazy->offsets[i] = (uint32_t)pos;
+		last_path = path;
+		last_flags = flags;
+		pos += entry_size;
 	}
 
-	path = (char *)mem + path_offset;
-	disk_size -= path_offset;
+	git_hash_buf_ext(checksum, buffer, entries_end,
+		git_oid_algorithm(index->oid_type), GIT_HASH_TRUSTED);
 
-	if (last) {
-		varint_len = git_encode_varint((unsigned char *) path,
-					  disk_size, strlen(last) - same_len);
-		GIT_ASSERT(varint_len > 0);
+	lazy->buffer = buffer;
+	lazy->buffer_size = buffer_size;
 
-		path += varint_len;
-		disk_size -= varint_len;
+	index->lazy = lazy;
+	lazy = NULL;
 
-		/*
-		 * If using path compression, we are not allowed
-		 * to have additional trailing NULs.
-		 */
-		GIT_ASSERT(disk_size == path_len + 1);
-	} else {
-		/*
-		 * If no path compression is used, we do have
-		 * NULs as padding. As such, simply assert that
-		 * we have enough space left to write the path.
-		 */
-		GIT_ASSERT(disk_size > path_len);
+	while (pos < entries_end) {
+		if ((error = read_extension(&extension_size, index, deferred,
+				checksum_size, buffer + pos, buffer_size - pos)) < 0)
+			goto done;
+
+		pos += extension_size;
 	}
 
-	memcpy(path, path_start, path_len + 1);
+	if (pos != entries_end)
+		error = index_error_invalid(
+			"buffer size does not match index footer size");
 
-	return 0;
+done:
+	if (lazy) {
+		git__free(lazy->offsets);
+		git__free(lazy);
+	}
+
+	if (error == GIT_PASSTHROUGH)
+		git_error_clear();
+
+	return error;
 }
 
-static int write_entries(git_index *index, git_filebuf *file)
+static int shared_index_path(git_str *out, git_index *index, const git_oid *id)
 {
-	int error = 0;
-	size_t i;
-	git_vector case_sorted = GIT_VECTOR_INIT, *entries = NULL;
-	git_index_entry *entry;
-	const char *last = NULL;
+	char hex[GIT_OID_MAX_HEXSIZE + 1];
+
+	if (git_fs_path_dirname_r(out, index->index_file_path) < 0 ||
+	    git_str_joinpath(out, out->ptr, INDEX_SHARED_FILE) < 0)
+		return -1;
+
+	if (id) {
+		git_oid_tostr(hex, sizeof(hex), id);
+
+		git_str_putc(out, '.');
+		git_str_puts(out, hex);
+	}
+
+	return git_str_oom(out) ? -1 : 0;
+}
+
+static int shared_index_load(git_index **out, git_index *index, const git_oid *id)
+{
+	git_index_options opts = GIT_INDEX_OPTIONS_INIT;
+	git_index *shared = NULL;
+	git_str path = GIT_STR_INIT;
+	int error;
+
+	/* the shared index is usually unchanged since it was last read */
+	if (index->shared &&
+	    memcmp(index->shared->checksum, id->id, git_oid_size(index->oid_type)) == 0) {
+		*out = index->shared;
+		index->shared = NULL;
+		return 0;
+	}
+
+	opts.oid_type = index->oid_type;
+
+	if ((error = shared_index_path(&path, index, id)) < 0 ||
+	    (error = git_index_open_ext(&shared, path.ptr, &opts)) < 0)
+		goto done;
+
+	if (!shared->on_disk) {
+		git_error_set(GIT_ERROR_INDEX, "shared index '%s' does not exist", path.ptr);
+		error = -1;
+	} else if (shared->shared) {
+		git_error_set(GIT_ERROR_INDEX, "shared index '%s' is itself split", path.ptr);
+		error = -1;
+	} else if (memcmp(shared->checksum, id->id, git_oid_size(index->oid_type)) != 0) {
+		git_error_set(GIT_ERROR_INDEX, "shared index '%s' does not match its name", path.ptr);
+		error = -1;
+	}
+
+done:
+	if (error < 0)
+		git_index_free(shared);
+	else
+		*out = shared;
+
+	git_str_dispose(&path);
+	return error;
+}
+
+/*
+ * Merge the entries of a split index into its shared index: each shared
+ * entry is either kept, deleted, or replaced by the next entry of the
+ * split index (which is stored without its path), and any entries that
+ * remain are new.
+ */
+static int index_merge_shared(git_index *index, struct index_link *link)
+{
+	git_index *shared = NULL;
+	git_vector merged = GIT_VECTOR_INIT;
+	git_bitvec deleted = {0}, replaced = {0};
+	git_index_entry *entry, *split, *merged_entry;
+	size_t deleted_len = 0, replaced_len = 0, i, next = 0;
+	bool added;
+	int error = 0;
+
+	if (!link->present || git_oid_is_zero(&link->shared_id)) {
+		git_index_free(index->shared);
+		index->shared = NULL;
+		return 0;
+	}
+
+	if ((error = shared_index_load(&shared, index, &link->shared_id)) < 0)
+		return error;
+
+	if ((error = index_materialize(shared)) < 0)
+		goto done;
+
+	if (link->bitmaps_len &&
+	    ((error = git_ewah_read(&deleted, &deleted_len, link->bitmaps,
+			link->bitmaps_len, shared->entries.length)) < 0 ||
+	     (error = git_ewah_read(&replaced, &replaced_len,
+			link->bitmaps + deleted_len, link->bitmaps_len - deleted_len,
+			shared->entries.length)) < 0))
+		goto done;
+
+	if (deleted_len + replaced_len != link->bitmaps_len) {
+		error = index_error_invalid("garbage at the end of the link extension");
+		goto done;
+	}
+
+	if ((error = git_vector_init(&merged,
+			shared->entries.length + index->entries.length,
+			git_index_entry_cmp)) < 0)
+		goto done;
+
+	git_vector_foreach(&shared->entries, i, entry) {
+		git_index_entry replacement;
+
+		if (replaced_len && git_bitvec_get(&replaced, i)) {
+			if (next >= index->entries.length ||
+			    *(split = git_vector_get(&index->entries, next++))->path) {
+				error = index_error_invalid("invalid replaced entry in split index");
+				goto done;
+			}
+
+			memcpy(&replacement, split, sizeof(replacement));
+			replacement.path = entry->path;
+			index_entry_adjust_namemask(&replacement, strlen(entry->path));
+
+			error = index_entry_dup(&merged_entry, index, &replacement);
+		} else if (deleted_len && git_bitvec_get(&deleted, i)) {
+			continue;
+		} else {
+			error = index_entry_dup(&merged_entry, index, entry);
+		}
+
+		if (error < 0 ||
+		    (error = git_vector_insert(&merged, merged_entry)) < 0)
+			goto done;
+	}
+
+	added = (next < index->entries.length);
+
+	for (; next < index->entries.length; next++) {
+		split = git_vector_get(&index->entries, next);
+
+		if (!*split->path) {
+			error = index_error_invalid("unmatched replaced entry in split index");
+			goto done;
+		}
+
+		if ((error = index_entry_dup(&merged_entry, index, split)) < 0 ||
+		    (error = git_vector_insert(&merged, merged_entry)) < 0)
+			goto done;
+	}
+
+	/* new entries were appended after the shared ones */
+	if (added)
+		git_vector_sort(&merged);
+
+	git_vector_set_cmp(&merged, index->entries._cmp);
+	git_vector_swap(&index->entries, &merged);
+
+	git_index_free(index->shared);
+	index->shared = shared;
+	shared = NULL;
+
+done:
+	git_vector_foreach(&merged, i, entry)
+		index_entry_free(entry);
+
+	git_vector_dispose(&merged);
+	git_bitvec_free(&deleted);
+	git_bitvec_free(&replaced);
+	git_index_free(shared);
+	return error;
+}
+
+/*
+ * Marks the entries that are not dirty in the "FSMN" bitmap as valid;
+ * the bitmap refers to the entries in their on-disk order.
+ */
+static void index_apply_fsmonitor(git_index *index, struct index_fsmonitor *fsmonitor)
+{
+	git_bitvec dirty;
+	git_index_entry *entry;
+	size_t dirty_len, i;
+
+	git_vector_foreach(&index->entries, i, entry)
+		entry->flags_extended &= ~GIT_INDEX_ENTRY_FSMONITOR_VALID;
+
+	if (!fsmonitor->present)
+		return;
+
+	if (git_ewah_read(&dirty, &dirty_len, fsmonitor->bitmap,
+			fsmonitor->bitmap_len, git_index_entrycount(index)) < 0) {
+		git_error_clear();
+		git__free(index->fsmonitor_token);
+		index->fsmonitor_token = NULL;
+		return;
+	}
+
+	/* entries that are still mapped are marked as they're decoded */
+	if (index->lazy) {
+		memcpy(&index->lazy->fsmonitor_dirty, &dirty, sizeof(dirty));
+		index->lazy->fsmonitor = 1;
+		return;
+	}
+
+	git_vector_foreach(&index->entries, i, entry) {
+		if (!git_bitvec_get(&dirty, i))
+			entry->flags_extended |= GIT_INDEX_ENTRY_FSMONITOR_VALID;
+	}
+
+	git_bitvec_free(&dirty);
+}
+
+static int parse_index(git_index *index, git_map *map)
+{
+	const char *buffer = map->data;
+	size_t buffer_size = map->len;
+	int error = 0;
+	struct index_header header = { 0 };
+	unsigned char checksum[GIT_HASH_MAX_SIZE];
+	unsigned char zero_checksum[GIT_HASH_MAX_SIZE] = { 0 };
+	size_t checksum_size = git_hash_size(git_oid_algorithm(index->oid_type));
+	struct index_deferred deferred;
+	const char *trailer;
+
+	if (buffer_size < INDEX_HEADER_SIZE + checksum_size)
+		return index_error_invalid("insufficient buffer space");
+
+	trailer = buffer + buffer_size - checksum_size;
+
+	/* Parse header */
+	if ((error = read_header(&header, buffer)) < 0)
+		return error;
+
+	index->version = header.version;
+
+	GIT_ASSERT(!index->entries.length);
+
+	memset(&deferred, 0, sizeof(deferred));
+
+	if ((error = git_vector_size_hint(&index->entries, header.entry_count)) < 0)
+		return error;
+
+	index_map_invalidate(index);
+
+	error = index_lazy_supported(index, &header, buffer_size) ?
+		parse_index_lazy(index, checksum, &header, &deferred,
+			buffer, buffer_size, checksum_size) :
+		GIT_PASSTHROUGH;
+
+	if (error == GIT_PASSTHROUGH)
+		error = parse_index_threaded(index, checksum, &header, &deferred,
+			buffer, buffer_size, checksum_size);
+
+	if (error == GIT_PASSTHROUGH)
+		error = parse_index_sequential(index, checksum, &header, &deferred,
+			buffer, buffer_size, checksum_size);
+
+	if (error < 0)
+		goto done;
+
+	/*
+	 * SHA-1 or SHA-256 (depending on the repository's object format)
+	 * over the content of the index file before this checksum.
+	 * Note: checksum may be 0 if the index was written by a client
+	 * where index.skipHash was set to true.
+	 */
+	if (memcmp(zero_checksum, trailer, checksum_size) != 0 &&
+	    memcmp(checksum, trailer, checksum_size) != 0) {
+		error = index_error_invalid(
+			"calculated checksum does not match expected");
+		goto done;
+	}
+
+	memcpy(index->checksum, checksum, checksum_size);
+
+	/* these extensions rewrite the entries */
+	if ((deferred.link.present || deferred.sparse_dirs) &&
+	    (error = index_materialize(index)) < 0)
+		goto done;
+
+	if ((error = index_merge_shared(index, &deferred.link)) < 0)
+		goto done;
+
+	index_apply_fsmonitor(index, &deferred.fsmonitor);
+
+	index->sparse = deferred.sparse_dirs;
+
+	/* Entries are stored case-sensitively on disk, so re-sort now if
+	 * in-memory index is supposed to be case-insensitive
+	 */
+	git_vector_set_sorted(&index->entries, !index->ignore_case);
+	git_vector_sort(&index->entries);
+
+	/* the entries that are still mapped keep the map */
+	if (index->lazy) {
+		memcpy(&index->lazy->map, map, sizeof(git_map));
+		memset(map, 0, sizeof(git_map));
+	}
+
+	index->dirty = 0;
+done:
+	if (error < 0)
+		index_lazy_free(index);
+
+	return error;
+}
+
+static bool is_index_extended(git_index *index)
+{
+	size_t i, extended;
+	git_index_entry *entry;
+
+	extended = 0;
+
+	git_vector_foreach(&index->entries, i, entry) {
+		entry->flags &= ~GIT_INDEX_ENTRY_EXTENDED;
+		if (entry->flags_extended & GIT_INDEX_ENTRY_EXTENDED_FLAGS) {
+			extended++;
+			entry->flags |= GIT_INDEX_ENTRY_EXTENDED;
+		}
+	}
+
+	return (extended > 0);
+}
+
+static int write_disk_entry(
+	size_t *out_size,
+	git_index *index,
+	git_filebuf *file,
+	git_index_entry *entry,
+	const char *last,
+	bool block_start)
+{
+	void *mem = NULL;
+	struct entry_common *ondisk_common = NULL;
+	size_t path_len, path_offset, disk_size;
+	int varint_len = 0;
+	char *path;
+	const char *path_start = entry->path;
+	size_t same_len = 0;
+
+	index_entry_short_sha1 ondisk_sha1;
+	index_entry_long_sha1 ondisk_ext_sha1;
+#ifdef GIT_EXPERIMENTAL_SHA256
+	index_entry_short_sha256 ondisk_sha256;
+	index_entry_long_sha256 ondisk_ext_sha256;
+#endif
+
+	switch (index->oid_type) {
+	case GIT_OID_SHA1:
+		ondisk_common = &ondisk_sha1.common;
+		break;
+#ifdef GIT_EXPERIMENTAL_SHA256
+	case GIT_OID_SHA256:
+		ondisk_common = &ondisk_sha256.common;
+		break;
+#endif
+	default:
+		GIT_ASSERT(!"invalid oid type");
+	}
+
+	path_len = ((struct entry_internal *)entry)->pathlen;
+
+	/*
+	 * The first entry of an offset table block shares no prefix with
+	 * its predecessor, so that it can be read without it.
+	 */
+	if (last && !block_start) {
+		const char *last_c = last;
+
+		while (*path_start == *last_c) {
+			if (!*path_start || !*last_c)
+				break;
+			++path_start;
+			++last_c;
+			++same_len;
+		}
+		path_len -= same_len;
+	}
+
+	if (last)
+		varint_len = git_encode_varint(NULL, 0, strlen(last) - same_len);
+
+	disk_size = index_entry_size(path_len, varint_len, index->oid_type, entry->flags);
+
+	if (!disk_size || git_filebuf_reserve(file, &mem, disk_size) < 0)
+		return -1;
+
+	*out_size = disk_size;
+
+	memset(mem, 0x0, disk_size);
+
+	/**
+	 * Yes, we have to truncate.
+	 *
+	 * The on-disk format for Index entries clearly defines
+	 * the time and size fields to be 4 bytes each -- so even if
+	 * we store these values with 8 bytes on-memory, they must
+	 * be truncated to 4 bytes before writing to disk.
+	 *
+	 * In 2038 I will be either too dead or too rich to care about this
+	 */
+	ondisk_common->ctime.seconds = htonl((uint32_t)entry->ctime.seconds);
+	ondisk_common->mtime.seconds = htonl((uint32_t)entry->mtime.seconds);
+	ondisk_common->ctime.nanoseconds = htonl(entry->ctime.nanoseconds);
+	ondisk_common->mtime.nanoseconds = htonl(entry->mtime.nanoseconds);
+	ondisk_common->dev = htonl(entry->dev);
+	ondisk_common->ino = htonl(entry->ino);
+	ondisk_common->mode = htonl(entry->mode);
+	ondisk_common->uid = htonl(entry->uid);
+	ondisk_common->gid = htonl(entry->gid);
+	ondisk_common->file_size = htonl((uint32_t)entry->file_size);
+
+	switch (index->oid_type) {
+	case GIT_OID_SHA1:
+		git_oid_raw_cpy(ondisk_sha1.oid, entry->id.id, GIT_OID_SHA1_SIZE);
+		ondisk_sha1.flags = htons(entry->flags);
+		break;
+#ifdef GIT_EXPERIMENTAL_SHA256
+	case GIT_OID_SHA256:
+		git_oid_raw_cpy(ondisk_sha256.oid, entry->id.id, GIT_OID_SHA256_SIZE);
+		ondisk_sha256.flags = htons(entry->flags);
+		break;
+#endif
+	default:
+		GIT_ASSERT(!"invalid oid type");
+	}
+
+	path_offset = index_entry_path_offset(index->oid_type, entry->flags);
+
+	if (entry->flags & GIT_INDEX_ENTRY_EXTENDED) {
+		struct entry_common *ondisk_ext = NULL;
+		uint16_t flags_extended = htons(entry->flags_extended &
+			GIT_INDEX_ENTRY_EXTENDED_FLAGS);
+
+		switch (index->oid_type) {
+		case GIT_OID_SHA1:
+			memcpy(&ondisk_ext_sha1, &ondisk_sha1,
+				sizeof(index_entry_short_sha1));
+			ondisk_ext_sha1.flags_extended = flags_extended;
+			ondisk_ext = &ondisk_ext_sha1.common;
+			break;
+#ifdef GIT_EXPERIMENTAL_SHA256
+		case GIT_OID_SHA256:
+			memcpy(&ondisk_ext_sha256, &ondisk_sha256,
+				sizeof(index_entry_short_sha256));
+			ondisk_ext_sha256.flags_extended = flags_extended;
+			ondisk_ext = &ondisk_ext_sha256.common;
+			break;
+#endif
+		default:
+			GIT_ASSERT(!"invalid oid type");
+		}
+
+		memcpy(mem, ondisk_ext, path_offset);
+	} else {
+		switch (index->oid_type) {
+		case GIT_OID_SHA1:
+			memcpy(mem, &ondisk_sha1, path_offset);
+			break;
+#ifdef GIT_EXPERIMENTAL_SHA256
+		case GIT_OID_SHA256:
+			memcpy(mem, &ondisk_sha256, path_offset);
+			break;
+#endif
+		default:
+			GIT_ASSERT(!"invalid oid type");
+		}
+	}
+
+	path = (char *)mem + path_offset;
+	disk_size -= path_offset;
+
+	if (last) {
+		varint_len = git_encode_varint((unsigned char *) path,
+					  disk_size, strlen(last) - same_len);
+		GIT_ASSERT(varint_len > 0);
+
+		path += varint_len;
+		disk_size -= varint_len;
+
+		/*
+		 * If using path compression, we are not allowed
+		 * to have additional trailing NULs.
+		 */
+		GIT_ASSERT(disk_size == path_len + 1);
+	} else {
+		/*
+		 * If no path compression is used, we do have
+		 * NULs as padding. As such, simply assert that
+		 * we have enough space left to write the path.
+		 */
+		GIT_ASSERT(disk_size > path_len);
+	}
+
+	memcpy(path, path_start, path_len + 1);
+
+	return 0;
+}
+
+static int write_entries(
+	git_index *index,
+	git_filebuf *file,
+	git_vector *entries,
+	size_t *offset,
+	index_entry_block_array *blocks)
+{
+	int error = 0;
+	size_t i, entry_size;
+	git_index_entry *entry;
+	struct index_entry_block *block;
+	const char *last = NULL;
+
+	if (index->version >= INDEX_VERSION_NUMBER_COMP)
+		last = "";
+
+	git_vector_foreach(entries, i, entry) {
+		bool block_start = false;
+
+		if (blocks && (i % INDEX_IEOT_BLOCK_ENTRIES) == 0) {
+			if ((block = git_array_alloc(*blocks)) == NULL) {
+				error = -1;
+				break;
+			}
+
+			block->offset = (uint32_t)*offset;
+			block->nr = (uint32_t)min(entries->length - i, INDEX_IEOT_BLOCK_ENTRIES);
+			block_start = true;
+		}
+
+		if ((error = write_disk_entry(&entry_size, index, file, entry, last, block_start)) < 0)
+			break;
+
+		*offset += entry_size;
+
+		if (index->version >= INDEX_VERSION_NUMBER_COMP)
+			last = entry->path;
+	}
+
+	return error;
+}
+
+static int write_extension(
+	git_filebuf *file,
+	git_hash_ctx *eoie,
+	struct index_extension *header,
+	git_str *data)
+{
+	struct index_extension ondisk;
+
+	memset(&ondisk, 0x0, sizeof(struct index_extension));
+	memcpy(&ondisk, header, 4);
+	ondisk.extension_size = htonl(header->extension_size);
+
+	/* the end of entries extension hashes the extension headers */
+	if (eoie && git_hash_update(eoie, &ondisk, sizeof(struct index_extension)) < 0)
+		return -1;
+
+	git_filebuf_write(file, &ondisk, sizeof(struct index_extension));
+	return git_filebuf_write(file, data->ptr, data->size);
+}
+
+static int create_name_extension_data(git_str *name_buf, git_index_name_entry *conflict_name)
+{
+	int error = 0;
+
+	if (conflict_name->ancestor == NULL)
+		error = git_str_put(name_buf, "\0", 1);
+	else
+		error = git_str_put(name_buf, conflict_name->ancestor, strlen(conflict_name->ancestor) + 1);
+
+	if (error != 0)
+		goto on_error;
+
+	if (conflict_name->ours == NULL)
+		error = git_str_put(name_buf, "\0", 1);
+	else
+		error = git_str_put(name_buf, conflict_name->ours, strlen(conflict_name->ours) + 1);
+
+	if (error != 0)
+		goto on_error;
+
+	if (conflict_name->theirs == NULL)
+		error = git_str_put(name_buf, "\0", 1);
+	else
+		error = git_str_put(name_buf, conflict_name->theirs, strlen(conflict_name->theirs) + 1);
+
+on_error:
+	return error;
+}
+
+static int write_name_extension(git_index *index, git_filebuf *file, git_hash_ctx *eoie)
+{
+	git_str name_buf = GIT_STR_INIT;
+	git_vector *out = &index->names;
+	git_index_name_entry *conflict_name;
+	struct index_extension extension;
+	size_t i;
+	int error = 0;
+
+	git_vector_foreach(out, i, conflict_name) {
+		if ((error = create_name_extension_data(&name_buf, conflict_name)) < 0)
+			goto done;
+	}
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_CONFLICT_NAME_SIG, 4);
+	extension.extension_size = (uint32_t)name_buf.size;
+
+	error = write_extension(file, eoie, &extension, &name_buf);
+
+	git_str_dispose(&name_buf);
+
+done:
+	return error;
+}
+
+static int create_reuc_extension_data(git_str *reuc_buf, git_index *index, git_index_reuc_entry *reuc)
+{
+	size_t oid_size = git_oid_size(index->oid_type);
+	int i;
+	int error = 0;
+
+	if ((error = git_str_put(reuc_buf, reuc->path, strlen(reuc->path) + 1)) < 0)
+		return error;
+
+	for (i = 0; i < 3; i++) {
+		if ((error = git_str_printf(reuc_buf, "%o", reuc->mode[i])) < 0 ||
+			(error = git_str_put(reuc_buf, "\0", 1)) < 0)
+			return error;
+	}
+
+	for (i = 0; i < 3; i++) {
+		if (reuc->mode[i] && (error = git_str_put(reuc_buf, (char *)&reuc->oid[i].id, oid_size)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+static int write_reuc_extension(git_index *index, git_filebuf *file, git_hash_ctx *eoie)
+{
+	git_str reuc_buf = GIT_STR_INIT;
+	git_vector *out = &index->reuc;
+	git_index_reuc_entry *reuc;
+	struct index_extension extension;
+	size_t i;
+	int error = 0;
+
+	git_vector_foreach(out, i, reuc) {
+		if ((error = create_reuc_extension_data(&reuc_buf, index, reuc)) < 0)
+			goto done;
+	}
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_UNMERGED_SIG, 4);
+	extension.extension_size = (uint32_t)reuc_buf.size;
+
+	error = write_extension(file, eoie, &extension, &reuc_buf);
+
+	git_str_dispose(&reuc_buf);
+
+done:
+	return error;
+}
+
+static int write_tree_extension(git_index *index, git_filebuf *file, git_hash_ctx *eoie)
+{
+	struct index_extension extension;
+	git_str buf = GIT_STR_INIT;
+	int error;
+
+	if (index->tree == NULL)
+		return 0;
+
+	if ((error = git_tree_cache_write(&buf, index->tree)) < 0)
+		return error;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_TREECACHE_SIG, 4);
+	extension.extension_size = (uint32_t)buf.size;
+
+	error = write_extension(file, eoie, &extension, &buf);
+
+	git_str_dispose(&buf);
+
+	return error;
+}
+
+static int write_untracked_extension(git_index *index, git_filebuf *file, git_hash_ctx *eoie)
+{
+	struct index_extension extension;
+	git_str buf = GIT_STR_INIT;
+	int error;
+
+	if ((error = git_untracked_cache_write(&buf, index->untracked)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_UNTRACKED_SIG, 4);
+	extension.extension_size = (uint32_t)buf.size;
+
+	error = write_extension(file, eoie, &extension, &buf);
+
+done:
+	git_str_dispose(&buf);
+	return error;
+}
+
+/* Whether `core.untrackedCache` asks for any untracked cache to be removed */
+static bool index_untracked_disabled(git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	int setting;
+
+	if (!repo)
+		return false;
+
+	if (git_repository__configmap_lookup(&setting, repo, GIT_CONFIGMAP_UNTRACKEDCACHE) < 0) {
+		git_error_clear();
+		return false;
+	}
+
+	return (setting == GIT_UNTRACKEDCACHE_FALSE);
+}
+
+int git_index__untracked_cache(git_untracked_cache **out, git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	const char *workdir;
+	int setting;
+
+	*out = NULL;
+
+	if (!repo || (workdir = git_repository_workdir(repo)) == NULL)
+		return 0;
+
+	if (git_repository__configmap_lookup(&setting, repo, GIT_CONFIGMAP_UNTRACKEDCACHE) < 0)
+		return -1;
+
+	if (setting == GIT_UNTRACKEDCACHE_FALSE)
+		return 0;
+
+	/* a cache recorded elsewhere (or by git itself) is left alone */
+	if (index->untracked && !git_untracked_cache_usable(index->untracked, workdir)) {
+		if (setting != GIT_UNTRACKEDCACHE_TRUE)
+			return 0;
+
+		git_untracked_cache_free(index->untracked);
+		index->untracked = NULL;
+	}
+
+	if (!index->untracked && setting == GIT_UNTRACKEDCACHE_TRUE &&
+	    git_untracked_cache_new(&index->untracked, workdir, index->oid_type) < 0)
+		return -1;
+
+	*out = index->untracked;
+	return 0;
+}
+
+static int write_fsmonitor_extension(
+	git_index *index,
+	git_filebuf *file,
+	git_hash_ctx *eoie,
+	git_vector *entries)
+{
+	struct index_extension extension;
+	git_bitvec dirty;
+	git_index_entry *entry;
+	git_str buf = GIT_STR_INIT;
+	uint32_t version = htonl(2), bitmap_len;
+	size_t bitmap_pos, i;
+	int error;
+
+	if ((error = git_bitvec_init(&dirty, entries->length)) < 0)
+		return error;
+
+	git_vector_foreach(entries, i, entry) {
+		if (!(entry->flags_extended & GIT_INDEX_ENTRY_FSMONITOR_VALID))
+			git_bitvec_set(&dirty, i, true);
+	}
+
+	git_str_put(&buf, (const char *)&version, 4);
+	git_str_put(&buf, index->fsmonitor_token, strlen(index->fsmonitor_token) + 1);
+
+	/* the size of the bitmap precedes it */
+	bitmap_pos = buf.size + 4;
+	git_str_put(&buf, "\0\0\0\0", 4);
+
+	if ((error = git_ewah_write(&buf, &dirty, entries->length)) < 0)
+		goto done;
+
+	if (buf.size - bitmap_pos > UINT32_MAX) {
+		git_error_set(GIT_ERROR_INDEX, "fsmonitor bitmap is too large");
+		error = -1;
+		goto done;
+	}
+
+	bitmap_len = htonl((uint32_t)(buf.size - bitmap_pos));
+	memcpy(buf.ptr + bitmap_pos - 4, &bitmap_len, 4);
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_FSMONITOR_SIG, 4);
+	extension.extension_size = (uint32_t)buf.size;
+
+	error = write_extension(file, eoie, &extension, &buf);
+
+done:
+	git_bitvec_free(&dirty);
+	git_str_dispose(&buf);
+	return error;
+}
+
+/* Whether the fsmonitor state should be removed, as there is no monitor */
+static bool index_fsmonitor_disabled(git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+
+	return (repo && !git_fsmonitor__enabled(repo));
+}
+
+/*
+ * Clears the valid flag of the entries at or beneath `path`; the index
+ * is sorted so that those follow the first entry prefixed with it.
+ */
+static bool index_fsmonitor_invalidate(git_index *index, const char *path)
+{
+	int (*strncomp)(const char *a, const char *b, size_t sz);
+	git_index_entry *entry;
+	size_t len = strlen(path), pos;
+	bool changed = false;
+
+	strncomp = index->ignore_case ? git__strncasecmp : git__strncmp;
+
+	index_find(&pos, index, path, len, GIT_INDEX_STAGE_ANY);
+
+	while ((entry = git_vector_get(&index->entries, pos++)) != NULL &&
+	       strncomp(entry->path, path, len) == 0) {
+		if (entry->path[len] != '\0' && entry->path[len] != '/')
+			continue;
+
+		if (entry->flags_extended & GIT_INDEX_ENTRY_FSMONITOR_VALID) {
+			entry->flags_extended &= ~GIT_INDEX_ENTRY_FSMONITOR_VALID;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+int git_index__fsmonitor_refresh(bool *valid, git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	git_fsmonitor_changes changes;
+	git_index_entry *entry;
+	const char *path;
+	size_t i;
+	int error;
+
+	*valid = false;
+
+	if (!repo || !git_repository_workdir(repo))
+		return 0;
+
+	if ((error = git_fsmonitor__query(&changes, repo, index->fsmonitor_token)) < 0) {
+		/* forget the state of a monitor that was removed */
+		if (error == GIT_ENOTFOUND) {
+			git_error_clear();
+			error = 0;
+
+			if (index->fsmonitor_token) {
+				git__free(index->fsmonitor_token);
+				index->fsmonitor_token = NULL;
+				index->fsmonitor_changed = 1;
+			}
+		}
+
+		goto done;
+	}
+
+	if ((error = index_materialize(index)) < 0)
+		goto done;
+
+	if (changes.all) {
+		git_vector_foreach(&index->entries, i, entry) {
+			if (entry->flags_extended & GIT_INDEX_ENTRY_FSMONITOR_VALID) {
+				entry->flags_extended &= ~GIT_INDEX_ENTRY_FSMONITOR_VALID;
+				index->fsmonitor_changed = 1;
+			}
+		}
+	} else {
+		git_vector_foreach(&changes.paths, i, path) {
+			if (index_fsmonitor_invalidate(index, path))
+				index->fsmonitor_changed = 1;
+		}
+	}
+
+	if (!changes.token.size ? (index->fsmonitor_token != NULL) :
+	    (!index->fsmonitor_token ||
+	     strcmp(index->fsmonitor_token, changes.token.ptr) != 0)) {
+		git__free(index->fsmonitor_token);
+		index->fsmonitor_token = changes.token.size ?
+			git_str_detach(&changes.token) : NULL;
+		index->fsmonitor_changed = 1;
+	}
+
+	*valid = (index->fsmonitor_token != NULL);
+
+done:
+	git_fsmonitor_changes_dispose(&changes);
+	return error;
+}
+
+void git_index__fsmonitor_mark_valid(git_index *index, const git_index_entry *entry)
+{
+	git_index_entry *e = (git_index_entry *)entry;
+
+	if (!index->fsmonitor_token ||
+	    (e->flags_extended & GIT_INDEX_ENTRY_FSMONITOR_VALID))
+		return;
+
+	e->flags_extended |= GIT_INDEX_ENTRY_FSMONITOR_VALID;
+	index->fsmonitor_changed = 1;
+}
+
+static int write_ieot_extension(
+	git_filebuf *file,
+	git_hash_ctx *eoie,
+	index_entry_block_array *blocks)
+{
+	struct index_extension extension;
+	struct index_entry_block *block;
+	git_str buf = GIT_STR_INIT;
+	uint32_t value;
+	size_t i;
+	int error;
+
+	value = htonl(INDEX_IEOT_VERSION);
+
+	if ((error = git_str_put(&buf, (const char *)&value, sizeof(value))) < 0)
+		goto done;
+
+	git_array_foreach(*blocks, i, block) {
+		value = htonl(block->offset);
+		git_str_put(&buf, (const char *)&value, sizeof(value));
+
+		value = htonl(block->nr);
+		git_str_put(&buf, (const char *)&value, sizeof(value));
+	}
+
+	if (git_str_oom(&buf)) {
+		error = -1;
+		goto done;
+	}
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_ENTRY_OFFSETS_SIG, 4);
+	extension.extension_size = (uint32_t)buf.size;
+
+	error = write_extension(file, eoie, &extension, &buf);
+
+done:
+	git_str_dispose(&buf);
+	return error;
+}
+
+static int write_eoie_extension(
+	git_index *index,
+	git_filebuf *file,
+	git_hash_ctx *eoie,
+	size_t entries_end)
+{
+	struct index_extension extension;
+	unsigned char hash[GIT_HASH_MAX_SIZE];
+	size_t hash_size = git_hash_size(git_oid_algorithm(index->oid_type));
+	git_str buf = GIT_STR_INIT;
+	uint32_t offset = htonl((uint32_t)entries_end);
+	int error;
+
+	if ((error = git_hash_final(hash, eoie)) < 0 ||
+	    (error = git_str_put(&buf, (const char *)&offset, sizeof(offset))) < 0 ||
+	    (error = git_str_put(&buf, (const char *)hash, hash_size)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_END_OF_ENTRIES_SIG, 4);
+	extension.extension_size = (uint32_t)buf.size;
+
+	error = write_extension(file, NULL, &extension, &buf);
+
+done:
+	git_str_dispose(&buf);
+	return error;
+}
+
+/*
+ * Whether to write the end of entries and entry offset table extensions;
+ * by default they are written when the index is large enough for readers
+ * to split it across threads.
+ */
+static void index_record_offsets(bool *eoie, bool *ieot, git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	git_config *config;
+	bool large = index->entries.length >= INDEX_THREAD_ENTRIES * 2;
+
+	*eoie = *ieot = large;
+
+	if (repo && git_repository_config__weakptr(&config, repo) == 0) {
+		*eoie = git_config__get_bool_force(config, "index.recordendofindexentries", large);
+		*ieot = git_config__get_bool_force(config, "index.recordoffsettable", large);
+	} else if (repo) {
+		git_error_clear();
+	}
+
+	/* readers find the offset table through the end of entries */
+	if (*ieot)
+		*eoie = true;
+}
+
+/* The entries of a split index, relative to its shared index */
+struct index_split {
+	git_vector entries; /* the replaced entries, then the new ones */
+	git_vector stripped; /* copies of the replaced entries, without paths */
+	git_bitvec deleted;
+	git_bitvec replaced;
+};
+
+#define INDEX_SPLIT_MAX_PERCENT 20
+#define INDEX_SHARED_EXPIRE "2.weeks.ago"
+
+static void index_split_dispose(struct index_split *split)
+{
+	git_index_entry *entry;
+	size_t i;
+
+	git_vector_foreach(&split->stripped, i, entry)
+		index_entry_free(entry);
+
+	git_vector_dispose(&split->stripped);
+	git_vector_dispose(&split->entries);
+	git_bitvec_free(&split->deleted);
+	git_bitvec_free(&split->replaced);
+
+	memset(split, 0x0, sizeof(*split));
+}
+
+/*
+ * Whether to write a split index: "core.splitIndex" turns splitting on
+ * or off, and an index that was read split stays split when it's unset.
+ */
+static bool index_split_enabled(int *max_percent, git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	git_config *config;
+	bool split = (index->shared != NULL);
+
+	*max_percent = INDEX_SPLIT_MAX_PERCENT;
+
+	if (repo && git_repository_config__weakptr(&config, repo) == 0) {
+		split = git_config__get_bool_force(config, "core.splitindex", split);
+		*max_percent = git_config__get_int_force(config,
+			"splitindex.maxpercentchange", INDEX_SPLIT_MAX_PERCENT);
+	} else if (repo) {
+		git_error_clear();
+	}
+
+	return split;
+}
+
+/* Whether two entries are identical once written to disk */
+static bool index_entry_ondisk_equal(
+	const git_index_entry *a,
+	const git_index_entry *b)
+{
+	return a->ctime.seconds == b->ctime.seconds &&
+	       a->ctime.nanoseconds == b->ctime.nanoseconds &&
+	       a->mtime.seconds == b->mtime.seconds &&
+	       a->mtime.nanoseconds == b->mtime.nanoseconds &&
+	       a->dev == b->dev &&
+	       a->ino == b->ino &&
+	       a->mode == b->mode &&
+	       a->uid == b->uid &&
+	       a->gid == b->gid &&
+	       a->file_size == b->file_size &&
+	       a->flags == b->flags &&
+	       (a->flags_extended & GIT_INDEX_ENTRY_EXTENDED_FLAGS) ==
+	       (b->flags_extended & GIT_INDEX_ENTRY_EXTENDED_FLAGS) &&
+	       git_oid_equal(&a->id, &b->id);
+}
+
+/*
+ * Compare the (case-sensitively sorted) entries against the shared
+ * index to find the shared entries that were deleted or replaced, and
+ * the entries that are new.
+ */
+static int index_split_prepare(
+	struct index_split *split,
+	git_index *index,
+	git_vector *entries)
+{
+	git_vector *shared = &index->shared->entries;
+	git_vector added = GIT_VECTOR_INIT;
+	git_index_entry *entry, *base, *stripped;
+	size_t i = 0, j = 0;
+	int cmp, error;
+
+	if ((error = git_vector_init(&split->entries, 32, NULL)) < 0 ||
+	    (error = git_vector_init(&split->stripped, 32, NULL)) < 0 ||
+	    (error = git_bitvec_init(&split->deleted, shared->length)) < 0 ||
+	    (error = git_bitvec_init(&split->replaced, shared->length)) < 0)
+		goto done;
+
+	while (i < entries->length || j < shared->length) {
+		entry = git_vector_get(entries, i);
+		base = git_vector_get(shared, j);
+
+		cmp = !entry ? 1 : !base ? -1 : git_index_entry_cmp(entry, base);
+
+		if (cmp < 0) {
+			error = git_vector_insert(&added, entry);
+			i++;
+		} else if (cmp > 0) {
+			git_bitvec_set(&split->deleted, j, true);
+			j++;
+		} else {
+			if (!index_entry_ondisk_equal(entry, base)) {
+				git_bitvec_set(&split->replaced, j, true);
+
+				/* the path is taken from the shared entry */
+				if ((error = index_entry_create(&stripped, INDEX_OWNER(index), "", NULL, false)) < 0 ||
+				    (error = git_vector_insert(&split->stripped, stripped)) < 0)
+					goto done;
+
+				index_entry_cpy(stripped, entry);
+				stripped->flags &= ~GIT_INDEX_ENTRY_NAMEMASK;
+
+				error = git_vector_insert(&split->entries, stripped);
+			}
+
+			i++;
+			j++;
+		}
+
+		if (error < 0)
+			goto done;
+	}
+
+	git_vector_foreach(&added, i, entry) {
+		if ((error = git_vector_insert(&split->entries, entry)) < 0)
+			goto done;
+	}
+
+done:
+	git_vector_dispose(&added);
+	return error;
+}
+
+static int write_link_extension(
+	git_index *index,
+	git_filebuf *file,
+	struct index_split *split)
+{
+	struct index_extension extension;
+	git_str buf = GIT_STR_INIT;
+	size_t count = index->shared->entries.length;
+	int error;
+
+	if ((error = git_str_put(&buf, (const char *)index->shared->checksum,
+			git_oid_size(index->oid_type))) < 0 ||
+	    (error = git_ewah_write(&buf, &split->deleted, count)) < 0 ||
+	    (error = git_ewah_write(&buf, &split->replaced, count)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_LINK_SIG, 4);
+	extension.extension_size = (uint32_t)buf.size;
+
+	error = write_extension(file, NULL, &extension, &buf);
+
+done:
+	git_str_dispose(&buf);
+	return error;
+}
+
+struct shared_index_expire_data {
+	git_time_t expire;
+	const char *keep;
+};
+
+static int shared_index_expire_cb(void *payload, git_str *path)
+{
+	struct shared_index_expire_data *data = payload;
+	const char *filename = path->ptr + git_fs_path_basename_offset(path);
+	size_t prefix_len = CONST_STRLEN(INDEX_SHARED_FILE) + 1;
+	struct stat st;
+
+	if (strncmp(filename, INDEX_SHARED_FILE ".", prefix_len) != 0 ||
+	    strspn(filename + prefix_len, "0123456789abcdef") != strlen(filename + prefix_len) ||
+	    strcmp(path->ptr, data->keep) == 0)
+		return 0;
+
+	if (p_lstat(path->ptr, &st) == 0 && st.st_mtime < data->expire)
+		p_unlink(path->ptr);
+
+	return 0;
+}
+
+/*
+ * Remove the shared indexes that are no longer used by this index and
+ * that were not used by any other (eg, a worktree's) for a while.
+ */
+static int shared_index_expire(git_index *index, const char *keep)
+{
+	struct shared_index_expire_data data = { 0, keep };
+	git_repository *repo = INDEX_OWNER(index);
+	git_config *config;
+	git_str dir = GIT_STR_INIT;
+	char *expire = NULL;
+	int error = 0;
+
+	if (repo && git_repository_config__weakptr(&config, repo) == 0)
+		expire = git_config__get_string_force(config,
+			"splitindex.sharedindexexpire", INDEX_SHARED_EXPIRE);
+	else
+		expire = git__strdup(INDEX_SHARED_EXPIRE);
+
+	GIT_ERROR_CHECK_ALLOC(expire);
+
+	if (git_date_parse(&data.expire, expire) < 0) {
+		git_error_set(GIT_ERROR_CONFIG,
+			"invalid value for splitIndex.sharedIndexExpire: '%s'", expire);
+		error = -1;
+		goto done;
+	}
+
+	if ((error = git_fs_path_dirname_r(&dir, index->index_file_path)) < 0)
+		goto done;
+
+	error = git_fs_path_direach(&dir, 0, shared_index_expire_cb, &data);
+
+done:
+	git_str_dispose(&dir);
+	git__free(expire);
+	return error;
+}
+
+/*
+ * Write all the entries (and no extensions) to a new shared index, which
+ * is named after its checksum, and make it the base of the split index.
+ */
+static int write_shared_index(
+	git_index *index,
+	git_vector *entries,
+	uint32_t version)
+{
+	git_index_options opts = GIT_INDEX_OPTIONS_INIT;
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_str path = GIT_STR_INIT;
+	git_index *shared = NULL;
+	git_index_entry *entry, *dup;
+	struct index_header header;
+	unsigned char checksum[GIT_HASH_MAX_SIZE];
+	size_t checksum_size = git_oid_size(index->oid_type), offset = 0, i;
+	git_oid shared_id;
+	int error;
+
+	header.signature = htonl(INDEX_HEADER_SIG);
+	header.version = htonl(version);
+	header.entry_count = htonl((uint32_t)entries->length);
+
+	if ((error = shared_index_path(&path, index, NULL)) < 0 ||
+	    (error = git_filebuf_open(&file, path.ptr,
+			git_filebuf_hash_flags(git_oid_algorithm(index->oid_type)),
+			GIT_INDEX_FILE_MODE)) < 0 ||
+	    (error = git_filebuf_write(&file, &header, sizeof(header))) < 0 ||
+	    (error = write_entries(index, &file, entries, &offset, NULL)) < 0 ||
+	    (error = git_filebuf_hash(checksum, &file)) < 0 ||
+	    (error = git_filebuf_write(&file, checksum, checksum_size)) < 0 ||
+	    (error = git_oid_from_raw(&shared_id, checksum, index->oid_type)) < 0)
+		goto done;
+
+	git_str_clear(&path);
+
+	if ((error = shared_index_path(&path, index, &shared_id)) < 0 ||
+	    (error = git_filebuf_commit_at(&file, path.ptr)) < 0)
+		goto done;
+
+	opts.oid_type = index->oid_type;
+
+	if ((error = git_index_new_ext(&shared, &opts)) < 0 ||
+	    (error = git_vector_size_hint(&shared->entries, entries->length)) < 0)
+		goto done;
+
+	git_vector_foreach(entries, i, entry) {
+		if ((error = index_entry_dup(&dup, shared, entry)) < 0 ||
+		    (error = git_vector_insert(&shared->entries, dup)) < 0)
+			goto done;
+	}
+
+	memcpy(shared->checksum, checksum, checksum_size);
+	shared->version = version;
+
+	git_index_free(index->shared);
+	index->shared = shared;
+	shared = NULL;
+
+	error = shared_index_expire(index, path.ptr);
+
+done:
+	git_filebuf_cleanup(&file);
+	git_index_free(shared);
+	git_str_dispose(&path);
+	return error;
+}
+
+/*
+ * Prepare to write a split index, writing a new shared index when
+ * there is none yet or when too many entries have changed since it was
+ * written ("splitIndex.maxPercentChange").
+ */
+static int index_split(
+	struct index_split *split,
+	git_index *index,
+	git_vector *entries,
+	uint32_t version,
+	int max_percent)
+{
+	git_str path = GIT_STR_INIT;
+	git_oid shared_id;
+	int error;
+
+	if (index->shared) {
+		if ((error = index_split_prepare(split, index, entries)) < 0)
+			return error;
+
+		if (max_percent >= 100 ||
+		    (max_percent > 0 &&
+		     (uint64_t)split->entries.length * 100 <=
+		     (uint64_t)entries->length * max_percent)) {
+			/* keep the shared index from expiring */
+			if ((error = git_oid_from_raw(&shared_id, index->shared->checksum, index->oid_type)) == 0 &&
+			    (error = shared_index_path(&path, index, &shared_id)) == 0)
+				error = git_futils_touch(path.ptr, NULL);
+
+			git_str_dispose(&path);
+			return error;
+		}
+
+		index_split_dispose(split);
+	}
+
+	if ((error = write_shared_index(index, entries, version)) < 0)
+		return error;
+
+	return index_split_prepare(split, index, entries);
+}
+
+static void clear_uptodate(git_index *index)
+{
+	git_index_entry *entry;
+	size_t i;
+
+	git_vector_foreach(&index->entries, i, entry)
+		entry->flags_extended &= ~GIT_INDEX_ENTRY_UPTODATE;
+}
+
+/*
+ * The tree cache counts the entries beneath each directory, which
+ * depends on whether its sparse directories are expanded; recount them
+ * for the (case-sensitively sorted) entries that are written.
+ */
+static void index_tree_cache_recount(
+	git_tree_cache *tree,
+	git_vector *entries,
+	git_str *path)
+{
+	size_t start, end, len = path->size, i;
 
-	/* If index->entries is sorted case-insensitively, then we need
-	 * to re-sort it case-sensitively before writing */
-	if (index->ignore_case) {
-		if ((error = git_vector_dup(&case_sorted, &index->entries, git_index_entry_cmp)) < 0)
-			goto done;
+	if (tree->entry_count >= 0) {
+		if (!len) {
+			tree->entry_count = entries->length;
+		} else {
+			index_find_in_entries(&start, entries, git_index_entry_srch, path->ptr, len, 0);
 
-		git_vector_sort(&case_sorted);
-		entries = &case_sorted;
-	} else {
-		entries = &index->entries;
+			/* the entries beneath "dir/" sort before "dir0" */
+			path->ptr[len - 1] = '0';
+			index_find_in_entries(&end, entries, git_index_entry_srch, path->ptr, len, 0);
+			path->ptr[len - 1] = '/';
+
+			tree->entry_count = end - start;
+		}
 	}
 
-	if (index->version >= INDEX_VERSION_NUMBER_COMP)
-		last = "";
+	for (i = 0; i < tree->children_count; i++) {
+		git_tree_cache *child = tree->children[i];
 
-	git_vector_foreach(entries, i, entry) {
-		if ((error = write_disk_entry(index, file, entry, last)) < 0)
-			break;
-		if (index->version >= INDEX_VERSION_NUMBER_COMP)
-			last = entry->path;
+		git_str_truncate(path, len);
+
+		if (git_str_put(path, child->name, child->namelen) < 0 ||
+		    git_str_putc(path, '/') < 0)
+			return;
+
+		index_tree_cache_recount(child, entries, path);
 	}
 
-done:
-	git_vector_dispose(&case_sorted);
-	return error;
+	git_str_truncate(path, len);
 }
 
-static int write_extension(git_filebuf *file, struct index_extension *header, git_str *data)
+/*
+ * Return the length of the outermost directory of `path` that's outside
+ * of the sparse checkout, or 0 if it's within.
+ */
+static size_t index_sparse_excluded_dir(git_sparse *sparse, const char *path)
 {
-	struct index_extension ondisk;
+	const char *slash;
 
-	memset(&ondisk, 0x0, sizeof(struct index_extension));
-	memcpy(&ondisk, header, 4);
-	ondisk.extension_size = htonl(header->extension_size);
+	for (slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+		git_sparse_t type = git_sparse__dir(sparse, path, slash - path);
 
-	git_filebuf_write(file, &ondisk, sizeof(struct index_extension));
-	return git_filebuf_write(file, data->ptr, data->size);
+		if (type == GIT_SPARSE_EXCLUDED)
+			return slash - path;
+		else if (type == GIT_SPARSE_INCLUDED)
+			break;
+	}
+
+	return 0;
 }
 
-static int create_name_extension_data(git_str *name_buf, git_index_name_entry *conflict_name)
-{
-	int error = 0;
+/*
+ * Collapse the entries beneath the directories outside of the sparse
+ * checkout into sparse directory entries, when they are all
+ * `skip-worktree` and the directory's tree is known; the tree cache is
+ * brought up to date, without writing any trees, when it isn't.  The
+ * new entries are put in `created`, so that they can be freed.
+ */
+static int index_sparse_collapse(
+	git_vector *out,
+	git_vector *created,
+	git_index *index,
+	git_vector *entries,
+	git_sparse *sparse)
+{
+	git_str dir = GIT_STR_INIT;
+	git_index_entry *entry, *dir_entry;
+	const git_tree_cache *cache;
+	bool collapse, refreshed = false;
+	size_t i = 0, j, dir_len;
+	int error;
 
-	if (conflict_name->ancestor == NULL)
-		error = git_str_put(name_buf, "\0", 1);
-	else
-		error = git_str_put(name_buf, conflict_name->ancestor, strlen(conflict_name->ancestor) + 1);
+	if ((error = git_vector_init(out, entries->length, git_index_entry_cmp)) < 0)
+		return error;
 
-	if (error != 0)
-		goto on_error;
+	while (i < entries->length) {
+		entry = git_vector_get(entries, i);
 
-	if (conflict_name->ours == NULL)
-		error = git_str_put(name_buf, "\0", 1);
-	else
-		error = git_str_put(name_buf, conflict_name->ours, strlen(conflict_name->ours) + 1);
+		if (git_index_entry__is_sparse_dir(entry) ||
+		    !(dir_len = index_sparse_excluded_dir(sparse, entry->path))) {
+			if ((error = git_vector_insert(out, entry)) < 0)
+				goto done;
 
-	if (error != 0)
-		goto on_error;
+			i++;
+			continue;
+		}
 
-	if (conflict_name->theirs == NULL)
-		error = git_str_put(name_buf, "\0", 1);
-	else
-		error = git_str_put(name_buf, conflict_name->theirs, strlen(conflict_name->theirs) + 1);
+		collapse = true;
 
-on_error:
-	return error;
-}
+		for (j = i; j < entries->length; j++) {
+			const git_index_entry *e = git_vector_get(entries, j);
 
-static int write_name_extension(git_index *index, git_filebuf *file)
-{
-	git_str name_buf = GIT_STR_INIT;
-	git_vector *out = &index->names;
-	git_index_name_entry *conflict_name;
-	struct index_extension extension;
-	size_t i;
-	int error = 0;
+			if (strncmp(e->path, entry->path, dir_len + 1) != 0)
+				break;
 
-	git_vector_foreach(out, i, conflict_name) {
-		if ((error = create_name_extension_data(&name_buf, conflict_name)) < 0)
-			goto done;
-	}
+			if (GIT_INDEX_ENTRY_STAGE(e) != 0 ||
+			    !(e->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE))
+				collapse = false;
+		}
 
-	memset(&extension, 0x0, sizeof(struct index_extension));
-	memcpy(&extension.signature, INDEX_EXT_CONFLICT_NAME_SIG, 4);
-	extension.extension_size = (uint32_t)name_buf.size;
+		git_str_clear(&dir);
 
-	error = write_extension(file, &extension, &name_buf);
+		if ((error = git_str_put(&dir, entry->path, dir_len)) < 0)
+			goto done;
 
-	git_str_dispose(&name_buf);
+		cache = git_tree_cache_get(index->tree, dir.ptr);
 
-done:
-	return error;
-}
+		/* a tree that's not in the object database stays invalid */
+		if (collapse && (!cache || cache->entry_count < 0) && !refreshed) {
+			refreshed = true;
 
-static int create_reuc_extension_data(git_str *reuc_buf, git_index *index, git_index_reuc_entry *reuc)
-{
-	size_t oid_size = git_oid_size(index->oid_type);
-	int i;
-	int error = 0;
+			if ((error = git_tree__update_index_cache(index, INDEX_OWNER(index))) < 0)
+				goto done;
 
-	if ((error = git_str_put(reuc_buf, reuc->path, strlen(reuc->path) + 1)) < 0)
-		return error;
+			cache = git_tree_cache_get(index->tree, dir.ptr);
+		}
 
-	for (i = 0; i < 3; i++) {
-		if ((error = git_str_printf(reuc_buf, "%o", reuc->mode[i])) < 0 ||
-			(error = git_str_put(reuc_buf, "\0", 1)) < 0)
-			return error;
-	}
+		if (!collapse || !cache || cache->entry_count < 0) {
+			for (; i < j; i++) {
+				if ((error = git_vector_insert(out, git_vector_get(entries, i))) < 0)
+					goto done;
+			}
 
-	for (i = 0; i < 3; i++) {
-		if (reuc->mode[i] && (error = git_str_put(reuc_buf, (char *)&reuc->oid[i].id, oid_size)) < 0)
-			return error;
-	}
+			continue;
+		}
 
-	return 0;
-}
+		if ((error = git_str_putc(&dir, '/')) < 0 ||
+		    (error = index_entry_create_sparse_dir(&dir_entry, INDEX_OWNER(index), dir.ptr)) < 0)
+			goto done;
 
-static int write_reuc_extension(git_index *index, git_filebuf *file)
-{
-	git_str reuc_buf = GIT_STR_INIT;
-	git_vector *out = &index->reuc;
-	git_index_reuc_entry *reuc;
-	struct index_extension extension;
-	size_t i;
-	int error = 0;
+		dir_entry->mode = GIT_FILEMODE_TREE;
+		dir_entry->flags_extended = GIT_INDEX_ENTRY_SKIP_WORKTREE;
+		dir_entry->flags = GIT_INDEX_ENTRY_EXTENDED;
+		index_entry_adjust_namemask(dir_entry, dir.size);
+		git_oid_cpy(&dir_entry->id, &cache->oid);
 
-	git_vector_foreach(out, i, reuc) {
-		if ((error = create_reuc_extension_data(&reuc_buf, index, reuc)) < 0)
+		if ((error = git_vector_insert(created, dir_entry)) < 0) {
+			index_entry_free(dir_entry);
 			goto done;
-	}
+		}
 
-	memset(&extension, 0x0, sizeof(struct index_extension));
-	memcpy(&extension.signature, INDEX_EXT_UNMERGED_SIG, 4);
-	extension.extension_size = (uint32_t)reuc_buf.size;
+		if ((error = git_vector_insert(out, dir_entry)) < 0)
+			goto done;
 
-	error = write_extension(file, &extension, &reuc_buf);
+		i = j;
+	}
 
-	git_str_dispose(&reuc_buf);
+	/* the entries are in the order they were given */
+	git_vector_set_sorted(out, true);
 
 done:
+	git_str_dispose(&dir);
 	return error;
 }
 
-static int write_tree_extension(git_index *index, git_filebuf *file)
+/*
+ * Expand the sparse directories that are no longer outside of the
+ * sparse checkout, since its cone was widened.
+ */
+static int index_sparse_expand_included(git_index *index, git_sparse *sparse)
 {
-	struct index_extension extension;
-	git_str buf = GIT_STR_INIT;
+	git_index_entry *entry;
+	size_t i = 0;
+	bool sparse_dirs = false;
 	int error;
 
-	if (index->tree == NULL)
-		return 0;
+	while (i < index->entries.length) {
+		entry = git_vector_get(&index->entries, i);
 
-	if ((error = git_tree_cache_write(&buf, index->tree)) < 0)
-		return error;
+		if (!git_index_entry__is_sparse_dir(entry)) {
+			i++;
+		} else if (index_sparse_excluded_dir(sparse, entry->path)) {
+			sparse_dirs = true;
+			i++;
+		} else if ((error = index_sparse_expand_entry(index, i)) < 0) {
+			return error;
+		}
+	}
 
-	memset(&extension, 0x0, sizeof(struct index_extension));
-	memcpy(&extension.signature, INDEX_EXT_TREECACHE_SIG, 4);
-	extension.extension_size = (uint32_t)buf.size;
+	index->sparse = sparse_dirs;
+	return 0;
+}
 
-	error = write_extension(file, &extension, &buf);
+/*
+ * Whether to write a sparse index: "index.sparse" collapses the
+ * directories outside of a cone-mode sparse checkout, and (like git)
+ * a split index is never sparse.  Otherwise, the sparse directories of
+ * an index that was read sparse are expanded.
+ */
+static int index_sparse_prepare(git_sparse **out, git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	int max_percent, error;
 
-	git_str_dispose(&buf);
+	*out = NULL;
 
-	return error;
+	if (repo && git_sparse__index_enabled(repo) &&
+	    !index_split_enabled(&max_percent, index) &&
+	    (error = git_sparse__load(out, repo)) < 0)
+		return error;
+
+	if (!*out)
+		return git_index__ensure_full(index);
+
+	return index->sparse ? index_sparse_expand_included(index, *out) : 0;
 }
 
-static void clear_uptodate(git_index *index)
+static int write_sparse_extension(git_filebuf *file, git_hash_ctx *eoie)
 {
-	git_index_entry *entry;
-	size_t i;
+	struct index_extension extension;
+	git_str buf = GIT_STR_INIT;
 
-	git_vector_foreach(&index->entries, i, entry)
-		entry->flags_extended &= ~GIT_INDEX_ENTRY_UPTODATE;
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_SPARSE_DIRS_SIG, 4);
+	extension.extension_size = 0;
+
+	return write_extension(file, eoie, &extension, &buf);
 }
 
 static int write_index(
@@ -3210,8 +5667,17 @@ static int write_index(
 	git_filebuf *file)
 {
 	struct index_header header;
-	bool is_extended;
+	index_entry_block_array blocks = GIT_ARRAY_INIT;
+	git_hash_ctx eoie_ctx, *eoie = NULL;
+	git_vector case_sorted = GIT_VECTOR_INIT, *entries, *all_entries;
+	git_vector collapsed = GIT_VECTOR_INIT, sparse_dirs = GIT_VECTOR_INIT;
+	struct index_split split = {{0}};
+	git_sparse *sparse = NULL;
+	git_str tree_path = GIT_STR_INIT;
+	size_t offset = sizeof(struct index_header);
+	bool is_extended, is_split, record_eoie, record_ieot;
 	uint32_t index_version_number;
+	int max_percent, error = -1;
 
 	GIT_ASSERT_ARG(index);
 	GIT_ASSERT_ARG(file);
@@ -3220,6 +5686,9 @@ static int write_index(
 
 	*checksum_size = git_hash_size(git_oid_algorithm(index->oid_type));
 
+	if (index_sparse_prepare(&sparse, index) < 0)
+		goto done;
+
 	if (index->version <= INDEX_VERSION_NUMBER_EXT)  {
 		is_extended = is_index_extended(index);
 		index_version_number = is_extended ? INDEX_VERSION_NUMBER_EXT : INDEX_VERSION_NUMBER_LB;
@@ -3227,39 +5696,139 @@ static int write_index(
 		index_version_number = index->version;
 	}
 
+	/* If index->entries is sorted case-insensitively, then we need
+	 * to re-sort it case-sensitively before writing */
+	if (index->ignore_case) {
+		if (git_vector_dup(&case_sorted, &index->entries, git_index_entry_cmp) < 0)
+			goto done;
+
+		git_vector_sort(&case_sorted);
+		entries = &case_sorted;
+	} else {
+		entries = &index->entries;
+	}
+
+	if (sparse) {
+		if (index_sparse_collapse(&collapsed, &sparse_dirs, index, entries, sparse) < 0)
+			goto done;
+
+		entries = &collapsed;
+	}
+
+	all_entries = entries;
+
+	/* a split index only holds the entries that changed */
+	if ((is_split = index_split_enabled(&max_percent, index))) {
+		if (index_split(&split, index, entries, index_version_number, max_percent) < 0)
+			goto done;
+
+		entries = &split.entries;
+	} else {
+		git_index_free(index->shared);
+		index->shared = NULL;
+	}
+
 	header.signature = htonl(INDEX_HEADER_SIG);
 	header.version = htonl(index_version_number);
-	header.entry_count = htonl((uint32_t)index->entries.length);
+	header.entry_count = htonl((uint32_t)entries->length);
 
 	if (git_filebuf_write(file, &header, sizeof(struct index_header)) < 0)
-		return -1;
+		goto done;
 
-	if (write_entries(index, file) < 0)
-		return -1;
+	/* the entries of a split index are few enough to read directly */
+	if (is_split)
+		record_eoie = record_ieot = false;
+	else
+		index_record_offsets(&record_eoie, &record_ieot, index);
+
+	if (write_entries(index, file, entries, &offset, record_ieot ? &blocks : NULL) < 0)
+		goto done;
+
+	/* the extensions store 32-bit offsets */
+	if (record_eoie && offset <= UINT32_MAX) {
+		if (git_hash_ctx_init(&eoie_ctx, git_oid_algorithm(index->oid_type)) < 0)
+			goto done;
+
+		eoie = &eoie_ctx;
+	}
+
+	/* write the entry offset table extension */
+	if (eoie && git_array_size(blocks) > 0 &&
+	    write_ieot_extension(file, eoie, &blocks) < 0)
+		goto done;
+
+	/* write the link to the shared index */
+	if (is_split && write_link_extension(index, file, &split) < 0)
+		goto done;
 
 	/* write the tree cache extension */
-	if (index->tree != NULL && write_tree_extension(index, file) < 0)
-		return -1;
+	if (index->tree != NULL) {
+		index_tree_cache_recount(index->tree, all_entries, &tree_path);
+
+		if (write_tree_extension(index, file, eoie) < 0)
+			goto done;
+	}
 
 	/* write the rename conflict extension */
-	if (index->names.length > 0 && write_name_extension(index, file) < 0)
-		return -1;
+	if (index->names.length > 0 && write_name_extension(index, file, eoie) < 0)
+		goto done;
 
 	/* write the reuc extension */
-	if (index->reuc.length > 0 && write_reuc_extension(index, file) < 0)
-		return -1;
+	if (index->reuc.length > 0 && write_reuc_extension(index, file, eoie) < 0)
+		goto done;
+
+	/* write the untracked cache extension, unless it was disabled */
+	if (index->untracked && index_untracked_disabled(index)) {
+		git_untracked_cache_free(index->untracked);
+		index->untracked = NULL;
+	}
+
+	if (index->untracked && write_untracked_extension(index, file, eoie) < 0)
+		goto done;
+
+	/* write the fsmonitor extension, unless there is no monitor */
+	if (index->fsmonitor_token && index_fsmonitor_disabled(index)) {
+		git__free(index->fsmonitor_token);
+		index->fsmonitor_token = NULL;
+	}
+
+	if (index->fsmonitor_token &&
+	    write_fsmonitor_extension(index, file, eoie, all_entries) < 0)
+		goto done;
+
+	/* mark the index sparse, if it has sparse directories */
+	if ((sparse_dirs.length > 0 || index->sparse) &&
+	    write_sparse_extension(file, eoie) < 0)
+		goto done;
+
+	/* write the end of entries extension; this must be the last one */
+	if (eoie && write_eoie_extension(index, file, eoie, offset) < 0)
+		goto done;
 
 	/* get out the hash for all the contents we've appended to the file */
 	git_filebuf_hash(checksum, file);
 
 	/* write it at the end of the file */
 	if (git_filebuf_write(file, checksum, *checksum_size) < 0)
-		return -1;
+		goto done;
 
 	/* file entries are no longer up to date */
 	clear_uptodate(index);
 
-	return 0;
+	error = 0;
+
+done:
+	if (eoie)
+		git_hash_ctx_cleanup(eoie);
+
+	index_split_dispose(&split);
+	git_index__sparse_entries_free(&sparse_dirs);
+	git_vector_dispose(&collapsed);
+	git_vector_dispose(&case_sorted);
+	git_sparse__free(sparse);
+	git_str_dispose(&tree_path);
+	git_array_clear(blocks);
+	return error;
 }
 
 int git_index_entry_stage(const git_index_entry *entry)
@@ -3327,10 +5896,11 @@ int git_index_read_tree(git_index *index, const git_tree *tree)
 {
 	int error = 0;
 	git_vector entries = GIT_VECTOR_INIT;
-	git_index_entrymap entries_map = GIT_INDEX_ENTRYMAP_INIT;
 	read_tree_data data;
-	size_t i;
-	git_index_entry *e;
+
+	/* unchanged entries keep their cached stat data */
+	if ((error = index_materialize(index)) < 0)
+		return error;
 
 	git_vector_set_cmp(&entries, index->entries._cmp); /* match sort */
 
@@ -3347,31 +5917,18 @@ int git_index_read_tree(git_index *index, const git_tree *tree)
 	if ((error = git_tree_walk(tree, GIT_TREEWALK_POST, read_tree_cb, &data)) < 0)
 		goto cleanup;
 
-	if ((error = git_index_entrymap_resize(&entries_map, entries.length)) < 0)
-		goto cleanup;
-
-	git_vector_foreach(&entries, i, e) {
-		if ((error = git_index_entrymap_put(&entries_map, e)) < 0) {
-			git_error_set(GIT_ERROR_INDEX, "failed to insert entry into map");
-			return error;
-		}
-	}
-
-	error = 0;
-
 	git_vector_sort(&entries);
 
 	if ((error = git_index_clear(index)) < 0)
 		goto cleanup;
 
 	git_vector_swap(&entries, &index->entries);
-	git_index_entrymap_swap(&entries_map, &index->entries_map);
+	index_map_invalidate(index);
 
 	index->dirty = 1;
 
 cleanup:
 	git_vector_dispose(&entries);
-	git_index_entrymap_dispose(&entries_map);
 
 	if (error < 0)
 		return error;
@@ -3388,7 +5945,6 @@ static int git_index_read_iterator(
 {
 	git_vector new_entries = GIT_VECTOR_INIT,
 		remove_entries = GIT_VECTOR_INIT;
-	git_index_entrymap new_entries_map = GIT_INDEX_ENTRYMAP_INIT;
 	git_iterator *index_iterator = NULL;
 	git_iterator_options opts = GIT_ITERATOR_OPTIONS_INIT;
 	const git_index_entry *old_entry, *new_entry;
@@ -3398,14 +5954,14 @@ static int git_index_read_iterator(
 
 	GIT_ASSERT((new_iterator->flags & GIT_ITERATOR_DONT_IGNORE_CASE));
 
+	/* the existing entries are kept, so they must be the index's own */
+	if ((error = git_index__ensure_full(index)) < 0)
+		return error;
+
 	if ((error = git_vector_init(&new_entries, new_length_hint, index->entries._cmp)) < 0 ||
 	    (error = git_vector_init(&remove_entries, index->entries.length, NULL)) < 0)
 		goto done;
 
-	if (new_length_hint &&
-	    (error = git_index_entrymap_resize(&new_entries_map, new_length_hint)) < 0)
-		goto done;
-
 	opts.flags = GIT_ITERATOR_DONT_IGNORE_CASE |
 		GIT_ITERATOR_INCLUDE_CONFLICTS;
 
@@ -3463,14 +6019,14 @@ static int git_index_read_iterator(
 		/* invalidate this path in the tree cache if this is new (to
 		 * invalidate the parent trees)
 		 */
-		if (dup_entry && !remove_entry && index->tree)
+		if (dup_entry && !remove_entry) {
 			git_tree_cache_invalidate_path(index->tree, dup_entry->path);
-
-		if (add_entry) {
-			if ((error = git_vector_insert(&new_entries, add_entry)) == 0)
-				error = git_index_entrymap_put(&new_entries_map, add_entry);
+			git_untracked_cache_invalidate_path(index->untracked, dup_entry->path);
 		}
 
+		if (add_entry)
+			error = git_vector_insert(&new_entries, add_entry);
+
 		if (remove_entry && error >= 0)
 			error = git_vector_insert(&remove_entries, remove_entry);
 
@@ -3497,11 +6053,11 @@ static int git_index_read_iterator(
 	    goto done;
 
 	git_vector_swap(&new_entries, &index->entries);
-	git_index_entrymap_swap(&index->entries_map, &new_entries_map);
+	index_map_invalidate(index);
 
 	git_vector_foreach(&remove_entries, i, entry) {
-		if (index->tree)
-			git_tree_cache_invalidate_path(index->tree, entry->path);
+		git_tree_cache_invalidate_path(index->tree, entry->path);
+		git_untracked_cache_invalidate_path(index->untracked, entry->path);
 
 		index_entry_free(entry);
 	}
@@ -3512,7 +6068,6 @@ static int git_index_read_iterator(
 	error = 0;
 
 done:
-	git_index_entrymap_dispose(&new_entries_map);
 	git_vector_dispose(&new_entries);
 	git_vector_dispose(&remove_entries);
 	git_iterator_free(index_iterator);
@@ -3533,7 +6088,7 @@ int git_index_read_index(
 	if ((error = git_iterator_for_index(&new_iterator,
 		git_index_owner(new_index), (git_index *)new_index, &opts)) < 0 ||
 		(error = git_index_read_iterator(index, new_iterator,
-		new_index->entries.length)) < 0)
+		git_index_entrycount(new_index))) < 0)
 		goto done;
 
 done:
@@ -3708,7 +6263,8 @@ static int index_apply_to_all(
 
 	GIT_ASSERT_ARG(index);
 
-	if ((error = git_pathspec__init(&ps, paths)) < 0)
+	if ((error = index_materialize(index)) < 0 ||
+	    (error = git_pathspec__init(&ps, paths)) < 0)
 		return error;
 
 	git_vector_sort(&index->entries);
@@ -3800,6 +6356,9 @@ int git_index_snapshot_new(git_vector *snap, git_index *index)
 {
 	int error;
 
+	if ((error = index_materialize(index)) < 0)
+		return error;
+
 	GIT_REFCOUNT_INC(index);
 
 	git_atomic32_inc(&index->readers);
@@ -3888,6 +6447,11 @@ int git_indexwriter_commit(git_indexwriter *writer)
 	if (!writer->should_write)
 		return 0;
 
+	if ((error = index_materialize(writer->index)) < 0) {
+		git_indexwriter_cleanup(writer);
+		return error;
+	}
+
 	git_vector_sort(&writer->index->entries);
 	git_vector_sort(&writer->index->reuc);
 
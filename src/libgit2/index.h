@@ -13,6 +13,7 @@
 #include "filebuf.h"
 #include "vector.h"
 #include "tree-cache.h"
+#include "untracked_cache.h"
 #include "index_map.h"
 #include "git2/odb.h"
 #include "git2/index.h"
@@ -26,6 +27,8 @@
 
 extern bool git_index__enforce_unsaved_safety;
 
+struct index_lazy;
+
 struct git_index {
 	git_refcount rc;
 
@@ -34,7 +37,9 @@ struct git_index {
 	unsigned char checksum[GIT_HASH_MAX_SIZE];
 
 	git_vector entries;
+	struct index_lazy *lazy; /* entries still in the mapped index file */
 	git_index_entrymap entries_map;
+	size_t entries_map_misses; /* lookups while the map is not built */
 
 	git_vector deleted; /* deleted entries if readers > 0 */
 	git_atomic32 readers; /* number of active iterators */
@@ -46,6 +51,8 @@ struct git_index {
 	unsigned int distrust_filemode:1;
 	unsigned int no_symlinks:1;
 	unsigned int dirty:1;	/* whether we have unsaved changes */
+	unsigned int entries_map_lazy:1; /* entries are not in entries_map */
+	unsigned int sparse:1; /* entries may include sparse directories */
 
 	git_tree_cache *tree;
 	git_pool tree_pool;
@@ -53,6 +60,13 @@ struct git_index {
 	git_vector names;
 	git_vector reuc;
 
+	git_index *shared; /* the shared index, when the index is split */
+
+	git_untracked_cache *untracked;
+
+	char *fsmonitor_token; /* the token of the last fsmonitor query */
+	unsigned int fsmonitor_changed:1;
+
 	git_vector_cmp entries_cmp_path;
 	git_vector_cmp entries_search;
 	git_vector_cmp entries_search_path;
@@ -133,6 +147,12 @@ extern int git_index__find_pos(
 
 extern int git_index__fill(git_index *index, const git_vector *source_entries);
 
+/*
+ * Decode the entries that are still in the mapped index file into
+ * `index->entries`, for the callers that walk the vector directly.
+ */
+extern int git_index__materialize(git_index *index);
+
 extern void git_index__set_ignore_case(git_index *index, bool ignore_case);
 
 extern unsigned int git_index__create_mode(unsigned int mode);
@@ -169,6 +189,79 @@ GIT_INLINE(int) git_index_is_dirty(git_index *index)
 	return index->dirty;
 }
 
+/*
+ * In-memory flag of entries that were unchanged when last examined and
+ * that the filesystem monitor has not reported changed since.
+ */
+#define GIT_INDEX_ENTRY_FSMONITOR_VALID (1 << 3)
+
+/*
+ * Whether the untracked cache or the filesystem monitor state has
+ * changes that should be written
+ */
+GIT_INLINE(bool) git_index__extensions_changed(git_index *index)
+{
+	return (index->untracked && index->untracked->changed) ||
+	       index->fsmonitor_changed;
+}
+
+/*
+ * Get the untracked cache to use for the repository's working directory,
+ * creating it if `core.untrackedCache` is set.  `out` is set to NULL when
+ * there is no cache that may be used.
+ */
+extern int git_index__untracked_cache(
+	git_untracked_cache **out, git_index *index);
+
+/*
+ * Query the repository's filesystem monitor and mark the entries that
+ * it reports changed.  `valid` is set when entries marked with
+ * `GIT_INDEX_ENTRY_FSMONITOR_VALID` may be trusted to be unchanged.
+ */
+extern int git_index__fsmonitor_refresh(bool *valid, git_index *index);
+
+/*
+ * Record that the given entry of the index matched the working
+ * directory, after a refresh.
+ */
+extern void git_index__fsmonitor_mark_valid(
+	git_index *index, const git_index_entry *entry);
+
+/*
+ * A sparse index holds a single "sparse directory" entry for each
+ * directory outside of the sparse checkout cone, instead of an entry for
+ * each of the files beneath it: its path has a trailing slash, its mode
+ * is that of a tree, its id is the tree's and it is `skip-worktree`.
+ */
+GIT_INLINE(bool) git_index_entry__is_sparse_dir(const git_index_entry *entry)
+{
+	return S_ISDIR(entry->mode);
+}
+
+/*
+ * Expand the sparse directory entries of the index, for the callers
+ * that need every file's entry (like those that access entries by
+ * their position).  This also materializes the index's entries.
+ */
+extern int git_index__ensure_full(git_index *index);
+
+/*
+ * Create the entries of the files beneath a sparse directory entry,
+ * which are freed with `git_index__sparse_entries_free`.
+ */
+extern int git_index__sparse_entries(
+	git_vector *out, git_index *index, const git_index_entry *dir);
+extern void git_index__sparse_entries_free(git_vector *entries);
+
+/*
+ * The number of threads to split work on `entries` index entries
+ * across, given how many entries make it worth another thread.
+ */
+extern size_t git_index__threads(
+	git_index *index,
+	size_t entries,
+	size_t entries_per_thread);
+
 extern int git_index_read_safely(git_index *index);
 
 typedef struct {
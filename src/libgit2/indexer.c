@@ -302,7 +302,11 @@ static int hash_object_stream(git_indexer*idx, git_packfile_stream *stream)
 		if ((read = git_packfile_stream_read(stream, idx->objbuf, sizeof(idx->objbuf))) < 0)
 			break;
 
-		if (idx->do_verify)
+		/*
+		 * Blobs have no outgoing links, so there is no need to
+		 * keep their (possibly huge) contents for verification.
+		 */
+		if (idx->do_verify && idx->entry_type != GIT_OBJECT_BLOB)
 			git_str_put(&idx->entry_data, idx->objbuf, read);
 
 		git_hash_update(&idx->hash_ctx, idx->objbuf, read);
@@ -394,10 +398,19 @@ static int add_expected_oid(git_indexer *idx, const git_oid *oid)
 	return 0;
 }
 
+static void remove_expected_oid(git_indexer *idx, const git_oid *oid)
+{
+	git_oid *expected;
+
+	if (git_indexer_oidmap_get(&expected, &idx->expected_oids, oid) == 0) {
+		git_indexer_oidmap_remove(&idx->expected_oids, oid);
+		git__free(expected);
+	}
+}
+
 static int check_object_connectivity(git_indexer *idx, const git_rawobj *obj)
 {
 	git_object *object;
-	git_oid *expected;
 	int error = 0;
 
 	if (obj->type != GIT_OBJECT_BLOB &&
@@ -415,10 +428,7 @@ static int check_object_connectivity(git_indexer *idx, const git_rawobj *obj)
 		goto out;
 	}
 
-	if (git_indexer_oidmap_get(&expected, &idx->expected_oids, &object->cached.oid) == 0) {
-		git_indexer_oidmap_remove(&idx->expected_oids, &object->cached.oid);
-		git__free(expected);
-	}
+	remove_expected_oid(idx, &object->cached.oid);
 
 	/*
 	 * Check whether this is a known object. If so, we can just continue as
@@ -509,7 +519,9 @@ static int store_object(git_indexer *idx)
 		entry->offset = (uint32_t)entry_start;
 	}
 
-	if (idx->do_verify) {
+	if (idx->do_verify && idx->entry_type == GIT_OBJECT_BLOB) {
+		remove_expected_oid(idx, &oid);
+	} else if (idx->do_verify) {
 		git_rawobj rawobj = {
 		    idx->entry_data.ptr,
 		    idx->entry_data.size,
@@ -597,33 +609,25 @@ static int save_entry(git_indexer *idx, struct entry *entry, struct git_pack_ent
 	return 0;
 }
 
-static int hash_and_save(git_indexer *idx, git_rawobj *obj, off64_t entry_start)
+static int save_resolved(
+	git_indexer *idx,
+	const git_oid *oid,
+	off64_t entry_start,
+	size_t entry_size)
 {
-	git_object_id_options id_opts = GIT_OBJECT_ID_OPTIONS_INIT;
-	git_oid oid;
-	size_t entry_size;
 	struct entry *entry;
 	struct git_pack_entry *pentry = NULL;
 
 	entry = git__calloc(1, sizeof(*entry));
 	GIT_ERROR_CHECK_ALLOC(entry);
 
-	id_opts.object_type = obj->type;
-	id_opts.oid_type = idx->oid_type;
-
-	if (git_object_id_from_buffer(&oid, obj->data, obj->len, &id_opts) < 0) {
-		git_error_set(GIT_ERROR_INDEXER, "failed to hash object");
-		goto on_error;
-	}
-
 	pentry = git__calloc(1, sizeof(struct git_pack_entry));
 	GIT_ERROR_CHECK_ALLOC(pentry);
 
-	git_oid_cpy(&pentry->id, &oid);
-	git_oid_cpy(&entry->oid, &oid);
+	git_oid_cpy(&pentry->id, oid);
+	git_oid_cpy(&entry->oid, oid);
 	entry->crc = crc32(0L, Z_NULL, 0);
 
-	entry_size = (size_t)(idx->off - entry_start);
 	if (crc_object(&entry->crc, &idx->pack->mwf, entry_start, entry_size) < 0)
 		goto on_error;
 
@@ -632,7 +636,6 @@ static int hash_and_save(git_indexer *idx, git_rawobj *obj, off64_t entry_start)
 on_error:
 	git__free(pentry);
 	git__free(entry);
-	git__free(obj->data);
 	return -1;
 }
 
@@ -1132,16 +1135,79 @@ static int fix_thin_pack(git_indexer *idx, git_indexer_progress *stats)
 	return 0;
 }
 
+/*
+ * Resolved deltas are hashed in batches so that small objects can be
+ * hashed in parallel, when the hash implementation supports it.  Large
+ * objects are hashed immediately so that we do not keep several of them
+ * in memory.
+ */
+#define RESOLVE_BATCH_COUNT 8
+#define RESOLVE_BATCH_MAX_SIZE (64 * 1024)
+
+struct resolved_delta {
+	git_rawobj obj;
+	struct delta_info *delta;
+	size_t pos;
+	size_t entry_size;
+};
+
+static int save_resolved_deltas(
+	git_indexer *idx,
+	git_indexer_progress *stats,
+	struct resolved_delta *resolved,
+	size_t count,
+	int *progressed)
+{
+	git_rawobj objs[RESOLVE_BATCH_COUNT] = {{0}};
+	git_oid ids[RESOLVE_BATCH_COUNT];
+	size_t i;
+	int error = 0;
+
+	for (i = 0; i < count; i++)
+		objs[i] = resolved[i].obj;
+
+	if (git_odb__hash_rawobjs(ids, objs, count, idx->oid_type) < 0) {
+		git_error_set(GIT_ERROR_INDEXER, "failed to hash object");
+		error = -1;
+		goto done;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (save_resolved(idx, &ids[i], resolved[i].delta->delta_off,
+				resolved[i].entry_size) < 0)
+			continue;
+
+		stats->indexed_objects++;
+		stats->indexed_deltas++;
+		*progressed = 1;
+
+		if ((error = do_progress_callback(idx, stats)) < 0)
+			goto done;
+
+		/* remove from the list */
+		git_vector_set(NULL, &idx->deltas, resolved[i].pos, NULL);
+		git__free(resolved[i].delta);
+	}
+
+done:
+	for (i = 0; i < count; i++)
+		git__free(resolved[i].obj.data);
+
+	return error;
+}
+
 static int resolve_deltas(git_indexer *idx, git_indexer_progress *stats)
 {
-	unsigned int i;
+	struct resolved_delta resolved[RESOLVE_BATCH_COUNT];
+	size_t resolved_count = 0, i;
 	int error;
 	struct delta_info *delta;
-	int progressed = 0, non_null = 0, progress_cb_result;
+	int progressed = 0, non_null = 0;
 
 	while (idx->deltas.length > 0) {
 		progressed = 0;
 		non_null = 0;
+
 		git_vector_foreach(&idx->deltas, i, delta) {
 			git_rawobj obj = {0};
 
@@ -1155,26 +1221,39 @@ static int resolve_deltas(git_indexer *idx, git_indexer_progress *stats)
 					/* We have not seen the base object, we'll try again later. */
 					continue;
 				}
-				return -1;
+				goto on_error;
 			}
 
 			if (idx->do_verify && check_object_connectivity(idx, &obj) < 0)
 				/* TODO: error? continue? */
 				continue;
 
-			if (hash_and_save(idx, &obj, delta->delta_off) < 0)
+			resolved[resolved_count].obj = obj;
+			resolved[resolved_count].delta = delta;
+			resolved[resolved_count].pos = i;
+			resolved[resolved_count].entry_size =
+				(size_t)(idx->off - delta->delta_off);
+			resolved_count++;
+
+			if (resolved_count < RESOLVE_BATCH_COUNT &&
+			    obj.len < RESOLVE_BATCH_MAX_SIZE)
 				continue;
 
-			git__free(obj.data);
-			stats->indexed_objects++;
-			stats->indexed_deltas++;
-			progressed = 1;
-			if ((progress_cb_result = do_progress_callback(idx, stats)) < 0)
-				return progress_cb_result;
+			error = save_resolved_deltas(idx, stats,
+				resolved, resolved_count, &progressed);
+			resolved_count = 0;
 
-			/* remove from the list */
-			git_vector_set(NULL, &idx->deltas, i, NULL);
-			git__free(delta);
+			if (error < 0)
+				return error;
+		}
+
+		if (resolved_count) {
+			error = save_resolved_deltas(idx, stats,
+				resolved, resolved_count, &progressed);
+			resolved_count = 0;
+
+			if (error < 0)
+				return error;
 		}
 
 		/* if none were actually set, we're done */
@@ -1187,6 +1266,12 @@ static int resolve_deltas(git_indexer *idx, git_indexer_progress *stats)
 	}
 
 	return 0;
+
+on_error:
+	for (i = 0; i < resolved_count; i++)
+		git__free(resolved[i].obj.data);
+
+	return -1;
 }
 
 static int update_header_and_rehash(git_indexer *idx, git_indexer_progress *stats)
@@ -10,6 +10,7 @@
 #include "tree.h"
 #include "index.h"
 #include "path.h"
+#include "config.h"
 
 #define GIT_ITERATOR_FIRST_ACCESS   (1 << 15)
 #define GIT_ITERATOR_HONOR_IGNORES  (1 << 16)
@@ -123,6 +124,7 @@ static int iterator_init_common(
 	iter->repo = repo;
 	iter->index = index;
 	iter->flags = options->flags;
+	iter->sparse_skip = options->sparse_skip;
 
 	if ((iter->flags & GIT_ITERATOR_IGNORE_CASE) != 0) {
 		ignore_case = true;
@@ -813,6 +815,11 @@ static int tree_iterator_advance(const git_index_entry **out, git_iterator *i)
 
 		is_tree = git_tree_entry__is_tree(entry->tree_entry);
 
+		/* the caller is not interested in this sparse directory */
+		if (is_tree && iter->base.sparse_skip &&
+		    git_hashset_str_contains(iter->base.sparse_skip, iter->entry_path.ptr))
+			continue;
+
 		/* if we are *not* including trees then advance over this entry */
 		if (is_tree && !iterator__include_trees(iter)) {
 
@@ -1042,6 +1049,12 @@ typedef struct {
 	git_index *index;
 	git_vector index_snapshot;
 
+	git_untracked_cache *untracked;
+	size_t untracked_generation;
+
+	bool fsmonitor; /* whether fsmonitor-valid entries are unchanged */
+	struct filesystem_iterator_preload *preload; /* by snapshot position */
+
 	git_oid_t oid_type;
 
 	git_array_t(filesystem_iterator_frame) frames;
@@ -1345,6 +1358,475 @@ static int filesystem_iterator_entry_init(
 	return error;
 }
 
+/*
+ * Add the entry at the given path (relative to the iterator root) to the
+ * frame, unless it's something that we don't iterate over.
+ */
+static int filesystem_iterator_frame_add(
+	filesystem_iterator *iter,
+	filesystem_iterator_frame *new_frame,
+	const char *path,
+	size_t path_len,
+	struct stat *statbuf,
+	bool dir_expected,
+	iterator_pathlist_search_t pathlist_match)
+{
+	filesystem_iterator_entry *entry;
+	int error;
+
+	iter->base.stat_calls++;
+
+	/* Ignore wacky things in the filesystem */
+	if (!S_ISDIR(statbuf->st_mode) &&
+		!S_ISREG(statbuf->st_mode) &&
+		!S_ISLNK(statbuf->st_mode) &&
+		statbuf->st_mode != GIT_FILEMODE_UNREADABLE)
+		return 0;
+
+	if (filesystem_iterator_is_dot_git(iter, path, path_len))
+		return 0;
+
+	/* convert submodules to GITLINK and remove trailing slashes */
+	if (S_ISDIR(statbuf->st_mode)) {
+		bool submodule = false;
+
+		if ((error = filesystem_iterator_is_submodule(&submodule,
+				iter, path, path_len)) < 0)
+			return error;
+
+		if (submodule)
+			statbuf->st_mode = GIT_FILEMODE_COMMIT;
+	}
+
+	/* Ensure that the pathlist entry lines up with what we expected */
+	else if (dir_expected)
+		return 0;
+
+	if ((error = filesystem_iterator_entry_init(&entry,
+		iter, new_frame, path, path_len, statbuf, pathlist_match)) < 0)
+		return error;
+
+	return git_vector_insert(&new_frame->entries, entry);
+}
+
+/* Whether this is a workdir iterator over the whole working directory */
+static bool filesystem_iterator_covers_workdir(filesystem_iterator *iter)
+{
+	const char *workdir;
+
+	return (iter->base.type == GIT_ITERATOR_WORKDIR &&
+		iter->index && iter->base.repo &&
+		iterator__ignore_dot_git(&iter->base) &&
+		!iterator__descend_symlinks(&iter->base) &&
+		(workdir = git_repository_workdir(iter->base.repo)) != NULL &&
+		strcmp(workdir, iter->root) == 0);
+}
+
+/*
+ * The untracked cache records the names in each directory that are not
+ * in the index; those and the index entries beneath the directory are
+ * its contents as long as its stat data has not changed.  The cache is
+ * only consulted for workdir iterators over the whole working directory.
+ */
+static int filesystem_iterator_untracked_init(filesystem_iterator *iter)
+{
+	git_untracked_cache *cache;
+
+	iter->untracked = NULL;
+
+	if (!filesystem_iterator_covers_workdir(iter) ||
+	    iterator__ignore_case(&iter->base) ||
+	    iterator__flag(&iter->base, PRECOMPOSE_UNICODE))
+		return 0;
+
+	if (git_index__untracked_cache(&cache, iter->index) < 0)
+		return -1;
+
+	if (cache) {
+		iter->untracked = cache;
+		iter->untracked_generation = cache->generation;
+	}
+
+	return 0;
+}
+
+static git_untracked_cache *filesystem_iterator_untracked(
+	filesystem_iterator *iter)
+{
+	git_untracked_cache *cache = iter->untracked;
+
+	/*
+	 * Stop using the cache if the index changed since the snapshot was
+	 * taken; the snapshot no longer says what the cache leaves out.
+	 */
+	if (cache && (iter->index->untracked != cache ||
+	              cache->generation != iter->untracked_generation))
+		iter->untracked = cache = NULL;
+
+	return cache;
+}
+
+/*
+ * With a filesystem monitor, the index entries that it has not reported
+ * changed since they last matched the working directory are not stat'ed
+ * again; their stat data is taken from the index instead.
+ */
+static int filesystem_iterator_fsmonitor_init(filesystem_iterator *iter)
+{
+	iter->fsmonitor = false;
+
+	if (!filesystem_iterator_covers_workdir(iter))
+		return 0;
+
+	return git_index__fsmonitor_refresh(&iter->fsmonitor, iter->index);
+}
+
+/* The stat data of an index entry's file, examined ahead of iteration. */
+struct filesystem_iterator_preload {
+	time_t ctime;
+	time_t mtime;
+	uint32_t ctime_nsec;
+	uint32_t mtime_nsec;
+	uint64_t size;
+	uint64_t ino;
+	uint32_t dev;
+	uint32_t mode;
+	uint32_t uid;
+	uint32_t gid;
+	unsigned int loaded:1;
+};
+
+#ifdef GIT_THREADS
+
+/* The number of index entries that make it worth another preload thread */
+#define FILESYSTEM_ITERATOR_PRELOAD_ENTRIES 500
+
+typedef struct {
+	git_thread thread;
+	filesystem_iterator *iter;
+	size_t start;
+	size_t end;
+	unsigned int started:1;
+} filesystem_iterator_preloader;
+
+static void *filesystem_iterator_preload_entries(void *payload)
+{
+	filesystem_iterator_preloader *preloader = payload;
+	filesystem_iterator *iter = preloader->iter;
+	git_str path = GIT_STR_INIT;
+	struct stat st;
+	size_t i;
+
+	for (i = preloader->start; i < preloader->end; i++) {
+		const git_index_entry *entry = git_vector_get(&iter->index_snapshot, i);
+		struct filesystem_iterator_preload *preload = &iter->preload[i];
+
+		if (git_index_entry_stage(entry) != 0 ||
+		    (!S_ISREG(entry->mode) && !S_ISLNK(entry->mode)) ||
+		    (entry->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE) ||
+		    (iter->fsmonitor &&
+		     (entry->flags_extended & GIT_INDEX_ENTRY_FSMONITOR_VALID)))
+			continue;
+
+		git_str_clear(&path);
+
+		if (git_str_join(&path, '\0', iter->root, entry->path) < 0)
+			break;
+
+		/* leave anything unusual to be examined during iteration */
+		if (p_lstat(path.ptr, &st) < 0)
+			continue;
+
+		preload->ctime = st.st_ctime;
+		preload->mtime = st.st_mtime;
+#if defined(GIT_NSEC)
+		preload->ctime_nsec = st.st_ctime_nsec;
+		preload->mtime_nsec = st.st_mtime_nsec;
+#endif
+		preload->size = st.st_size;
+		preload->ino = st.st_ino;
+		preload->dev = st.st_dev;
+		preload->mode = st.st_mode;
+		preload->uid = st.st_uid;
+		preload->gid = st.st_gid;
+		preload->loaded = 1;
+	}
+
+	git_str_dispose(&path);
+	return NULL;
+}
+
+/*
+ * Unless "core.preloadIndex" is disabled, the files of the index entries
+ * are stat'ed up front, on several threads that each take a contiguous
+ * range of the snapshot, so that the latency of a slow (or cold)
+ * filesystem is not paid one file at a time during iteration.
+ */
+static int filesystem_iterator_preload_init(filesystem_iterator *iter)
+{
+	filesystem_iterator_preloader *preloaders;
+	git_config *config;
+	size_t entries = iter->index_snapshot.length, threads, i;
+	int error;
+
+	if (!filesystem_iterator_covers_workdir(iter) ||
+	    iter->base.start_len || iter->base.end_len ||
+	    iter->base.pathlist.length)
+		return 0;
+
+	if ((error = git_repository_config__weakptr(&config, iter->base.repo)) < 0)
+		return error;
+
+	if (!git_config__get_bool_force(config, "core.preloadindex", 1))
+		return 0;
+
+	threads = min(git_index__threads(iter->index, entries,
+		FILESYSTEM_ITERATOR_PRELOAD_ENTRIES), entries);
+
+	if (threads < 2)
+		return 0;
+
+	iter->preload = git__calloc(entries, sizeof(struct filesystem_iterator_preload));
+	GIT_ERROR_CHECK_ALLOC(iter->preload);
+
+	preloaders = git__calloc(threads, sizeof(filesystem_iterator_preloader));
+	GIT_ERROR_CHECK_ALLOC(preloaders);
+
+	for (i = 0; i < threads; i++) {
+		preloaders[i].iter = iter;
+		preloaders[i].start = (size_t)((uint64_t)entries * i / threads);
+		preloaders[i].end = (size_t)((uint64_t)entries * (i + 1) / threads);
+
+		/* a range that gets no thread is examined on this one */
+		if (git_thread_create(&preloaders[i].thread,
+				filesystem_iterator_preload_entries, &preloaders[i]) == 0)
+			preloaders[i].started = 1;
+		else
+			filesystem_iterator_preload_entries(&preloaders[i]);
+	}
+
+	for (i = 0; i < threads; i++) {
+		if (preloaders[i].started)
+			git_thread_join(&preloaders[i].thread, NULL);
+	}
+
+	git__free(preloaders);
+	return 0;
+}
+
+#else
+
+static int filesystem_iterator_preload_init(filesystem_iterator *iter)
+{
+	GIT_UNUSED(iter);
+	return 0;
+}
+
+#endif
+
+/*
+ * Fill in the stat data of a file in the index without examining it,
+ * when it is already known: the filesystem monitor did not report the
+ * file changed, or it was preloaded.
+ */
+static bool filesystem_iterator_known_stat(
+	struct stat *st,
+	filesystem_iterator *iter,
+	const char *path,
+	size_t path_len)
+{
+	const git_index_entry *entry;
+	const struct filesystem_iterator_preload *preload;
+	size_t pos;
+
+	if ((!iter->fsmonitor && !iter->preload) ||
+	    git_index_snapshot_find(&pos, &iter->index_snapshot,
+			iter->base.entry_srch, path, path_len, 0) < 0)
+		return false;
+
+	entry = git_vector_get(&iter->index_snapshot, pos);
+	memset(st, 0, sizeof(struct stat));
+
+	if (iter->preload && iter->preload[pos].loaded) {
+		preload = &iter->preload[pos];
+
+		st->st_ctime = preload->ctime;
+		st->st_mtime = preload->mtime;
+#if defined(GIT_NSEC)
+		st->st_ctime_nsec = preload->ctime_nsec;
+		st->st_mtime_nsec = preload->mtime_nsec;
+#endif
+		st->st_size = preload->size;
+		st->st_ino = preload->ino;
+		st->st_dev = preload->dev;
+		st->st_mode = preload->mode;
+		st->st_uid = preload->uid;
+		st->st_gid = preload->gid;
+
+		return true;
+	}
+
+	if (!iter->fsmonitor ||
+	    !(entry->flags_extended & GIT_INDEX_ENTRY_FSMONITOR_VALID) ||
+	    (!S_ISREG(entry->mode) && !S_ISLNK(entry->mode)))
+		return false;
+
+	/* the reverse of `git_index_entry__init_from_stat` */
+	st->st_ctime = entry->ctime.seconds;
+	st->st_mtime = entry->mtime.seconds;
+#if defined(GIT_NSEC)
+	st->st_ctime_nsec = entry->ctime.nanoseconds;
+	st->st_mtime_nsec = entry->mtime.nanoseconds;
+#endif
+	st->st_rdev = entry->dev;
+	st->st_ino = entry->ino;
+	st->st_mode = entry->mode;
+	st->st_uid = entry->uid;
+	st->st_gid = entry->gid;
+	st->st_size = entry->file_size;
+
+	return true;
+}
+
+static int filesystem_iterator_index_child_srch(const void *key, const void *entry)
+{
+	return strcmp(key, ((const git_index_entry *)entry)->path);
+}
+
+static int filesystem_iterator_index_children(
+	git_vector *out,
+	git_pool *pool,
+	filesystem_iterator *iter,
+	const char *dir,
+	size_t dir_len)
+{
+	const git_index_entry *entry;
+	git_str key = GIT_STR_INIT;
+	const char *name, *slash;
+	char *child;
+	size_t pos = 0;
+	int error = 0;
+
+	if (git_str_put(&key, dir, dir_len) < 0)
+		return -1;
+
+	git_vector_bsearch2(&pos, &iter->index_snapshot,
+		filesystem_iterator_index_child_srch, key.ptr);
+
+	while ((entry = git_vector_get(&iter->index_snapshot, pos)) != NULL &&
+	       strncmp(entry->path, dir, dir_len) == 0) {
+		name = entry->path + dir_len;
+
+		if ((slash = strchr(name, '/')) == NULL) {
+			child = git_pool_strdup(pool, name);
+			pos++;
+		} else {
+			child = git_pool_strndup(pool, name, slash - name);
+
+			/* skip the rest of the directory; '0' sorts after '/' */
+			git_str_truncate(&key, dir_len);
+			git_str_put(&key, name, slash - name);
+			git_str_putc(&key, '0');
+
+			if ((error = git_str_oom(&key) ? -1 : 0) < 0)
+				break;
+
+			git_vector_bsearch2(&pos, &iter->index_snapshot,
+				filesystem_iterator_index_child_srch, key.ptr);
+		}
+
+		if (!child || (error = git_vector_insert(out, child)) < 0) {
+			error = -1;
+			break;
+		}
+	}
+
+	if (!error) {
+		git_vector_sort(out);
+		git_vector_uniq(out, NULL);
+	}
+
+	git_str_dispose(&key);
+	return error;
+}
+
+static int filesystem_iterator_frame_push_cached(
+	filesystem_iterator *iter,
+	filesystem_iterator_entry *frame_entry,
+	filesystem_iterator_frame *new_frame,
+	git_str *root,
+	git_untracked_cache_dir *cache_dir,
+	git_vector *names,
+	git_pool *pool)
+{
+	git_str path = GIT_STR_INIT;
+	const char *name;
+	struct stat statbuf;
+	size_t i, name_len;
+	int error = 0;
+
+	/* the cached names are the remaining contents of the directory */
+	git_vector_foreach(&cache_dir->untracked, i, name) {
+		char *stripped;
+
+		name_len = strlen(name);
+
+		if (name_len && name[name_len - 1] == '/')
+			name_len--;
+
+		if ((stripped = git_pool_strndup(pool, name, name_len)) == NULL ||
+		    git_vector_insert(names, stripped) < 0)
+			return -1;
+	}
+
+	git_vector_sort(names);
+	git_vector_uniq(names, NULL);
+
+	git_vector_foreach(names, i, name) {
+		iterator_pathlist_search_t pathlist_match = ITERATOR_PATHLIST_FULL;
+		bool dir_expected = false;
+		const char *relative;
+		size_t relative_len;
+
+		git_str_clear(&path);
+
+		if ((error = git_str_join(&path, '\0', root->ptr, name)) < 0 ||
+		    (error = git_path_validate_str_length(iter->base.repo, &path)) < 0)
+			break;
+
+		relative = path.ptr + iter->root_len;
+		relative_len = path.size - iter->root_len;
+
+		if (!filesystem_iterator_examine_path(&dir_expected, &pathlist_match,
+			iter, frame_entry, relative, relative_len))
+			continue;
+
+		if (!filesystem_iterator_known_stat(&statbuf,
+				iter, relative, relative_len) &&
+		    (error = git_fs_path_lstat(path.ptr, &statbuf)) < 0) {
+			/* file was removed since it was recorded */
+			if (error == GIT_ENOTFOUND) {
+				error = 0;
+				continue;
+			}
+
+			/* treat the file as unreadable */
+			memset(&statbuf, 0, sizeof(statbuf));
+			statbuf.st_mode = GIT_FILEMODE_UNREADABLE;
+
+			error = 0;
+		}
+
+		if ((error = filesystem_iterator_frame_add(iter, new_frame,
+				relative, relative_len, &statbuf,
+				dir_expected, pathlist_match)) < 0)
+			break;
+	}
+
+	git_str_dispose(&path);
+	return error;
+}
+
 static int filesystem_iterator_frame_push(
 	filesystem_iterator *iter,
 	filesystem_iterator_entry *frame_entry)
@@ -1352,10 +1834,15 @@ static int filesystem_iterator_frame_push(
 	filesystem_iterator_frame *new_frame = NULL;
 	git_fs_path_diriter diriter = GIT_FS_PATH_DIRITER_INIT;
 	git_str root = GIT_STR_INIT;
+	git_untracked_cache *cache;
+	git_untracked_cache_dir *cache_dir = NULL;
+	git_vector index_children = GIT_VECTOR_INIT,
+		untracked = GIT_VECTOR_INIT;
+	git_pool name_pool = {0};
 	const char *path;
-	filesystem_iterator_entry *entry;
-	struct stat statbuf;
+	struct stat statbuf, dir_st;
 	size_t path_len;
+	bool record = false;
 	int error;
 
 	if (iter->frames.size == FILESYSTEM_MAX_DEPTH) {
@@ -1382,29 +1869,64 @@ static int filesystem_iterator_frame_push(
 
 	new_frame->path_len = frame_entry ? frame_entry->path_len : 0;
 
-	/* Any error here is equivalent to the dir not existing, skip over it */
-	if ((error = git_fs_path_diriter_init(
-			&diriter, root.ptr, iter->dirload_flags)) < 0) {
-		error = GIT_ENOTFOUND;
-		goto done;
-	}
-
 	if ((error = git_vector_init(&new_frame->entries, 64,
 			iterator__ignore_case(&iter->base) ?
 			filesystem_iterator_entry_cmp_icase :
 			filesystem_iterator_entry_cmp)) < 0)
 		goto done;
 
-	if ((error = git_pool_init(&new_frame->entry_pool, 1)) < 0)
+	if ((error = git_pool_init(&new_frame->entry_pool, 1)) < 0 ||
+	    (error = git_pool_init(&name_pool, 1)) < 0)
 		goto done;
 
+	/* look the directory up in the untracked cache, if we have one */
+	if ((cache = filesystem_iterator_untracked(iter)) != NULL) {
+		const char *dir = frame_entry ? frame_entry->path : "";
+
+		if (frame_entry)
+			memcpy(&dir_st, &frame_entry->st, sizeof(struct stat));
+		else if (p_lstat(root.ptr, &dir_st) < 0)
+			cache = NULL;
+
+		if (cache &&
+		    ((error = git_untracked_cache_dir_lookup(&cache_dir, cache, dir)) < 0 ||
+		     (error = git_vector_init(&index_children, 16, git__strcmp_cb)) < 0 ||
+		     (error = filesystem_iterator_index_children(&index_children,
+				&name_pool, iter, dir, new_frame->path_len)) < 0))
+			goto done;
+	}
+
+	if (cache_dir && git_untracked_cache_dir_uptodate(cache_dir, &dir_st)) {
+		filesystem_iterator_frame_push_ignores(iter, frame_entry, new_frame);
+
+		error = filesystem_iterator_frame_push_cached(iter, frame_entry,
+			new_frame, &root, cache_dir, &index_children, &name_pool);
+		goto sort;
+	}
+
+	/* Any error here is equivalent to the dir not existing, skip over it */
+	if ((error = git_fs_path_diriter_init(
+			&diriter, root.ptr, iter->dirload_flags)) < 0) {
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
 	/* check if this directory is ignored */
 	filesystem_iterator_frame_push_ignores(iter, frame_entry, new_frame);
 
+	/* only a complete listing of the directory can be recorded */
+	record = (cache_dir != NULL &&
+		!iter->base.start_len && !iter->base.end_len &&
+		!iter->base.pathlist.length);
+
+	if (record && (error = git_vector_init(&untracked, 16, git__strcmp_cb)) < 0)
+		goto done;
+
 	while ((error = git_fs_path_diriter_next(&diriter)) == 0) {
 		iterator_pathlist_search_t pathlist_match = ITERATOR_PATHLIST_FULL;
 		git_str path_str = GIT_STR_INIT;
 		bool dir_expected = false;
+		int type;
 
 		if ((error = git_fs_path_diriter_fullpath(&path, &path_len, &diriter)) < 0)
 			goto done;
@@ -1430,11 +1952,24 @@ static int filesystem_iterator_frame_push(
 			iter, frame_entry, path, path_len))
 			continue;
 
-		/* TODO: don't need to stat if assume unchanged for this path and
-		 * we have an index, we can just copy the data out of it.
+		/*
+		 * When the directory listing includes the type of the item,
+		 * there's no need to examine the things that we don't iterate
+		 * over, or anything but a directory when one is expected.
 		 */
+		type = git_fs_path_diriter_type(&diriter);
+
+		if (type && type != S_IFDIR && type != S_IFREG && type != S_IFLNK)
+			continue;
+
+		if (type && dir_expected && type != S_IFDIR)
+			continue;
 
-		if ((error = git_fs_path_diriter_stat(&statbuf, &diriter)) < 0) {
+		/* the known stat data is stale if the item changed type */
+		if ((!filesystem_iterator_known_stat(&statbuf,
+				iter, path, path_len) ||
+		     (type && type != (int)(statbuf.st_mode & S_IFMT))) &&
+		    (error = git_fs_path_diriter_stat(&statbuf, &diriter)) < 0) {
 			/* file was removed between readdir and lstat */
 			if (error == GIT_ENOTFOUND)
 				continue;
@@ -1446,44 +1981,51 @@ static int filesystem_iterator_frame_push(
 			error = 0;
 		}
 
-		iter->base.stat_calls++;
+		if (record && !filesystem_iterator_is_dot_git(iter, path, path_len)) {
+			const char *name = path + new_frame->path_len;
+			size_t name_len = path_len - new_frame->path_len;
+			char *recorded;
 
-		/* Ignore wacky things in the filesystem */
-		if (!S_ISDIR(statbuf.st_mode) &&
-			!S_ISREG(statbuf.st_mode) &&
-			!S_ISLNK(statbuf.st_mode) &&
-			statbuf.st_mode != GIT_FILEMODE_UNREADABLE)
-			continue;
+			if (git_vector_bsearch(NULL, &index_children, name) < 0) {
+				if ((recorded = git__malloc(name_len + 2)) == NULL) {
+					error = -1;
+					goto done;
+				}
 
-		if (filesystem_iterator_is_dot_git(iter, path, path_len))
-			continue;
+				/* directories are recorded with a trailing slash */
+				memcpy(recorded, name, name_len);
 
-		/* convert submodules to GITLINK and remove trailing slashes */
-		if (S_ISDIR(statbuf.st_mode)) {
-			bool submodule = false;
+				if (S_ISDIR(statbuf.st_mode))
+					recorded[name_len++] = '/';
 
-			if ((error = filesystem_iterator_is_submodule(&submodule,
-					iter, path, path_len)) < 0)
-				goto done;
+				recorded[name_len] = '\0';
 
-			if (submodule)
-				statbuf.st_mode = GIT_FILEMODE_COMMIT;
+				if ((error = git_vector_insert(&untracked, recorded)) < 0) {
+					git__free(recorded);
+					goto done;
+				}
+			}
 		}
 
-		/* Ensure that the pathlist entry lines up with what we expected */
-		else if (dir_expected)
-			continue;
-
-		if ((error = filesystem_iterator_entry_init(&entry,
-			iter, new_frame, path, path_len, &statbuf, pathlist_match)) < 0)
+		if ((error = filesystem_iterator_frame_add(iter, new_frame,
+				path, path_len, &statbuf, dir_expected, pathlist_match)) < 0)
 			goto done;
-
-		git_vector_insert(&new_frame->entries, entry);
 	}
 
 	if (error == GIT_ITEROVER)
 		error = 0;
 
+	/*
+	 * A directory that is changed within the same second as it was
+	 * read may not get a new timestamp; only record older ones.
+	 */
+	if (!error && record && dir_st.st_mtime < time(NULL)) {
+		git_vector_sort(&untracked);
+		git_untracked_cache_dir_set(iter->untracked, cache_dir,
+			&untracked, &dir_st);
+	}
+
+sort:
 	/* sort now that directory suffix is added */
 	git_vector_sort(&new_frame->entries);
 
@@ -1491,6 +2033,9 @@ done:
 	if (error < 0)
 		git_array_pop(iter->frames);
 
+	git_vector_dispose_deep(&untracked);
+	git_vector_dispose(&index_children);
+	git_pool_clear(&name_pool);
 	git_str_dispose(&root);
 	git_fs_path_diriter_free(&diriter);
 	return error;
@@ -1918,6 +2463,7 @@ static void filesystem_iterator_free(git_iterator *i)
 	git_tree_free(iter->tree);
 	if (iter->index)
 		git_index_snapshot_release(&iter->index_snapshot, iter->index);
+	git__free(iter->preload);
 	filesystem_iterator_clear(iter);
 }
 
@@ -1990,7 +2536,10 @@ static int iterator_for_filesystem(
 
 	iter->oid_type = options->oid_type;
 
-	if ((error = filesystem_iterator_init(iter)) < 0)
+	if ((error = filesystem_iterator_untracked_init(iter)) < 0 ||
+	    (error = filesystem_iterator_fsmonitor_init(iter)) < 0 ||
+	    (error = filesystem_iterator_preload_init(iter)) < 0 ||
+	    (error = filesystem_iterator_init(iter)) < 0)
 		goto on_error;
 
 	*out = &iter->base;
@@ -2058,6 +2607,9 @@ typedef struct {
 	git_vector entries;
 	size_t next_idx;
 
+	/* the entries beneath the expanded sparse directories */
+	git_vector sparse_entries;
+
 	/* the pseudotree entry */
 	git_index_entry tree_entry;
 	git_str tree_buf;
@@ -2266,9 +2818,49 @@ static void index_iterator_free(git_iterator *i)
 	index_iterator *iter = GIT_CONTAINER_OF(i, index_iterator, base);
 
 	git_index_snapshot_release(&iter->entries, iter->base.index);
+	git_index__sparse_entries_free(&iter->sparse_entries);
 	git_str_dispose(&iter->tree_buf);
 }
 
+/*
+ * Replace the sparse directory entries of the snapshot with the entries
+ * beneath them, unless the caller asked to skip the directory.
+ */
+static int index_iterator_expand_sparse(index_iterator *iter)
+{
+	git_vector entries = GIT_VECTOR_INIT;
+	git_index_entry *entry;
+	size_t i;
+	int error;
+
+	if ((error = git_vector_init(&entries,
+			iter->entries.length, iter->entries._cmp)) < 0)
+		return error;
+
+	git_vector_foreach(&iter->entries, i, entry) {
+		if (!git_index_entry__is_sparse_dir(entry))
+			error = git_vector_insert(&entries, entry);
+		else if (!iter->base.sparse_skip ||
+		         !git_hashset_str_contains(iter->base.sparse_skip, entry->path))
+			error = git_index__sparse_entries(&iter->sparse_entries,
+				iter->base.index, entry);
+
+		if (error < 0)
+			goto done;
+	}
+
+	git_vector_foreach(&iter->sparse_entries, i, entry) {
+		if ((error = git_vector_insert(&entries, entry)) < 0)
+			goto done;
+	}
+
+	git_vector_swap(&iter->entries, &entries);
+
+done:
+	git_vector_dispose(&entries);
+	return error;
+}
+
 int git_iterator_for_index(
 	git_iterator **out,
 	git_repository *repo,
@@ -2300,6 +2892,7 @@ int git_iterator_for_index(
 
 	if ((error = iterator_init_common(&iter->base, repo, index, options)) < 0 ||
 		(error = git_index_snapshot_new(&iter->entries, index)) < 0 ||
+		(index->sparse && (error = index_iterator_expand_sparse(iter)) < 0) ||
 		(error = index_iterator_init(iter)) < 0)
 		goto on_error;
 
@@ -13,6 +13,7 @@
 #include "vector.h"
 #include "str.h"
 #include "ignore.h"
+#include "hashmap_str.h"
 
 typedef struct git_iterator git_iterator;
 
@@ -66,6 +67,12 @@ typedef struct {
 
 	/* oid type - necessary for non-workdir filesystem iterators */
 	git_oid_t oid_type;
+
+	/* directories (with a trailing slash) that are not iterated: the
+	 * sparse directory entries of an index that are not expanded, and
+	 * the trees at those paths.
+	 */
+	git_hashset_str *sparse_skip;
 } git_iterator_options;
 
 #define GIT_ITERATOR_OPTIONS_INIT {0}
@@ -103,6 +110,7 @@ struct git_iterator {
 	int (*entry_srch)(const void *key, const void *array_member);
 	size_t stat_calls;
 	unsigned int flags;
+	git_hashset_str *sparse_skip;
 };
 
 extern int git_iterator_for_nothing(
@@ -21,6 +21,7 @@
 #include "settings.h"
 #include "sysdir.h"
 #include "thread.h"
+#include "zstream.h"
 #include "git2/global.h"
 #include "streams/registry.h"
 #include "streams/mbedtls.h"
@@ -54,6 +55,7 @@ int git_libgit2_init(void)
 		git_mbedtls_stream_global_init,
 		git_mwindow_global_init,
 		git_pool_global_init,
+		git_zstream_global_init,
 		git_settings_global_init,
 		git_reftable_global_init
 	};
@@ -3091,6 +3091,9 @@ int git_merge__check_result(git_repository *repo, git_index *index_new)
 			goto done;
 	}
 
+	if ((error = git_index__ensure_full(index_new)) < 0)
+		goto done;
+
 	for (i = 0; i < git_index_entrycount(index_new); i++) {
 		e = git_index_get_byindex(index_new, i);
 
@@ -3137,7 +3140,8 @@ int git_merge__append_conflicts_to_merge_msg(
 	if (!git_index_has_conflicts(index))
 		return 0;
 
-	if ((error = git_str_joinpath(&file_path, repo->gitdir, GIT_MERGE_MSG_FILE)) < 0 ||
+	if ((error = git_index__ensure_full(index)) < 0 ||
+		(error = git_str_joinpath(&file_path, repo->gitdir, GIT_MERGE_MSG_FILE)) < 0 ||
 		(error = git_filebuf_open(&file, file_path.ptr, GIT_FILEBUF_APPEND, GIT_MERGE_FILE_MODE)) < 0)
 		goto cleanup;
 
@@ -716,7 +716,7 @@ static int midx_write(
 	checksum_size = git_hash_size(checksum_type);
 	GIT_ASSERT(oid_size && checksum_type && checksum_size);
 
-	if ((error = git_hash_ctx_init(&ctx, checksum_type)) < 0)
+	if ((error = git_hash_ctx_init_ext(&ctx, checksum_type, GIT_HASH_TRUSTED)) < 0)
 		return error;
 
 	cb_data = &hash_cb_data;
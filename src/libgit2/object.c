@@ -623,6 +623,11 @@ GIT_INLINE(bool) needs_filter(git_object_id_options *opts)
 	        (!opts->object_type || opts->object_type == GIT_OBJECT_BLOB));
 }
 
+GIT_INLINE(unsigned int) hash_flags(const git_object_id_options *opts)
+{
+	return (opts->flags & GIT_OBJECT_ID_TRUSTED) ? GIT_HASH_TRUSTED : 0;
+}
+
 GIT_INLINE(int) normalize_options(
 	git_object_id_options *normalized,
 	const git_object_id_options *given_opts)
@@ -643,8 +648,10 @@ GIT_INLINE(int) normalize_options(
 		return -1;
 	}
 
-	if (given_opts)
+	if (given_opts) {
 		normalized->filters = given_opts->filters;
+		normalized->flags = given_opts->flags;
+	}
 
 	return 0;
 }
@@ -665,7 +672,8 @@ static int id_from_fd(
 
 	algorithm = git_oid_algorithm(opts->oid_type);
 
-	if ((error = git_hash_ctx_init(&ctx, algorithm)) < 0)
+	if ((error = git_hash_ctx_init_ext(&ctx, algorithm,
+			hash_flags(opts))) < 0)
 		return error;
 
 	if ((error = git_odb__format_object_header(&hdr_len, hdr,
@@ -872,7 +880,7 @@ static int id_from_buffer(
 	id->type = opts->oid_type;
 #endif
 
-	return git_hash_vec(id->id, vec, 2, algorithm);
+	return git_hash_vec_ext(id->id, vec, 2, algorithm, hash_flags(opts));
 }
 
 int git_object_id_from_buffer(
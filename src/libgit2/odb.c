@@ -162,6 +162,56 @@ void git_odb_object_free(git_odb_object *object)
 	git_cached_obj_decref(object);
 }
 
+#define HASH_RAWOBJS_BATCH 64
+
+int git_odb__hash_rawobjs(
+	git_oid *ids,
+	const git_rawobj *objs,
+	size_t n,
+	git_oid_t oid_type)
+{
+	git_str_vec vec[HASH_RAWOBJS_BATCH * 2];
+	char headers[HASH_RAWOBJS_BATCH][64];
+	unsigned char out[HASH_RAWOBJS_BATCH * GIT_HASH_MAX_SIZE];
+	git_hash_algorithm_t algorithm = git_oid_algorithm(oid_type);
+	size_t hash_size = git_hash_size(algorithm), batch, hdrlen, i, j;
+	int error;
+
+	for (i = 0; i < n; i += batch) {
+		batch = min(n - i, HASH_RAWOBJS_BATCH);
+
+		for (j = 0; j < batch; j++) {
+			const git_rawobj *obj = &objs[i + j];
+
+			if (!obj->data && obj->len != 0) {
+				git_error_set(GIT_ERROR_INVALID, "invalid object");
+				return -1;
+			}
+
+			if ((error = git_odb__format_object_header(&hdrlen,
+					headers[j], sizeof(headers[j]),
+					obj->len, obj->type)) < 0)
+				return error;
+
+			vec[j * 2].data = headers[j];
+			vec[j * 2].len = hdrlen;
+			vec[j * 2 + 1].data = obj->data;
+			vec[j * 2 + 1].len = obj->len;
+		}
+
+		if ((error = git_hash_vec_multi(out, vec, 2, batch, algorithm, 0)) < 0)
+			return error;
+
+		for (j = 0; j < batch; j++) {
+			if ((error = git_oid_from_raw(&ids[i + j],
+					out + (j * hash_size), oid_type)) < 0)
+				return error;
+		}
+	}
+
+	return 0;
+}
+
 #ifndef GIT_DEPRECATE_HARD
 
 int git_odb_hashfile(
@@ -486,6 +536,11 @@ int git_odb__add_default_backends(
 	loose_opts.oid_type = db->options.oid_type;
 	pack_opts.oid_type = db->options.oid_type;
 
+	if (!as_alternates && !db->objects_dir) {
+		db->objects_dir = git__strdup(objects_dir);
+		GIT_ERROR_CHECK_ALLOC(db->objects_dir);
+	}
+
 	/* add the loose object backend */
 	if (git_odb__backend_loose(&loose, objects_dir, &loose_opts) < 0 ||
 		add_backend_internal(db, loose, git_odb__loose_priority, as_alternates, inode) < 0)
@@ -659,6 +714,9 @@ static void odb_free(git_odb *db)
 		git_mutex_unlock(&db->lock);
 
 	git_commit_graph_free(db->cgraph);
+	git_futils_fsync_batch_dispose(db->fsync_batch);
+	git__free(db->fsync_batch);
+	git__free(db->objects_dir);
 	git_vector_dispose(&db->backends);
 	git_cache_dispose(&db->own_cache);
 	git_mutex_free(&db->lock);
@@ -771,6 +829,50 @@ int git_odb__freshen(git_odb *db, const git_oid *id)
 	return 0;
 }
 
+int git_odb__pack_location(
+	struct git_pack_file **pack,
+	off64_t *offset,
+	size_t *size,
+	git_odb *db,
+	const git_oid *id)
+{
+	size_t i;
+	int error;
+
+	GIT_ASSERT_ARG(pack);
+	GIT_ASSERT_ARG(offset);
+	GIT_ASSERT_ARG(size);
+	GIT_ASSERT_ARG(db);
+	GIT_ASSERT_ARG(id);
+
+	if ((error = git_mutex_lock(&db->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to acquire the odb lock");
+		return error;
+	}
+
+	error = GIT_ENOTFOUND;
+
+	for (i = 0; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+
+		error = git_odb__backend_pack_location(
+			pack, offset, size, internal->backend, id);
+
+		if (error != GIT_ENOTFOUND && error != GIT_PASSTHROUGH)
+			break;
+	}
+
+	git_mutex_unlock(&db->lock);
+
+	if (error == GIT_PASSTHROUGH)
+		error = GIT_ENOTFOUND;
+
+	if (error == GIT_ENOTFOUND)
+		git_error_clear();
+
+	return error;
+}
+
 int git_odb_exists(git_odb *db, const git_oid *id)
 {
     return git_odb_exists_ext(db, id, 0);
@@ -1379,6 +1481,7 @@ int git_odb_write(
 
 	id_opts.object_type = type;
 	id_opts.oid_type = db->options.oid_type;
+	id_opts.flags = GIT_OBJECT_ID_TRUSTED;
 
 	GIT_ASSERT_ARG(oid);
 	GIT_ASSERT_ARG(db);
@@ -1484,7 +1587,7 @@ int git_odb_open_wstream(
 	ctx = git__malloc(sizeof(git_hash_ctx));
 	GIT_ERROR_CHECK_ALLOC(ctx);
 
-	if ((error = git_hash_ctx_init(ctx, git_oid_algorithm(db->options.oid_type))) < 0 ||
+	if ((error = git_hash_ctx_init_ext(ctx, git_oid_algorithm(db->options.oid_type), GIT_HASH_TRUSTED)) < 0 ||
 	    (error = hash_header(ctx, size, type)) < 0)
 		goto done;
 
@@ -1664,6 +1767,139 @@ int git_odb_write_multi_pack_index(git_odb *db)
 	return error;
 }
 
+int git_odb_bulk_begin(git_odb *db)
+{
+	git_odb_backend *bulk;
+
+	GIT_ASSERT_ARG(db);
+
+	if (!db->objects_dir) {
+		git_error_set(GIT_ERROR_ODB, "cannot begin a bulk write session on an object database without an objects directory");
+		return -1;
+	}
+
+	if (db->bulk) {
+		git_error_set(GIT_ERROR_ODB, "a bulk write session is already in progress");
+		return -1;
+	}
+
+	if (git_odb__backend_bulk(&bulk, db->objects_dir, db->options.oid_type,
+		db->do_fsync || git_repository__fsync_gitdir) < 0)
+		return -1;
+
+	if (add_backend_internal(db, bulk, GIT_ODB_BULK_PRIORITY, false, 0) < 0) {
+		bulk->free(bulk);
+		return -1;
+	}
+
+	db->bulk = bulk;
+	return 0;
+}
+
+static int odb_bulk_end(git_odb *db, bool commit)
+{
+	backend_internal *internal;
+	git_odb_backend *bulk = NULL;
+	size_t i;
+	int error = 0;
+
+	GIT_ASSERT_ARG(db);
+
+	if (!db->bulk) {
+		git_error_set(GIT_ERROR_ODB, "no bulk write session is in progress");
+		return -1;
+	}
+
+	if ((error = git_mutex_lock(&db->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to acquire the odb lock");
+		return error;
+	}
+
+	/*
+	 * Readers are locked out while the packfile is finalized, so
+	 * that the objects disappear from the bulk backend only once
+	 * they can be found by the packfile backend.
+	 */
+	if (commit && (error = git_odb__backend_bulk_commit(db->bulk)) < 0) {
+		git_mutex_unlock(&db->lock);
+		return error;
+	}
+
+	git_vector_foreach(&db->backends, i, internal) {
+		if (internal->backend == db->bulk) {
+			git_vector_remove(&db->backends, i);
+			bulk = internal->backend;
+			git__free(internal);
+			break;
+		}
+	}
+
+	db->bulk = NULL;
+	git_mutex_unlock(&db->lock);
+
+	if (bulk)
+		bulk->free(bulk);
+
+	if (commit)
+		error = git_odb_refresh(db);
+
+	return error;
+}
+
+int git_odb_bulk_commit(git_odb *db)
+{
+	return odb_bulk_end(db, true);
+}
+
+int git_odb_bulk_abort(git_odb *db)
+{
+	return odb_bulk_end(db, false);
+}
+
+int git_odb_fsync_batch_begin(git_odb *db)
+{
+	git_futils_fsync_batch *batch;
+
+	GIT_ASSERT_ARG(db);
+
+	if (db->fsync_batch) {
+		git_error_set(GIT_ERROR_ODB, "an fsync batch is already in progress");
+		return -1;
+	}
+
+	batch = git__malloc(sizeof(git_futils_fsync_batch));
+	GIT_ERROR_CHECK_ALLOC(batch);
+
+	if (git_futils_fsync_batch_init(batch) < 0) {
+		git__free(batch);
+		return -1;
+	}
+
+	db->fsync_batch = batch;
+	return 0;
+}
+
+int git_odb_fsync_batch_commit(git_odb *db)
+{
+	git_futils_fsync_batch *batch;
+	int error;
+
+	GIT_ASSERT_ARG(db);
+
+	if ((batch = db->fsync_batch) == NULL) {
+		git_error_set(GIT_ERROR_ODB, "no fsync batch is in progress");
+		return -1;
+	}
+
+	error = git_futils_fsync_batch_commit(batch);
+
+	db->fsync_batch = NULL;
+	git_futils_fsync_batch_dispose(batch);
+	git__free(batch);
+
+	return error;
+}
+
 void *git_odb_backend_data_alloc(git_odb_backend *backend, size_t len)
 {
 	GIT_UNUSED(backend);
@@ -18,15 +18,19 @@
 #include "cache.h"
 #include "commit_graph.h"
 #include "filter.h"
+#include "futils.h"
 #include "posix.h"
 #include "vector.h"
 
+struct git_pack_file;
+
 #define GIT_OBJECTS_DIR "objects/"
 #define GIT_OBJECT_DIR_MODE 0777
 #define GIT_OBJECT_FILE_MODE 0444
 
 #define GIT_ODB_DEFAULT_LOOSE_PRIORITY 1
 #define GIT_ODB_DEFAULT_PACKED_PRIORITY 2
+#define GIT_ODB_BULK_PRIORITY 1000
 
 extern bool git_odb__strict_hash_verification;
 
@@ -51,6 +55,9 @@ struct git_odb {
 	git_vector backends;
 	git_cache own_cache;
 	git_commit_graph *cgraph;
+	char *objects_dir;
+	git_odb_backend *bulk;
+	git_futils_fsync_batch *fsync_batch;
 	unsigned int do_fsync :1;
 };
 
@@ -75,6 +82,17 @@ int git_odb__add_default_backends(
  */
 int git_odb__format_object_header(size_t *out_len, char *hdr, size_t hdr_size, git_object_size_t obj_len, git_object_t obj_type);
 
+/*
+ * Calculate the object IDs of several (unfiltered) raw objects at once;
+ * depending on the hash implementation, small objects may be hashed in
+ * parallel.
+ */
+int git_odb__hash_rawobjs(
+	git_oid *ids,
+	const git_rawobj *objs,
+	size_t n,
+	git_oid_t oid_type);
+
 /**
  * Generate a GIT_EMISMATCH error for the ODB.
  */
@@ -113,6 +131,48 @@ int git_odb__freshen(git_odb *db, const git_oid *id);
 /* fully free the object; internal method, DO NOT EXPORT */
 void git_odb_object__free(void *object);
 
+/*
+ * Create a backend that appends every object written to it to a single
+ * temporary packfile in `objects_dir`, for bulk write sessions.
+ */
+int git_odb__backend_bulk(
+	git_odb_backend **out,
+	const char *objects_dir,
+	git_oid_t oid_type,
+	bool do_fsync);
+
+/*
+ * Finalize the packfile of a bulk backend and write its index; the
+ * objects will then be readable by the packfile backend once the odb
+ * is refreshed.
+ */
+int git_odb__backend_bulk_commit(git_odb_backend *backend);
+
+/*
+ * Find the packfile that an object is stored in, the offset of the
+ * object in it and its inflated size, so that reads of many objects can
+ * be made in pack order.  The size of a delta is read from the delta,
+ * without resolving its chain.  Returns GIT_ENOTFOUND when the object
+ * is not packed.
+ */
+int git_odb__pack_location(
+	struct git_pack_file **pack,
+	off64_t *offset,
+	size_t *size,
+	git_odb *db,
+	const git_oid *id);
+
+/*
+ * The pack location of an object in a packfile backend; returns
+ * GIT_PASSTHROUGH when `backend` is not a packfile backend.
+ */
+int git_odb__backend_pack_location(
+	struct git_pack_file **pack,
+	off64_t *offset,
+	size_t *size,
+	git_odb_backend *backend,
+	const git_oid *id);
+
 /* SHA256 support */
 
 int git_odb__backend_loose(
@@ -0,0 +1,800 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "odb.h"
+
+#include <zlib.h>
+
+#include "filebuf.h"
+#include "futils.h"
+#include "hash.h"
+#include "hashmap_oid.h"
+#include "pack.h"
+#include "vector.h"
+#include "zstream.h"
+
+#include "git2/sys/odb_backend.h"
+
+#define BULK_BUFFER_SIZE (1024 * 1024)
+#define UINT31_MAX (0x7FFFFFFF)
+
+/*
+ * A bulk write session appends every object that is written to the
+ * object database to a single, temporary packfile. Objects are stored
+ * undeltified, so that they can be read back (and the final index be
+ * written) without any further inflating or hashing: we remember the
+ * location, type, size and CRC of every object in memory as it is
+ * written. On commit, the pack header is fixed up with the final object
+ * count, the pack checksum is computed and the `.pack` and `.idx` files
+ * take their final names.
+ */
+
+struct bulk_entry {
+	git_oid oid;
+	git_object_t type;
+	size_t size;
+	off64_t offset;
+	off64_t data_offset;
+	size_t data_len;
+	uint32_t crc;
+};
+
+GIT_HASHMAP_OID_SETUP(git_odb_bulk_oidmap, struct bulk_entry *);
+
+typedef struct {
+	git_odb_backend parent;
+	git_mutex lock;
+
+	git_oid_t oid_type;
+	unsigned int do_fsync : 1,
+	             streaming : 1;
+
+	char *pack_dir;
+	git_str tmp_path;
+	int fd;
+	off64_t size;
+
+	git_vector entries;
+	git_odb_bulk_oidmap objects;
+	git_str deflated;
+} bulk_backend;
+
+typedef struct {
+	git_odb_stream parent;
+	struct bulk_entry entry;
+	git_zstream zstream;
+	unsigned char *zbuf;
+	size_t written;
+} bulk_writestream;
+
+static int bulk_entry_cmp(const void *a, const void *b)
+{
+	const struct bulk_entry *entry_a = a;
+	const struct bulk_entry *entry_b = b;
+
+	return git_oid_cmp(&entry_a->oid, &entry_b->oid);
+}
+
+static int bulk_write_at(
+	bulk_backend *bulk,
+	const void *data,
+	size_t len,
+	off64_t offset)
+{
+	const char *ptr = data;
+
+	while (len > 0) {
+		ssize_t written;
+
+		HANDLE_EINTR(written, p_pwrite(bulk->fd, ptr, len, offset));
+
+		if (written <= 0) {
+			git_error_set(GIT_ERROR_OS, "cannot write to bulk packfile '%s'",
+				bulk->tmp_path.ptr);
+			return -1;
+		}
+
+		ptr += written;
+		offset += written;
+		len -= written;
+	}
+
+	return 0;
+}
+
+static int bulk_read_at(
+	bulk_backend *bulk,
+	void *data,
+	size_t len,
+	off64_t offset)
+{
+	char *ptr = data;
+
+	while (len > 0) {
+		ssize_t nread;
+
+		HANDLE_EINTR(nread, p_pread(bulk->fd, ptr, len, offset));
+
+		if (nread <= 0) {
+			git_error_set(GIT_ERROR_OS, "cannot read from bulk packfile '%s'",
+				bulk->tmp_path.ptr);
+			return -1;
+		}
+
+		ptr += nread;
+		offset += nread;
+		len -= nread;
+	}
+
+	return 0;
+}
+
+static int bulk_append(bulk_backend *bulk, const void *data, size_t len, uint32_t *crc)
+{
+	int error;
+
+	if ((error = bulk_write_at(bulk, data, len, bulk->size)) < 0)
+		return error;
+
+	*crc = crc32(*crc, data, (uInt)len);
+	bulk->size += len;
+	return 0;
+}
+
+static int bulk_append_header(
+	bulk_backend *bulk,
+	struct bulk_entry *entry,
+	size_t size,
+	git_object_t type)
+{
+	unsigned char hdr[10];
+	size_t hdr_len;
+	int error;
+
+	entry->type = type;
+	entry->size = size;
+	entry->offset = bulk->size;
+	entry->crc = crc32(0L, Z_NULL, 0);
+
+	if ((error = git_packfile__object_header(&hdr_len, hdr, size, type)) < 0 ||
+	    (error = bulk_append(bulk, hdr, hdr_len, &entry->crc)) < 0)
+		return error;
+
+	entry->data_offset = bulk->size;
+	return 0;
+}
+
+static int bulk_insert(bulk_backend *bulk, const struct bulk_entry *src)
+{
+	struct bulk_entry *entry;
+
+	entry = git__malloc(sizeof(struct bulk_entry));
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	memcpy(entry, src, sizeof(struct bulk_entry));
+
+	if (git_vector_insert(&bulk->entries, entry) < 0 ||
+	    git_odb_bulk_oidmap_put(&bulk->objects, &entry->oid, entry) < 0) {
+		git__free(entry);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Forget an object that was partially appended to the pack. */
+static void bulk_truncate(bulk_backend *bulk, off64_t offset)
+{
+	if (p_ftruncate(bulk->fd, offset) == 0)
+		bulk->size = offset;
+}
+
+static int bulk_backend__write(
+	git_odb_backend *_backend,
+	const git_oid *oid,
+	const void *data,
+	size_t len,
+	git_object_t type)
+{
+	bulk_backend *bulk = (bulk_backend *)_backend;
+	struct bulk_entry entry = { 0 };
+	off64_t start = 0;
+	int error;
+
+	if ((error = git_mutex_lock(&bulk->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk write session");
+		return error;
+	}
+
+	if (git_odb_bulk_oidmap_contains(&bulk->objects, oid))
+		goto done;
+
+	/* the pack is busy with a streaming write; let another backend have it */
+	if (bulk->streaming) {
+		git_error_set(GIT_ERROR_ODB, "bulk write session is busy");
+		error = -1;
+		goto done;
+	}
+
+	start = bulk->size;
+
+	git_str_clear(&bulk->deflated);
+	git_oid_cpy(&entry.oid, oid);
+
+	if ((error = git_zstream_deflatebuf(&bulk->deflated, data, len)) < 0 ||
+	    (error = bulk_append_header(bulk, &entry, len, type)) < 0 ||
+	    (error = bulk_append(bulk, bulk->deflated.ptr, bulk->deflated.size, &entry.crc)) < 0)
+		goto done;
+
+	entry.data_len = bulk->deflated.size;
+	error = bulk_insert(bulk, &entry);
+
+done:
+	if (error < 0 && start)
+		bulk_truncate(bulk, start);
+
+	git_mutex_unlock(&bulk->lock);
+	return error;
+}
+
+static int bulk_writestream_flush(bulk_writestream *stream, bool finish)
+{
+	bulk_backend *bulk = (bulk_backend *)stream->parent.backend;
+	size_t zbuf_len;
+	int error;
+
+	do {
+		zbuf_len = BULK_BUFFER_SIZE;
+
+		if (finish)
+			error = git_zstream_get_output(stream->zbuf, &zbuf_len, &stream->zstream);
+		else
+			error = git_zstream_get_output_chunk(stream->zbuf, &zbuf_len, &stream->zstream);
+
+		if (error < 0 ||
+		    (error = bulk_append(bulk, stream->zbuf, zbuf_len, &stream->entry.crc)) < 0)
+			return error;
+	} while (finish ? !git_zstream_done(&stream->zstream) :
+	         (stream->zstream.in_len || zbuf_len == BULK_BUFFER_SIZE));
+
+	return 0;
+}
+
+static int bulk_writestream_write(git_odb_stream *_stream, const char *data, size_t len)
+{
+	bulk_writestream *stream = (bulk_writestream *)_stream;
+	int error;
+
+	if ((error = git_zstream_set_partial_input(&stream->zstream, data, len)) < 0 ||
+	    (error = bulk_writestream_flush(stream, false)) < 0)
+		return error;
+
+	stream->written += len;
+	return 0;
+}
+
+static int bulk_writestream_finalize(git_odb_stream *_stream, const git_oid *oid)
+{
+	bulk_writestream *stream = (bulk_writestream *)_stream;
+	bulk_backend *bulk = (bulk_backend *)stream->parent.backend;
+	int error;
+
+	if ((error = git_zstream_set_input(&stream->zstream, NULL, 0)) < 0 ||
+	    (error = bulk_writestream_flush(stream, true)) < 0)
+		return error;
+
+	git_oid_cpy(&stream->entry.oid, oid);
+	stream->entry.data_len = (size_t)(bulk->size - stream->entry.data_offset);
+
+	if ((error = git_mutex_lock(&bulk->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk write session");
+		return error;
+	}
+
+	if (!git_odb_bulk_oidmap_contains(&bulk->objects, oid) &&
+	    (error = bulk_insert(bulk, &stream->entry)) == 0)
+		stream->entry.offset = 0;
+
+	git_mutex_unlock(&bulk->lock);
+	return error;
+}
+
+static void bulk_writestream_free(git_odb_stream *_stream)
+{
+	bulk_writestream *stream = (bulk_writestream *)_stream;
+	bulk_backend *bulk = (bulk_backend *)stream->parent.backend;
+
+	/*
+	 * If the object was not finalized (or was already known to us)
+	 * then drop what we appended to the pack for it.
+	 */
+	if (git_mutex_lock(&bulk->lock) == 0) {
+		if (stream->entry.offset)
+			bulk_truncate(bulk, stream->entry.offset);
+
+		bulk->streaming = 0;
+		git_mutex_unlock(&bulk->lock);
+	}
+
+	git_zstream_free(&stream->zstream);
+	git__free(stream->zbuf);
+	git__free(stream);
+}
+
+static int bulk_backend__writestream(
+	git_odb_stream **out,
+	git_odb_backend *_backend,
+	git_object_size_t length,
+	git_object_t type)
+{
+	bulk_backend *bulk = (bulk_backend *)_backend;
+	bulk_writestream *stream;
+	int error;
+
+	if (!git__is_sizet(length)) {
+		git_error_set(GIT_ERROR_ODB, "object is too large for a bulk write session");
+		return -1;
+	}
+
+	stream = git__calloc(1, sizeof(bulk_writestream));
+	GIT_ERROR_CHECK_ALLOC(stream);
+
+	stream->zbuf = git__malloc(BULK_BUFFER_SIZE);
+	GIT_ERROR_CHECK_ALLOC(stream->zbuf);
+
+	if ((error = git_zstream_init(&stream->zstream, GIT_ZSTREAM_DEFLATE)) < 0)
+		goto on_error;
+
+	if ((error = git_mutex_lock(&bulk->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk write session");
+		goto on_error;
+	}
+
+	if (bulk->streaming) {
+		git_error_set(GIT_ERROR_ODB, "bulk write session is busy");
+		error = -1;
+	} else if ((error = bulk_append_header(bulk, &stream->entry, (size_t)length, type)) < 0) {
+		bulk_truncate(bulk, stream->entry.offset);
+	} else {
+		bulk->streaming = 1;
+	}
+
+	git_mutex_unlock(&bulk->lock);
+
+	if (error < 0)
+		goto on_error;
+
+	stream->parent.backend = _backend;
+	stream->parent.mode = GIT_STREAM_WRONLY;
+	stream->parent.write = &bulk_writestream_write;
+	stream->parent.finalize_write = &bulk_writestream_finalize;
+	stream->parent.free = &bulk_writestream_free;
+
+	*out = (git_odb_stream *)stream;
+	return 0;
+
+on_error:
+	git_zstream_free(&stream->zstream);
+	git__free(stream->zbuf);
+	git__free(stream);
+	return error;
+}
+
+static int bulk_lookup(
+	struct bulk_entry **out,
+	bulk_backend *bulk,
+	const git_oid *oid)
+{
+	size_t oid_hexsize = git_oid_hexsize(bulk->oid_type);
+
+	if (git_odb_bulk_oidmap_get(out, &bulk->objects, oid) != 0)
+		return git_odb__error_notfound("object not found in bulk write session",
+			oid, oid_hexsize);
+
+	return 0;
+}
+
+static int bulk_backend__read(
+	void **buffer_p,
+	size_t *len_p,
+	git_object_t *type_p,
+	git_odb_backend *_backend,
+	const git_oid *oid)
+{
+	bulk_backend *bulk = (bulk_backend *)_backend;
+	struct bulk_entry *entry;
+	git_str deflated = GIT_STR_INIT, inflated = GIT_STR_INIT;
+	int error;
+
+	if ((error = git_mutex_lock(&bulk->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk write session");
+		return error;
+	}
+
+	if ((error = bulk_lookup(&entry, bulk, oid)) < 0 ||
+	    (error = git_str_grow(&deflated, entry->data_len)) < 0 ||
+	    (error = bulk_read_at(bulk, deflated.ptr, entry->data_len, entry->data_offset)) < 0)
+		goto done;
+
+	deflated.size = entry->data_len;
+
+	if ((error = git_zstream_inflatebuf(&inflated, deflated.ptr, deflated.size)) < 0)
+		goto done;
+
+	if (inflated.size != entry->size) {
+		git_error_set(GIT_ERROR_ODB, "corrupt object in bulk write session");
+		error = -1;
+		goto done;
+	}
+
+	*len_p = entry->size;
+	*type_p = entry->type;
+	*buffer_p = git_str_detach(&inflated);
+
+done:
+	git_mutex_unlock(&bulk->lock);
+	git_str_dispose(&deflated);
+	git_str_dispose(&inflated);
+	return error;
+}
+
+static int bulk_backend__read_header(
+	size_t *len_p,
+	git_object_t *type_p,
+	git_odb_backend *_backend,
+	const git_oid *oid)
+{
+	bulk_backend *bulk = (bulk_backend *)_backend;
+	struct bulk_entry *entry;
+	int error;
+
+	if ((error = git_mutex_lock(&bulk->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk write session");
+		return error;
+	}
+
+	if ((error = bulk_lookup(&entry, bulk, oid)) == 0) {
+		*len_p = entry->size;
+		*type_p = entry->type;
+	}
+
+	git_mutex_unlock(&bulk->lock);
+	return error;
+}
+
+static int bulk_backend__exists(git_odb_backend *_backend, const git_oid *oid)
+{
+	bulk_backend *bulk = (bulk_backend *)_backend;
+	int exists;
+
+	if (git_mutex_lock(&bulk->lock) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk write session");
+		return -1;
+	}
+
+	exists = git_odb_bulk_oidmap_contains(&bulk->objects, oid);
+
+	git_mutex_unlock(&bulk->lock);
+	return exists;
+}
+
+static int bulk_backend__foreach(
+	git_odb_backend *_backend,
+	git_odb_foreach_cb cb,
+	void *payload)
+{
+	bulk_backend *bulk = (bulk_backend *)_backend;
+	struct bulk_entry *entry;
+	git_oid *oids;
+	size_t oids_len, i;
+	int error = 0;
+
+	/*
+	 * Objects may be written while the callback runs, so it's given
+	 * a copy of the ids rather than the entries themselves.
+	 */
+	if ((error = git_mutex_lock(&bulk->lock)) < 0) {
+		git_error_set(GIT_ERROR_ODB, "failed to lock bulk write session");
+		return error;
+	}
+
+	oids_len = bulk->entries.length;
+	oids = git__calloc(oids_len ? oids_len : 1, sizeof(git_oid));
+
+	if (oids) {
+		git_vector_foreach(&bulk->entries, i, entry)
+			git_oid_cpy(&oids[i], &entry->oid);
+	}
+
+	git_mutex_unlock(&bulk->lock);
+	GIT_ERROR_CHECK_ALLOC(oids);
+
+	for (i = 0; i < oids_len; i++) {
+		if ((error = cb(&oids[i], payload)) != 0) {
+			error = git_error_set_after_callback(error);
+			break;
+		}
+	}
+
+	git__free(oids);
+	return error;
+}
+
+static void bulk_backend__free(git_odb_backend *_backend)
+{
+	bulk_backend *bulk = (bulk_backend *)_backend;
+	struct bulk_entry *entry;
+	size_t i;
+
+	if (!bulk)
+		return;
+
+	if (bulk->fd >= 0) {
+		p_close(bulk->fd);
+		p_unlink(bulk->tmp_path.ptr);
+	}
+
+	git_vector_foreach(&bulk->entries, i, entry)
+		git__free(entry);
+
+	git_vector_dispose(&bulk->entries);
+	git_odb_bulk_oidmap_dispose(&bulk->objects);
+	git_str_dispose(&bulk->deflated);
+	git_str_dispose(&bulk->tmp_path);
+	git__free(bulk->pack_dir);
+	git_mutex_free(&bulk->lock);
+	git__free(bulk);
+}
+
+int git_odb__backend_bulk(
+	git_odb_backend **out,
+	const char *objects_dir,
+	git_oid_t oid_type,
+	bool do_fsync)
+{
+	bulk_backend *bulk;
+	struct git_pack_header hdr;
+	git_str path = GIT_STR_INIT;
+	uint32_t crc = 0;
+	int error = -1;
+
+	bulk = git__calloc(1, sizeof(bulk_backend));
+	GIT_ERROR_CHECK_ALLOC(bulk);
+
+	bulk->fd = -1;
+	bulk->oid_type = oid_type;
+	bulk->do_fsync = do_fsync;
+
+	if (git_mutex_init(&bulk->lock) < 0) {
+		git__free(bulk);
+		return -1;
+	}
+
+	if (git_vector_init(&bulk->entries, 0, bulk_entry_cmp) < 0 ||
+	    git_str_joinpath(&path, objects_dir, "pack") < 0 ||
+	    git_futils_mkdir(path.ptr, GIT_OBJECT_DIR_MODE, GIT_MKDIR_PATH) < 0)
+		goto done;
+
+	bulk->pack_dir = git_str_detach(&path);
+
+	if (git_str_joinpath(&path, bulk->pack_dir, "pack") < 0 ||
+	    (bulk->fd = git_futils_mktmp(&bulk->tmp_path, path.ptr, GIT_PACK_FILE_MODE)) < 0)
+		goto done;
+
+	/* the object count is filled in when the session is committed */
+	hdr.hdr_signature = htonl(PACK_SIGNATURE);
+	hdr.hdr_version = htonl(PACK_VERSION);
+	hdr.hdr_entries = 0;
+
+	if (bulk_append(bulk, &hdr, sizeof(hdr), &crc) < 0)
+		goto done;
+
+	bulk->parent.version = GIT_ODB_BACKEND_VERSION;
+	bulk->parent.read = &bulk_backend__read;
+	bulk->parent.read_header = &bulk_backend__read_header;
+	bulk->parent.exists = &bulk_backend__exists;
+	bulk->parent.write = &bulk_backend__write;
+	bulk->parent.writestream = &bulk_backend__writestream;
+	bulk->parent.foreach = &bulk_backend__foreach;
+	bulk->parent.free = &bulk_backend__free;
+
+	*out = (git_odb_backend *)bulk;
+	error = 0;
+
+done:
+	if (error < 0)
+		bulk_backend__free((git_odb_backend *)bulk);
+
+	git_str_dispose(&path);
+	return error;
+}
+
+static int bulk_finalize_pack(unsigned char *checksum, bulk_backend *bulk)
+{
+	struct git_pack_header hdr;
+	git_hash_ctx ctx;
+	char *buf = NULL;
+	off64_t offset = 0;
+	size_t checksum_size, len;
+	int error;
+
+	hdr.hdr_signature = htonl(PACK_SIGNATURE);
+	hdr.hdr_version = htonl(PACK_VERSION);
+	hdr.hdr_entries = htonl((uint32_t)bulk->entries.length);
+
+	if ((error = bulk_write_at(bulk, &hdr, sizeof(hdr), 0)) < 0 ||
+	    (error = git_hash_ctx_init_ext(&ctx, git_oid_algorithm(bulk->oid_type), GIT_HASH_TRUSTED)) < 0)
+		return error;
+
+	buf = git__malloc(BULK_BUFFER_SIZE);
+	GIT_ERROR_CHECK_ALLOC(buf);
+
+	/* the header changed, so the trailer can only be computed now */
+	while (offset < bulk->size) {
+		len = (size_t)min(bulk->size - offset, BULK_BUFFER_SIZE);
+
+		if ((error = bulk_read_at(bulk, buf, len, offset)) < 0 ||
+		    (error = git_hash_update(&ctx, buf, len)) < 0)
+			goto done;
+
+		offset += len;
+	}
+
+	checksum_size = git_oid_size(bulk->oid_type);
+
+	if ((error = git_hash_final(checksum, &ctx)) < 0 ||
+	    (error = bulk_write_at(bulk, checksum, checksum_size, bulk->size)) < 0)
+		goto done;
+
+	bulk->size += checksum_size;
+
+	if (bulk->do_fsync && p_fsync(bulk->fd) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to fsync bulk packfile");
+		error = -1;
+	}
+
+done:
+	git_hash_ctx_cleanup(&ctx);
+	git__free(buf);
+	return error;
+}
+
+static int bulk_write_index(
+	bulk_backend *bulk,
+	const char *path,
+	const unsigned char *pack_checksum)
+{
+	git_filebuf index_file = GIT_FILEBUF_INIT;
+	struct git_pack_idx_header hdr;
+	struct bulk_entry *entry;
+	unsigned char checksum[GIT_HASH_MAX_SIZE];
+	uint32_t fanout[256] = { 0 }, long_offsets = 0;
+	size_t checksum_size = git_oid_size(bulk->oid_type), i;
+	int flags, error;
+
+	flags = git_filebuf_hash_flags(git_oid_algorithm(bulk->oid_type));
+
+	if (bulk->do_fsync)
+		flags |= GIT_FILEBUF_FSYNC;
+
+	git_vector_foreach(&bulk->entries, i, entry)
+		fanout[entry->oid.id[0]]++;
+
+	for (i = 1; i < 256; i++)
+		fanout[i] += fanout[i - 1];
+
+	if ((error = git_filebuf_open(&index_file, path, flags, GIT_PACK_FILE_MODE)) < 0)
+		return error;
+
+	hdr.idx_signature = htonl(PACK_IDX_SIGNATURE);
+	hdr.idx_version = htonl(2);
+	git_filebuf_write(&index_file, &hdr, sizeof(hdr));
+
+	for (i = 0; i < 256; i++) {
+		uint32_t n = htonl(fanout[i]);
+		git_filebuf_write(&index_file, &n, sizeof(n));
+	}
+
+	git_vector_foreach(&bulk->entries, i, entry)
+		git_filebuf_write(&index_file, entry->oid.id, checksum_size);
+
+	git_vector_foreach(&bulk->entries, i, entry) {
+		uint32_t n = htonl(entry->crc);
+		git_filebuf_write(&index_file, &n, sizeof(n));
+	}
+
+	git_vector_foreach(&bulk->entries, i, entry) {
+		uint32_t n;
+
+		if (entry->offset > UINT31_MAX)
+			n = htonl(0x80000000 | long_offsets++);
+		else
+			n = htonl((uint32_t)entry->offset);
+
+		git_filebuf_write(&index_file, &n, sizeof(n));
+	}
+
+	git_vector_foreach(&bulk->entries, i, entry) {
+		uint32_t split[2];
+
+		if (entry->offset <= UINT31_MAX)
+			continue;
+
+		split[0] = htonl((uint32_t)(entry->offset >> 32));
+		split[1] = htonl((uint32_t)(entry->offset & 0xffffffff));
+
+		git_filebuf_write(&index_file, &split, sizeof(split));
+	}
+
+	if ((error = git_filebuf_write(&index_file, pack_checksum, checksum_size)) < 0 ||
+	    (error = git_filebuf_hash(checksum, &index_file)) < 0 ||
+	    (error = git_filebuf_write(&index_file, checksum, checksum_size)) < 0 ||
+	    (error = git_filebuf_commit(&index_file)) < 0)
+		goto done;
+
+done:
+	git_filebuf_cleanup(&index_file);
+	return error;
+}
+
+int git_odb__backend_bulk_commit(git_odb_backend *_backend)
+{
+	bulk_backend *bulk = (bulk_backend *)_backend;
+	unsigned char checksum[GIT_HASH_MAX_SIZE];
+	char name[(GIT_HASH_MAX_SIZE * 2) + 1];
+	git_str pack_path = GIT_STR_INIT, index_path = GIT_STR_INIT;
+	int error;
+
+	GIT_ASSERT_ARG(bulk);
+
+	if (bulk->streaming) {
+		git_error_set(GIT_ERROR_ODB, "cannot commit a bulk write session with an open stream");
+		return -1;
+	}
+
+	/* nothing was written; the temporary pack is removed on free */
+	if (!bulk->entries.length)
+		return 0;
+
+	git_vector_sort(&bulk->entries);
+
+	if ((error = bulk_finalize_pack(checksum, bulk)) < 0 ||
+	    (error = git_hash_fmt(name, checksum, git_oid_size(bulk->oid_type))) < 0)
+		goto done;
+
+	if ((error = git_str_printf(&pack_path, "%s/pack-%s.pack", bulk->pack_dir, name)) < 0 ||
+	    (error = git_str_printf(&index_path, "%s/pack-%s.idx", bulk->pack_dir, name)) < 0)
+		goto done;
+
+	if (p_close(bulk->fd) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to close bulk packfile");
+		error = -1;
+		goto done;
+	}
+
+	bulk->fd = -1;
+
+	/* the packfile goes first: it only becomes visible with its index */
+	if ((error = p_rename(bulk->tmp_path.ptr, pack_path.ptr)) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to rename bulk packfile");
+		p_unlink(bulk->tmp_path.ptr);
+		goto done;
+	}
+
+	if ((error = bulk_write_index(bulk, index_path.ptr, checksum)) < 0) {
+		p_unlink(pack_path.ptr);
+		goto done;
+	}
+
+	if (bulk->do_fsync)
+		error = git_futils_fsync_parent(pack_path.ptr);
+
+done:
+	git_str_dispose(&pack_path);
+	git_str_dispose(&index_path);
+	return error;
+}
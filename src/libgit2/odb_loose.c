@@ -273,6 +273,52 @@ done:
 	return error;
 }
 
+/*
+ * Inflate the entire object (including the header that we have already
+ * parsed) with a single call into a buffer of its exact size, then drop
+ * the header.
+ */
+static int read_loose_standard_oneshot(
+	git_rawobj *out,
+	git_str *obj,
+	obj_hdr *hdr,
+	size_t head_len)
+{
+	unsigned char *data;
+	size_t alloc_size, data_len, in_len = obj->size;
+	int error;
+
+	GIT_ERROR_CHECK_ALLOC_ADD(&data_len, head_len, hdr->size);
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloc_size, data_len, 1);
+	data = git__calloc(1, alloc_size);
+	GIT_ERROR_CHECK_ALLOC(data);
+
+	if ((error = git_zstream_inflate_oneshot(data, &data_len, obj->ptr, &in_len)) == GIT_EBUFS) {
+		git_error_set(GIT_ERROR_ODB, "malformed object: body was longer than specified in header");
+		goto on_error;
+	} else if (error < 0) {
+		goto on_error;
+	}
+
+	if (in_len != obj->size || data_len < head_len) {
+		git_error_set(GIT_ERROR_ZLIB, "failed to finish zlib inflation: stream aborted prematurely");
+		goto on_error;
+	}
+
+	/* object bodies that are too short are silently zero-padded */
+	memmove(data, data + head_len, data_len - head_len);
+	memset(data + (data_len - head_len), 0, head_len);
+
+	out->data = data;
+	out->len = hdr->size;
+	out->type = hdr->type;
+	return 0;
+
+on_error:
+	git__free(data);
+	return -1;
+}
+
 static int read_loose_standard(git_rawobj *out, git_str *obj)
 {
 	git_zstream zstream = GIT_ZSTREAM_INIT;
@@ -302,6 +348,15 @@ static int read_loose_standard(git_rawobj *out, git_str *obj)
 		goto done;
 	}
 
+	/*
+	 * with a dedicated decompressor, the rest of the object is faster
+	 * to inflate again from the start, now that its size is known
+	 */
+	if (GIT_ZSTREAM_INFLATE_ONESHOT && !git_zstream_done(&zstream)) {
+		error = read_loose_standard_oneshot(out, obj, &hdr, head_len);
+		goto done;
+	}
+
 	/*
 	 * allocate a buffer and inflate the object data into it
 	 * (including the initial sequence in the head buffer).
@@ -458,17 +513,33 @@ done:
 	return error;
 }
 
+static git_futils_fsync_batch *fsync_batch(loose_backend *backend)
+{
+	return backend->parent.odb ? backend->parent.odb->fsync_batch : NULL;
+}
+
 static int locate_object(
 	git_str *object_location,
 	loose_backend *backend,
 	const git_oid *oid)
 {
+	git_futils_fsync_batch *batch = fsync_batch(backend);
+	git_str pending = GIT_STR_INIT;
 	int error = object_file_name(object_location, backend, oid);
 
-	if (!error && !git_fs_path_exists(object_location->ptr))
+	if (error || git_fs_path_exists(object_location->ptr))
+		return error;
+
+	/* the object may be waiting for its fsync batch to be committed */
+	if (!batch)
 		return GIT_ENOTFOUND;
 
-	return error;
+	if ((error = git_futils_fsync_batch_lookup(&pending, batch, object_location->ptr)) < 0)
+		return error;
+
+	git_str_swap(object_location, &pending);
+	git_str_dispose(&pending);
+	return 0;
 }
 
 /* Explore an entry of a directory and see if it matches a short oid */
@@ -823,8 +894,8 @@ static int loose_backend__writestream_finalize(git_odb_stream *_stream, const gi
 		object_mkdir(&final_path, backend) < 0)
 		error = -1;
 	else
-		error = git_filebuf_commit_at(
-			&stream->fbuf, final_path.ptr);
+		error = git_filebuf_commit_batch(
+			&stream->fbuf, final_path.ptr, fsync_batch(backend));
 
 	git_str_dispose(&final_path);
 
@@ -1119,7 +1190,7 @@ static int loose_backend__write(git_odb_backend *_backend, const git_oid *oid, c
 
 	if (object_file_name(&final_path, backend, oid) < 0 ||
 		object_mkdir(&final_path, backend) < 0 ||
-		git_filebuf_commit_at(&fbuf, final_path.ptr) < 0)
+		git_filebuf_commit_batch(&fbuf, final_path.ptr, fsync_batch(backend)) < 0)
 		error = -1;
 
 cleanup:
@@ -1140,7 +1211,9 @@ static int loose_backend__freshen(
 	if (object_file_name(&path, backend, oid) < 0)
 		return -1;
 
-	error = git_futils_touch(path.ptr, NULL);
+	if ((error = git_futils_touch(path.ptr, NULL)) == GIT_ENOTFOUND &&
+	    (error = locate_object(&path, backend, oid)) == 0)
+		error = git_futils_touch(path.ptr, NULL);
 	git_str_dispose(&path);
 
 	return error;
@@ -39,6 +39,16 @@ struct pack_writepack {
 	git_indexer *indexer;
 };
 
+struct pack_readstream {
+	git_odb_stream parent;
+	struct git_pack_file *p;
+	git_packfile_stream packstream;
+	git_rawobj raw;
+	size_t size;
+	size_t read;
+	unsigned int inflating : 1;
+};
+
 /**
  * The wonderful tale of a Packed Object lookup query
  * ===================================================
@@ -156,6 +166,14 @@ struct pack_writepack {
  *     <https://github.com/git/git/blob/master/Documentation/technical/pack-format.txt>
  *     for specifics on the Packfile format and how do we read from it.
  *
+ * # pack_backend__readstream
+ * | Like a regular lookup, but the object is handed back to the caller
+ * | piecemeal instead of in a single buffer. Objects stored in their
+ * | undeltified representation are inflated straight out of the mmap
+ * | windows as the caller reads, so a blob of any size can be read in
+ * | constant memory. Deltified objects are reconstructed once with
+ * | `git_packfile_unpack` and then played back from memory.
+ *
  */
 
 
@@ -604,6 +622,28 @@ static int pack_backend__read(
 	return 0;
 }
 
+int git_odb__backend_pack_location(
+	struct git_pack_file **pack,
+	off64_t *offset,
+	size_t *size,
+	git_odb_backend *backend,
+	const git_oid *id)
+{
+	struct git_pack_entry e;
+	int error;
+
+	if (backend->read != pack_backend__read)
+		return GIT_PASSTHROUGH;
+
+	if ((error = pack_entry_find(&e, (struct pack_backend *)backend, id)) < 0 ||
+	    (error = git_packfile_resolve_size(size, e.p, e.offset)) < 0)
+		return error;
+
+	*pack = e.p;
+	*offset = e.offset;
+	return 0;
+}
+
 static int pack_backend__read_prefix(
 	git_oid *out_oid,
 	void **buffer_p,
@@ -642,6 +682,128 @@ static int pack_backend__read_prefix(
 	return error;
 }
 
+static int pack_backend__readstream_read(
+	git_odb_stream *_stream,
+	char *buffer,
+	size_t buffer_len)
+{
+	struct pack_readstream *stream = (struct pack_readstream *)_stream;
+	off64_t last_pos;
+	ssize_t chunk;
+
+	buffer_len = min(buffer_len, stream->size - stream->read);
+	buffer_len = min(buffer_len, INT_MAX);
+
+	if (!buffer_len)
+		return 0;
+
+	if (!stream->inflating) {
+		memcpy(buffer, (char *)stream->raw.data + stream->read, buffer_len);
+		stream->read += buffer_len;
+		return (int)buffer_len;
+	}
+
+	/*
+	 * The packfile stream asks for more input when it consumed an
+	 * entire window without producing output; keep feeding it as
+	 * long as it makes progress through the pack.
+	 */
+	do {
+		last_pos = stream->packstream.curpos;
+		chunk = git_packfile_stream_read(&stream->packstream,
+			buffer, buffer_len);
+	} while (chunk == GIT_EBUFS && stream->packstream.curpos != last_pos);
+
+	if (chunk == 0 || chunk == GIT_EBUFS) {
+		git_error_set(GIT_ERROR_ODB, "truncated packed object");
+		return -1;
+	} else if (chunk < 0) {
+		return (int)chunk;
+	}
+
+	stream->read += chunk;
+	return (int)chunk;
+}
+
+static void pack_backend__readstream_free(git_odb_stream *_stream)
+{
+	struct pack_readstream *stream = (struct pack_readstream *)_stream;
+
+	if (stream->inflating)
+		git_packfile_stream_dispose(&stream->packstream);
+
+	git_mwindow_put_pack(stream->p);
+	git__free(stream->raw.data);
+	git__free(stream);
+}
+
+static int pack_backend__readstream(
+	git_odb_stream **stream_out,
+	size_t *len_out,
+	git_object_t *type_out,
+	git_odb_backend *_backend,
+	const git_oid *oid)
+{
+	struct pack_readstream *stream;
+	struct git_pack_entry e;
+	git_mwindow *w_curs = NULL;
+	off64_t curpos;
+	size_t size;
+	git_object_t type;
+	int error;
+
+	GIT_ASSERT_ARG(stream_out);
+	GIT_ASSERT_ARG(len_out);
+	GIT_ASSERT_ARG(type_out);
+	GIT_ASSERT_ARG(_backend);
+	GIT_ASSERT_ARG(oid);
+
+	if ((error = pack_entry_find(&e, (struct pack_backend *)_backend, oid)) < 0)
+		return error;
+
+	curpos = e.offset;
+
+	if ((error = git_packfile_unpack_header(&size, &type, e.p, &w_curs, &curpos)) < 0)
+		return error;
+
+	stream = git__calloc(1, sizeof(struct pack_readstream));
+	GIT_ERROR_CHECK_ALLOC(stream);
+
+	if (type == GIT_PACKFILE_OFS_DELTA || type == GIT_PACKFILE_REF_DELTA) {
+		error = git_packfile_unpack(&stream->raw, e.p, &e.offset);
+		size = stream->raw.len;
+		type = stream->raw.type;
+	} else if (git_object_type_is_valid(type)) {
+		error = git_packfile_stream_open(&stream->packstream, e.p, curpos);
+		stream->inflating = (error == 0);
+	} else {
+		git_error_set(GIT_ERROR_ODB, "invalid packfile type in header");
+		error = -1;
+	}
+
+	if (error < 0) {
+		git__free(stream->raw.data);
+		git__free(stream);
+		return error;
+	}
+
+	/* keep the packfile alive for as long as the stream is open */
+	git_atomic32_inc(&e.p->refcount);
+	stream->p = e.p;
+	stream->size = size;
+
+	stream->parent.backend = _backend;
+	stream->parent.mode = GIT_STREAM_RDONLY;
+	stream->parent.read = &pack_backend__readstream_read;
+	stream->parent.free = &pack_backend__readstream_free;
+
+	*stream_out = (git_odb_stream *)stream;
+	*len_out = size;
+	*type_out = type;
+
+	return 0;
+}
+
 static int pack_backend__exists(git_odb_backend *backend, const git_oid *oid)
 {
 	struct git_pack_entry e;
@@ -907,6 +1069,7 @@ static int pack_backend__alloc(
 	backend->parent.read = &pack_backend__read;
 	backend->parent.read_prefix = &pack_backend__read_prefix;
 	backend->parent.read_header = &pack_backend__read_header;
+	backend->parent.readstream = &pack_backend__readstream;
 	backend->parent.exists = &pack_backend__exists;
 	backend->parent.exists_prefix = &pack_backend__exists_prefix;
 	backend->parent.refresh = &pack_backend__refresh;
@@ -115,7 +115,7 @@ static int packbuilder_config(git_packbuilder *pb)
 		   GIT_PACK_DELTA_CACHE_SIZE);
 	config_get("pack.deltaCacheLimit", pb->cache_max_small_delta_size,
 		   GIT_PACK_DELTA_CACHE_LIMIT);
-	config_get("pack.deltaCacheSize", pb->big_file_threshold,
+	config_get("core.bigFileThreshold", pb->big_file_threshold,
 		   GIT_PACK_BIG_FILE_THRESHOLD);
 	config_get("pack.windowMemory", pb->window_memory_limit, 0);
 
@@ -148,7 +148,7 @@ int git_packbuilder_new(git_packbuilder **out, git_repository *repo)
 	pb->repo = repo;
 	pb->nr_threads = 1; /* do not spawn any thread by default */
 
-	if (git_hash_ctx_init(&pb->ctx, hash_algorithm) < 0 ||
+	if (git_hash_ctx_init_ext(&pb->ctx, hash_algorithm, GIT_HASH_TRUSTED) < 0 ||
 		git_zstream_init(&pb->zstream, GIT_ZSTREAM_DEFLATE) < 0 ||
 		git_repository_odb(&pb->odb, repo) < 0 ||
 		packbuilder_config(pb) < 0)
@@ -311,6 +311,109 @@ on_error:
 	return -1;
 }
 
+static int write_deflated(
+	git_packbuilder *pb,
+	unsigned char *zbuf,
+	size_t zbuf_len,
+	int (*write_cb)(void *buf, size_t size, void *cb_data),
+	void *cb_data)
+{
+	int error;
+
+	if (!zbuf_len)
+		return 0;
+
+	if ((error = write_cb(zbuf, zbuf_len, cb_data)) < 0)
+		return error;
+
+	return git_hash_update(&pb->ctx, zbuf, zbuf_len);
+}
+
+/*
+ * Objects over the big file threshold are never deltified, so rather
+ * than loading them into memory we deflate them into the pack as they
+ * are read from the object database. Returns GIT_PASSTHROUGH when the
+ * object database cannot stream the object.
+ */
+static int write_big_object(
+	git_packbuilder *pb,
+	git_pobject *po,
+	int (*write_cb)(void *buf, size_t size, void *cb_data),
+	void *cb_data)
+{
+	git_odb_stream *stream;
+	git_object_t type;
+	unsigned char hdr[10], *zbuf = NULL;
+	char *inbuf = NULL;
+	size_t hdr_len, zbuf_len, data_len, total = 0;
+	int read, error;
+
+	if (git_odb_open_rstream(&stream, &data_len, &type, pb->odb, &po->id) < 0) {
+		git_error_clear();
+		return GIT_PASSTHROUGH;
+	}
+
+	zbuf = git__malloc(COMPRESS_BUFLEN);
+	inbuf = git__malloc(COMPRESS_BUFLEN);
+
+	if (!zbuf || !inbuf) {
+		error = -1;
+		goto done;
+	}
+
+	if ((error = git_packfile__object_header(&hdr_len, hdr, data_len, type)) < 0 ||
+	    (error = write_cb(hdr, hdr_len, cb_data)) < 0 ||
+	    (error = git_hash_update(&pb->ctx, hdr, hdr_len)) < 0)
+		goto done;
+
+	git_zstream_reset(&pb->zstream);
+
+	while ((read = git_odb_stream_read(stream, inbuf, COMPRESS_BUFLEN)) > 0) {
+		total += read;
+
+		if ((error = git_zstream_set_partial_input(&pb->zstream, inbuf, read)) < 0)
+			goto done;
+
+		do {
+			zbuf_len = COMPRESS_BUFLEN;
+
+			if ((error = git_zstream_get_output_chunk(zbuf, &zbuf_len, &pb->zstream)) < 0 ||
+			    (error = write_deflated(pb, zbuf, zbuf_len, write_cb, cb_data)) < 0)
+				goto done;
+		} while (pb->zstream.in_len || zbuf_len == COMPRESS_BUFLEN);
+	}
+
+	if (read < 0) {
+		error = read;
+		goto done;
+	}
+
+	if (total != data_len) {
+		git_error_set(GIT_ERROR_ODB, "short read from object stream");
+		error = -1;
+		goto done;
+	}
+
+	if ((error = git_zstream_set_input(&pb->zstream, NULL, 0)) < 0)
+		goto done;
+
+	while (!git_zstream_done(&pb->zstream)) {
+		zbuf_len = COMPRESS_BUFLEN;
+
+		if ((error = git_zstream_get_output(zbuf, &zbuf_len, &pb->zstream)) < 0 ||
+		    (error = write_deflated(pb, zbuf, zbuf_len, write_cb, cb_data)) < 0)
+			goto done;
+	}
+
+	pb->nr_written++;
+
+done:
+	git__free(inbuf);
+	git__free(zbuf);
+	git_odb_stream_free(stream);
+	return error;
+}
+
 static int write_object(
 	git_packbuilder *pb,
 	git_pobject *po,
@@ -326,6 +429,10 @@ static int write_object(
 
 	oid_size = git_oid_size(pb->oid_type);
 
+	if (!po->delta && po->size > pb->big_file_threshold &&
+	    (error = write_big_object(pb, po, write_cb, cb_data)) != GIT_PASSTHROUGH)
+		return error;
+
 	/*
 	 * If we have a delta base, let's use the delta to save space.
 	 * Otherwise load the whole object. 'data' ends up pointing to
@@ -495,17 +495,22 @@ int git_packfile_unpack_header(
 	return 0;
 }
 
-int git_packfile_resolve_header(
+/*
+ * Read the header of the object at `offset`: its type in the pack, its
+ * inflated size and, for a delta, the offset of its base.  The size of
+ * a delta is read from the delta itself, without walking to its base.
+ */
+static int packfile_object_size(
 		size_t *size_p,
 		git_object_t *type_p,
+		off64_t *base_offset_p,
 		struct git_pack_file *p,
+		git_mwindow **w_curs,
 		off64_t offset)
 {
-	git_mwindow *w_curs = NULL;
 	off64_t curpos = offset;
 	size_t size;
 	git_object_t type;
-	off64_t base_offset;
 	int error;
 
 	error = git_mutex_lock(&p->lock);
@@ -528,7 +533,7 @@ int git_packfile_resolve_header(
 	git_mutex_unlock(&p->mwf.lock);
 	git_mutex_unlock(&p->lock);
 
-	error = git_packfile_unpack_header(&size, &type, p, &w_curs, &curpos);
+	error = git_packfile_unpack_header(&size, &type, p, w_curs, &curpos);
 	if (error < 0)
 		return error;
 
@@ -536,8 +541,8 @@ int git_packfile_resolve_header(
 		size_t base_size;
 		git_packfile_stream stream;
 
-		error = get_delta_base(&base_offset, p, &w_curs, &curpos, type, offset);
-		git_mwindow_close(&w_curs);
+		error = get_delta_base(base_offset_p, p, w_curs, &curpos, type, offset);
+		git_mwindow_close(w_curs);
 
 		if (error < 0)
 			return error;
@@ -550,9 +555,47 @@ int git_packfile_resolve_header(
 			return error;
 	} else {
 		*size_p = size;
-		base_offset = 0;
+		*base_offset_p = 0;
 	}
 
+	*type_p = type;
+	return 0;
+}
+
+int git_packfile_resolve_size(
+		size_t *size_p,
+		struct git_pack_file *p,
+		off64_t offset)
+{
+	git_mwindow *w_curs = NULL;
+	git_object_t type;
+	off64_t base_offset;
+	int error;
+
+	error = packfile_object_size(size_p, &type, &base_offset,
+		p, &w_curs, offset);
+	git_mwindow_close(&w_curs);
+
+	return error;
+}
+
+int git_packfile_resolve_header(
+		size_t *size_p,
+		git_object_t *type_p,
+		struct git_pack_file *p,
+		off64_t offset)
+{
+	git_mwindow *w_curs = NULL;
+	off64_t curpos;
+	size_t size;
+	git_object_t type;
+	off64_t base_offset;
+	int error;
+
+	if ((error = packfile_object_size(size_p, &type, &base_offset,
+			p, &w_curs, offset)) < 0)
+		return error;
+
 	while (type == GIT_PACKFILE_OFS_DELTA || type == GIT_PACKFILE_REF_DELTA) {
 		curpos = base_offset;
 		error = git_packfile_unpack_header(&size, &type, p, &w_curs, &curpos);
@@ -883,6 +926,36 @@ void git_packfile_stream_dispose(git_packfile_stream *obj)
 	git_zstream_free(&obj->zstream);
 }
 
+static int packfile_unpack_oneshot(
+	char *data,
+	struct git_pack_file *p,
+	git_mwindow **mwindow,
+	off64_t *position,
+	size_t size)
+{
+	unsigned int window_len;
+	size_t in_len, out_len = size;
+	unsigned char *in;
+	int error;
+
+	if ((in = pack_window_open(p, mwindow, *position, &window_len)) == NULL) {
+		git_error_clear();
+		return GIT_PASSTHROUGH;
+	}
+
+	in_len = window_len;
+	error = git_zstream_inflate_oneshot(data, &out_len, in, &in_len);
+	git_mwindow_close(mwindow);
+
+	if (error < 0 || out_len != size) {
+		git_error_clear();
+		return GIT_PASSTHROUGH;
+	}
+
+	*position += in_len;
+	return 0;
+}
+
 static int packfile_unpack_compressed(
 	git_rawobj *obj,
 	struct git_pack_file *p,
@@ -900,6 +973,16 @@ static int packfile_unpack_compressed(
 	data = git__calloc(1, buffer_len);
 	GIT_ERROR_CHECK_ALLOC(data);
 
+	/*
+	 * The compressed data is usually entirely within the current
+	 * window, so try to inflate it with a single call.  If it is not,
+	 * or the data is corrupt, fall back to streaming (which will
+	 * produce the appropriate error).
+	 */
+	if (GIT_ZSTREAM_INFLATE_ONESHOT &&
+	    (error = packfile_unpack_oneshot(data, p, mwindow, position, size)) == 0)
+		goto done;
+
 	if ((error = git_zstream_init(&zstream, GIT_ZSTREAM_INFLATE)) < 0) {
 		git_error_set(GIT_ERROR_ZLIB, "failed to init zlib stream on unpack");
 		goto out;
@@ -941,6 +1024,7 @@ static int packfile_unpack_compressed(
 		goto out;
 	}
 
+done:
 	/* zlib may have garbled the trailing buffer */
 	data[size] = '\0';
 
@@ -179,6 +179,16 @@ int git_packfile_resolve_header(
 		struct git_pack_file *p,
 		off64_t offset);
 
+/*
+ * The inflated size of the object at `offset`; unlike
+ * `git_packfile_resolve_header`, this does not walk a delta's chain to
+ * find its type.
+ */
+int git_packfile_resolve_size(
+		size_t *size_p,
+		struct git_pack_file *p,
+		off64_t offset);
+
 int git_packfile_unpack(git_rawobj *obj, struct git_pack_file *p, off64_t *obj_offset);
 
 int git_packfile_stream_open(git_packfile_stream *obj, struct git_pack_file *p, off64_t curpos);
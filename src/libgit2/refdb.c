@@ -111,6 +111,32 @@ int git_refdb_compress(git_refdb *db)
 	return 0;
 }
 
+int git_refdb_pack_options_init(
+	git_refdb_pack_options *opts,
+	unsigned int version)
+{
+	GIT_INIT_STRUCTURE_FROM_TEMPLATE(opts, version,
+		git_refdb_pack_options, GIT_REFDB_PACK_OPTIONS_INIT);
+	return 0;
+}
+
+int git_refdb_pack_refs(git_refdb *db, const git_refdb_pack_options *given_opts)
+{
+	git_refdb_pack_options opts = GIT_REFDB_PACK_OPTIONS_INIT;
+
+	GIT_ASSERT_ARG(db);
+	GIT_ERROR_CHECK_VERSION(given_opts, GIT_REFDB_PACK_OPTIONS_VERSION,
+		"git_refdb_pack_options");
+
+	if (given_opts)
+		memcpy(&opts, given_opts, sizeof(opts));
+
+	if (db->backend->pack_refs)
+		return db->backend->pack_refs(db->backend, &opts);
+
+	return git_refdb_compress(db);
+}
+
 void git_refdb__free(git_refdb *db)
 {
 	refdb_free_backend(db);
@@ -118,6 +144,22 @@ void git_refdb__free(git_refdb *db)
 	git__free(db);
 }
 
+int git_refdb__batch_flush(git_refdb *db)
+{
+	int (*flush)(git_refdb_backend *backend) = db->batch_flush;
+
+	db->batch_flush = NULL;
+	return flush ? flush(db->backend) : 0;
+}
+
+int git_refdb__batch_done(git_refdb *db, int success)
+{
+	int (*done)(git_refdb_backend *backend, int success) = db->batch_done;
+
+	db->batch_done = NULL;
+	return done ? done(db->backend, success) : 0;
+}
+
 void git_refdb_free(git_refdb *db)
 {
 	if (db == NULL)
@@ -219,6 +261,32 @@ out:
 	return error;
 }
 
+size_t git_refdb__glob_prefix_len(const char *glob, bool dir)
+{
+	const char *pos, *last_sep = NULL;
+
+	for (pos = glob; *pos; pos++) {
+		switch (*pos) {
+		case '?':
+		case '*':
+		case '[':
+		case '\\':
+			break;
+		case '/':
+			last_sep = pos;
+			/* FALLTHROUGH */
+		default:
+			continue;
+		}
+		break;
+	}
+
+	if (!dir)
+		return (size_t)(pos - glob);
+
+	return last_sep ? (size_t)(last_sep - glob) + 1 : 0;
+}
+
 int git_refdb_iterator(git_reference_iterator **out, git_refdb *db, const char *glob)
 {
 	int error;
@@ -322,6 +390,35 @@ int git_refdb_reflog_read(git_reflog **out, git_refdb *db,  const char *name)
 	return 0;
 }
 
+int git_refdb_reflog_foreach(
+	git_refdb *db,
+	const char *name,
+	git_refdb_reflog_foreach_cb cb,
+	void *payload)
+{
+	git_reflog *reflog;
+	size_t i;
+	int error = 0;
+
+	GIT_ASSERT_ARG(db);
+	GIT_ASSERT_ARG(db->backend);
+	GIT_ASSERT_ARG(cb);
+
+	if (db->backend->reflog_foreach)
+		return db->backend->reflog_foreach(db->backend, name, cb, payload);
+
+	if ((error = db->backend->reflog_read(&reflog, db->backend, name)) < 0)
+		return error;
+
+	for (i = 0; i < git_reflog_entrycount(reflog); i++) {
+		if ((error = cb(git_reflog_entry_byindex(reflog, i), payload)) != 0)
+			break;
+	}
+
+	git_reflog_free(reflog);
+	return error;
+}
+
 int git_refdb_should_write_reflog(int *out, git_refdb *db, const git_reference *ref)
 {
 	int error, logall;
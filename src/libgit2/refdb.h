@@ -10,6 +10,7 @@
 #include "common.h"
 
 #include "git2/refdb.h"
+#include "git2/sys/refdb_backend.h"
 #include "repository.h"
 
 #define GIT_INVALID_HEAD "refs/heads/.invalid"
@@ -18,10 +19,29 @@ struct git_refdb {
 	git_refcount rc;
 	git_repository *repo;
 	git_refdb_backend *backend;
+	git_futils_fsync_batch *fsync_batch;
+
+	/*
+	 * Set while a transaction is being committed. Backends may defer
+	 * work that is shared by all of the transaction's references, like
+	 * rewriting packed-refs, and set `batch_flush` to do it once every
+	 * reference has been updated.  Work that must only see the
+	 * references once they are durable, like packing them, goes in
+	 * `batch_done`, which runs after the batch's files were committed.
+	 */
+	unsigned int batch : 1;
+	int (*batch_flush)(git_refdb_backend *backend);
+	int (*batch_done)(git_refdb_backend *backend, int success);
 };
 
 void git_refdb__free(git_refdb *db);
 
+/* Run the work that the backend deferred during the current batch. */
+int git_refdb__batch_flush(git_refdb *db);
+
+/* Run the work that the backend deferred until the batch was committed. */
+int git_refdb__batch_done(git_refdb *db, int success);
+
 int git_refdb_init(git_refdb *refdb,
 		   const char *head_target,
 		   mode_t mode,
@@ -71,6 +91,15 @@ int git_refdb_rename(
 	const git_signature *who,
 	const char *message);
 
+/*
+ * The length of the literal prefix of a reference glob, before its first
+ * wildcard.  Every reference that matches the glob starts with this
+ * prefix, so backends that store references in sorted order can seek to
+ * it and stop iterating once they are past it.  If `dir` is set, the
+ * prefix is shortened to end at its last path separator.
+ */
+size_t git_refdb__glob_prefix_len(const char *glob, bool dir);
+
 int git_refdb_iterator(git_reference_iterator **out, git_refdb *db, const char *glob);
 int git_refdb_iterator_next(git_reference **out, git_reference_iterator *iter);
 int git_refdb_iterator_next_name(const char **out, git_reference_iterator *iter);
@@ -80,6 +109,17 @@ int git_refdb_write(git_refdb *refdb, git_reference *ref, int force, const git_s
 int git_refdb_delete(git_refdb *refdb, const char *ref_name, const git_oid *old_id, const char *old_target);
 
 int git_refdb_reflog_read(git_reflog **out, git_refdb *db,  const char *name);
+
+/*
+ * Call `cb` for each entry of a reflog, from the most recent one to the
+ * oldest, stopping as soon as it returns non-zero.  Backends may stream
+ * the entries instead of reading the whole reflog.
+ */
+int git_refdb_reflog_foreach(
+	git_refdb *db,
+	const char *name,
+	git_refdb_reflog_foreach_cb cb,
+	void *payload);
 int git_refdb_reflog_write(git_reflog *reflog);
 
 /**
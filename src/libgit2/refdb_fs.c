@@ -8,6 +8,7 @@
 #include "refs.h"
 #include "hash.h"
 #include "repository.h"
+#include "config.h"
 #include "futils.h"
 #include "filebuf.h"
 #include "pack.h"
@@ -67,10 +68,35 @@ typedef struct refdb_fs_backend {
 	git_map packed_refs_map;
 	git_mutex prlock; /* protect packed_refs_map */
 	git_futils_filestamp packed_refs_stamp;
+
+	/*
+	 * The references deleted by the transaction that is being
+	 * committed. They are removed from packed-refs, which stays locked,
+	 * in a single rewrite once the transaction is done, and only then
+	 * is their loose file deleted.
+	 */
+	git_filebuf packed_lock;
+	git_vector batch_deletes;
+
+	/*
+	 * The number of loose references written by the transaction, and
+	 * the number of loose references there were after the last one, to
+	 * decide when to pack them automatically.
+	 */
+	size_t batch_writes;
+	size_t loose_estimate;
+	unsigned int loose_counted : 1;
 } refdb_fs_backend;
 
+struct batch_delete {
+	git_filebuf *lock;
+	unsigned int packed : 1;
+	char name[GIT_FLEX_ARRAY];
+};
+
 static int refdb_reflog_fs__delete(git_refdb_backend *_backend, const char *name);
 static char *packed_set_peeling_mode(char *data, size_t data_sz, refdb_fs_backend *backend);
+static int packed_lookup(git_reference **out, refdb_fs_backend *backend, const char *ref_name);
 
 GIT_INLINE(int) loose_path(
 	git_str *out,
@@ -249,7 +275,10 @@ static int loose_readbuffer(git_str *buf, const char *base, const char *path)
 	return error;
 }
 
-static int loose_lookup_to_packfile(refdb_fs_backend *backend, const char *name)
+static int loose_lookup_to_packfile(
+	refdb_fs_backend *backend,
+	const char *name,
+	char flags)
 {
 	int error = 0;
 	git_str ref_file = GIT_STR_INIT;
@@ -279,7 +308,7 @@ static int loose_lookup_to_packfile(refdb_fs_backend *backend, const char *name)
 			(void **)&ref, backend->refcache, name))) {
 
 		git_oid_cpy(&ref->oid, &oid);
-		ref->flags = PACKREF_WAS_LOOSE;
+		ref->flags = flags;
 	}
 
 	git_sortedcache_wunlock(backend->refcache);
@@ -326,17 +355,72 @@ static bool refdb_fs_should_fsync(refdb_fs_backend *backend)
 	return false;
 }
 
+/*
+ * Loose references and reflogs that are written during a transaction
+ * share its fsync batch, so they are synchronized all at once.
+ */
+static git_futils_fsync_batch *refdb_fs_fsync_batch(refdb_fs_backend *backend)
+{
+	return backend->repo->_refdb ? backend->repo->_refdb->fsync_batch : NULL;
+}
+
+typedef struct {
+	refdb_fs_backend *backend;
+	const git_refdb_pack_options *opts;
+	size_t count;
+} loose_load_data;
+
+/* Whether the loose reference `name` is selected by the pack options */
+static bool loose_should_pack(const git_refdb_pack_options *opts, const char *name)
+{
+	size_t i;
+
+	if ((opts->flags & GIT_REFDB_PACK_ALL) ||
+	    !git__prefixcmp(name, GIT_REFS_TAGS_DIR))
+		return true;
+
+	for (i = 0; i < opts->prefixes.count; i++)
+		if (!git__prefixcmp(name, opts->prefixes.strings[i]))
+			return true;
+
+	return false;
+}
+
+/* Whether the directory `name` may contain references to pack */
+static bool loose_should_descend(const git_refdb_pack_options *opts, const char *name)
+{
+	size_t i;
+
+	if (loose_should_pack(opts, name) ||
+	    !git__prefixcmp(GIT_REFS_TAGS_DIR, name))
+		return true;
+
+	for (i = 0; i < opts->prefixes.count; i++)
+		if (!git__prefixcmp(opts->prefixes.strings[i], name))
+			return true;
+
+	return false;
+}
+
 static int _dirent_loose_load(void *payload, git_str *full_path)
 {
-	refdb_fs_backend *backend = payload;
+	loose_load_data *data = payload;
+	refdb_fs_backend *backend = data->backend;
 	const char *file_path;
 
 	if (git__suffixcmp(full_path->ptr, ".lock") == 0)
 		return 0;
 
+	file_path = full_path->ptr + strlen(backend->gitpath);
+
 	if (git_fs_path_isdir(full_path->ptr)) {
-		int error = git_fs_path_direach(
-			full_path, refdb_fs_get_direach_flags(backend), _dirent_loose_load, backend);
+		int error;
+
+		if (data->opts && !loose_should_descend(data->opts, file_path))
+			return 0;
+
+		error = git_fs_path_direach(
+			full_path, refdb_fs_get_direach_flags(backend), _dirent_loose_load, data);
 		/* Race with the filesystem, ignore it */
 		if (error == GIT_ENOTFOUND) {
 			git_error_clear();
@@ -346,38 +430,67 @@ static int _dirent_loose_load(void *payload, git_str *full_path)
 		return error;
 	}
 
-	file_path = full_path->ptr + strlen(backend->gitpath);
+	/* Only count the references when there are no pack options */
+	if (!data->opts) {
+		data->count++;
+		return 0;
+	}
 
-	return loose_lookup_to_packfile(backend, file_path);
+	if (!loose_should_pack(data->opts, file_path))
+		return 0;
+
+	return loose_lookup_to_packfile(backend, file_path,
+		(data->opts->flags & GIT_REFDB_PACK_NO_PRUNE) ? 0 : PACKREF_WAS_LOOSE);
 }
 
-/*
- * Load all the loose references from the repository
- * into the in-memory Packfile, and build a vector with
- * all the references so it can be written back to
- * disk.
- */
-static int packed_loadloose(refdb_fs_backend *backend)
+static int loose_walk(loose_load_data *data)
 {
-	int error;
 	git_str refs_path = GIT_STR_INIT;
+	int error;
 
-	if (git_str_joinpath(&refs_path, backend->gitpath, GIT_REFS_DIR) < 0)
+	if (git_str_joinpath(&refs_path, data->backend->gitpath, GIT_REFS_DIR) < 0)
 		return -1;
 
-	/*
-	 * Load all the loose files from disk into the Packfile table.
-	 * This will overwrite any old packed entries with their
-	 * updated loose versions
-	 */
-	error = git_fs_path_direach(
-		&refs_path, refdb_fs_get_direach_flags(backend), _dirent_loose_load, backend);
+	error = git_fs_path_direach(&refs_path,
+		refdb_fs_get_direach_flags(data->backend), _dirent_loose_load, data);
 
 	git_str_dispose(&refs_path);
-
 	return error;
 }
 
+/*
+ * Load the loose references that are selected by the pack options from
+ * the repository into the in-memory Packfile, so that they can be
+ * written back to disk.  This will overwrite any old packed entries
+ * with their updated loose versions.
+ */
+static int packed_loadloose(
+	refdb_fs_backend *backend,
+	const git_refdb_pack_options *opts)
+{
+	loose_load_data data = { 0 };
+
+	data.backend = backend;
+	data.opts = opts;
+
+	return loose_walk(&data);
+}
+
+/* Count the loose references in the repository. */
+static int loose_count(size_t *out, refdb_fs_backend *backend)
+{
+	loose_load_data data = { 0 };
+	int error;
+
+	data.backend = backend;
+
+	if ((error = loose_walk(&data)) < 0)
+		return error;
+
+	*out = data.count;
+	return 0;
+}
+
 static int refdb_fs_backend__init(struct git_refdb_backend *_backend,
 				  const char *head_target,
 				  mode_t mode,
@@ -439,6 +552,7 @@ static int refdb_fs_backend__exists(
 {
 	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
 	git_str ref_path = GIT_STR_INIT;
+	git_reference *ref;
 	int error;
 
 	GIT_ASSERT_ARG(backend);
@@ -453,12 +567,12 @@ static int refdb_fs_backend__exists(
 		goto out;
 	}
 
-	if ((error = packed_reload(backend)) < 0)
-		goto out;
-
-	if (git_sortedcache_lookup(backend->refcache, ref_name) != NULL) {
+	if ((error = packed_lookup(&ref, backend, ref_name)) == 0) {
+		git_reference_free(ref);
 		*exists = 1;
-		goto out;
+	} else if (error == GIT_ENOTFOUND) {
+		git_error_clear();
+		error = 0;
 	}
 
 out:
@@ -771,86 +885,255 @@ static int packed_unsorted_lookup(
 	return error;
 }
 
-static int packed_lookup(
-        git_reference **out,
-        refdb_fs_backend *backend,
-        const char *ref_name)
+/*
+ * Find the first record in the sorted packed-refs map whose name is not
+ * less than `ref_name`; when there is no such record, this is the end of
+ * the data.
+ */
+static int packed_map_seek(
+	const char **out,
+	refdb_fs_backend *backend,
+	const char *ref_name)
 {
-	int error = 0;
 	const char *left, *right, *data_end;
-	size_t oid_hexsize = git_oid_hexsize(backend->oid_type);
-
-	if ((error = packed_map_check(backend)) < 0)
-		return error;
-
-	if (!backend->sorted)
-		return packed_unsorted_lookup(out, backend, ref_name);
 
 	left = backend->packed_refs_map.data;
 	right = data_end = (const char *) backend->packed_refs_map.data +
 	                   backend->packed_refs_map.len;
 
 	while (left < right && *left == '#') {
-		if (!(left = memchr(left, '\n', data_end - left)))
-			goto parse_failed;
+		if (!(left = memchr(left, '\n', data_end - left))) {
+			git_error_set(GIT_ERROR_REFERENCE, "corrupted packed references file");
+			return -1;
+		}
 		left++;
 	}
 
 	while (left < right) {
 		const char *mid, *rec;
-		int compare;
 
 		mid = left + (right - left) / 2;
 		rec = start_of_record(left, mid);
-		compare = cmp_record_to_refname(rec, data_end - rec, ref_name, backend->oid_type);
 
-		if (compare < 0) {
+		if (cmp_record_to_refname(rec, data_end - rec, ref_name, backend->oid_type) < 0)
 			left = end_of_record(mid, right);
-		} else if (compare > 0) {
+		else
 			right = rec;
-		} else {
-			const char *eol;
-			git_oid oid, peel, *peel_ptr = NULL;
+	}
 
-			if (data_end - rec < (long)oid_hexsize ||
-			    git_oid_from_prefix(&oid, rec, oid_hexsize, backend->oid_type) < 0) {
-				goto parse_failed;
-			}
-			rec += oid_hexsize + 1;
-			if (!(eol = memchr(rec, '\n', data_end - rec))) {
-				goto parse_failed;
-			}
+	*out = left;
+	return 0;
+}
 
-			/* look for optional "^<OID>\n" */
+typedef struct {
+	const char *name;
+	size_t name_len;
+	git_oid oid;
+	git_oid peel;
+	unsigned int has_peel : 1;
+} packed_record;
 
-			if (eol + 1 < data_end) {
-				rec = eol + 1;
+/*
+ * Parse the "<OID> <refname>\n" record (optionally followed by a
+ * "^<OID>\n" peel line) at `*rec` in the packed-refs map, and advance
+ * `*rec` to the next record.
+ */
+static int packed_map_parse(
+	packed_record *out,
+	const char **rec,
+	const char *data_end,
+	git_oid_t oid_type)
+{
+	size_t oid_hexsize = git_oid_hexsize(oid_type);
+	const char *scan = *rec, *eol;
 
-				if (*rec == '^') {
-					rec++;
-					if (data_end - rec < (long)oid_hexsize ||
-					    git_oid_from_prefix(&peel, rec, oid_hexsize, backend->oid_type) < 0) {
-						goto parse_failed;
-					}
-					peel_ptr = &peel;
-				}
-			}
+	if (data_end - scan < (long)oid_hexsize + 2 ||
+	    git_oid_from_prefix(&out->oid, scan, oid_hexsize, oid_type) < 0 ||
+	    scan[oid_hexsize] != ' ')
+		goto parse_failed;
 
-			*out = git_reference__alloc(ref_name, &oid, peel_ptr);
-			if (!*out) {
-				return -1;
-			}
+	scan += oid_hexsize + 1;
 
-			return 0;
-		}
+	if (!(eol = memchr(scan, '\n', data_end - scan)))
+		goto parse_failed;
+
+	out->name = scan;
+	out->name_len = (eol > scan && eol[-1] == '\r') ?
+		(size_t)(eol - scan - 1) : (size_t)(eol - scan);
+	out->has_peel = 0;
+
+	scan = eol + 1;
+
+	/* look for optional "^<OID>\n" */
+	if (scan < data_end && *scan == '^') {
+		scan++;
+
+		if (data_end - scan < (long)oid_hexsize ||
+		    git_oid_from_prefix(&out->peel, scan, oid_hexsize, oid_type) < 0)
+			goto parse_failed;
+
+		out->has_peel = 1;
+
+		if (!(eol = memchr(scan, '\n', data_end - scan)))
+			scan = data_end;
+		else
+			scan = eol + 1;
 	}
-	return ref_error_notfound(ref_name);
+
+	*rec = scan;
+	return 0;
 
 parse_failed:
 	git_error_set(GIT_ERROR_REFERENCE, "corrupted packed references file");
 	return -1;
 }
 
+/*
+ * While a transaction is committed, the references it deleted have only
+ * been removed from the cache, and packed-refs itself is rewritten once
+ * the transaction is done.
+ */
+static int packed_cache_lookup(
+	git_reference **out,
+	refdb_fs_backend *backend,
+	const char *ref_name)
+{
+	struct packref *entry;
+	int error = 0;
+
+	if ((error = git_sortedcache_rlock(backend->refcache)) < 0)
+		return error;
+
+	if ((entry = git_sortedcache_lookup(backend->refcache, ref_name)) == NULL) {
+		error = ref_error_notfound(ref_name);
+	} else {
+		*out = git_reference__alloc(ref_name, &entry->oid,
+			(entry->flags & PACKREF_HAS_PEEL) ? &entry->peel : NULL);
+
+		if (!*out)
+			error = -1;
+	}
+
+	git_sortedcache_runlock(backend->refcache);
+	return error;
+}
+
+static int packed_lookup(
+        git_reference **out,
+        refdb_fs_backend *backend,
+        const char *ref_name)
+{
+	const char *rec, *data_end;
+	packed_record record;
+	int error = 0;
+
+	if (backend->batch_deletes.length)
+		return packed_cache_lookup(out, backend, ref_name);
+
+	if ((error = packed_map_check(backend)) < 0)
+		return error;
+
+	if (!backend->sorted)
+		return packed_unsorted_lookup(out, backend, ref_name);
+
+	data_end = (const char *) backend->packed_refs_map.data +
+	           backend->packed_refs_map.len;
+
+	if ((error = packed_map_seek(&rec, backend, ref_name)) < 0)
+		return error;
+
+	if (rec == data_end ||
+	    cmp_record_to_refname(rec, data_end - rec, ref_name, backend->oid_type) != 0)
+		return ref_error_notfound(ref_name);
+
+	if ((error = packed_map_parse(&record, &rec, data_end, backend->oid_type)) < 0)
+		return error;
+
+	*out = git_reference__alloc(ref_name, &record.oid,
+		record.has_peel ? &record.peel : NULL);
+	GIT_ERROR_CHECK_ALLOC(*out);
+
+	return 0;
+}
+
+/*
+ * Load only the packed references whose names begin with `prefix` into
+ * a new cache, by seeking to them in the sorted packed-refs map; this
+ * avoids parsing every reference when there are many of them.  Returns
+ * `GIT_PASSTHROUGH` when the packed-refs file is not sorted, in which
+ * case the entire file must be loaded instead.
+ */
+static int packed_load_prefix(
+	git_sortedcache **out,
+	refdb_fs_backend *backend,
+	const char *prefix,
+	size_t prefix_len)
+{
+	git_sortedcache *cache = NULL;
+	git_str name = GIT_STR_INIT;
+	const char *rec, *data_end;
+	int error;
+
+	if (backend->batch_deletes.length)
+		return GIT_PASSTHROUGH;
+
+	if ((error = packed_map_check(backend)) < 0)
+		return error;
+
+	if (!backend->sorted || !backend->packed_refs_map.data)
+		return GIT_PASSTHROUGH;
+
+	data_end = (const char *) backend->packed_refs_map.data +
+	           backend->packed_refs_map.len;
+
+	if ((error = git_str_put(&name, prefix, prefix_len)) < 0 ||
+	    (error = packed_map_seek(&rec, backend, name.ptr)) < 0 ||
+	    (error = git_sortedcache_new(&cache, offsetof(struct packref, name),
+			NULL, NULL, packref_cmp, git_sortedcache_path(backend->refcache))) < 0 ||
+	    (error = git_sortedcache_wlock(cache)) < 0)
+		goto done;
+
+	while (rec < data_end) {
+		packed_record record;
+		struct packref *ref;
+
+		if ((error = packed_map_parse(&record, &rec, data_end, backend->oid_type)) < 0)
+			break;
+
+		if (record.name_len < prefix_len ||
+		    memcmp(record.name, prefix, prefix_len) != 0)
+			break;
+
+		git_str_clear(&name);
+
+		if ((error = git_str_put(&name, record.name, record.name_len)) < 0 ||
+		    (error = git_sortedcache_upsert((void **)&ref, cache, name.ptr)) < 0)
+			break;
+
+		git_oid_cpy(&ref->oid, &record.oid);
+
+		if (record.has_peel) {
+			git_oid_cpy(&ref->peel, &record.peel);
+			ref->flags |= PACKREF_HAS_PEEL;
+		} else if (backend->peeling_mode == PEELING_FULL ||
+		           (backend->peeling_mode == PEELING_STANDARD &&
+		            git__prefixcmp(ref->name, GIT_REFS_TAGS_DIR) == 0)) {
+			ref->flags |= PACKREF_CANNOT_PEEL;
+		}
+	}
+
+	git_sortedcache_wunlock(cache);
+
+done:
+	if (error < 0)
+		git_sortedcache_free(cache);
+	else
+		*out = cache;
+
+	git_str_dispose(&name);
+	return error;
+}
+
 static int refdb_fs_backend__lookup(
 	git_reference **out,
 	git_refdb_backend *_backend,
@@ -915,30 +1198,14 @@ struct iter_load_context {
 
 static void iter_load_optimize_prefix(struct iter_load_context *ctx)
 {
-	const char *pos, *last_sep = NULL;
+	size_t prefix_len;
 
 	if (!ctx->iter->glob)
 		return;
 
-	for (pos = ctx->iter->glob; *pos; pos++) {
-		switch (*pos) {
-		case '?':
-		case '*':
-		case '[':
-		case '\\':
-			break;
-		case '/':
-			last_sep = pos;
-			/* FALLTHROUGH */
-		default:
-			continue;
-		}
-		break;
-	}
-
-	if (last_sep) {
+	if ((prefix_len = git_refdb__glob_prefix_len(ctx->iter->glob, true)) > 0) {
 		ctx->ref_prefix = ctx->iter->glob;
-		ctx->ref_prefix_len = (last_sep - ctx->ref_prefix) + 1;
+		ctx->ref_prefix_len = prefix_len;
 	}
 }
 
@@ -1129,6 +1396,7 @@ static int refdb_fs_backend__iterator(
 {
 	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
 	refdb_fs_iter *iter = NULL;
+	size_t prefix_len;
 	int error;
 
 	GIT_ASSERT_ARG(backend);
@@ -1151,11 +1419,22 @@ static int refdb_fs_backend__iterator(
 	if ((error = iter_load_loose_paths(backend, iter)) < 0)
 		goto out;
 
-	if ((error = packed_reload(backend)) < 0)
-		goto out;
+	/*
+	 * When only references with a common prefix can match the glob, we
+	 * can avoid loading the entire packed-refs file.
+	 */
+	if (iter->glob && (prefix_len = git_refdb__glob_prefix_len(iter->glob, false)) > 0)
+		error = packed_load_prefix(&iter->cache, backend, iter->glob, prefix_len);
+	else
+		error = GIT_PASSTHROUGH;
 
-	if ((error = git_sortedcache_copy(&iter->cache, backend->refcache, 1, NULL, NULL)) < 0)
+	if (error == GIT_PASSTHROUGH) {
+		if ((error = packed_reload(backend)) < 0 ||
+		    (error = git_sortedcache_copy(&iter->cache, backend->refcache, 1, NULL, NULL)) < 0)
+			goto out;
+	} else if (error < 0) {
 		goto out;
+	}
 
 	iter->parent.next = refdb_fs_backend__iterator_next;
 	iter->parent.next_name = refdb_fs_backend__iterator_next_name;
@@ -1273,7 +1552,10 @@ static int loose_lock(git_filebuf *file, refdb_fs_backend *backend, const char *
 	return error;
 }
 
-static int loose_commit(git_filebuf *file, const git_reference *ref)
+static int loose_commit(
+	refdb_fs_backend *backend,
+	git_filebuf *file,
+	const git_reference *ref)
 {
 	GIT_ASSERT_ARG(file);
 	GIT_ASSERT_ARG(ref);
@@ -1289,7 +1571,7 @@ static int loose_commit(git_filebuf *file, const git_reference *ref)
 		GIT_ASSERT(0);
 	}
 
-	return git_filebuf_commit(file);
+	return git_filebuf_commit_batch(file, NULL, refdb_fs_fsync_batch(backend));
 }
 
 static int refdb_fs_backend__lock(void **out, git_refdb_backend *_backend, const char *refname)
@@ -1327,19 +1609,44 @@ static int refdb_fs_backend__delete_tail(
 	const git_oid *old_id,
 	const char *old_target);
 
+static git_refdb *refdb_fs_batch(refdb_fs_backend *backend)
+{
+	git_refdb *refdb = backend->repo->_refdb;
+	return (refdb && refdb->batch) ? refdb : NULL;
+}
+
+static int refdb_fs_backend__batch_delete(
+	refdb_fs_backend *backend,
+	git_refdb *refdb,
+	git_filebuf *lock,
+	const char *ref_name);
+
+static int refdb_fs_backend__batch_flush(git_refdb_backend *_backend);
+static int refdb_fs_backend__batch_done(git_refdb_backend *_backend, int success);
+
 static int refdb_fs_backend__unlock(git_refdb_backend *backend, void *payload, int success, int update_reflog,
 				    const git_reference *ref, const git_signature *sig, const char *message)
 {
+	refdb_fs_backend *fs_backend = GIT_CONTAINER_OF(backend, refdb_fs_backend, parent);
 	git_filebuf *lock = (git_filebuf *) payload;
+	git_refdb *refdb;
 	int error = 0;
 
-	if (success == 2)
+	if (success == 2 && (refdb = refdb_fs_batch(fs_backend)) != NULL)
+		return refdb_fs_backend__batch_delete(fs_backend, refdb, lock, ref->name);
+	else if (success == 2)
 		error = refdb_fs_backend__delete_tail(backend, lock, ref->name, NULL, NULL);
 	else if (success)
 		error = refdb_fs_backend__write_tail(backend, ref, lock, update_reflog, NULL, NULL, sig, message);
 	else
 		git_filebuf_cleanup(lock);
 
+	if (success == 1 && !error && (refdb = refdb_fs_batch(fs_backend)) != NULL) {
+		fs_backend->batch_writes++;
+		refdb->batch_flush = refdb_fs_backend__batch_flush;
+		refdb->batch_done = refdb_fs_backend__batch_done;
+	}
+
 	git__free(lock);
 	return error;
 }
@@ -1494,18 +1801,30 @@ static int packed_remove_loose(refdb_fs_backend *backend)
 	return 0;
 }
 
+static int packed_lock_open(git_filebuf *pack_file, refdb_fs_backend *backend)
+{
+	int open_flags = 0;
+
+	if (refdb_fs_should_fsync(backend))
+		open_flags = GIT_FILEBUF_FSYNC;
+
+	return git_filebuf_open(pack_file, git_sortedcache_path(backend->refcache),
+		open_flags, GIT_PACKEDREFS_FILE_MODE);
+}
+
 /*
- * Write all the contents in the in-memory packfile to disk.
+ * Write all the contents in the in-memory packfile to disk, through
+ * the already locked `pack_file`.
  */
-static int packed_write(refdb_fs_backend *backend)
+static int packed_commit(refdb_fs_backend *backend, git_filebuf *pack_file)
 {
 	git_sortedcache *refcache = backend->refcache;
-	git_filebuf pack_file = GIT_FILEBUF_INIT;
-	int error, open_flags = 0;
+	int error;
 	size_t i;
 
 	/* take lock and close up packed-refs mmap if open */
 	if ((error = git_mutex_lock(&backend->prlock)) < 0) {
+		git_filebuf_cleanup(pack_file);
 		return error;
 	}
 
@@ -1514,20 +1833,15 @@ static int packed_write(refdb_fs_backend *backend)
 	git_mutex_unlock(&backend->prlock);
 
 	/* lock the cache to updates while we do this */
-	if ((error = git_sortedcache_wlock(refcache)) < 0)
+	if ((error = git_sortedcache_wlock(refcache)) < 0) {
+		git_filebuf_cleanup(pack_file);
 		return error;
-
-	if (refdb_fs_should_fsync(backend))
-		open_flags = GIT_FILEBUF_FSYNC;
-
-	/* Open the file! */
-	if ((error = git_filebuf_open(&pack_file, git_sortedcache_path(refcache), open_flags, GIT_PACKEDREFS_FILE_MODE)) < 0)
-		goto fail;
+	}
 
 	/* Packfiles have a header... apparently
 	 * This is in fact not required, but we might as well print it
 	 * just for kicks */
-	if ((error = git_filebuf_printf(&pack_file, "%s\n", GIT_PACKEDREFS_HEADER)) < 0)
+	if ((error = git_filebuf_printf(pack_file, "%s\n", GIT_PACKEDREFS_HEADER)) < 0)
 		goto fail;
 
 	for (i = 0; i < git_sortedcache_entrycount(refcache); ++i) {
@@ -1541,13 +1855,13 @@ static int packed_write(refdb_fs_backend *backend)
 		if ((error = packed_find_peel(backend, ref)) < 0)
 			goto fail;
 
-		if ((error = packed_write_ref(ref, &pack_file)) < 0)
+		if ((error = packed_write_ref(ref, pack_file)) < 0)
 			goto fail;
 	}
 
 	/* if we've written all the references properly, we can commit
 	 * the packfile to make the changes effective */
-	if ((error = git_filebuf_commit(&pack_file)) < 0)
+	if ((error = git_filebuf_commit(pack_file)) < 0)
 		goto fail;
 
 	/* when and only when the packfile has been properly written,
@@ -1562,12 +1876,23 @@ static int packed_write(refdb_fs_backend *backend)
 	return 0;
 
 fail:
-	git_filebuf_cleanup(&pack_file);
+	git_filebuf_cleanup(pack_file);
 	git_sortedcache_wunlock(refcache);
 
 	return error;
 }
 
+static int packed_write(refdb_fs_backend *backend)
+{
+	git_filebuf pack_file = GIT_FILEBUF_INIT;
+	int error;
+
+	if ((error = packed_lock_open(&pack_file, backend)) < 0)
+		return error;
+
+	return packed_commit(backend, &pack_file);
+}
+
 static int packed_delete(refdb_fs_backend *backend, const char *ref_name)
 {
 	size_t pack_pos;
@@ -1758,7 +2083,7 @@ static int refdb_fs_backend__write_tail(
 		}
 	}
 
-	return loose_commit(file, ref);
+	return loose_commit(backend, file, ref);
 
 on_error:
         git_filebuf_cleanup(file);
@@ -1917,6 +2242,130 @@ cleanup:
 	return error;
 }
 
+static int refdb_fs_autopack(refdb_fs_backend *backend, size_t written);
+
+static int refdb_fs_backend__batch_flush(git_refdb_backend *_backend)
+{
+	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+	struct batch_delete *del;
+	bool packed = false;
+	size_t i;
+	int error = 0, delete_error;
+
+	git_vector_foreach(&backend->batch_deletes, i, del)
+		packed |= del->packed;
+
+	/*
+	 * The deleted references must be gone from packed-refs before
+	 * their loose files are removed, or else their packed value would
+	 * briefly become visible again.
+	 */
+	if (packed) {
+		if ((error = packed_commit(backend, &backend->packed_lock)) < 0)
+			git_futils_filestamp_set(&backend->refcache->stamp, NULL);
+	} else {
+		git_filebuf_cleanup(&backend->packed_lock);
+	}
+
+	git_vector_foreach(&backend->batch_deletes, i, del) {
+		if (!error) {
+			delete_error = loose_delete(backend, del->name);
+
+			if (delete_error == GIT_ENOTFOUND)
+				delete_error = del->packed ? 0 : ref_error_notfound(del->name);
+			if (!delete_error)
+				delete_error = refdb_fs_backend__prune_refs(backend, del->name, "");
+
+			if (delete_error < 0)
+				error = delete_error;
+		}
+
+		git_filebuf_cleanup(del->lock);
+		git__free(del->lock);
+		git__free(del);
+	}
+
+	git_vector_clear(&backend->batch_deletes);
+	return error;
+}
+
+/*
+ * Pack the references once the transaction's loose references have
+ * been committed; until then, they are only lock files.  The references
+ * have been updated, so failing to pack them does not fail the
+ * transaction.
+ */
+static int refdb_fs_backend__batch_done(git_refdb_backend *_backend, int success)
+{
+	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+
+	if (success && refdb_fs_autopack(backend, backend->batch_writes) < 0)
+		git_error_clear();
+
+	backend->batch_writes = 0;
+	return 0;
+}
+
+/*
+ * Delete a reference as part of the transaction that is being committed:
+ * take the packed-refs lock when the first reference is deleted, drop
+ * the reference from the packed references in memory, and keep the
+ * loose reference locked until the transaction is done.
+ */
+static int refdb_fs_backend__batch_delete(
+	refdb_fs_backend *backend,
+	git_refdb *refdb,
+	git_filebuf *lock,
+	const char *ref_name)
+{
+	struct batch_delete *del;
+	size_t alloclen, pos;
+	int error;
+
+	if (!backend->batch_deletes.length &&
+	    ((error = packed_lock_open(&backend->packed_lock, backend)) < 0 ||
+	     (error = packed_reload(backend)) < 0))
+		goto on_error;
+
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, sizeof(*del), strlen(ref_name) + 1);
+	if ((del = git__calloc(1, alloclen)) == NULL) {
+		error = -1;
+		goto on_error;
+	}
+
+	memcpy(del->name, ref_name, strlen(ref_name));
+	del->lock = lock;
+
+	if ((error = git_vector_insert(&backend->batch_deletes, del)) < 0) {
+		git__free(del);
+		goto on_error;
+	}
+
+	if ((error = git_sortedcache_wlock(backend->refcache)) < 0) {
+		git_vector_pop(&backend->batch_deletes);
+		git__free(del);
+		goto on_error;
+	}
+
+	if (git_sortedcache_lookup_index(&pos, backend->refcache, ref_name) == 0) {
+		git_sortedcache_remove(backend->refcache, pos);
+		del->packed = 1;
+	}
+
+	git_sortedcache_wunlock(backend->refcache);
+
+	refdb->batch_flush = refdb_fs_backend__batch_flush;
+	return 0;
+
+on_error:
+	if (!backend->batch_deletes.length)
+		git_filebuf_cleanup(&backend->packed_lock);
+
+	git_filebuf_cleanup(lock);
+	git__free(lock);
+	return error;
+}
+
 static int refdb_reflog_fs__rename(git_refdb_backend *_backend, const char *old_name, const char *new_name);
 
 static int refdb_fs_backend__rename(
@@ -1972,7 +2421,7 @@ static int refdb_fs_backend__rename(
 		return error;
 	}
 
-	if ((error = loose_commit(&file, new)) < 0 || out == NULL) {
+	if ((error = loose_commit(backend, &file, new)) < 0 || out == NULL) {
 		git_reference_free(new);
 		git_filebuf_cleanup(&file);
 		return error;
@@ -1982,28 +2431,96 @@ static int refdb_fs_backend__rename(
 	return 0;
 }
 
-static int refdb_fs_backend__compress(git_refdb_backend *_backend)
+static int refdb_fs_backend__pack_refs(
+	git_refdb_backend *_backend,
+	const git_refdb_pack_options *opts)
 {
 	int error;
 	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
 
 	GIT_ASSERT_ARG(backend);
+	GIT_ASSERT_ARG(opts);
 
 	if ((error = packed_reload(backend)) < 0 || /* load the existing packfile */
-	    (error = packed_loadloose(backend)) < 0 || /* add all the loose refs */
+	    (error = packed_loadloose(backend, opts)) < 0 || /* add the selected loose refs */
 	    (error = packed_write(backend)) < 0) /* write back to disk */
 		return error;
 
+	backend->loose_counted = 0;
+	return 0;
+}
+
+static int refdb_fs_backend__compress(git_refdb_backend *_backend)
+{
+	git_refdb_pack_options opts = GIT_REFDB_PACK_OPTIONS_INIT;
+
+	opts.flags = GIT_REFDB_PACK_ALL;
+
+	return refdb_fs_backend__pack_refs(_backend, &opts);
+}
+
+/*
+ * Pack all references once more than "gc.autoPackRefs" loose references
+ * have accumulated.  The loose references are only counted again when
+ * the references written since the last count could have reached the
+ * limit, so that most transactions do not walk the refs directory.
+ */
+static int refdb_fs_autopack(refdb_fs_backend *backend, size_t written)
+{
+	git_config *config;
+	size_t count;
+	int limit, error;
+
+	if ((error = git_repository_config__weakptr(&config, backend->repo)) < 0)
+		return error;
+
+	if ((limit = git_config__get_int_force(config, "gc.autopackrefs", 0)) <= 0)
+		return 0;
+
+	if (backend->loose_counted &&
+	    backend->loose_estimate + written <= (size_t)limit) {
+		backend->loose_estimate += written;
+		return 0;
+	}
+
+	if ((error = loose_count(&count, backend)) < 0)
+		return error;
+
+	backend->loose_estimate = count;
+	backend->loose_counted = 1;
+
+	if (count <= (size_t)limit)
+		return 0;
+
+	if ((error = refdb_fs_backend__compress(&backend->parent)) < 0)
+		return error;
+
+	/* Symbolic references and references that moved stay loose */
+	if ((error = loose_count(&count, backend)) < 0)
+		return error;
+
+	backend->loose_estimate = count;
+	backend->loose_counted = 1;
 	return 0;
 }
 
 static void refdb_fs_backend__free(git_refdb_backend *_backend)
 {
 	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+	struct batch_delete *del;
+	size_t i;
 
 	if (!backend)
 		return;
 
+	git_vector_foreach(&backend->batch_deletes, i, del) {
+		git_filebuf_cleanup(del->lock);
+		git__free(del->lock);
+		git__free(del);
+	}
+
+	git_vector_dispose(&backend->batch_deletes);
+	git_filebuf_cleanup(&backend->packed_lock);
 	git_sortedcache_free(backend->refcache);
 
 	git_mutex_lock(&backend->prlock);
@@ -2091,56 +2608,76 @@ static int reflog_alloc(
 	return 0;
 }
 
-static int reflog_parse(git_reflog *log, const char *buf, size_t buf_size)
+/*
+ * Parse the reflog entry on the parser's current line.  Returns
+ * `GIT_EINVALID` for malformed entries, which are skipped.
+ */
+static int reflog_parse_entry(
+	git_reflog_entry **out,
+	git_parse_ctx *parser,
+	git_oid_t oid_type)
 {
-	git_parse_ctx parser = GIT_PARSE_CTX_INIT;
+	git_reflog_entry *entry;
+	const char *sig;
+	char c;
 
-	if ((git_parse_ctx_init(&parser, buf, buf_size)) < 0)
-		return -1;
+	entry = git__calloc(1, sizeof(*entry));
+	GIT_ERROR_CHECK_ALLOC(entry);
+	entry->committer = git__calloc(1, sizeof(*entry->committer));
+	GIT_ERROR_CHECK_ALLOC(entry->committer);
 
-	for (; parser.remain_len; git_parse_advance_line(&parser)) {
-		git_reflog_entry *entry;
-		const char *sig;
-		char c;
+	if (git_parse_advance_oid(&entry->oid_old, parser, oid_type) < 0 ||
+	    git_parse_advance_expected(parser, " ", 1) < 0 ||
+	    git_parse_advance_oid(&entry->oid_cur, parser, oid_type) < 0)
+		goto invalid;
+
+	sig = parser->line;
+	while (git_parse_peek(&c, parser, 0) == 0 && c != '\t' && c != '\n')
+		git_parse_advance_chars(parser, 1);
 
-		entry = git__calloc(1, sizeof(*entry));
-		GIT_ERROR_CHECK_ALLOC(entry);
-		entry->committer = git__calloc(1, sizeof(*entry->committer));
-		GIT_ERROR_CHECK_ALLOC(entry->committer);
+	if (git_signature__parse(entry->committer, &sig, parser->line, NULL, 0) < 0)
+		goto invalid;
 
-		if (git_parse_advance_oid(&entry->oid_old, &parser, log->oid_type) < 0 ||
-		    git_parse_advance_expected(&parser, " ", 1) < 0 ||
-		    git_parse_advance_oid(&entry->oid_cur, &parser, log->oid_type) < 0)
-			goto next;
+	if (c == '\t') {
+		size_t len;
+		git_parse_advance_chars(parser, 1);
 
-		sig = parser.line;
-		while (git_parse_peek(&c, &parser, 0) == 0 && c != '\t' && c != '\n')
-			git_parse_advance_chars(&parser, 1);
+		len = parser->line_len;
+		if (parser->line[len - 1] == '\n')
+			len--;
 
-		if (git_signature__parse(entry->committer, &sig, parser.line, NULL, 0) < 0)
-			goto next;
+		entry->msg = git__strndup(parser->line, len);
+		GIT_ERROR_CHECK_ALLOC(entry->msg);
+	}
 
-		if (c == '\t') {
-			size_t len;
-			git_parse_advance_chars(&parser, 1);
+	*out = entry;
+	return 0;
 
-			len = parser.line_len;
-			if (parser.line[len - 1] == '\n')
-				len--;
+invalid:
+	git_reflog_entry__free(entry);
+	return GIT_EINVALID;
+}
 
-			entry->msg = git__strndup(parser.line, len);
-			GIT_ERROR_CHECK_ALLOC(entry->msg);
-		}
+static int reflog_parse(git_reflog *log, const char *buf, size_t buf_size)
+{
+	git_parse_ctx parser = GIT_PARSE_CTX_INIT;
+	int error;
+
+	if ((git_parse_ctx_init(&parser, buf, buf_size)) < 0)
+		return -1;
+
+	for (; parser.remain_len; git_parse_advance_line(&parser)) {
+		git_reflog_entry *entry;
+
+		if ((error = reflog_parse_entry(&entry, &parser, log->oid_type)) == GIT_EINVALID)
+			continue;
+		else if (error < 0)
+			return error;
 
 		if ((git_vector_insert(&log->entries, entry)) < 0) {
 			git_reflog_entry__free(entry);
 			return -1;
 		}
-
-		continue;
-
-next:
-		git_reflog_entry__free(entry);
 	}
 
 	return 0;
@@ -2259,6 +2796,95 @@ success:
 	return error;
 }
 
+/*
+ * Walk the reflog from its last line backwards, parsing one entry at a
+ * time from the mapped file, so that looking up the most recent entries
+ * does not depend on the size of the reflog.
+ */
+static int refdb_reflog_fs__foreach(
+	git_refdb_backend *_backend,
+	const char *name,
+	git_refdb_reflog_foreach_cb cb,
+	void *payload)
+{
+	refdb_fs_backend *backend;
+	git_str log_path = GIT_STR_INIT;
+	git_map map = { 0 };
+	const char *data;
+	size_t start, end;
+	uint64_t size;
+	git_file fd = -1;
+	int error;
+
+	GIT_ASSERT_ARG(_backend);
+	GIT_ASSERT_ARG(name);
+	GIT_ASSERT_ARG(cb);
+
+	backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+
+	if ((error = reflog_path(&log_path, backend->repo, name)) < 0)
+		goto done;
+
+	if ((fd = git_futils_open_ro(log_path.ptr)) < 0) {
+		error = fd;
+
+		/* A missing reflog has no entries */
+		if (error == GIT_ENOTFOUND) {
+			git_error_clear();
+			error = 0;
+		}
+
+		goto done;
+	}
+
+	if ((error = git_futils_filesize(&size, fd)) < 0)
+		goto done;
+
+	if (!git__is_sizet(size)) {
+		git_error_set(GIT_ERROR_OS, "reflog '%s' too large to map", log_path.ptr);
+		error = -1;
+		goto done;
+	}
+
+	if (!size || (error = git_futils_mmap_ro(&map, fd, 0, (size_t)size)) < 0)
+		goto done;
+
+	data = map.data;
+
+	for (end = map.len; end > 0; end = start) {
+		git_parse_ctx parser = GIT_PARSE_CTX_INIT;
+		git_reflog_entry *entry;
+
+		/* The previous line ends right before this one starts */
+		for (start = end - 1; start > 0 && data[start - 1] != '\n'; start--)
+			;
+
+		if ((error = git_parse_ctx_init(&parser, data + start, end - start)) < 0)
+			break;
+
+		if ((error = reflog_parse_entry(&entry, &parser, backend->oid_type)) == GIT_EINVALID) {
+			error = 0;
+			continue;
+		} else if (error < 0) {
+			break;
+		}
+
+		error = cb(entry, payload);
+		git_reflog_entry__free(entry);
+
+		if (error)
+			break;
+	}
+
+done:
+	if (map.data)
+		git_futils_mmap_free(&map);
+	if (fd >= 0)
+		p_close(fd);
+	git_str_dispose(&log_path);
+	return error;
+}
+
 static int serialize_reflog_entry(
 	git_str *buf,
 	const git_oid *oid_old,
@@ -2453,7 +3079,8 @@ static int reflog_append(
 	if (refdb_fs_should_fsync(backend))
 		open_flags |= O_FSYNC;
 
-	error = git_futils_writebuffer(&buf, git_str_cstr(&path), open_flags, GIT_REFLOG_FILE_MODE);
+	error = git_futils_writebuffer_batch(&buf, git_str_cstr(&path), open_flags,
+		GIT_REFLOG_FILE_MODE, refdb_fs_fsync_batch(backend));
 
 cleanup:
 	git_str_dispose(&buf);
@@ -2627,12 +3254,14 @@ int git_refdb_backend_fs(
 	backend->parent.del = &refdb_fs_backend__delete;
 	backend->parent.rename = &refdb_fs_backend__rename;
 	backend->parent.compress = &refdb_fs_backend__compress;
+	backend->parent.pack_refs = &refdb_fs_backend__pack_refs;
 	backend->parent.lock = &refdb_fs_backend__lock;
 	backend->parent.unlock = &refdb_fs_backend__unlock;
 	backend->parent.has_log = &refdb_reflog_fs__has_log;
 	backend->parent.ensure_log = &refdb_reflog_fs__ensure_log;
 	backend->parent.free = &refdb_fs_backend__free;
 	backend->parent.reflog_read = &refdb_reflog_fs__read;
+	backend->parent.reflog_foreach = &refdb_reflog_fs__foreach;
 	backend->parent.reflog_write = &refdb_reflog_fs__write;
 	backend->parent.reflog_rename = &refdb_reflog_fs__rename;
 	backend->parent.reflog_delete = &refdb_reflog_fs__delete;
@@ -7,6 +7,7 @@
 
 #include "refdb_reftable.h"
 
+#include "config.h"
 #include "refdb.h"
 #include "reflog.h"
 #include "signature.h"
@@ -37,11 +38,22 @@ typedef struct {
 	refdb_reftable_stack_t which;
 } refdb_reftable_stack;
 
+/*
+ * The number of open stacks of each kind that we keep around. A stack is
+ * taken out of the pool for the duration of an operation, so this bounds
+ * the number of concurrent operations (e.g. nested iterators) that can
+ * reuse an already-loaded stack instead of opening all of its tables
+ * again.
+ */
+#define REFDB_REFTABLE_STACK_POOL 4
+
 typedef struct {
 	git_refdb_backend parent;
 	git_repository *repo;
-	refdb_reftable_stack *stack;
-	refdb_reftable_stack *worktree_stack;
+	refdb_reftable_stack *stacks[REFDB_REFTABLE_STACK_POOL];
+	refdb_reftable_stack *worktree_stacks[REFDB_REFTABLE_STACK_POOL];
+	/* the updates of the transaction that is being committed */
+	git_vector batch;
 } refdb_reftable;
 
 typedef struct {
@@ -61,6 +73,7 @@ typedef struct {
 	refdb_reftable_stack_iterator main;
 	refdb_reftable_stack_iterator worktree;
 	const char *glob;
+	size_t prefix_len;
 } refdb_reftable_iterator;
 
 static int refdb_reftable_error(int error, const char *msg)
@@ -105,28 +118,74 @@ static void refdb_reftable_stack_free(void *_stack)
 static void refdb_reftable_return_stack(refdb_reftable *backend,
 					refdb_reftable_stack *stack)
 {
+	refdb_reftable_stack **pool;
+	size_t i;
+
 	if (!stack)
 		return;
 
 	switch (stack->which) {
 	case REFDB_REFTABLE_STACK_WORKTREE:
-		if (git_atomic_compare_and_swap(&backend->worktree_stack, NULL, stack) != NULL)
-			refdb_reftable_stack_free(stack);
+		pool = backend->worktree_stacks;
 		break;
 	case REFDB_REFTABLE_STACK_MAIN:
-		if (git_atomic_compare_and_swap(&backend->stack, NULL, stack) != NULL)
-			refdb_reftable_stack_free(stack);
+		pool = backend->stacks;
 		break;
+	default:
+		refdb_reftable_stack_free(stack);
+		return;
+	}
+
+	for (i = 0; i < REFDB_REFTABLE_STACK_POOL; i++) {
+		if (git_atomic_compare_and_swap(&pool[i], NULL, stack) == NULL)
+			return;
 	}
+
+	refdb_reftable_stack_free(stack);
+}
+
+/*
+ * Read the table layout and compaction settings that git honors for
+ * reftable repositories. Invalid or out-of-range values are ignored in
+ * favor of the library defaults.
+ */
+static int refdb_reftable_write_options(struct reftable_write_options *options,
+					refdb_reftable *backend)
+{
+	git_config *config;
+	int value;
+
+	if (git_repository_config__weakptr(&config, backend->repo) < 0)
+		return -1;
+
+	value = git_config__get_int_force(config, "reftable.blocksize", 0);
+	if (value > 0 && value < (1 << 24))
+		options->block_size = (uint32_t)value;
+
+	value = git_config__get_int_force(config, "reftable.restartinterval", 0);
+	if (value > 0 && value <= UINT16_MAX)
+		options->restart_interval = (uint16_t)value;
+
+	value = git_config__get_int_force(config, "reftable.geometricfactor", 0);
+	if (value > 0 && value <= UINT8_MAX)
+		options->auto_compaction_factor = (uint8_t)value;
+
+	options->skip_index_objects =
+		!git_config__get_bool_force(config, "reftable.indexobjects", 1);
+	options->lock_timeout_ms =
+		git_config__get_int_force(config, "reftable.locktimeout", 100);
+
+	return 0;
 }
 
 static int refdb_reftable_stack_for(refdb_reftable_stack **out,
 				    refdb_reftable *backend, refdb_reftable_stack_t which)
 {
 	struct reftable_write_options options = { 0 };
-	refdb_reftable_stack **stack_ptr, *stack;
+	refdb_reftable_stack **pool, *stack = NULL;
 	const char *parent_directory;
 	git_str path = GIT_STR_INIT;
+	size_t i;
 	int error;
 
 	*out = NULL;
@@ -146,12 +205,11 @@ static int refdb_reftable_stack_for(refdb_reftable_stack **out,
 #else
 	options.hash_id = REFTABLE_HASH_SHA1;
 #endif
-	options.lock_timeout_ms = 100;
 
 	switch (which) {
 	case REFDB_REFTABLE_STACK_WORKTREE:
 		if (git_repository_is_worktree(backend->repo)) {
-			stack_ptr = &backend->worktree_stack;
+			pool = backend->worktree_stacks;
 			parent_directory = backend->repo->gitdir;
 			break;
 		}
@@ -163,7 +221,7 @@ static int refdb_reftable_stack_for(refdb_reftable_stack **out,
 
 		/* fallthru */
 	case REFDB_REFTABLE_STACK_MAIN:
-		stack_ptr = &backend->stack;
+		pool = backend->stacks;
 		parent_directory = backend->repo->commondir;
 		break;
 	default:
@@ -171,9 +229,17 @@ static int refdb_reftable_stack_for(refdb_reftable_stack **out,
 		goto out;
 	}
 
-	stack = git_atomic_swap(*stack_ptr, NULL);
+	for (i = 0; !stack && i < REFDB_REFTABLE_STACK_POOL; i++)
+		stack = git_atomic_swap(pool[i], NULL);
+
+	/*
+	 * Reloading a stack only stats "tables.list" when it did not
+	 * change, and otherwise keeps the tables that are still in use
+	 * open, so reusing a stack is much cheaper than opening it anew.
+	 */
 	if (stack) {
 		if ((error = reftable_stack_reload(stack->stack)) < 0) {
+			refdb_reftable_stack_free(stack);
 			error = refdb_reftable_error(error, "failed reloading stack");
 			goto out;
 		}
@@ -182,6 +248,11 @@ static int refdb_reftable_stack_for(refdb_reftable_stack **out,
 		GIT_ERROR_CHECK_ALLOC(stack);
 		stack->which = which;
 
+		if ((error = refdb_reftable_write_options(&options, backend)) < 0) {
+			refdb_reftable_stack_free(stack);
+			goto out;
+		}
+
 		if ((error = git_str_joinpath(&path, parent_directory, "reftable")) < 0 ||
 		    (error = reftable_new_stack(&stack->stack, path.ptr, &options)) < 0) {
 			refdb_reftable_stack_free(stack);
@@ -593,7 +664,8 @@ out:
 
 static int refdb_reftable_stack_iter_maybe_advance(refdb_reftable_stack_iterator *it,
 				    refdb_reftable_stack_t which,
-				    const char *glob, bool is_worktree)
+				    const char *glob, size_t prefix_len,
+				    bool is_worktree)
 {
 	if (it->state == STACK_ITER_READY ||
 	    it->state == STACK_ITER_EXHAUSTED)
@@ -610,6 +682,15 @@ static int refdb_reftable_stack_iter_maybe_advance(refdb_reftable_stack_iterator
 			return refdb_reftable_error(error, "failed retrieving next record");
 		}
 
+		/*
+		 * References are sorted, so once we are past the literal
+		 * prefix of the glob, no other reference can match.
+		 */
+		if (glob && strncmp(it->ref.refname, glob, prefix_len) != 0) {
+			it->state = STACK_ITER_EXHAUSTED;
+			return 0;
+		}
+
 		switch (which) {
 		case REFDB_REFTABLE_STACK_MAIN:
 			if (is_worktree && git_reference__is_per_worktree_ref(it->ref.refname))
@@ -637,12 +718,12 @@ static int refdb_reftable_merged_iter_next(struct reftable_ref_record **out,
 	int error;
 
 	if ((error = refdb_reftable_stack_iter_maybe_advance(&it->main, REFDB_REFTABLE_STACK_MAIN,
-							     it->glob, is_worktree)) < 0)
+							     it->glob, it->prefix_len, is_worktree)) < 0)
 		return error;
 
 	if (git_repository_is_worktree(backend->repo)) {
 		if ((error = refdb_reftable_stack_iter_maybe_advance(&it->worktree, REFDB_REFTABLE_STACK_WORKTREE,
-								     it->glob, is_worktree)) < 0)
+								     it->glob, it->prefix_len, is_worktree)) < 0)
 			return error;
 
 		if (it->main.state == STACK_ITER_READY &&
@@ -746,41 +827,21 @@ static int refdb_reftable_iterator_new(git_reference_iterator **out,
 			goto out;
 	}
 
-	if (glob) {
-		const char *separator = NULL;
-		const char *pos;
-
-		for (pos = glob; *pos; pos++) {
-			switch (*pos) {
-			case '?':
-			case '*':
-			case '[':
-			case '\\':
-				break;
-			case '/':
-				separator = pos;
-				/* FALLTHROUGH */
-			default:
-				continue;
-			}
-			break;
-		}
-
-		if (separator) {
-			it->glob = git__strdup(glob);
-		} else {
-			git_str pattern = GIT_STR_INIT;
-			if ((git_str_printf(&pattern, "refs/%s", glob)) < 0)
-				goto out;
-			it->glob = git_str_detach(&pattern);
-		}
-
-		needle = git__strndup(glob, glob - pos);
+	if (glob && git_refdb__glob_prefix_len(glob, true) > 0) {
+		it->glob = git__strdup(glob);
+	} else if (glob) {
+		git_str pattern = GIT_STR_INIT;
+		if ((error = git_str_printf(&pattern, "refs/%s", glob)) < 0)
+			goto out;
+		it->glob = git_str_detach(&pattern);
 	} else {
 		it->glob = git__strdup("refs/*");
-		needle = git__strdup("refs/");
 	}
 	GIT_ERROR_CHECK_ALLOC(it->glob);
+
+	/* Seek to the first reference that can match the glob. */
+	it->prefix_len = git_refdb__glob_prefix_len(it->glob, false);
+	needle = git__strndup(it->glob, it->prefix_len);
 	GIT_ERROR_CHECK_ALLOC(needle);
 
 	if ((error = reftable_iterator_seek_ref(&it->main.iter, needle)) < 0) {
@@ -800,59 +861,57 @@ out:
 	if (error < 0 && it)
 		refdb_reftable_iterator_free(&it->parent);
 	git__free(needle);
-	return 0;
+	return error;
 }
 
-typedef struct {
-	refdb_reftable *backend;
-	refdb_reftable_stack *stack;
-	const git_reference *ref;
-	int force;
-	const git_signature *who;
-	const char *message;
-	const git_oid *expected_oid;
-	const char *expected_target;
-	int error;
-} refdb_reftable_write_table_data;
-
-static int refdb_reftable_write_table(struct reftable_writer *writer, void *cb_data)
+/*
+ * Prepare the records that update `ref` to its new value: the ref record
+ * and, depending on the reflog configuration, up to two log records that
+ * are appended to `log_records`. Returns `GIT_PASSTHROUGH` when the
+ * reference already has the desired value and nothing needs to be written.
+ */
+static int refdb_reftable_prepare_write(struct reftable_ref_record *ref_record,
+					struct reftable_log_record *log_records,
+					size_t *logs_nr,
+					refdb_reftable *backend,
+					refdb_reftable_stack *stack,
+					const git_reference *ref,
+					int force,
+					int update_reflog,
+					const git_signature *who,
+					const char *message,
+					const git_oid *expected_oid,
+					const char *expected_target,
+					uint64_t update_index)
 {
-	refdb_reftable_write_table_data *data = cb_data;
-	struct reftable_log_record log_records[2] = {{ 0 }};
-	struct reftable_ref_record ref_record = { 0 };
 	const char *new_target = NULL;
 	const git_oid *new_id = NULL;
 	int error, write_reflog;
-	uint64_t update_index;
-	size_t logs_nr = 0, i;
 	git_refdb *refdb;
 
-	if (data->ref->type == GIT_REFERENCE_SYMBOLIC)
-		new_target = data->ref->target.symbolic;
+	if (ref->type == GIT_REFERENCE_SYMBOLIC)
+		new_target = ref->target.symbolic;
 	else
-		new_id = &data->ref->target.oid;
+		new_id = &ref->target.oid;
 
 	/*
 	 * Verify that the current state of the refname matches the expected
 	 * state for non-racy updates.
 	 */
-	if ((error = refdb_reftable_check_ref(data->stack, data->ref->name, data->expected_oid, data->expected_target)) < 0) {
-		data->error = error;
+	if ((error = refdb_reftable_check_ref(stack, ref->name, expected_oid, expected_target)) < 0) {
 		git_error_set(GIT_ERROR_REFERENCE, "old reference value does not match");
-		goto out;
+		return error;
 	}
 
-	if ((error = refdb_reftable_check_refname_available(data->stack, NULL, data->ref->name, data->force)) < 0) {
-		data->error = error;
-		goto out;
-	}
+	if ((error = refdb_reftable_check_refname_available(stack, NULL, ref->name, force)) < 0)
+		return error;
 
 	/*
 	 * Check whether the update is a no-op. If so, we want to skip the
 	 * update completely, most importantly so that we don't write a reflog
 	 * entry.
 	 */
-	if ((error = refdb_reftable_check_ref(data->stack, data->ref->name, new_id, new_target)) < 0) {
+	if ((error = refdb_reftable_check_ref(stack, ref->name, new_id, new_target)) < 0) {
 		if (error == GIT_EMODIFIED) {
 			/*
 			 * The reference is different than what we expected.
@@ -864,112 +923,135 @@ static int refdb_reftable_write_table(struct reftable_writer *writer, void *cb_d
 			 * delete it. As the current state already matches the
 			 * desired state we don't have to do anything.
 			 */
-			error = 0;
-			goto out;
+			return GIT_PASSTHROUGH;
 		} else if (error == GIT_ENOTFOUND) {
 			/*
 			 * The reference does not exist, but we want it to.
 			 * Good, continue with the write.
 			 */
 		} else {
-			data->error = error;
-			goto out;
+			return error;
 		}
 	} else {
 		/*
 		 * The reference already matches our desired value, so we do
 		 * not need to write anything.
 		 */
-		error = 0;
-		goto out;
+		return GIT_PASSTHROUGH;
 	}
 
-	update_index = reftable_stack_next_update_index(data->stack->stack);
-
-	ref_record.refname = (char *) data->ref->name;
-	ref_record.update_index = update_index;
-	switch (git_reference_type(data->ref)) {
+	ref_record->refname = (char *) ref->name;
+	ref_record->update_index = update_index;
+	switch (git_reference_type(ref)) {
 	case GIT_REFERENCE_SYMBOLIC:
-		ref_record.value_type = REFTABLE_REF_SYMREF;
-		ref_record.value.symref = (char *) git_reference_symbolic_target(data->ref);
+		ref_record->value_type = REFTABLE_REF_SYMREF;
+		ref_record->value.symref = (char *) git_reference_symbolic_target(ref);
 		break;
 	case GIT_REFERENCE_DIRECT: {
 		git_object *peeled = NULL;
 
-		if ((error = git_reference_peel(&peeled, data->ref, GIT_OBJECT_COMMIT)) == 0 &&
-		    !git_oid_equal(git_reference_target(data->ref), git_object_id(peeled))) {
-			ref_record.value_type = REFTABLE_REF_VAL2;
-			memcpy(ref_record.value.val2.value, git_reference_target(data->ref), GIT_OID_MAX_SIZE);
-			memcpy(ref_record.value.val2.target_value, git_object_id(peeled)->id, GIT_OID_MAX_SIZE);
+		if ((error = git_reference_peel(&peeled, ref, GIT_OBJECT_COMMIT)) == 0 &&
+		    !git_oid_equal(git_reference_target(ref), git_object_id(peeled))) {
+			ref_record->value_type = REFTABLE_REF_VAL2;
+			memcpy(ref_record->value.val2.value, git_reference_target(ref), GIT_OID_MAX_SIZE);
+			memcpy(ref_record->value.val2.target_value, git_object_id(peeled)->id, GIT_OID_MAX_SIZE);
 		} else {
-			ref_record.value_type = REFTABLE_REF_VAL1;
-			memcpy(ref_record.value.val1, git_reference_target(data->ref), GIT_OID_MAX_SIZE);
+			ref_record->value_type = REFTABLE_REF_VAL1;
+			memcpy(ref_record->value.val1, git_reference_target(ref), GIT_OID_MAX_SIZE);
 		}
 
 		git_object_free(peeled);
 		break;
 	}
 	default:
-		data->error = error = -1;
-		goto out;
+		return -1;
 	}
 
-	if ((error = git_repository_refdb__weakptr(&refdb, data->backend->repo)) < 0 ||
-	    (error = git_refdb_should_write_reflog(&write_reflog, refdb, data->ref)) < 0) {
-		data->error = error;
-		goto out;
-	}
+	if (!update_reflog)
+		return 0;
+
+	if ((error = git_repository_refdb__weakptr(&refdb, backend->repo)) < 0 ||
+	    (error = git_refdb_should_write_reflog(&write_reflog, refdb, ref)) < 0)
+		return error;
 
 	if (write_reflog) {
 		int write_head_reflog = 0;
 		git_oid old_id, new_id;
 
-		git_oid_clear(&old_id, data->backend->repo->oid_type);
-		git_oid_clear(&new_id, data->backend->repo->oid_type);
+		git_oid_clear(&old_id, backend->repo->oid_type);
+		git_oid_clear(&new_id, backend->repo->oid_type);
 
-		error = git_reference_name_to_id(&old_id, data->backend->repo, data->ref->name);
-		if (error < 0 && error != GIT_ENOTFOUND) {
-			data->error = error;
-			goto out;
-		}
+		error = git_reference_name_to_id(&old_id, backend->repo, ref->name);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			return error;
 
-		if (data->ref->type == GIT_REFERENCE_SYMBOLIC) {
-			error = git_reference_name_to_id(&new_id, data->backend->repo,
-							 git_reference_symbolic_target(data->ref));
-			if (error < 0 && error != GIT_ENOTFOUND) {
-				data->error = error;
-				goto out;
-			}
+		if (ref->type == GIT_REFERENCE_SYMBOLIC) {
+			error = git_reference_name_to_id(&new_id, backend->repo,
+							 git_reference_symbolic_target(ref));
+			if (error < 0 && error != GIT_ENOTFOUND)
+				return error;
 
 			/* Detaching HEAD does not create an entry. */
-			if (!strcmp(data->ref->name, GIT_HEAD_REF) && error == GIT_ENOTFOUND)
+			if (!strcmp(ref->name, GIT_HEAD_REF) && error == GIT_ENOTFOUND)
 				write_reflog = 0;
 			/* Symbolic refs other than HEAD do not create an entry, either. */
-			else if (strcmp(data->ref->name, GIT_HEAD_REF))
+			else if (strcmp(ref->name, GIT_HEAD_REF))
 				write_reflog = 0;
 		} else {
-			git_oid_cpy(&new_id, git_reference_target(data->ref));
+			git_oid_cpy(&new_id, git_reference_target(ref));
 		}
 
 		if (write_reflog &&
-		    (error = git_refdb_should_write_head_reflog(&write_head_reflog, refdb, data->ref)) < 0) {
-			data->error = error;
-			goto out;
-		}
+		    (error = git_refdb_should_write_head_reflog(&write_head_reflog, refdb, ref)) < 0)
+			return error;
 
 		if (write_reflog &&
-		    (error = refdb_reftable_log_fill(&log_records[logs_nr++], data->who, &old_id, &new_id,
-						     data->ref->name, data->message, update_index)) < 0) {
-			data->error = error;
-			goto out;
-		}
+		    (error = refdb_reftable_log_fill(&log_records[(*logs_nr)++], who, &old_id, &new_id,
+						     ref->name, message, update_index)) < 0)
+			return error;
 
 		if (write_head_reflog &&
-		    (error = refdb_reftable_log_fill(&log_records[logs_nr++], data->who, &old_id, &new_id,
-						     GIT_HEAD_REF, data->message, update_index)) < 0) {
+		    (error = refdb_reftable_log_fill(&log_records[(*logs_nr)++], who, &old_id, &new_id,
+						     GIT_HEAD_REF, message, update_index)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+typedef struct {
+	refdb_reftable *backend;
+	refdb_reftable_stack *stack;
+	const git_reference *ref;
+	int force;
+	const git_signature *who;
+	const char *message;
+	const git_oid *expected_oid;
+	const char *expected_target;
+	int error;
+} refdb_reftable_write_table_data;
+
+static int refdb_reftable_write_table(struct reftable_writer *writer, void *cb_data)
+{
+	refdb_reftable_write_table_data *data = cb_data;
+	struct reftable_log_record log_records[2] = {{ 0 }};
+	struct reftable_ref_record ref_record = { 0 };
+	uint64_t update_index;
+	size_t logs_nr = 0, i;
+	int error;
+
+	update_index = reftable_stack_next_update_index(data->stack->stack);
+
+	if ((error = refdb_reftable_prepare_write(&ref_record, log_records, &logs_nr,
+						  data->backend, data->stack, data->ref,
+						  data->force, 1, data->who, data->message,
+						  data->expected_oid, data->expected_target,
+						  update_index)) < 0) {
+		if (error == GIT_PASSTHROUGH)
+			error = 0;
+		else
 			data->error = error;
-			goto out;
-		}
+		goto out;
 	}
 
 	if ((error = reftable_writer_set_limits(writer, update_index, update_index)) < 0 ||
@@ -1178,6 +1260,366 @@ out:
 	return error;
 }
 
+/*
+ * A reference update that is part of a transaction. The reftable stack
+ * has no per-reference locks, as "tables.list" is only locked while a
+ * new table is being added. Locking a reference thus records its name
+ * and current value, and the update is written when the reference is
+ * unlocked. The value is checked again while the stack is locked, so an
+ * update fails with GIT_EMODIFIED if the reference was changed since.
+ * While a transaction is being committed, its updates are collected
+ * instead and written as a single table per stack once it is done.
+ */
+typedef struct {
+	char *refname;
+	/* the value at the time of locking; a zero id if it did not exist */
+	git_oid old_id;
+	char *old_target;
+	git_reference *ref;
+	git_signature *who;
+	char *message;
+	int update_reflog;
+	unsigned int remove : 1;
+} refdb_reftable_update;
+
+static void refdb_reftable_update_free(refdb_reftable_update *update)
+{
+	if (!update)
+		return;
+
+	git_reference_free(update->ref);
+	git_signature_free(update->who);
+	git__free(update->message);
+	git__free(update->old_target);
+	git__free(update->refname);
+	git__free(update);
+}
+
+typedef struct {
+	refdb_reftable *backend;
+	refdb_reftable_stack *stack;
+	refdb_reftable_update **updates;
+	size_t updates_nr;
+	int error;
+} refdb_reftable_batch_data;
+
+static int refdb_reftable_batch_grow_logs(struct reftable_log_record **logs,
+					  size_t *logs_alloc,
+					  size_t needed)
+{
+	struct reftable_log_record *grown;
+	size_t alloc = *logs_alloc;
+
+	if (needed <= alloc)
+		return 0;
+
+	while (alloc < needed)
+		GIT_ERROR_CHECK_ALLOC_MULTIPLY(&alloc, alloc ? alloc : 8, 2);
+
+	grown = git__reallocarray(*logs, alloc, sizeof(*grown));
+	GIT_ERROR_CHECK_ALLOC(grown);
+
+	*logs = grown;
+	*logs_alloc = alloc;
+	return 0;
+}
+
+static int refdb_reftable_write_batch_table(struct reftable_writer *writer, void *cb_data)
+{
+	refdb_reftable_batch_data *data = cb_data;
+	struct reftable_log_record *logs = NULL, *log_deletions = NULL;
+	struct reftable_ref_record *refs = NULL;
+	size_t refs_nr = 0, logs_nr = 0, logs_alloc = 0, log_deletions_nr = 0, i, j;
+	uint64_t update_index;
+	bool head_logged = false;
+	int error = 0;
+
+	update_index = reftable_stack_next_update_index(data->stack->stack);
+
+	refs = git__calloc(data->updates_nr, sizeof(*refs));
+	if (!refs) {
+		data->error = error = -1;
+		goto out;
+	}
+
+	for (i = 0; i < data->updates_nr; i++) {
+		refdb_reftable_update *update = data->updates[i];
+		size_t first_log = logs_nr;
+
+		if ((error = refdb_reftable_check_ref(data->stack, update->refname,
+				update->old_target ? NULL : &update->old_id,
+				update->old_target)) < 0) {
+			if (error == GIT_EMODIFIED || error == GIT_ENOTFOUND) {
+				git_error_set(GIT_ERROR_REFERENCE,
+					"reference '%s' was modified since it was locked",
+					update->refname);
+				error = GIT_EMODIFIED;
+			}
+			data->error = error;
+			goto out;
+		}
+
+		if (update->remove) {
+			if ((error = refdb_reftable_updates_for_reflog_delete_or_rename(data->stack,
+					update->refname, NULL, &log_deletions, &log_deletions_nr)) < 0 ||
+			    (error = refdb_reftable_batch_grow_logs(&logs, &logs_alloc,
+					logs_nr + log_deletions_nr)) < 0) {
+				data->error = error;
+				goto out;
+			}
+
+			if (log_deletions_nr)
+				memcpy(logs + logs_nr, log_deletions, log_deletions_nr * sizeof(*logs));
+			logs_nr += log_deletions_nr;
+
+			git__free(log_deletions);
+			log_deletions = NULL;
+			log_deletions_nr = 0;
+
+			refs[refs_nr].refname = update->refname;
+			refs[refs_nr].update_index = update_index;
+			refs[refs_nr].value_type = REFTABLE_REF_DELETION;
+			refs_nr++;
+			continue;
+		}
+
+		if ((error = refdb_reftable_batch_grow_logs(&logs, &logs_alloc, logs_nr + 2)) < 0) {
+			data->error = error;
+			goto out;
+		}
+
+		error = refdb_reftable_prepare_write(&refs[refs_nr], logs, &logs_nr,
+						     data->backend, data->stack, update->ref,
+						     1, update->update_reflog, update->who,
+						     update->message, NULL, NULL, update_index);
+		if (error == GIT_PASSTHROUGH) {
+			error = 0;
+			continue;
+		} else if (error < 0) {
+			data->error = error;
+			goto out;
+		}
+
+		refs_nr++;
+
+		/*
+		 * All of the updates share a single update index, but a log
+		 * can only have one entry per update index. Only the first
+		 * update of the reference that HEAD points to is logged for
+		 * HEAD.
+		 */
+		for (j = first_log; j < logs_nr; j++) {
+			if (strcmp(logs[j].refname, GIT_HEAD_REF))
+				continue;
+
+			if (!head_logged) {
+				head_logged = true;
+				continue;
+			}
+
+			reftable_log_record_release(&logs[j]);
+			memmove(&logs[j], &logs[j + 1], (logs_nr - j - 1) * sizeof(*logs));
+			logs_nr--;
+			j--;
+		}
+	}
+
+	if (!refs_nr && !logs_nr)
+		goto out;
+
+	if ((error = reftable_writer_set_limits(writer, update_index, update_index)) < 0 ||
+	    (error = reftable_writer_add_refs(writer, refs, refs_nr)) < 0 ||
+	    (error = reftable_writer_add_logs(writer, logs, logs_nr)) < 0) {
+		data->error = refdb_reftable_error(error, "failed writing transaction table");
+		goto out;
+	}
+
+out:
+	for (i = 0; i < log_deletions_nr; i++)
+		reftable_log_record_release(&log_deletions[i]);
+	for (i = 0; i < logs_nr; i++)
+		reftable_log_record_release(&logs[i]);
+	git__free(log_deletions);
+	git__free(logs);
+	git__free(refs);
+	return error;
+}
+
+static int refdb_reftable_write_batch(refdb_reftable *backend,
+				      refdb_reftable_stack_t which,
+				      refdb_reftable_update **updates,
+				      size_t updates_nr)
+{
+	refdb_reftable_batch_data data;
+	int error;
+
+	if (!updates_nr)
+		return 0;
+
+	data.backend = backend;
+	data.updates = updates;
+	data.updates_nr = updates_nr;
+	data.error = 0;
+
+	if ((error = refdb_reftable_stack_for(&data.stack, backend, which)) < 0)
+		goto out;
+
+	if ((error = reftable_stack_add(data.stack->stack, refdb_reftable_write_batch_table, &data,
+					REFTABLE_STACK_NEW_ADDITION_RELOAD)) < 0) {
+		if (data.error)
+			error = data.error;
+		else
+			error = refdb_reftable_error(error, "failed stack update");
+		goto out;
+	}
+
+out:
+	refdb_reftable_return_stack(backend, data.stack);
+	return error;
+}
+
+static int refdb_reftable_batch_flush(git_refdb_backend *_backend)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	git_vector main = GIT_VECTOR_INIT, worktree = GIT_VECTOR_INIT;
+	refdb_reftable_update *update;
+	size_t i;
+	int error = 0;
+
+	git_vector_foreach(&backend->batch, i, update) {
+		git_vector *updates = git_reference__is_per_worktree_ref(update->refname) ?
+			&worktree : &main;
+
+		if ((error = git_vector_insert(updates, update)) < 0)
+			goto out;
+	}
+
+	if ((error = refdb_reftable_write_batch(backend, REFDB_REFTABLE_STACK_MAIN,
+			(refdb_reftable_update **)main.contents, main.length)) < 0 ||
+	    (error = refdb_reftable_write_batch(backend, REFDB_REFTABLE_STACK_WORKTREE,
+			(refdb_reftable_update **)worktree.contents, worktree.length)) < 0)
+		goto out;
+
+out:
+	git_vector_foreach(&backend->batch, i, update)
+		refdb_reftable_update_free(update);
+	git_vector_clear(&backend->batch);
+	git_vector_dispose(&worktree);
+	git_vector_dispose(&main);
+	return error;
+}
+
+static int refdb_reftable_lock(void **out, git_refdb_backend *_backend, const char *refname)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	refdb_reftable_update *update = NULL;
+	refdb_reftable_stack *stack = NULL;
+	struct reftable_ref_record ref = { 0 };
+	int error;
+
+	update = git__calloc(1, sizeof(*update));
+	GIT_ERROR_CHECK_ALLOC(update);
+
+	if ((update->refname = git__strdup(refname)) == NULL) {
+		error = -1;
+		goto out;
+	}
+
+	if ((error = refdb_reftable_stack_for_refname(&stack, backend, refname)) < 0)
+		goto out;
+
+	if ((error = reftable_stack_read_ref(stack->stack, refname, &ref)) < 0) {
+		error = refdb_reftable_error(error, "failed reading reference");
+		goto out;
+	} else if (error > 0) {
+		git_oid_clear(&update->old_id, backend->repo->oid_type);
+	} else if (ref.value_type == REFTABLE_REF_SYMREF) {
+		if ((update->old_target = git__strdup(ref.value.symref)) == NULL) {
+			error = -1;
+			goto out;
+		}
+	} else if (reftable_ref_record_val1(&ref) != NULL) {
+		if ((error = git_oid_from_raw(&update->old_id, reftable_ref_record_val1(&ref),
+					      backend->repo->oid_type)) < 0)
+			goto out;
+	} else {
+		git_error_set(GIT_ERROR_REFERENCE, "invalid reference record for '%s'", refname);
+		error = -1;
+		goto out;
+	}
+
+	*out = update;
+	update = NULL;
+	error = 0;
+
+out:
+	refdb_reftable_return_stack(backend, stack);
+	reftable_ref_record_release(&ref);
+	refdb_reftable_update_free(update);
+	return error;
+}
+
+static int refdb_reftable_unlock(git_refdb_backend *_backend,
+				 void *payload,
+				 int success,
+				 int update_reflog,
+				 const git_reference *ref,
+				 const git_signature *sig,
+				 const char *message)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	refdb_reftable_update *update = payload;
+	git_refdb *refdb = backend->repo->_refdb;
+	refdb_reftable_stack_t which = REFDB_REFTABLE_STACK_MAIN;
+	int error = 0;
+
+	if (!success)
+		goto out;
+
+	if (success == 2) {
+		update->remove = 1;
+	} else {
+		if (ref->type == GIT_REFERENCE_SYMBOLIC)
+			update->ref = git_reference__alloc_symbolic(ref->name, ref->target.symbolic);
+		else
+			update->ref = git_reference__alloc(ref->name, &ref->target.oid, NULL);
+
+		if (!update->ref) {
+			error = -1;
+			goto out;
+		}
+
+		/* Peeling the new value requires the reference's refdb. */
+		if ((error = git_repository_refdb(&update->ref->db, backend->repo)) < 0 ||
+		    (sig && (error = git_signature_dup(&update->who, sig)) < 0))
+			goto out;
+	}
+
+	if (message && (update->message = git__strdup(message)) == NULL) {
+		error = -1;
+		goto out;
+	}
+
+	update->update_reflog = update_reflog;
+
+	if (refdb && refdb->batch) {
+		if ((error = git_vector_insert(&backend->batch, update)) < 0)
+			goto out;
+
+		refdb->batch_flush = refdb_reftable_batch_flush;
+		return 0;
+	}
+
+	if (git_reference__is_per_worktree_ref(update->refname))
+		which = REFDB_REFTABLE_STACK_WORKTREE;
+
+	error = refdb_reftable_write_batch(backend, which, &update, 1);
+
+out:
+	refdb_reftable_update_free(update);
+	return error;
+}
+
 typedef struct {
 	refdb_reftable *backend;
 	refdb_reftable_stack *stack;
@@ -1371,8 +1813,18 @@ out:
 static void refdb_reftable_free(git_refdb_backend *_backend)
 {
 	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
-	refdb_reftable_stack_free(backend->worktree_stack);
-	refdb_reftable_stack_free(backend->stack);
+	refdb_reftable_update *update;
+	size_t i;
+
+	for (i = 0; i < REFDB_REFTABLE_STACK_POOL; i++) {
+		refdb_reftable_stack_free(backend->worktree_stacks[i]);
+		refdb_reftable_stack_free(backend->stacks[i]);
+	}
+
+	git_vector_foreach(&backend->batch, i, update)
+		refdb_reftable_update_free(update);
+	git_vector_dispose(&backend->batch);
+
 	git__free(backend);
 }
 
@@ -1467,30 +1919,82 @@ out:
 	return error;
 }
 
-static int refdb_reftable_reflog_read(git_reflog **out,
-				      git_refdb_backend *_backend,
-				      const char *name)
+/*
+ * Convert a log record into a reflog entry.  Returns `GIT_PASSTHROUGH`
+ * for records that do not correspond to an entry, like the ones that
+ * only mark that a reflog exists.
+ */
+static int refdb_reftable_log_entry(
+	git_reflog_entry **out,
+	refdb_reftable *backend,
+	struct reftable_log_record *record)
+{
+	git_signature *signature;
+	git_reflog_entry *entry;
+	int error;
+
+	if (git_signature_new(&signature,
+			      record->value.update.name,
+			      record->value.update.email,
+			      record->value.update.time,
+			      record->value.update.tz_offset) < 0)
+		return GIT_PASSTHROUGH;
+
+	entry = git__calloc(1, sizeof(*entry));
+	GIT_ERROR_CHECK_ALLOC(entry);
+	entry->committer = signature;
+
+	/* Compatibility hacks with the file-based reflog implementation. */
+	if (record->value.update.message && record->value.update.message[0] == '\0') {
+		git__free(record->value.update.message);
+		record->value.update.message = NULL;
+	} else if (record->value.update.message) {
+		size_t len = strlen(record->value.update.message);
+		while (len) {
+			if (!git__isspace(record->value.update.message[len - 1]))
+				break;
+			len--;
+		}
+		if (len)
+			entry->msg = git__strndup(record->value.update.message, len);
+	}
+
+	if ((error = git_oid_from_raw(&entry->oid_old, record->value.update.old_hash,
+				      backend->repo->oid_type)) < 0 ||
+	    (error = git_oid_from_raw(&entry->oid_cur, record->value.update.new_hash,
+				      backend->repo->oid_type)) < 0) {
+		git_reflog_entry__free(entry);
+		return error;
+	}
+
+	if (git_oid_is_zero(&entry->oid_old) && git_oid_is_zero(&entry->oid_cur)) {
+		git_reflog_entry__free(entry);
+		return GIT_PASSTHROUGH;
+	}
+
+	*out = entry;
+	return 0;
+}
+
+/*
+ * Seek to the reflog of `name` and call `cb` for each of its entries,
+ * which the log blocks store from the most recent to the oldest one.
+ */
+static int refdb_reftable_reflog_foreach(git_refdb_backend *_backend,
+					 const char *name,
+					 git_refdb_reflog_foreach_cb cb,
+					 void *payload)
 {
 	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
 	struct reftable_merged_table *table = NULL;
 	struct reftable_log_record record = { 0 };
 	struct reftable_iterator iter = { 0 };
-	refdb_reftable_stack *stack;
-	git_reflog *reflog = NULL;
+	refdb_reftable_stack *stack = NULL;
 	int error;
 
 	if ((error = refdb_reftable_stack_for_refname(&stack, backend, name)) < 0)
 		goto out;
 
-	reflog = git__calloc(1, sizeof(git_reflog));
-	GIT_ERROR_CHECK_ALLOC(reflog);
-	reflog->ref_name = git__strdup(name);
-	GIT_ERROR_CHECK_ALLOC(reflog->ref_name);
-	reflog->oid_type = backend->repo->oid_type;
-
-	if ((error = git_vector_init(&reflog->entries, 0, NULL)) < 0)
-		goto out;
-
 	table = reftable_stack_merged_table(stack->stack);
 	GIT_ERROR_CHECK_ALLOC(table);
 
@@ -1501,7 +2005,6 @@ static int refdb_reftable_reflog_read(git_reflog **out,
 	}
 
 	while (1) {
-		git_signature *signature;
 		git_reflog_entry *entry;
 
 		if ((error = reftable_iterator_next_log(&iter, &record)) < 0) {
@@ -1511,60 +2014,72 @@ static int refdb_reftable_reflog_read(git_reflog **out,
 		if (error > 0 || git__strcmp(record.refname, name))
 			break;
 
-		if ((error = git_signature_new(&signature,
-					       record.value.update.name,
-					       record.value.update.email,
-					       record.value.update.time,
-					       record.value.update.tz_offset)) < 0)
+		if ((error = refdb_reftable_log_entry(&entry, backend, &record)) == GIT_PASSTHROUGH)
 			continue;
-
-		entry = git__calloc(1, sizeof(*entry));
-		GIT_ERROR_CHECK_ALLOC(entry);
-		entry->committer = signature;
-
-		/* Compatibility hacks with the file-based reflog implementation. */
-		if (record.value.update.message && record.value.update.message[0] == '\0') {
-			git__free(record.value.update.message);
-		} else if (record.value.update.message) {
-			size_t len = strlen(record.value.update.message);
-			while (len) {
-				if (!git__isspace(record.value.update.message[len - 1]))
-					break;
-				len--;
-			}
-			if (len)
-				entry->msg = git__strndup(record.value.update.message, len);
-		}
-
-		if ((error = git_oid_from_raw(&entry->oid_old, record.value.update.old_hash,
-					      backend->repo->oid_type)) < 0 ||
-		    (error = git_oid_from_raw(&entry->oid_cur, record.value.update.new_hash,
-					      backend->repo->oid_type)) < 0) {
-			git_reflog_entry__free(entry);
+		else if (error < 0)
 			goto out;
-		}
 
-		if (git_oid_is_zero(&entry->oid_old) && git_oid_is_zero(&entry->oid_cur)) {
-			git_reflog_entry__free(entry);
-			continue;
-		}
+		error = cb(entry, payload);
+		git_reflog_entry__free(entry);
 
-		if ((error = git_vector_insert(&reflog->entries, entry)) < 0) {
-			git_reflog_entry__free(entry);
+		if (error)
 			goto out;
-		}
 	}
 	error = 0;
 
+out:
+	reftable_log_record_release(&record);
+	reftable_iterator_destroy(&iter);
+	refdb_reftable_return_stack(backend, stack);
+	return error;
+}
+
+static int refdb_reftable_reflog_read_cb(const git_reflog_entry *entry, void *payload)
+{
+	git_reflog *reflog = payload;
+	git_reflog_entry *copy;
+
+	copy = git__calloc(1, sizeof(*copy));
+	GIT_ERROR_CHECK_ALLOC(copy);
+
+	git_oid_cpy(&copy->oid_old, &entry->oid_old);
+	git_oid_cpy(&copy->oid_cur, &entry->oid_cur);
+
+	if (git_signature_dup(&copy->committer, entry->committer) < 0 ||
+	    (entry->msg && (copy->msg = git__strdup(entry->msg)) == NULL) ||
+	    git_vector_insert(&reflog->entries, copy) < 0) {
+		git_reflog_entry__free(copy);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int refdb_reftable_reflog_read(git_reflog **out,
+				      git_refdb_backend *_backend,
+				      const char *name)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	git_reflog *reflog = NULL;
+	int error;
+
+	reflog = git__calloc(1, sizeof(git_reflog));
+	GIT_ERROR_CHECK_ALLOC(reflog);
+	reflog->ref_name = git__strdup(name);
+	GIT_ERROR_CHECK_ALLOC(reflog->ref_name);
+	reflog->oid_type = backend->repo->oid_type;
+
+	if ((error = git_vector_init(&reflog->entries, 0, NULL)) < 0 ||
+	    (error = refdb_reftable_reflog_foreach(_backend, name,
+			refdb_reftable_reflog_read_cb, reflog)) < 0)
+		goto out;
+
 	/* Logs are expected in recency-order. */
 	git_vector_reverse(&reflog->entries);
 
 	*out = reflog;
 	reflog = NULL;
 out:
-	reftable_log_record_release(&record);
-	reftable_iterator_destroy(&iter);
-	refdb_reftable_return_stack(backend, stack);
 	git_reflog_free(reflog);
 	return error;
 }
@@ -1861,11 +2376,13 @@ int git_refdb_backend_reftable(git_refdb_backend **out,
 	backend->parent.ensure_log = refdb_reftable_ensure_log;
 	backend->parent.free = refdb_reftable_free;
 	backend->parent.reflog_read = refdb_reftable_reflog_read;
+	backend->parent.reflog_foreach = refdb_reftable_reflog_foreach;
 	backend->parent.reflog_write = refdb_reftable_reflog_write;
 	backend->parent.reflog_rename = refdb_reftable_reflog_rename;
 	backend->parent.reflog_delete = refdb_reftable_reflog_delete;
 	backend->parent.compress = refdb_reftable_compress;
-	/* TODO: transaction API */
+	backend->parent.lock = refdb_reftable_lock;
+	backend->parent.unlock = refdb_reftable_unlock;
 
 	*out = (git_refdb_backend *)backend;
 	backend = NULL;
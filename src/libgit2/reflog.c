@@ -231,3 +231,80 @@ int git_reflog_drop(git_reflog *reflog, size_t idx, int rewrite_previous_entry)
 
 	return 0;
 }
+
+typedef struct {
+	git_oid *out;
+	size_t idx;
+	size_t entries;
+	git_time_t time;
+} reflog_lookup_data;
+
+static int reflog_byindex_cb(const git_reflog_entry *entry, void *payload)
+{
+	reflog_lookup_data *data = payload;
+
+	if (data->entries++ < data->idx)
+		return 0;
+
+	git_oid_cpy(data->out, &entry->oid_cur);
+	return 1;
+}
+
+int git_reflog__id_byindex(
+	git_oid *out,
+	size_t *entries,
+	git_refdb *db,
+	const char *name,
+	size_t idx)
+{
+	reflog_lookup_data data = { 0 };
+	int error;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(db);
+	GIT_ASSERT_ARG(name);
+
+	data.out = out;
+	data.idx = idx;
+
+	if ((error = git_refdb_reflog_foreach(db, name, reflog_byindex_cb, &data)) < 0)
+		return error;
+
+	if (entries)
+		*entries = data.entries;
+
+	return error ? 0 : GIT_ENOTFOUND;
+}
+
+static int reflog_bytime_cb(const git_reflog_entry *entry, void *payload)
+{
+	reflog_lookup_data *data = payload;
+
+	data->entries++;
+	git_oid_cpy(data->out, &entry->oid_cur);
+
+	return entry->committer->when.time <= data->time;
+}
+
+int git_reflog__id_bytime(
+	git_oid *out,
+	git_refdb *db,
+	const char *name,
+	git_time_t time)
+{
+	reflog_lookup_data data = { 0 };
+	int error;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(db);
+	GIT_ASSERT_ARG(name);
+
+	data.out = out;
+	data.time = time;
+
+	/* Without a match, the oldest entry's id is left in `out` */
+	if ((error = git_refdb_reflog_foreach(db, name, reflog_bytime_cb, &data)) < 0)
+		return error;
+
+	return data.entries ? 0 : GIT_ENOTFOUND;
+}
@@ -39,4 +39,27 @@ GIT_INLINE(size_t) reflog_inverse_index(size_t idx, size_t total)
 
 void git_reflog_entry__free(git_reflog_entry *entry);
 
+/*
+ * Look up the new id of the reflog entry at `idx` without reading the
+ * whole reflog.  When there is no such entry, `GIT_ENOTFOUND` is
+ * returned and `entries` is set to the number of entries in the reflog.
+ */
+int git_reflog__id_byindex(
+	git_oid *out,
+	size_t *entries,
+	git_refdb *db,
+	const char *name,
+	size_t idx);
+
+/*
+ * Look up the new id of the most recent reflog entry that is not newer
+ * than `time`, or of the oldest entry if they all are, without reading
+ * the whole reflog.  Returns `GIT_ENOTFOUND` if the reflog is empty.
+ */
+int git_reflog__id_bytime(
+	git_oid *out,
+	git_refdb *db,
+	const char *name,
+	git_time_t time);
+
 #endif
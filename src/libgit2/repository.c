@@ -31,6 +31,7 @@
 #include "remote.h"
 #include "merge.h"
 #include "diff_driver.h"
+#include "fsmonitor.h"
 #include "annotated_commit.h"
 #include "submodule.h"
 #include "worktree.h"
@@ -181,6 +182,9 @@ void git_repository_free(git_repository *repo)
 	git_diff_driver_registry_free(repo->diff_drivers);
 	repo->diff_drivers = NULL;
 
+	git_fsmonitor__free(repo->fsmonitor);
+	repo->fsmonitor = NULL;
+
 	for (i = 0; i < repo->reserved_names.size; i++)
 		git_str_dispose(git_array_get(repo->reserved_names, i));
 	git_array_clear(repo->reserved_names);
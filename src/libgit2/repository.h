@@ -16,6 +16,7 @@
 #include "git2/object.h"
 #include "git2/config.h"
 #include "git2/sys/repository.h"
+#include "git2/sys/fsmonitor.h"
 
 #include "array.h"
 #include "cache.h"
@@ -55,6 +56,7 @@ typedef enum {
 	GIT_CONFIGMAP_PROTECTNTFS,      /* core.protectNTFS */
 	GIT_CONFIGMAP_FSYNCOBJECTFILES, /* core.fsyncObjectFiles */
 	GIT_CONFIGMAP_LONGPATHS,        /* core.longpaths */
+	GIT_CONFIGMAP_UNTRACKEDCACHE,   /* core.untrackedCache */
 	GIT_CONFIGMAP_CACHE_MAX
 } git_configmap_item;
 
@@ -123,7 +125,12 @@ typedef enum {
 	/* core.fsyncObjectFiles */
 	GIT_FSYNCOBJECTFILES_DEFAULT = GIT_CONFIGMAP_FALSE,
 	/* core.longpaths */
-	GIT_LONGPATHS_DEFAULT = GIT_CONFIGMAP_FALSE
+	GIT_LONGPATHS_DEFAULT = GIT_CONFIGMAP_FALSE,
+	/* core.untrackedCache */
+	GIT_UNTRACKEDCACHE_FALSE = GIT_CONFIGMAP_FALSE,
+	GIT_UNTRACKEDCACHE_TRUE = GIT_CONFIGMAP_TRUE,
+	GIT_UNTRACKEDCACHE_KEEP = 2,
+	GIT_UNTRACKEDCACHE_DEFAULT = GIT_UNTRACKEDCACHE_KEEP
 } git_configmap_value;
 
 /* internal repository init flags */
@@ -170,6 +177,8 @@ struct git_repository {
 
 	intptr_t configmap_cache[GIT_CONFIGMAP_CACHE_MAX];
 	git_submodule_cache *submodule_cache;
+
+	git_fsmonitor *fsmonitor;
 };
 
 GIT_INLINE(git_attr_cache *) git_repository_attr_cache(git_repository *repo)
@@ -10,6 +10,7 @@
 #include "str.h"
 #include "tree.h"
 #include "refdb.h"
+#include "reflog.h"
 #include "regexp.h"
 #include "date.h"
 
@@ -144,128 +145,103 @@ static int try_parse_numeric(int *n, const char *curly_braces_content)
 	return 0;
 }
 
-static int retrieve_previously_checked_out_branch_or_revision(git_object **out, git_reference **base_ref, git_repository *repo, const char *identifier, size_t position)
-{
-	git_reference *ref = NULL;
-	git_reflog *reflog = NULL;
+typedef struct {
 	git_regexp preg;
-	int error = -1;
-	size_t i, numentries, cur;
-	const git_reflog_entry *entry;
-	const char *msg;
-	git_str buf = GIT_STR_INIT;
-
-	cur = position;
+	size_t position;
+	git_str branch;
+} previously_checked_out_data;
 
-	if (*identifier != '\0' || *base_ref != NULL)
-		return GIT_EINVALIDSPEC;
+static int previously_checked_out_cb(const git_reflog_entry *entry, void *payload)
+{
+	previously_checked_out_data *data = payload;
+	const char *msg = git_reflog_entry_message(entry);
+	git_regmatch regexmatches[2];
 
-	if (build_regex(&preg, "checkout: moving from (.*) to .*") < 0)
-		return -1;
+	if (!msg)
+		return 0;
 
-	if (git_reference_lookup(&ref, repo, GIT_HEAD_REF) < 0)
-		goto cleanup;
+	if (git_regexp_search(&data->preg, msg, 2, regexmatches) < 0)
+		return 0;
 
-	if (git_reflog_read(&reflog, repo, GIT_HEAD_REF) < 0)
-		goto cleanup;
+	if (--data->position > 0)
+		return 0;
 
-	numentries  = git_reflog_entrycount(reflog);
+	if (git_str_put(&data->branch, msg + regexmatches[1].start,
+			regexmatches[1].end - regexmatches[1].start) < 0)
+		return -1;
 
-	for (i = 0; i < numentries; i++) {
-		git_regmatch regexmatches[2];
+	return 1;
+}
 
-		entry = git_reflog_entry_byindex(reflog, i);
-		msg = git_reflog_entry_message(entry);
-		if (!msg)
-			continue;
+static int retrieve_previously_checked_out_branch_or_revision(git_object **out, git_reference **base_ref, git_repository *repo, const char *identifier, size_t position)
+{
+	previously_checked_out_data data = { 0 };
+	git_refdb *refdb;
+	int error = -1;
 
-		if (git_regexp_search(&preg, msg, 2, regexmatches) < 0)
-			continue;
+	if (*identifier != '\0' || *base_ref != NULL)
+		return GIT_EINVALIDSPEC;
 
-		cur--;
+	if (build_regex(&data.preg, "checkout: moving from (.*) to .*") < 0)
+		return -1;
 
-		if (cur > 0)
-			continue;
+	data.position = position;
 
-		if ((git_str_put(&buf, msg+regexmatches[1].start, regexmatches[1].end - regexmatches[1].start)) < 0)
-			goto cleanup;
+	if (git_repository_refdb__weakptr(&refdb, repo) < 0)
+		goto cleanup;
 
-		if ((error = git_reference_dwim(base_ref, repo, git_str_cstr(&buf))) == 0)
-			goto cleanup;
+	/* Stop reading the reflog at the checkout that we are looking for */
+	if ((error = git_refdb_reflog_foreach(refdb, GIT_HEAD_REF,
+			previously_checked_out_cb, &data)) < 0)
+		goto cleanup;
 
-		if (error < 0 && error != GIT_ENOTFOUND)
-			goto cleanup;
+	if (error == 0) {
+		error = GIT_ENOTFOUND;
+		goto cleanup;
+	}
 
-		error = maybe_abbrev(out, repo, git_str_cstr(&buf));
+	if ((error = git_reference_dwim(base_ref, repo, git_str_cstr(&data.branch))) == 0)
+		goto cleanup;
 
+	if (error < 0 && error != GIT_ENOTFOUND)
 		goto cleanup;
-	}
 
-	error = GIT_ENOTFOUND;
+	error = maybe_abbrev(out, repo, git_str_cstr(&data.branch));
 
 cleanup:
-	git_reference_free(ref);
-	git_str_dispose(&buf);
-	git_regexp_dispose(&preg);
-	git_reflog_free(reflog);
+	git_str_dispose(&data.branch);
+	git_regexp_dispose(&data.preg);
 	return error;
 }
 
 static int retrieve_oid_from_reflog(git_oid *oid, git_reference *ref, size_t identifier)
 {
-	git_reflog *reflog;
-	size_t numentries;
-	const git_reflog_entry *entry = NULL;
+	git_refdb *refdb;
+	size_t numentries = 0;
 	bool search_by_pos = (identifier <= 100000000);
+	int error;
 
-	if (git_reflog_read(&reflog, git_reference_owner(ref), git_reference_name(ref)) < 0)
+	if (git_repository_refdb__weakptr(&refdb, git_reference_owner(ref)) < 0)
 		return -1;
 
-	numentries = git_reflog_entrycount(reflog);
-
-	if (search_by_pos) {
-		if (numentries < identifier + 1)
-			goto notfound;
-
-		entry = git_reflog_entry_byindex(reflog, identifier);
-		git_oid_cpy(oid, git_reflog_entry_id_new(entry));
-	} else {
-		size_t i;
-		git_time commit_time;
-
-		for (i = 0; i < numentries; i++) {
-			entry = git_reflog_entry_byindex(reflog, i);
-			commit_time = git_reflog_entry_committer(entry)->when;
-
-			if (commit_time.time > (git_time_t)identifier)
-				continue;
-
-			git_oid_cpy(oid, git_reflog_entry_id_new(entry));
-			break;
-		}
-
-		if (i == numentries) {
-			if (entry == NULL)
-				goto notfound;
-
-			/*
-			 * TODO: emit a warning (log for 'branch' only goes back to ...)
-			 */
-			git_oid_cpy(oid, git_reflog_entry_id_new(entry));
-		}
-	}
-
-	git_reflog_free(reflog);
-	return 0;
+	if (search_by_pos)
+		error = git_reflog__id_byindex(oid, &numentries, refdb,
+			git_reference_name(ref), identifier);
+	else
+		/*
+		 * TODO: emit a warning (log for 'branch' only goes back to ...)
+		 * when all of the entries are newer than the given time
+		 */
+		error = git_reflog__id_bytime(oid, refdb,
+			git_reference_name(ref), (git_time_t)identifier);
 
-notfound:
-	git_error_set(
-		GIT_ERROR_REFERENCE,
-		"reflog for '%s' has only %"PRIuZ" entries, asked for %"PRIuZ,
-		git_reference_name(ref), numentries, identifier);
+	if (error == GIT_ENOTFOUND)
+		git_error_set(
+			GIT_ERROR_REFERENCE,
+			"reflog for '%s' has only %"PRIuZ" entries, asked for %"PRIuZ,
+			git_reference_name(ref), numentries, identifier);
 
-	git_reflog_free(reflog);
-	return GIT_ENOTFOUND;
+	return error;
 }
 
 static int retrieve_revobject_from_reflog(git_object **out, git_reference **base_ref, git_repository *repo, const char *identifier, size_t position)
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "sparse.h"
+
+#include "repository.h"
+#include "config.h"
+#include "futils.h"
+
+static void sparse_dispose(git_sparse *sparse)
+{
+	git_hashset_str_dispose(&sparse->recursive);
+	git_hashset_str_dispose(&sparse->parents);
+	git_pool_clear(&sparse->pool);
+	git_str_dispose(&sparse->scratch);
+}
+
+void git_sparse__free(git_sparse *sparse)
+{
+	if (!sparse)
+		return;
+
+	sparse_dispose(sparse);
+	git__free(sparse);
+}
+
+/*
+ * Unescape the directory of a `/dir/` (or `!/dir/` followed by the
+ * subdirectory wildcard) pattern; patterns with unescaped wildcards are
+ * not cone patterns.
+ */
+static int sparse_pattern_dir(git_str *out, const char *pattern, size_t len)
+{
+	size_t i;
+
+	git_str_clear(out);
+
+	for (i = 0; i < len; i++) {
+		char c = pattern[i];
+
+		if (c == '\\') {
+			if (++i == len)
+				return GIT_ENOTFOUND;
+
+			c = pattern[i];
+		} else if (c == '*' || c == '?' || c == '[') {
+			return GIT_ENOTFOUND;
+		}
+
+		git_str_putc(out, c);
+	}
+
+	if (!out->size || out->ptr[0] == '/' || out->ptr[out->size - 1] == '/')
+		return GIT_ENOTFOUND;
+
+	return git_str_oom(out) ? -1 : 0;
+}
+
+static int sparse_add(git_hashset_str *set, git_sparse *sparse, const char *dir, size_t len)
+{
+	char *key;
+
+	if ((key = git_pool_strndup(&sparse->pool, dir, len)) == NULL)
+		return -1;
+
+	return git_hashset_str_contains(set, key) ? 0 :
+		git_hashset_str_add(set, key);
+}
+
+/* Add a parent directory, and the directories leading to it. */
+static int sparse_add_parents(git_sparse *sparse, const char *dir, size_t len)
+{
+	int error = sparse_add(&sparse->parents, sparse, dir, len);
+
+	while (!error && len-- > 0) {
+		if (dir[len] == '/')
+			error = sparse_add(&sparse->parents, sparse, dir, len);
+	}
+
+	return error;
+}
+
+/*
+ * Parse the patterns; returns GIT_ENOTFOUND when they are not cone
+ * patterns, or when they include everything.
+ */
+static int sparse_parse(git_sparse *sparse, const char *data)
+{
+	git_str line = GIT_STR_INIT, dir = GIT_STR_INIT;
+	git_hashmap_iter_t iter = GIT_HASHMAP_ITER_INIT;
+	const char *scan = data, *eol, *key;
+	bool root = false, excluded = false;
+	int error = 0;
+
+	while (*scan) {
+		if ((eol = strchr(scan, '\n')) == NULL)
+			eol = scan + strlen(scan);
+
+		git_str_clear(&line);
+		git_str_put(&line, scan, eol - scan);
+		git_str_rtrim(&line);
+
+		scan = *eol ? eol + 1 : eol;
+
+		if (!line.size || line.ptr[0] == '#')
+			continue;
+
+		if (!strcmp(line.ptr, "/*")) {
+			root = true;
+		} else if (!strcmp(line.ptr, "!/*/")) {
+			excluded = true;
+		} else if (line.size > 2 && line.ptr[0] == '/' &&
+		           line.ptr[line.size - 1] == '/') {
+			if ((error = sparse_pattern_dir(&dir, line.ptr + 1, line.size - 2)) < 0 ||
+			    (error = sparse_add(&sparse->recursive, sparse, dir.ptr, dir.size)) < 0)
+				goto done;
+		} else if (line.size > 6 && !strncmp(line.ptr, "!/", 2) &&
+		           !strcmp(line.ptr + line.size - 3, "/*/")) {
+			/* a directory that was listed is only a parent */
+			if ((error = sparse_pattern_dir(&dir, line.ptr + 2, line.size - 5)) < 0)
+				goto done;
+
+			if (!git_hashset_str_contains(&sparse->recursive, dir.ptr)) {
+				error = GIT_ENOTFOUND;
+				goto done;
+			}
+
+			git_hashset_str_remove(&sparse->recursive, dir.ptr);
+
+			if ((error = sparse_add_parents(sparse, dir.ptr, dir.size)) < 0)
+				goto done;
+		} else {
+			error = GIT_ENOTFOUND;
+			goto done;
+		}
+	}
+
+	if (!root || !excluded) {
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	/* the directories leading to the ones that are listed are parents */
+	while (git_hashset_str_iterate(&iter, &key, &sparse->recursive) == 0) {
+		const char *slash = strrchr(key, '/');
+
+		if (slash && (error = sparse_add_parents(sparse, key, slash - key)) < 0)
+			goto done;
+	}
+
+done:
+	git_str_dispose(&line);
+	git_str_dispose(&dir);
+	return error;
+}
+
+int git_sparse__load(git_sparse **out, git_repository *repo)
+{
+	git_sparse *sparse = NULL;
+	git_config *config;
+	git_str path = GIT_STR_INIT, data = GIT_STR_INIT;
+	int error;
+
+	*out = NULL;
+
+	if (git_repository_is_bare(repo))
+		return 0;
+
+	if ((error = git_repository_config__weakptr(&config, repo)) < 0)
+		return error;
+
+	if (!git_config__get_bool_force(config, "core.sparsecheckout", 0) ||
+	    !git_config__get_bool_force(config, "core.sparsecheckoutcone", 0))
+		return 0;
+
+	if ((error = git_repository__item_path(&path, repo, GIT_REPOSITORY_ITEM_INFO)) < 0 ||
+	    (error = git_str_joinpath(&path, path.ptr, GIT_SPARSE_CHECKOUT_FILE)) < 0)
+		goto done;
+
+	if ((error = git_futils_readbuffer(&data, path.ptr)) < 0) {
+		/* without patterns, everything is checked out */
+		if (error == GIT_ENOTFOUND) {
+			git_error_clear();
+			error = 0;
+		}
+
+		goto done;
+	}
+
+	sparse = git__calloc(1, sizeof(git_sparse));
+	GIT_ERROR_CHECK_ALLOC(sparse);
+
+	if ((error = git_pool_init(&sparse->pool, 1)) < 0)
+		goto done;
+
+	if ((error = sparse_parse(sparse, data.ptr)) == 0) {
+		*out = sparse;
+		sparse = NULL;
+	} else if (error == GIT_ENOTFOUND) {
+		error = 0;
+	}
+
+done:
+	git_sparse__free(sparse);
+	git_str_dispose(&path);
+	git_str_dispose(&data);
+	return error;
+}
+
+bool git_sparse__index_enabled(git_repository *repo)
+{
+	git_config *config;
+
+	if (git_repository_config__weakptr(&config, repo) < 0) {
+		git_error_clear();
+		return false;
+	}
+
+	return git_config__get_bool_force(config, "index.sparse", 0);
+}
+
+git_sparse_t git_sparse__dir(git_sparse *sparse, const char *dir, size_t dir_len)
+{
+	size_t i;
+
+	if (!dir_len)
+		return GIT_SPARSE_PARENT;
+
+	git_str_clear(&sparse->scratch);
+
+	if (git_str_put(&sparse->scratch, dir, dir_len) < 0)
+		return GIT_SPARSE_INCLUDED;
+
+	/* beneath a recursive directory, everything is included */
+	for (i = 1; i <= dir_len; i++) {
+		if (i < dir_len && dir[i] != '/')
+			continue;
+
+		sparse->scratch.ptr[i] = '\0';
+
+		if (git_hashset_str_contains(&sparse->recursive, sparse->scratch.ptr))
+			return GIT_SPARSE_INCLUDED;
+
+		if (i < dir_len)
+			sparse->scratch.ptr[i] = '/';
+	}
+
+	return git_hashset_str_contains(&sparse->parents, sparse->scratch.ptr) ?
+		GIT_SPARSE_PARENT : GIT_SPARSE_EXCLUDED;
+}
+
+bool git_sparse__includes(git_sparse *sparse, const char *path)
+{
+	const char *slash = strrchr(path, '/');
+
+	if (!slash)
+		return true;
+
+	return git_sparse__dir(sparse, path, slash - path) != GIT_SPARSE_EXCLUDED;
+}
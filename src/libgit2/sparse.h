@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_sparse_h__
+#define INCLUDE_sparse_h__
+
+#include "common.h"
+
+#include "pool.h"
+#include "str.h"
+#include "hashmap_str.h"
+
+/*
+ * A cone-mode sparse checkout ("core.sparseCheckout" and
+ * "core.sparseCheckoutCone") limits the working directory to the files
+ * at the root, the files directly in the "parent" directories and
+ * everything beneath the "recursive" directories.  Those are listed in
+ * `info/sparse-checkout` as the patterns that git writes: `/dir/` for a
+ * recursive directory, which is followed by the pattern excluding its
+ * subdirectories when it is only a parent.
+ *
+ * The index entries of the other files are marked `skip-worktree`.
+ */
+
+#define GIT_SPARSE_CHECKOUT_FILE "sparse-checkout"
+
+typedef enum {
+	/* nothing beneath the directory is checked out */
+	GIT_SPARSE_EXCLUDED = 0,
+	/* the files in the directory are checked out, but not all of its
+	 * subdirectories */
+	GIT_SPARSE_PARENT = 1,
+	/* everything beneath the directory is checked out */
+	GIT_SPARSE_INCLUDED = 2
+} git_sparse_t;
+
+typedef struct {
+	git_hashset_str recursive;
+	git_hashset_str parents;
+	git_pool pool;
+	git_str scratch;
+} git_sparse;
+
+/*
+ * Load the sparse checkout patterns of the repository.  `out` is set to
+ * NULL when the working directory is not sparse, or the patterns are
+ * not in cone mode (which is not supported, and checks out everything).
+ */
+extern int git_sparse__load(git_sparse **out, git_repository *repo);
+
+/*
+ * Whether a sparse index ("index.sparse") should be written for a
+ * sparse working directory.
+ */
+extern bool git_sparse__index_enabled(git_repository *repo);
+
+/* How much of a directory (given without a trailing slash) is checked out. */
+extern git_sparse_t git_sparse__dir(
+	git_sparse *sparse, const char *dir, size_t dir_len);
+
+/* Whether a file is checked out. */
+extern bool git_sparse__includes(git_sparse *sparse, const char *path);
+
+extern void git_sparse__free(git_sparse *sparse);
+
+#endif
@@ -489,6 +489,7 @@ static int commit_worktree(
 	int error = 0, ignorecase;
 
 	if ((error = git_repository_index(&r_index, repo) < 0) ||
+	    (error = git_index__materialize(r_index)) < 0 ||
 	    (error = git_index_new_ext(&i_index, &index_opts)) < 0 ||
 	    (error = git_index__fill(i_index, &r_index->entries) < 0) ||
 	    (error = git_repository__configmap_lookup(&ignorecase, repo, GIT_CONFIGMAP_IGNORECASE)) < 0)
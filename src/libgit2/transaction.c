@@ -330,21 +330,11 @@ static int update_target(git_refdb *db, transaction_node *node)
 	return error;
 }
 
-int git_transaction_commit(git_transaction *tx)
+static int transaction_commit_refs(git_transaction *tx)
 {
 	transaction_node *node;
 	git_hashmap_iter_t iter = GIT_HASHMAP_ITER_INIT;
-	int error = 0;
-
-	GIT_ASSERT_ARG(tx);
-
-	if (tx->type == TRANSACTION_CONFIG) {
-		error = git_config_unlock(tx->cfg, tx->cfg_data, true);
-		tx->cfg = NULL;
-		tx->cfg_data = NULL;
-
-		return error;
-	}
+	int error;
 
 	while (git_transaction_nodemap_iterate(&iter, NULL, &node, &tx->locks) == 0) {
 		if (node->reflog) {
@@ -367,6 +357,55 @@ int git_transaction_commit(git_transaction *tx)
 	return 0;
 }
 
+int git_transaction_commit(git_transaction *tx)
+{
+	git_futils_fsync_batch batch;
+	int error = 0, batch_error;
+
+	GIT_ASSERT_ARG(tx);
+
+	if (tx->type == TRANSACTION_CONFIG) {
+		error = git_config_unlock(tx->cfg, tx->cfg_data, true);
+		tx->cfg = NULL;
+		tx->cfg_data = NULL;
+
+		return error;
+	}
+
+	/*
+	 * References that need to be synchronized to disk are all made
+	 * durable together, once every one of them has been written.
+	 * Likewise, the backend may defer work that is shared by all of
+	 * the references (like rewriting packed-refs) until the end, which
+	 * must also happen when only some of the references were updated.
+	 */
+	if (tx->db->batch)
+		return transaction_commit_refs(tx);
+
+	if ((error = git_futils_fsync_batch_init(&batch)) < 0)
+		return error;
+
+	tx->db->fsync_batch = &batch;
+	tx->db->batch = 1;
+
+	error = transaction_commit_refs(tx);
+
+	if ((batch_error = git_refdb__batch_flush(tx->db)) < 0 && !error)
+		error = batch_error;
+
+	tx->db->batch = 0;
+	tx->db->fsync_batch = NULL;
+
+	if ((batch_error = git_futils_fsync_batch_commit(&batch)) < 0 && !error)
+		error = batch_error;
+
+	if ((batch_error = git_refdb__batch_done(tx->db, !error)) < 0 && !error)
+		error = batch_error;
+
+	git_futils_fsync_batch_dispose(&batch);
+	return error;
+}
+
 void git_transaction_free(git_transaction *tx)
 {
 	transaction_node *node;
@@ -71,6 +71,36 @@ const git_tree_cache *git_tree_cache_get(const git_tree_cache *tree, const char
 	}
 }
 
+git_tree_cache *git_tree_cache_get_child(
+	const git_tree_cache *tree, const char *name, size_t name_len)
+{
+	return tree ? find_child(tree, name, name + name_len) : NULL;
+}
+
+int git_tree_cache_set_children(
+	git_tree_cache *tree, const git_vector *children, git_pool *pool)
+{
+	size_t alloc_size;
+
+	GIT_ERROR_CHECK_ALLOC_MULTIPLY(&alloc_size, children->length, sizeof(git_tree_cache *));
+
+	/*
+	 * The pool is only cleared with the whole tree cache, so reuse the
+	 * array of the old children when the new ones fit into it.
+	 */
+	if (children->length > tree->children_count) {
+		tree->children = git_pool_malloc(pool, alloc_size);
+		GIT_ERROR_CHECK_ALLOC(tree->children);
+	}
+
+	tree->children_count = children->length;
+
+	if (children->length)
+		memcpy(tree->children, children->contents, alloc_size);
+
+	return 0;
+}
+
 static int read_tree_internal(
 	git_tree_cache **out,
 	const char **buffer_in,
@@ -12,6 +12,7 @@
 
 #include "pool.h"
 #include "str.h"
+#include "vector.h"
 #include "git2/oid.h"
 
 typedef struct git_tree_cache {
@@ -30,6 +31,16 @@ int git_tree_cache_write(git_str *out, git_tree_cache *tree);
 int git_tree_cache_read(git_tree_cache **tree, const char *buffer, size_t buffer_size, git_oid_t oid_type, git_pool *pool);
 void git_tree_cache_invalidate_path(git_tree_cache *tree, const char *path);
 const git_tree_cache *git_tree_cache_get(const git_tree_cache *tree, const char *path);
+/**
+ * Get the immediate subtree `name` (of `name_len` bytes) of `tree`, which
+ * may be NULL
+ */
+git_tree_cache *git_tree_cache_get_child(const git_tree_cache *tree, const char *name, size_t name_len);
+/**
+ * Replace the subtrees of `tree` with the `git_tree_cache` nodes in
+ * `children`; the array of its old subtrees is reused when they fit
+ */
+int git_tree_cache_set_children(git_tree_cache *tree, const git_vector *children, git_pool *pool);
 int git_tree_cache_new(git_tree_cache **out, const char *name, git_oid_t oid_type, git_pool *pool);
 /**
  * Read a tree as the root of the tree cache (like for `git read-tree`)
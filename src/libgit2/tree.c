@@ -458,11 +458,11 @@ int git_tree__parse(void *_tree, git_odb_object *odb_obj, git_oid_t oid_type)
 
 static size_t find_next_dir(const char *dirname, git_index *index, size_t start)
 {
-	size_t dirlen, i, entries = git_index_entrycount(index);
+	size_t dirlen, i, entries = index->entries.length;
 
 	dirlen = strlen(dirname);
 	for (i = start; i < entries; ++i) {
-		const git_index_entry *entry = git_index_get_byindex(index, i);
+		const git_index_entry *entry = git_vector_get(&index->entries, i);
 		if (strlen(entry->path) < dirlen ||
 		    memcmp(entry->path, dirname, dirlen) ||
 			(dirlen > 0 && entry->path[dirlen] != '/')) {
@@ -503,14 +503,10 @@ static int check_entry(git_repository *repo, const char *filename, const git_oid
 	return 0;
 }
 
-static int git_treebuilder__write_with_buffer(
-	git_oid *oid,
-	git_treebuilder *bld,
-	git_str *buf)
+static int treebuilder_serialize(git_str *buf, git_treebuilder *bld)
 {
 	int error = 0;
 	size_t i, entrycount;
-	git_odb *odb;
 	git_tree_entry *entry;
 	git_vector entries = GIT_VECTOR_INIT;
 	size_t oid_size = git_oid_size(bld->repo->oid_type);
@@ -547,15 +543,50 @@ static int git_treebuilder__write_with_buffer(
 		}
 	}
 
-	if ((error = git_repository_odb__weakptr(&odb, bld->repo)) == 0)
-		error = git_odb_write(oid, odb, buf->ptr, buf->size, GIT_OBJECT_TREE);
-
 out:
 	git_vector_dispose(&entries);
 
 	return error;
 }
 
+static int git_treebuilder__write_with_buffer(
+	git_oid *oid,
+	git_treebuilder *bld,
+	git_str *buf)
+{
+	git_odb *odb;
+	int error;
+
+	if ((error = treebuilder_serialize(buf, bld)) < 0 ||
+	    (error = git_repository_odb__weakptr(&odb, bld->repo)) < 0)
+		return error;
+
+	return git_odb_write(oid, odb, buf->ptr, buf->size, GIT_OBJECT_TREE);
+}
+
+/* Hash the tree without writing it, and look for it in the odb. */
+static int git_treebuilder__hash_with_buffer(
+	git_oid *oid,
+	bool *exists,
+	git_treebuilder *bld,
+	git_str *buf)
+{
+	git_object_id_options opts = GIT_OBJECT_ID_OPTIONS_INIT;
+	git_odb *odb;
+	int error;
+
+	opts.object_type = GIT_OBJECT_TREE;
+	opts.oid_type = bld->repo->oid_type;
+
+	if ((error = treebuilder_serialize(buf, bld)) < 0 ||
+	    (error = git_object_id_from_buffer(oid, buf->ptr, buf->size, &opts)) < 0 ||
+	    (error = git_repository_odb__weakptr(&odb, bld->repo)) < 0)
+		return error;
+
+	*exists = git_odb_exists_ext(odb, oid, GIT_ODB_LOOKUP_NO_REFRESH);
+	return 0;
+}
+
 static int append_entry(
 	git_treebuilder *bld,
 	const char *filename,
@@ -583,23 +614,63 @@ static int append_entry(
 	return 0;
 }
 
+/*
+ * A sparse directory entry is a leaf of the tree cache; an existing node
+ * for the directory is kept, and updated when its tree changed.
+ */
+static int tree_cache_sparse_dir(
+	git_tree_cache **out,
+	git_index *index,
+	git_tree_cache *parent,
+	const char *name,
+	const git_oid *id)
+{
+	git_tree_cache *cache = git_tree_cache_get_child(parent, name, strlen(name));
+	int error;
+
+	if (!cache &&
+	    (error = git_tree_cache_new(&cache, name, index->oid_type, &index->tree_pool)) < 0)
+		return error;
+
+	git_oid_cpy(&cache->oid, id);
+	cache->entry_count = 1;
+	cache->children_count = 0;
+
+	*out = cache;
+	return 0;
+}
+
+/*
+ * Write the tree of the entries beneath `dirname`, from `start`, and
+ * return the position of the first entry after them.  The tree cache
+ * node of the directory, `cache`, is used when it is valid; otherwise
+ * only its invalidated subtrees are written, and it is brought up to
+ * date and returned in `cache_out`.  When `repair` is set, the trees are
+ * only hashed, and a node is made valid when its tree already exists.
+ */
 static int write_tree(
 	git_oid *oid,
+	git_tree_cache **cache_out,
 	git_repository *repo,
 	git_index *index,
+	git_tree_cache *cache,
 	const char *dirname,
 	size_t start,
+	bool repair,
 	git_str *shared_buf)
 {
 	git_treebuilder *bld = NULL;
-	size_t i, entries = git_index_entrycount(index);
+	git_vector children = GIT_VECTOR_INIT;
+	git_tree_cache *child;
+	size_t i, entries = index->entries.length;
 	int error;
 	size_t dirname_len = strlen(dirname);
-	const git_tree_cache *cache;
+	const char *basename;
+	bool exists = true;
 
-	cache = git_tree_cache_get(index->tree, dirname);
-	if (cache != NULL && cache->entry_count >= 0){
+	if (cache != NULL && cache->entry_count >= 0) {
 		git_oid_cpy(oid, &cache->oid);
+		*cache_out = cache;
 		return (int)find_next_dir(dirname, index, start);
 	}
 
@@ -608,11 +679,12 @@ static int write_tree(
 
 	/*
 	 * This loop is unfortunate, but necessary. The index doesn't have
-	 * any directories, so we need to handle that manually, and we
-	 * need to keep track of the current position.
+	 * any directories (but for the sparse directories of a sparse index),
+	 * so we need to handle that manually, and we need to keep track of
+	 * the current position.
 	 */
 	for (i = start; i < entries; ++i) {
-		const git_index_entry *entry = git_index_get_byindex(index, i);
+		const git_index_entry *entry = git_vector_get(&index->entries, i);
 		const char *filename, *next_slash;
 
 	/*
@@ -633,7 +705,23 @@ static int write_tree(
 		if (*filename == '/')
 			filename++;
 		next_slash = strchr(filename, '/');
-		if (next_slash) {
+
+		/* a sparse directory is already a tree */
+		if (next_slash && !next_slash[1] &&
+		    git_index_entry__is_sparse_dir(entry)) {
+			char *name = git__strndup(filename, next_slash - filename);
+
+			error = name ? append_entry(bld, name, &entry->id,
+				GIT_FILEMODE_TREE, true) : -1;
+
+			if (!error &&
+			    (error = tree_cache_sparse_dir(&child, index, cache, name, &entry->id)) == 0)
+				error = git_vector_insert(&children, child);
+
+			git__free(name);
+			if (error < 0)
+				goto on_error;
+		} else if (next_slash) {
 			git_oid sub_oid;
 			int written;
 			char *subdir, *last_comp;
@@ -641,15 +729,6 @@ static int write_tree(
 			subdir = git__strndup(entry->path, next_slash - entry->path);
 			GIT_ERROR_CHECK_ALLOC(subdir);
 
-			/* Write out the subtree */
-			written = write_tree(&sub_oid, repo, index, subdir, i, shared_buf);
-			if (written < 0) {
-				git__free(subdir);
-				goto on_error;
-			} else {
-				i = written - 1; /* -1 because of the loop increment */
-			}
-
 			/*
 			 * We need to figure out what we want toinsert
 			 * into this tree. If we're traversing
@@ -663,9 +742,20 @@ static int write_tree(
 				last_comp = subdir;
 			}
 
+			/* Write out the subtree */
+			written = write_tree(&sub_oid, &child, repo, index,
+				git_tree_cache_get_child(cache, last_comp, strlen(last_comp)),
+				subdir, i, repair, shared_buf);
+			if (written < 0) {
+				git__free(subdir);
+				goto on_error;
+			} else {
+				i = written - 1; /* -1 because of the loop increment */
+			}
+
 			error = append_entry(bld, last_comp, &sub_oid, S_IFDIR, true);
 			git__free(subdir);
-			if (error < 0)
+			if (error < 0 || (error = git_vector_insert(&children, child)) < 0)
 				goto on_error;
 		} else {
 			error = append_entry(bld, filename, &entry->id, entry->mode, true);
@@ -674,34 +764,48 @@ static int write_tree(
 		}
 	}
 
-	if (git_treebuilder__write_with_buffer(oid, bld, shared_buf) < 0)
+	if (repair)
+		error = git_treebuilder__hash_with_buffer(oid, &exists, bld, shared_buf);
+	else
+		error = git_treebuilder__write_with_buffer(oid, bld, shared_buf);
+
+	if (error < 0)
+		goto on_error;
+
+	basename = strrchr(dirname, '/');
+	basename = basename ? basename + 1 : dirname;
+
+	if (!cache &&
+	    git_tree_cache_new(&cache, basename, index->oid_type, &index->tree_pool) < 0)
+		goto on_error;
+
+	if (git_tree_cache_set_children(cache, &children, &index->tree_pool) < 0)
 		goto on_error;
 
+	git_oid_cpy(&cache->oid, oid);
+	cache->entry_count = exists ? (ssize_t)(i - start) : -1;
+	*cache_out = cache;
+
+	git_vector_dispose(&children);
 	git_treebuilder_free(bld);
 	return (int)i;
 
 on_error:
+	git_vector_dispose(&children);
 	git_treebuilder_free(bld);
 	return -1;
 }
 
-int git_tree__write_index(
-	git_oid *oid, git_index *index, git_repository *repo)
+static int write_index(
+	git_oid *oid,
+	git_index *index,
+	git_repository *repo,
+	bool repair)
 {
-	int ret;
-	git_tree *tree;
+	git_tree_cache *tree = NULL;
 	git_str shared_buf = GIT_STR_INIT;
 	bool old_ignore_case = false;
-
-	GIT_ASSERT_ARG(oid);
-	GIT_ASSERT_ARG(index);
-	GIT_ASSERT_ARG(repo);
-
-	if (git_index_has_conflicts(index)) {
-		git_error_set(GIT_ERROR_INDEX,
-			"cannot create a tree from a not fully merged index.");
-		return GIT_EUNMERGED;
-	}
+	int ret;
 
 	if (index->tree != NULL && index->tree->entry_count >= 0) {
 		git_oid_cpy(oid, &index->tree->oid);
@@ -718,27 +822,48 @@ int git_tree__write_index(
 		git_index__set_ignore_case(index, false);
 	}
 
-	ret = write_tree(oid, repo, index, "", 0, &shared_buf);
+	git_vector_sort(&index->entries);
+
+	ret = write_tree(oid, &tree, repo, index, index->tree, "", 0, repair, &shared_buf);
 	git_str_dispose(&shared_buf);
 
 	if (old_ignore_case)
 		git_index__set_ignore_case(index, true);
 
-	index->tree = NULL;
-
 	if (ret < 0)
 		return ret;
 
-	git_pool_clear(&index->tree_pool);
+	index->tree = tree;
+	return 0;
+}
 
-	if ((ret = git_tree_lookup(&tree, repo, oid)) < 0)
-		return ret;
+int git_tree__write_index(
+	git_oid *oid, git_index *index, git_repository *repo)
+{
+	GIT_ASSERT_ARG(oid);
+	GIT_ASSERT_ARG(index);
+	GIT_ASSERT_ARG(repo);
 
-	/* Read the tree cache into the index */
-	ret = git_tree_cache_read_tree(&index->tree, tree, index->oid_type, &index->tree_pool);
-	git_tree_free(tree);
+	if (git_index_has_conflicts(index)) {
+		git_error_set(GIT_ERROR_INDEX,
+			"cannot create a tree from a not fully merged index.");
+		return GIT_EUNMERGED;
+	}
+
+	return write_index(oid, index, repo, false);
+}
+
+int git_tree__update_index_cache(git_index *index, git_repository *repo)
+{
+	git_oid oid;
+
+	GIT_ASSERT_ARG(index);
+	GIT_ASSERT_ARG(repo);
+
+	if (git_index_has_conflicts(index))
+		return 0;
 
-	return ret;
+	return write_index(&oid, index, repo, true);
 }
 
 int git_treebuilder_new(
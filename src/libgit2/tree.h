@@ -51,6 +51,13 @@ int git_tree__parse_raw(void *_tree, const char *data, size_t size, git_oid_t oi
 int git_tree__write_index(
 	git_oid *oid, git_index *index, git_repository *repo);
 
+/**
+ * Bring the tree cache of the index up to date without writing any
+ * trees; the directories whose trees are not in the repository (yet)
+ * are left invalid.  Nothing is done for an index with conflicts.
+ */
+int git_tree__update_index_cache(git_index *index, git_repository *repo);
+
 /**
  * Obsolete mode kept for compatibility reasons
  */
@@ -0,0 +1,773 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "untracked_cache.h"
+
+#include "bitvec.h"
+#include "ewah.h"
+#include "varint.h"
+
+#ifndef GIT_WIN32
+# include <sys/utsname.h>
+#endif
+
+/*
+ * The extension starts with a varint-prefixed identifier of the working
+ * directory and system that the cache was recorded on.  Then follows
+ * the stat data of `info/exclude` and `core.excludesFile`, the flags the
+ * cache was recorded with, the ids of both exclude files and the name
+ * of the per-directory exclude file.
+ *
+ * The directories are stored as a varint count followed by each of them
+ * in pre-order: the number of untracked names and child directories
+ * (as varints), the directory name and the untracked names.  After the
+ * directories are three bitmaps of the directories that are valid,
+ * check-only and that have exclude ids, followed by the stat data of
+ * the valid directories and the exclude ids, in that order.
+ */
+
+#define UNTRACKED_STAT_SIZE 36
+
+/* each directory name is followed by a slash in a path */
+#define UNTRACKED_MAX_DEPTH (GIT_PATH_MAX / 2)
+
+GIT_INLINE(uint32_t) untracked_get32(const char *p)
+{
+	uint32_t value;
+
+	memcpy(&value, p, sizeof(value));
+	return ntohl(value);
+}
+
+static void stat_read(git_untracked_cache_stat *out, const char *p)
+{
+	out->ctime_seconds = untracked_get32(p);
+	out->ctime_nanoseconds = untracked_get32(p + 4);
+	out->mtime_seconds = untracked_get32(p + 8);
+	out->mtime_nanoseconds = untracked_get32(p + 12);
+	out->dev = untracked_get32(p + 16);
+	out->ino = untracked_get32(p + 20);
+	out->uid = untracked_get32(p + 24);
+	out->gid = untracked_get32(p + 28);
+	out->size = untracked_get32(p + 32);
+}
+
+static int stat_write(git_str *out, const git_untracked_cache_stat *st)
+{
+	uint32_t data[9];
+
+	data[0] = htonl(st->ctime_seconds);
+	data[1] = htonl(st->ctime_nanoseconds);
+	data[2] = htonl(st->mtime_seconds);
+	data[3] = htonl(st->mtime_nanoseconds);
+	data[4] = htonl(st->dev);
+	data[5] = htonl(st->ino);
+	data[6] = htonl(st->uid);
+	data[7] = htonl(st->gid);
+	data[8] = htonl(st->size);
+
+	return git_str_put(out, (const char *)data, sizeof(data));
+}
+
+static void stat_from_struct(git_untracked_cache_stat *out, const struct stat *st)
+{
+	memset(out, 0, sizeof(*out));
+
+	out->ctime_seconds = (uint32_t)st->st_ctime;
+	out->mtime_seconds = (uint32_t)st->st_mtime;
+#if defined(GIT_NSEC)
+	out->ctime_nanoseconds = (uint32_t)st->st_ctime_nsec;
+	out->mtime_nanoseconds = (uint32_t)st->st_mtime_nsec;
+#endif
+	out->dev = (uint32_t)st->st_dev;
+	out->ino = (uint32_t)st->st_ino;
+	out->uid = (uint32_t)st->st_uid;
+	out->gid = (uint32_t)st->st_gid;
+	out->size = (uint32_t)st->st_size;
+}
+
+static int dir_cmp(const void *a, const void *b)
+{
+	const git_untracked_cache_dir *dir_a = a, *dir_b = b;
+	return strcmp(dir_a->name, dir_b->name);
+}
+
+static int dir_srch(const void *key, const void *dir)
+{
+	return strcmp(key, ((const git_untracked_cache_dir *)dir)->name);
+}
+
+static void dir_clear_untracked(git_untracked_cache_dir *dir)
+{
+	size_t i;
+	char *name;
+
+	git_vector_foreach(&dir->untracked, i, name)
+		git__free(name);
+
+	git_vector_clear(&dir->untracked);
+}
+
+static void dir_free(git_untracked_cache_dir *dir)
+{
+	git_untracked_cache_dir *child;
+	size_t i;
+
+	if (!dir)
+		return;
+
+	git_vector_foreach(&dir->dirs, i, child)
+		dir_free(child);
+
+	dir_clear_untracked(dir);
+	git_vector_dispose(&dir->untracked);
+	git_vector_dispose(&dir->dirs);
+	git__free(dir);
+}
+
+static int dir_new(
+	git_untracked_cache_dir **out,
+	const char *name,
+	size_t name_len)
+{
+	git_untracked_cache_dir *dir;
+	size_t alloc_size;
+
+	GIT_ERROR_CHECK_ALLOC_ADD3(&alloc_size,
+		sizeof(git_untracked_cache_dir), name_len, 1);
+
+	dir = git__calloc(1, alloc_size);
+	GIT_ERROR_CHECK_ALLOC(dir);
+
+	if (git_vector_init(&dir->untracked, 0, NULL) < 0 ||
+	    git_vector_init(&dir->dirs, 0, dir_cmp) < 0) {
+		dir_free(dir);
+		return -1;
+	}
+
+	memcpy(dir->name, name, name_len);
+	*out = dir;
+	return 0;
+}
+
+static int ident_for_workdir(git_str *out, const char *workdir)
+{
+	size_t len = strlen(workdir);
+	const char *system = "Windows";
+
+#ifndef GIT_WIN32
+	struct utsname uts;
+
+	if (uname(&uts) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to get system name");
+		return -1;
+	}
+
+	system = uts.sysname;
+#endif
+
+	/* the location is recorded without its trailing slash */
+	if (len > 1 && workdir[len - 1] == '/')
+		len--;
+
+	git_str_clear(out);
+	git_str_puts(out, "Location ");
+	git_str_put(out, workdir, len);
+	git_str_printf(out, ", system %s", system);
+	git_str_putc(out, '\0');
+
+	return git_str_oom(out) ? -1 : 0;
+}
+
+int git_untracked_cache_new(
+	git_untracked_cache **out,
+	const char *workdir,
+	git_oid_t oid_type)
+{
+	git_untracked_cache *cache;
+
+	cache = git__calloc(1, sizeof(git_untracked_cache));
+	GIT_ERROR_CHECK_ALLOC(cache);
+
+	cache->oid_type = oid_type;
+	cache->dir_flags = GIT_UNTRACKED_CACHE_FLAGS;
+	cache->exclude_per_dir = git__strdup(".gitignore");
+	cache->changed = 1;
+
+	git_oid_clear(&cache->info_exclude_id, oid_type);
+	git_oid_clear(&cache->excludes_file_id, oid_type);
+
+	if (!cache->exclude_per_dir ||
+	    ident_for_workdir(&cache->ident, workdir) < 0 ||
+	    dir_new(&cache->root, "", 0) < 0) {
+		git_untracked_cache_free(cache);
+		return -1;
+	}
+
+	*out = cache;
+	return 0;
+}
+
+static int untracked_error_invalid(void)
+{
+	git_error_set(GIT_ERROR_INDEX, "corrupted untracked cache extension");
+	return -1;
+}
+
+static int read_varint(size_t *out, const char **buffer, const char *end)
+{
+	size_t len;
+	uintmax_t value;
+
+	if (*buffer >= end)
+		return untracked_error_invalid();
+
+	value = git_decode_varint((const unsigned char *)*buffer, &len);
+
+	if (!len || len > (size_t)(end - *buffer) || value > SIZE_MAX)
+		return untracked_error_invalid();
+
+	*buffer += len;
+	*out = (size_t)value;
+	return 0;
+}
+
+/*
+ * Directories are attached to their parent (or the cache) as soon as
+ * they are created, so that freeing the cache frees them on error.
+ */
+static int read_dir(
+	git_untracked_cache *cache,
+	git_untracked_cache_dir *parent,
+	git_vector *all,
+	size_t depth,
+	const char **buffer,
+	const char *end)
+{
+	git_untracked_cache_dir *dir = NULL;
+	const char *name;
+	size_t untracked_count, dirs_count, i;
+
+	if (depth > UNTRACKED_MAX_DEPTH)
+		return untracked_error_invalid();
+
+	if (read_varint(&untracked_count, buffer, end) < 0 ||
+	    read_varint(&dirs_count, buffer, end) < 0)
+		return -1;
+
+	name = *buffer;
+
+	if ((*buffer = memchr(name, '\0', end - name)) == NULL)
+		return untracked_error_invalid();
+
+	if (dir_new(&dir, name, *buffer - name) < 0)
+		return -1;
+
+	(*buffer)++;
+
+	if (!parent) {
+		cache->root = dir;
+	} else if (git_vector_insert(&parent->dirs, dir) < 0) {
+		dir_free(dir);
+		return -1;
+	}
+
+	if (git_vector_insert(all, dir) < 0)
+		return -1;
+
+	for (i = 0; i < untracked_count; i++) {
+		char *untracked;
+
+		name = *buffer;
+
+		if ((*buffer = memchr(name, '\0', end - name)) == NULL)
+			return untracked_error_invalid();
+
+		untracked = git__strndup(name, *buffer - name);
+		GIT_ERROR_CHECK_ALLOC(untracked);
+
+		if (git_vector_insert(&dir->untracked, untracked) < 0) {
+			git__free(untracked);
+			return -1;
+		}
+
+		(*buffer)++;
+	}
+
+	for (i = 0; i < dirs_count; i++) {
+		if (read_dir(cache, dir, all, depth + 1, buffer, end) < 0)
+			return -1;
+	}
+
+	git_vector_sort(&dir->dirs);
+	return 0;
+}
+
+static int read_bitmap(
+	git_bitvec *out,
+	const char **buffer,
+	const char *end,
+	size_t count)
+{
+	size_t len;
+
+	if (git_ewah_read(out, &len, *buffer, end - *buffer, count) < 0)
+		return -1;
+
+	*buffer += len;
+	return 0;
+}
+
+static int read_dirs(
+	git_untracked_cache *cache,
+	const char *buffer,
+	const char *end)
+{
+	git_vector all = GIT_VECTOR_INIT;
+	git_bitvec valid, check_only, exclude_valid;
+	git_untracked_cache_dir *dir;
+	size_t oid_size = git_oid_size(cache->oid_type), count, i;
+	int error = -1;
+
+	memset(&valid, 0, sizeof(valid));
+	memset(&check_only, 0, sizeof(check_only));
+	memset(&exclude_valid, 0, sizeof(exclude_valid));
+
+	if (read_varint(&count, &buffer, end) < 0)
+		return -1;
+
+	if (!count)
+		return 0;
+
+	/* each directory takes at least three bytes */
+	if (count > (size_t)(end - buffer) / 3)
+		return untracked_error_invalid();
+
+	if (git_vector_init(&all, count, NULL) < 0)
+		return -1;
+
+	if (read_dir(cache, NULL, &all, 0, &buffer, end) < 0)
+		goto done;
+
+	if (all.length != count) {
+		untracked_error_invalid();
+		goto done;
+	}
+
+	if (read_bitmap(&valid, &buffer, end, count) < 0 ||
+	    read_bitmap(&check_only, &buffer, end, count) < 0 ||
+	    read_bitmap(&exclude_valid, &buffer, end, count) < 0)
+		goto done;
+
+	git_vector_foreach(&all, i, dir) {
+		dir->check_only = git_bitvec_get(&check_only, i);
+
+		if (!git_bitvec_get(&valid, i))
+			continue;
+
+		if ((size_t)(end - buffer) < UNTRACKED_STAT_SIZE) {
+			untracked_error_invalid();
+			goto done;
+		}
+
+		stat_read(&dir->stat, buffer);
+		dir->valid = 1;
+		buffer += UNTRACKED_STAT_SIZE;
+	}
+
+	git_vector_foreach(&all, i, dir) {
+		if (!git_bitvec_get(&exclude_valid, i))
+			continue;
+
+		if ((size_t)(end - buffer) < oid_size) {
+			untracked_error_invalid();
+			goto done;
+		}
+
+		if (git_oid_from_raw(&dir->exclude_id,
+				(const unsigned char *)buffer, cache->oid_type) < 0)
+			goto done;
+
+		dir->exclude_id_valid = 1;
+		buffer += oid_size;
+	}
+
+	error = 0;
+
+done:
+	git_bitvec_free(&valid);
+	git_bitvec_free(&check_only);
+	git_bitvec_free(&exclude_valid);
+	git_vector_dispose(&all);
+	return error;
+}
+
+int git_untracked_cache_read(
+	git_untracked_cache **out,
+	const char *buffer,
+	size_t buffer_size,
+	git_oid_t oid_type)
+{
+	git_untracked_cache *cache;
+	const char *end = buffer + buffer_size, *exclude_per_dir;
+	size_t oid_size = git_oid_size(oid_type), ident_len;
+
+	*out = NULL;
+
+	/* the data is terminated so that the strings in it are too */
+	if (buffer_size <= 1 || end[-1] != '\0')
+		return untracked_error_invalid();
+
+	end--;
+
+	cache = git__calloc(1, sizeof(git_untracked_cache));
+	GIT_ERROR_CHECK_ALLOC(cache);
+
+	cache->oid_type = oid_type;
+
+	if (read_varint(&ident_len, &buffer, end) < 0)
+		goto on_error;
+
+	if (ident_len > (size_t)(end - buffer) ||
+	    (size_t)(end - buffer) - ident_len < (UNTRACKED_STAT_SIZE * 2) + 4 + (oid_size * 2)) {
+		untracked_error_invalid();
+		goto on_error;
+	}
+
+	if (git_str_put(&cache->ident, buffer, ident_len) < 0)
+		goto on_error;
+
+	buffer += ident_len;
+
+	stat_read(&cache->info_exclude_stat, buffer);
+	stat_read(&cache->excludes_file_stat, buffer + UNTRACKED_STAT_SIZE);
+	buffer += UNTRACKED_STAT_SIZE * 2;
+
+	cache->dir_flags = untracked_get32(buffer);
+	buffer += 4;
+
+	if (git_oid_from_raw(&cache->info_exclude_id,
+			(const unsigned char *)buffer, oid_type) < 0 ||
+	    git_oid_from_raw(&cache->excludes_file_id,
+			(const unsigned char *)buffer + oid_size, oid_type) < 0)
+		goto on_error;
+
+	buffer += oid_size * 2;
+	exclude_per_dir = buffer;
+
+	/* the final terminator ends the last string */
+	buffer += strlen(exclude_per_dir) + 1;
+
+	cache->exclude_per_dir = git__strdup(exclude_per_dir);
+	GIT_ERROR_CHECK_ALLOC(cache->exclude_per_dir);
+
+	/* a cache without directories has no terminator */
+	if (buffer < end && read_dirs(cache, buffer, end) < 0)
+		goto on_error;
+
+	*out = cache;
+	return 0;
+
+on_error:
+	git_untracked_cache_free(cache);
+	return -1;
+}
+
+typedef struct {
+	git_str dirs;
+	git_str stats;
+	git_str exclude_ids;
+	git_bitvec valid;
+	git_bitvec check_only;
+	git_bitvec exclude_valid;
+	size_t count;
+	size_t oid_size;
+} untracked_writer;
+
+static int write_varint(git_str *out, size_t value)
+{
+	unsigned char buf[16];
+	int len;
+
+	if ((len = git_encode_varint(buf, sizeof(buf), value)) < 0) {
+		git_error_set(GIT_ERROR_INDEX, "untracked cache is too large");
+		return -1;
+	}
+
+	return git_str_put(out, (const char *)buf, len);
+}
+
+static size_t dir_count(git_untracked_cache_dir *dir)
+{
+	git_untracked_cache_dir *child;
+	size_t count = 1, i;
+
+	git_vector_foreach(&dir->dirs, i, child)
+		count += dir_count(child);
+
+	return count;
+}
+
+static int write_dir(untracked_writer *writer, git_untracked_cache_dir *dir)
+{
+	git_untracked_cache_dir *child;
+	const char *name;
+	size_t pos = writer->count++, i;
+
+	if (dir->valid) {
+		git_bitvec_set(&writer->valid, pos, true);
+
+		if (dir->check_only)
+			git_bitvec_set(&writer->check_only, pos, true);
+
+		if (stat_write(&writer->stats, &dir->stat) < 0)
+			return -1;
+	}
+
+	if (dir->exclude_id_valid) {
+		git_bitvec_set(&writer->exclude_valid, pos, true);
+		git_str_put(&writer->exclude_ids,
+			(const char *)dir->exclude_id.id, writer->oid_size);
+	}
+
+	/* the untracked names are only meaningful for valid directories */
+	if (write_varint(&writer->dirs, dir->valid ? dir->untracked.length : 0) < 0 ||
+	    write_varint(&writer->dirs, dir->dirs.length) < 0)
+		return -1;
+
+	git_str_put(&writer->dirs, dir->name, strlen(dir->name) + 1);
+
+	if (dir->valid) {
+		git_vector_foreach(&dir->untracked, i, name)
+			git_str_put(&writer->dirs, name, strlen(name) + 1);
+	}
+
+	git_vector_foreach(&dir->dirs, i, child) {
+		if (write_dir(writer, child) < 0)
+			return -1;
+	}
+
+	return git_str_oom(&writer->dirs) ? -1 : 0;
+}
+
+static int write_dirs(git_str *out, git_untracked_cache *cache)
+{
+	untracked_writer writer = {{0}};
+	size_t count = dir_count(cache->root);
+	int error = -1;
+
+	writer.oid_size = git_oid_size(cache->oid_type);
+
+	if (git_bitvec_init(&writer.valid, count) < 0 ||
+	    git_bitvec_init(&writer.check_only, count) < 0 ||
+	    git_bitvec_init(&writer.exclude_valid, count) < 0)
+		goto done;
+
+	if (write_varint(out, count) < 0 ||
+	    write_dir(&writer, cache->root) < 0 ||
+	    git_str_put(out, writer.dirs.ptr, writer.dirs.size) < 0 ||
+	    git_ewah_write(out, &writer.valid, count) < 0 ||
+	    git_ewah_write(out, &writer.check_only, count) < 0 ||
+	    git_ewah_write(out, &writer.exclude_valid, count) < 0 ||
+	    git_str_put(out, writer.stats.ptr, writer.stats.size) < 0 ||
+	    git_str_put(out, writer.exclude_ids.ptr, writer.exclude_ids.size) < 0 ||
+	    git_str_putc(out, '\0') < 0)
+		goto done;
+
+	error = 0;
+
+done:
+	git_bitvec_free(&writer.valid);
+	git_bitvec_free(&writer.check_only);
+	git_bitvec_free(&writer.exclude_valid);
+	git_str_dispose(&writer.dirs);
+	git_str_dispose(&writer.stats);
+	git_str_dispose(&writer.exclude_ids);
+	return error;
+}
+
+int git_untracked_cache_write(git_str *out, git_untracked_cache *cache)
+{
+	size_t oid_size = git_oid_size(cache->oid_type);
+	uint32_t dir_flags = htonl(cache->dir_flags);
+
+	if (write_varint(out, cache->ident.size) < 0 ||
+	    git_str_put(out, cache->ident.ptr, cache->ident.size) < 0 ||
+	    stat_write(out, &cache->info_exclude_stat) < 0 ||
+	    stat_write(out, &cache->excludes_file_stat) < 0 ||
+	    git_str_put(out, (const char *)&dir_flags, sizeof(dir_flags)) < 0 ||
+	    git_str_put(out, (const char *)cache->info_exclude_id.id, oid_size) < 0 ||
+	    git_str_put(out, (const char *)cache->excludes_file_id.id, oid_size) < 0 ||
+	    git_str_put(out, cache->exclude_per_dir,
+			strlen(cache->exclude_per_dir) + 1) < 0)
+		return -1;
+
+	if (!cache->root)
+		return write_varint(out, 0);
+
+	return write_dirs(out, cache);
+}
+
+bool git_untracked_cache_usable(
+	git_untracked_cache *cache,
+	const char *workdir)
+{
+	git_str ident = GIT_STR_INIT;
+	bool usable;
+
+	if (cache->dir_flags != GIT_UNTRACKED_CACHE_FLAGS || !cache->root)
+		return false;
+
+	if (ident_for_workdir(&ident, workdir) < 0) {
+		git_error_clear();
+		return false;
+	}
+
+	usable = (cache->ident.size == ident.size &&
+		memcmp(cache->ident.ptr, ident.ptr, ident.size) == 0);
+
+	git_str_dispose(&ident);
+	return usable;
+}
+
+static git_untracked_cache_dir *dir_child(
+	git_untracked_cache_dir *dir,
+	const char *name,
+	size_t name_len)
+{
+	char buf[GIT_PATH_MAX];
+	size_t pos;
+
+	if (name_len >= sizeof(buf))
+		return NULL;
+
+	memcpy(buf, name, name_len);
+	buf[name_len] = '\0';
+
+	if (git_vector_bsearch2(&pos, &dir->dirs, dir_srch, buf) < 0)
+		return NULL;
+
+	return git_vector_get(&dir->dirs, pos);
+}
+
+int git_untracked_cache_dir_lookup(
+	git_untracked_cache_dir **out,
+	git_untracked_cache *cache,
+	const char *path)
+{
+	git_untracked_cache_dir *dir = cache->root, *child;
+	const char *end;
+
+	while ((end = strchr(path, '/')) != NULL) {
+		if ((child = dir_child(dir, path, end - path)) == NULL) {
+			if (dir_new(&child, path, end - path) < 0)
+				return -1;
+
+			if (git_vector_insert_sorted(&dir->dirs, child, NULL) < 0) {
+				dir_free(child);
+				return -1;
+			}
+
+			cache->changed = 1;
+		}
+
+		dir = child;
+		path = end + 1;
+	}
+
+	*out = dir;
+	return 0;
+}
+
+bool git_untracked_cache_dir_uptodate(
+	git_untracked_cache_dir *dir,
+	const struct stat *st)
+{
+	git_untracked_cache_stat current;
+
+	if (!dir->valid)
+		return false;
+
+	stat_from_struct(&current, st);
+
+	/* the device may differ between mounts of the same filesystem */
+	return dir->stat.mtime_seconds == current.mtime_seconds &&
+	       dir->stat.mtime_nanoseconds == current.mtime_nanoseconds &&
+	       dir->stat.ctime_seconds == current.ctime_seconds &&
+	       dir->stat.ctime_nanoseconds == current.ctime_nanoseconds &&
+	       dir->stat.ino == current.ino &&
+	       dir->stat.uid == current.uid &&
+	       dir->stat.gid == current.gid &&
+	       dir->stat.size == current.size;
+}
+
+void git_untracked_cache_dir_set(
+	git_untracked_cache *cache,
+	git_untracked_cache_dir *dir,
+	git_vector *untracked,
+	const struct stat *st)
+{
+	dir_clear_untracked(dir);
+	git_vector_swap(&dir->untracked, untracked);
+
+	stat_from_struct(&dir->stat, st);
+	dir->valid = 1;
+	dir->check_only = 0;
+
+	cache->changed = 1;
+}
+
+static void dir_invalidate(
+	git_untracked_cache *cache,
+	git_untracked_cache_dir *dir)
+{
+	if (!dir->valid)
+		return;
+
+	dir_clear_untracked(dir);
+	dir->valid = 0;
+	dir->check_only = 0;
+
+	cache->generation++;
+	cache->changed = 1;
+}
+
+void git_untracked_cache_invalidate_path(
+	git_untracked_cache *cache,
+	const char *path)
+{
+	git_untracked_cache_dir *dir;
+	const char *end;
+
+	if (cache == NULL || (dir = cache->root) == NULL)
+		return;
+
+	/*
+	 * An entry changes whether its parents are listed as untracked,
+	 * so every directory containing it is invalidated.
+	 */
+	dir_invalidate(cache, dir);
+
+	while ((end = strchr(path, '/')) != NULL) {
+		if ((dir = dir_child(dir, path, end - path)) == NULL)
+			return;
+
+		dir_invalidate(cache, dir);
+		path = end + 1;
+	}
+}
+
+void git_untracked_cache_free(git_untracked_cache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	dir_free(cache->root);
+	git_str_dispose(&cache->ident);
+	git__free(cache->exclude_per_dir);
+	git__free(cache);
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_untracked_cache_h__
+#define INCLUDE_untracked_cache_h__
+
+#include "common.h"
+
+#include "str.h"
+#include "vector.h"
+#include "oid.h"
+
+/*
+ * The untracked cache ("UNTR" index extension) remembers, for each
+ * directory in the working directory, the names in it that are not in
+ * the index along with the directory's stat data.  When a directory's
+ * stat data is unchanged, its contents are known without reading it.
+ */
+
+/* The `dir_flags` we record with: every entry that is not in the index */
+#define GIT_UNTRACKED_CACHE_FLAGS 0x22
+
+/* Stat data, stored as 32-bit values like git's `struct stat_data` */
+typedef struct {
+	uint32_t ctime_seconds;
+	uint32_t ctime_nanoseconds;
+	uint32_t mtime_seconds;
+	uint32_t mtime_nanoseconds;
+	uint32_t dev;
+	uint32_t ino;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t size;
+} git_untracked_cache_stat;
+
+typedef struct git_untracked_cache_dir {
+	git_vector untracked; /* names, directories are suffixed with '/' */
+	git_vector dirs; /* child directories, sorted by name */
+
+	git_untracked_cache_stat stat;
+	git_oid exclude_id;
+
+	unsigned int valid:1; /* `stat` and `untracked` are up to date */
+	unsigned int check_only:1;
+	unsigned int exclude_id_valid:1;
+
+	char name[GIT_FLEX_ARRAY];
+} git_untracked_cache_dir;
+
+typedef struct {
+	git_str ident;
+
+	git_untracked_cache_stat info_exclude_stat;
+	git_untracked_cache_stat excludes_file_stat;
+	git_oid info_exclude_id;
+	git_oid excludes_file_id;
+
+	uint32_t dir_flags;
+	char *exclude_per_dir;
+
+	git_untracked_cache_dir *root;
+
+	git_oid_t oid_type;
+	size_t generation; /* bumped whenever a directory is invalidated */
+	unsigned int changed:1; /* whether there are unwritten changes */
+} git_untracked_cache;
+
+/**
+ * Create an empty cache that is recorded in the given working directory.
+ */
+extern int git_untracked_cache_new(
+	git_untracked_cache **out,
+	const char *workdir,
+	git_oid_t oid_type);
+
+extern int git_untracked_cache_read(
+	git_untracked_cache **out,
+	const char *buffer,
+	size_t buffer_size,
+	git_oid_t oid_type);
+
+extern int git_untracked_cache_write(git_str *out, git_untracked_cache *cache);
+
+/**
+ * Whether the cache was recorded by us in the given working directory
+ * (and may be used), rather than by another implementation or at
+ * another location.
+ */
+extern bool git_untracked_cache_usable(
+	git_untracked_cache *cache,
+	const char *workdir);
+
+/**
+ * Look up the directory with the given path (relative to the working
+ * directory, with a trailing slash) in the cache, creating it if it
+ * does not exist.
+ */
+extern int git_untracked_cache_dir_lookup(
+	git_untracked_cache_dir **out,
+	git_untracked_cache *cache,
+	const char *path);
+
+/**
+ * Whether the directory is valid and the given stat data matches the
+ * data that was recorded for it.
+ */
+extern bool git_untracked_cache_dir_uptodate(
+	git_untracked_cache_dir *dir,
+	const struct stat *st);
+
+/**
+ * Replace the untracked names in the directory, and make it valid with
+ * the given stat data.  Takes ownership of the names in the vector.
+ */
+extern void git_untracked_cache_dir_set(
+	git_untracked_cache *cache,
+	git_untracked_cache_dir *dir,
+	git_vector *untracked,
+	const struct stat *st);
+
+/**
+ * Invalidate the directories containing the given path, as its entry
+ * was added to or removed from the index.
+ */
+extern void git_untracked_cache_invalidate_path(
+	git_untracked_cache *cache,
+	const char *path);
+
+extern void git_untracked_cache_free(git_untracked_cache *cache);
+
+#endif
@@ -305,7 +305,7 @@ int git_filebuf_open_withsize(git_filebuf *file, const char *path, int flags, mo
 	if (flags & GIT_FILEBUF_HASH_SHA1) {
 		file->compute_digest = 1;
 
-		if (git_hash_ctx_init(&file->digest, GIT_HASH_ALGORITHM_SHA1) < 0)
+		if (git_hash_ctx_init_ext(&file->digest, GIT_HASH_ALGORITHM_SHA1, GIT_HASH_TRUSTED) < 0)
 			goto cleanup;
 	} else if (flags & GIT_FILEBUF_HASH_SHA256) {
 		file->compute_digest = 1;
@@ -418,7 +418,7 @@ int git_filebuf_commit_at(git_filebuf *file, const char *path)
 	return git_filebuf_commit(file);
 }
 
-int git_filebuf_commit(git_filebuf *file)
+static int filebuf_commit(git_filebuf *file, git_futils_fsync_batch *batch)
 {
 	/* temporary files cannot be committed */
 	GIT_ASSERT_ARG(file);
@@ -432,18 +432,38 @@ int git_filebuf_commit(git_filebuf *file)
 
 	file->fd_is_open = false;
 
-	if (file->do_fsync && p_fsync(file->fd) < 0) {
+	/*
+	 * When batching, the lock file is left in place: the batch
+	 * renames it once its contents are durable.
+	 */
+	if (file->do_fsync && batch) {
+		if (git_futils_fsync_batch_add(batch, file->fd,
+				file->path_lock, file->path_original) < 0)
+			goto on_error;
+
+		file->did_rename = true;
+	} else if (file->do_fsync && p_fsync(file->fd) < 0) {
 		git_error_set(GIT_ERROR_OS, "failed to fsync '%s'", file->path_lock);
 		goto on_error;
 	}
 
 	if (p_close(file->fd) < 0) {
 		git_error_set(GIT_ERROR_OS, "failed to close file at '%s'", file->path_lock);
+
+		/* the lock file is removed, rather than renamed by the batch */
+		if (file->did_rename) {
+			git_futils_fsync_batch_remove(batch, file->path_lock);
+			file->did_rename = false;
+		}
+
 		goto on_error;
 	}
 
 	file->fd = -1;
 
+	if (file->did_rename)
+		goto done;
+
 	if (p_rename(file->path_lock, file->path_original) < 0) {
 		git_error_set(GIT_ERROR_OS, "failed to rename lockfile to '%s'", file->path_original);
 		goto on_error;
@@ -454,6 +474,7 @@ int git_filebuf_commit(git_filebuf *file)
 
 	file->did_rename = true;
 
+done:
 	git_filebuf_cleanup(file);
 	return 0;
 
@@ -462,6 +483,25 @@ on_error:
 	return -1;
 }
 
+int git_filebuf_commit(git_filebuf *file)
+{
+	return filebuf_commit(file, NULL);
+}
+
+int git_filebuf_commit_batch(
+	git_filebuf *file,
+	const char *path,
+	git_futils_fsync_batch *batch)
+{
+	if (path) {
+		git__free(file->path_original);
+		file->path_original = git__strdup(path);
+		GIT_ERROR_CHECK_ALLOC(file->path_original);
+	}
+
+	return filebuf_commit(file, batch);
+}
+
 GIT_INLINE(void) add_to_cache(git_filebuf *file, const void *buf, size_t len)
 {
 	memcpy(file->buffer + file->buf_pos, buf, len);
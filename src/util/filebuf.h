@@ -87,6 +87,17 @@ int git_filebuf_open(git_filebuf *lock, const char *path, int flags, mode_t mode
 int git_filebuf_open_withsize(git_filebuf *file, const char *path, int flags, mode_t mode, size_t size);
 int git_filebuf_commit(git_filebuf *lock);
 int git_filebuf_commit_at(git_filebuf *lock, const char *path);
+
+/*
+ * Commit the file (to `path`, if it is not NULL) as part of an fsync
+ * batch: if the file was opened with `GIT_FILEBUF_FSYNC`, it is not
+ * synchronized or renamed into place until the batch is committed.
+ * Otherwise, this behaves like `git_filebuf_commit_at`.
+ */
+int git_filebuf_commit_batch(
+	git_filebuf *lock,
+	const char *path,
+	git_futils_fsync_batch *batch);
 void git_filebuf_cleanup(git_filebuf *lock);
 int git_filebuf_hash(unsigned char *out, git_filebuf *file);
 int git_filebuf_flush(git_filebuf *file);
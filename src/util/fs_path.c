@@ -1397,8 +1397,18 @@ void git_fs_path_diriter_free(git_fs_path_diriter *diriter)
 	}
 }
 
+int git_fs_path_diriter_type(git_fs_path_diriter *diriter)
+{
+	GIT_UNUSED(diriter);
+	return 0;
+}
+
 #else
 
+#ifdef GIT_IO_GETDENTS64
+# define DIRITER_BUF_SIZE (64 * 1024)
+#endif
+
 int git_fs_path_diriter_init(
 	git_fs_path_diriter *diriter,
 	const char *path,
@@ -1409,6 +1419,10 @@ int git_fs_path_diriter_init(
 
 	memset(diriter, 0, sizeof(git_fs_path_diriter));
 
+#ifdef GIT_IO_GETDENTS64
+	diriter->fd = -1;
+#endif
+
 	if (git_str_puts(&diriter->path, path) < 0)
 		return -1;
 
@@ -1419,13 +1433,24 @@ int git_fs_path_diriter_init(
 		return -1;
 	}
 
+#ifdef GIT_IO_GETDENTS64
+	if ((diriter->fd = p_open(diriter->path.ptr, O_RDONLY | O_DIRECTORY)) < 0) {
+#else
 	if ((diriter->dir = opendir(diriter->path.ptr)) == NULL) {
+#endif
 		git_str_dispose(&diriter->path);
 
 		git_error_set(GIT_ERROR_OS, "failed to open directory '%s'", path);
 		return -1;
 	}
 
+#ifdef GIT_IO_GETDENTS64
+	if ((diriter->buf = git__malloc(DIRITER_BUF_SIZE)) == NULL) {
+		git_fs_path_diriter_free(diriter);
+		return -1;
+	}
+#endif
+
 #ifdef GIT_I18N_ICONV
 	if ((flags & GIT_FS_PATH_DIR_PRECOMPOSE_UNICODE) != 0)
 		(void)git_fs_path_iconv_init_precompose(&diriter->ic);
@@ -1437,9 +1462,58 @@ int git_fs_path_diriter_init(
 	return 0;
 }
 
-int git_fs_path_diriter_next(git_fs_path_diriter *diriter)
+/* Read the name and type of the next item in the directory. */
+static int diriter_read(git_fs_path_diriter *diriter)
 {
+#ifdef GIT_IO_GETDENTS64
+	struct dirent64 *de;
+	ssize_t len;
+
+	if (diriter->buf_pos >= diriter->buf_len) {
+		if ((len = getdents64(diriter->fd,
+				diriter->buf, DIRITER_BUF_SIZE)) < 0) {
+			git_error_set(GIT_ERROR_OS,
+				"could not read directory '%s'", diriter->path.ptr);
+			return -1;
+		}
+
+		if (len == 0)
+			return GIT_ITEROVER;
+
+		diriter->buf_len = (size_t)len;
+		diriter->buf_pos = 0;
+	}
+
+	de = (struct dirent64 *)(diriter->buf + diriter->buf_pos);
+	diriter->buf_pos += de->d_reclen;
+#else
 	struct dirent *de;
+
+	errno = 0;
+
+	if ((de = readdir(diriter->dir)) == NULL) {
+		if (!errno)
+			return GIT_ITEROVER;
+
+		git_error_set(GIT_ERROR_OS,
+			"could not read directory '%s'", diriter->path.ptr);
+		return -1;
+	}
+#endif
+
+	diriter->name = de->d_name;
+
+#ifdef DT_UNKNOWN
+	diriter->type = de->d_type;
+#else
+	diriter->type = 0;
+#endif
+
+	return 0;
+}
+
+int git_fs_path_diriter_next(git_fs_path_diriter *diriter)
+{
 	const char *filename;
 	size_t filename_len;
 	bool skip_dot = !(diriter->flags & GIT_FS_PATH_DIR_INCLUDE_DOT_AND_DOTDOT);
@@ -1447,20 +1521,12 @@ int git_fs_path_diriter_next(git_fs_path_diriter *diriter)
 
 	GIT_ASSERT_ARG(diriter);
 
-	errno = 0;
-
 	do {
-		if ((de = readdir(diriter->dir)) == NULL) {
-			if (!errno)
-				return GIT_ITEROVER;
+		if ((error = diriter_read(diriter)) < 0)
+			return error;
+	} while (skip_dot && git_fs_path_is_dot_or_dotdot(diriter->name));
 
-			git_error_set(GIT_ERROR_OS,
-				"could not read directory '%s'", diriter->path.ptr);
-			return -1;
-		}
-	} while (skip_dot && git_fs_path_is_dot_or_dotdot(de->d_name));
-
-	filename = de->d_name;
+	filename = diriter->name;
 	filename_len = strlen(filename);
 
 #ifdef GIT_I18N_ICONV
@@ -1517,18 +1583,77 @@ int git_fs_path_diriter_stat(struct stat *out, git_fs_path_diriter *diriter)
 	GIT_ASSERT_ARG(out);
 	GIT_ASSERT_ARG(diriter);
 
+#ifdef GIT_IO_FSTATAT
+	/*
+	 * Examine the item relative to the open directory, so that the
+	 * kernel does not walk the full path again for every item.
+	 */
+	if (diriter->name) {
+# ifdef GIT_IO_GETDENTS64
+		int fd = diriter->fd;
+# else
+		int fd = dirfd(diriter->dir);
+# endif
+
+		if (fstatat(fd, diriter->name, out, AT_SYMLINK_NOFOLLOW) == 0)
+			return 0;
+
+		return git_fs_path_set_error(errno, diriter->path.ptr, "stat");
+	}
+#endif
+
 	return git_fs_path_lstat(diriter->path.ptr, out);
 }
 
+int git_fs_path_diriter_type(git_fs_path_diriter *diriter)
+{
+	if (!diriter)
+		return 0;
+
+#ifdef DT_UNKNOWN
+	switch (diriter->type) {
+	case DT_DIR:
+		return S_IFDIR;
+	case DT_REG:
+		return S_IFREG;
+	case DT_LNK:
+		return S_IFLNK;
+	case DT_FIFO:
+		return S_IFIFO;
+	case DT_CHR:
+		return S_IFCHR;
+	case DT_BLK:
+		return S_IFBLK;
+	case DT_SOCK:
+		return S_IFSOCK;
+	}
+#endif
+
+	return 0;
+}
+
 void git_fs_path_diriter_free(git_fs_path_diriter *diriter)
 {
 	if (diriter == NULL)
 		return;
 
+#ifdef GIT_IO_GETDENTS64
+	if (diriter->fd >= 0) {
+		p_close(diriter->fd);
+		diriter->fd = -1;
+	}
+
+	git__free(diriter->buf);
+	diriter->buf = NULL;
+	diriter->buf_len = diriter->buf_pos = 0;
+#else
 	if (diriter->dir) {
 		closedir(diriter->dir);
 		diriter->dir = NULL;
 	}
+#endif
+
+	diriter->name = NULL;
 
 #ifdef GIT_I18N_ICONV
 	git_fs_path_iconv_clear(&diriter->ic);
@@ -515,14 +515,30 @@ struct git_fs_path_diriter
 
 	unsigned int flags;
 
+#ifdef GIT_IO_GETDENTS64
+	/* the directory entries are read in large batches */
+	int fd;
+	char *buf;
+	size_t buf_len;
+	size_t buf_pos;
+#else
 	DIR *dir;
+#endif
+
+	/* the name of the current item as it was read, and its type */
+	const char *name;
+	unsigned char type;
 
 #ifdef GIT_I18N_ICONV
 	git_fs_path_iconv_t ic;
 #endif
 };
 
-#define GIT_FS_PATH_DIRITER_INIT { GIT_STR_INIT }
+#ifdef GIT_IO_GETDENTS64
+# define GIT_FS_PATH_DIRITER_INIT { GIT_STR_INIT, 0, 0, -1 }
+#else
+# define GIT_FS_PATH_DIRITER_INIT { GIT_STR_INIT }
+#endif
 
 #endif
 
@@ -585,6 +601,16 @@ extern int git_fs_path_diriter_fullpath(
  */
 extern int git_fs_path_diriter_stat(struct stat *out, git_fs_path_diriter *diriter);
 
+/**
+ * Returns the type (`S_IFDIR`, `S_IFREG`, `S_IFLNK`, etc) of the
+ * current item in the iterator when the directory listing includes
+ * it, without examining the item itself, or 0 when it is not known.
+ *
+ * @param diriter The directory iterator
+ * @return the file type or 0
+ */
+extern int git_fs_path_diriter_type(git_fs_path_diriter *diriter);
+
 /**
  * Closes the directory iterator.
  *
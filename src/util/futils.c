@@ -302,6 +302,16 @@ int git_futils_readbuffer(git_str *buf, const char *path)
 
 int git_futils_writebuffer(
 	const git_str *buf, const char *path, int flags, mode_t mode)
+{
+	return git_futils_writebuffer_batch(buf, path, flags, mode, NULL);
+}
+
+int git_futils_writebuffer_batch(
+	const git_str *buf,
+	const char *path,
+	int flags,
+	mode_t mode,
+	git_futils_fsync_batch *batch)
 {
 	int fd, do_fsync = 0, error = 0;
 
@@ -327,7 +337,14 @@ int git_futils_writebuffer(
 		return error;
 	}
 
-	if (do_fsync && (error = p_fsync(fd)) < 0) {
+	if (do_fsync && batch) {
+		if ((error = git_futils_fsync_batch_add(batch, fd, path, NULL)) < 0) {
+			p_close(fd);
+			return error;
+		}
+
+		do_fsync = 0;
+	} else if (do_fsync && (error = p_fsync(fd)) < 0) {
 		git_error_set(GIT_ERROR_OS, "could not fsync '%s'", path);
 		p_close(fd);
 		return error;
@@ -1235,3 +1252,306 @@ int git_futils_fsync_parent(const char *path)
 	git__free(parent);
 	return error;
 }
+
+struct fsync_batch_entry {
+	char *path;
+	char *target;
+	dev_t dev;
+	unsigned int renamed : 1;
+};
+
+static void fsync_batch_entry_free(struct fsync_batch_entry *entry)
+{
+	if (!entry)
+		return;
+
+	git__free(entry->path);
+	git__free(entry->target);
+	git__free(entry);
+}
+
+int git_futils_fsync_batch_init(git_futils_fsync_batch *batch)
+{
+	memset(batch, 0, sizeof(git_futils_fsync_batch));
+
+	if (git_mutex_init(&batch->lock) < 0 ||
+	    git_vector_init(&batch->entries, 0, NULL) < 0)
+		return -1;
+
+	return 0;
+}
+
+int git_futils_fsync_batch_add(
+	git_futils_fsync_batch *batch,
+	int fd,
+	const char *path,
+	const char *target)
+{
+	struct fsync_batch_entry *entry;
+	struct stat st;
+	int error;
+
+	GIT_ASSERT_ARG(batch);
+	GIT_ASSERT_ARG(path);
+
+	if (p_fstat(fd, &st) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to stat '%s'", path);
+		return -1;
+	}
+
+#ifndef GIT_SYNCFS
+	if (p_fsync(fd) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to fsync '%s'", path);
+		return -1;
+	}
+#endif
+
+	entry = git__calloc(1, sizeof(struct fsync_batch_entry));
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	entry->dev = st.st_dev;
+	entry->path = git__strdup(path);
+
+	if (!entry->path ||
+	    (target && (entry->target = git__strdup(target)) == NULL)) {
+		fsync_batch_entry_free(entry);
+		return -1;
+	}
+
+	if ((error = git_mutex_lock(&batch->lock)) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock fsync batch");
+		fsync_batch_entry_free(entry);
+		return error;
+	}
+
+	if ((error = git_vector_insert(&batch->entries, entry)) < 0)
+		fsync_batch_entry_free(entry);
+	else if (entry->target)
+		error = git_hashmap_str_put(&batch->targets, entry->target, entry);
+
+	git_mutex_unlock(&batch->lock);
+	return error;
+}
+
+int git_futils_fsync_batch_remove(
+	git_futils_fsync_batch *batch,
+	const char *path)
+{
+	struct fsync_batch_entry *entry = NULL;
+	size_t i;
+	int error;
+
+	GIT_ASSERT_ARG(batch);
+	GIT_ASSERT_ARG(path);
+
+	if ((error = git_mutex_lock(&batch->lock)) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock fsync batch");
+		return error;
+	}
+
+	/* the file is usually the one that was added last */
+	for (i = batch->entries.length; i > 0; i--) {
+		entry = git_vector_get(&batch->entries, i - 1);
+
+		if (strcmp(entry->path, path) == 0)
+			break;
+	}
+
+	if (i == 0) {
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	if (entry->target)
+		git_hashmap_str_remove(&batch->targets, entry->target);
+
+	if ((error = git_vector_remove(&batch->entries, i - 1)) == 0)
+		fsync_batch_entry_free(entry);
+
+done:
+	git_mutex_unlock(&batch->lock);
+	return error;
+}
+
+int git_futils_fsync_batch_lookup(
+	git_str *out,
+	git_futils_fsync_batch *batch,
+	const char *target)
+{
+	struct fsync_batch_entry *entry;
+	int error;
+
+	GIT_ASSERT_ARG(out);
+	GIT_ASSERT_ARG(batch);
+	GIT_ASSERT_ARG(target);
+
+	if ((error = git_mutex_lock(&batch->lock)) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock fsync batch");
+		return error;
+	}
+
+	if (git_hashmap_str_get((void **)&entry, &batch->targets, target) == 0)
+		error = git_str_sets(out, entry->path);
+	else
+		error = GIT_ENOTFOUND;
+
+	git_mutex_unlock(&batch->lock);
+	return error;
+}
+
+/*
+ * Issue a barrier for the files in the batch.  With `syncfs`, a single
+ * call per filesystem flushes everything that was written to it, file
+ * contents and renames alike.  Without it, the file contents were
+ * already synchronized as they were added, and the renames are made
+ * durable by synchronizing each of their parent directories once.
+ */
+#ifdef GIT_SYNCFS
+static int fsync_batch_barrier(git_futils_fsync_batch *batch, bool renamed)
+{
+	struct fsync_batch_entry *entry;
+	git_vector devices = GIT_VECTOR_INIT;
+	dev_t *dev;
+	char *dir;
+	size_t i, j;
+	int fd, error = 0;
+
+	git_vector_foreach(&batch->entries, i, entry) {
+		git_vector_foreach(&devices, j, dev) {
+			if (*dev == entry->dev)
+				break;
+		}
+
+		if (j < devices.length)
+			continue;
+
+		if ((error = git_vector_insert(&devices, &entry->dev)) < 0)
+			break;
+
+		if ((dir = git_fs_path_dirname(entry->path)) == NULL) {
+			error = -1;
+			break;
+		}
+
+		if ((fd = p_open(dir, O_RDONLY)) < 0 || syncfs(fd) < 0) {
+			git_error_set(GIT_ERROR_OS, "failed to sync filesystem of '%s'", dir);
+			error = -1;
+		}
+
+		if (fd >= 0)
+			p_close(fd);
+
+		git__free(dir);
+
+		if (error < 0)
+			break;
+	}
+
+	GIT_UNUSED(renamed);
+
+	git_vector_dispose(&devices);
+	return error;
+}
+#else
+static int fsync_batch_barrier(git_futils_fsync_batch *batch, bool renamed)
+{
+	struct fsync_batch_entry *entry;
+	git_hashset_str seen = GIT_HASHSET_INIT;
+	git_vector dirs = GIT_VECTOR_INIT;
+	char *dir;
+	size_t i;
+	int error = 0;
+
+	if (!renamed)
+		return 0;
+
+	git_vector_foreach(&batch->entries, i, entry) {
+		if ((dir = git_fs_path_dirname(entry->target ?
+				entry->target : entry->path)) == NULL ||
+		    git_vector_insert(&dirs, dir) < 0) {
+			git__free(dir);
+			error = -1;
+			break;
+		}
+
+		if (git_hashset_str_contains(&seen, dir))
+			continue;
+
+		if ((error = git_futils_fsync_dir(dir)) < 0 ||
+		    (error = git_hashset_str_add(&seen, dir)) < 0)
+			break;
+	}
+
+	git_vector_foreach(&dirs, i, dir)
+		git__free(dir);
+
+	git_vector_dispose(&dirs);
+	git_hashset_str_dispose(&seen);
+	return error;
+}
+#endif
+
+static void fsync_batch_clear(git_futils_fsync_batch *batch)
+{
+	struct fsync_batch_entry *entry;
+	size_t i;
+
+	git_vector_foreach(&batch->entries, i, entry) {
+		if (entry->target && !entry->renamed)
+			p_unlink(entry->path);
+
+		fsync_batch_entry_free(entry);
+	}
+
+	git_vector_clear(&batch->entries);
+	git_hashmap_str_clear(&batch->targets);
+}
+
+int git_futils_fsync_batch_commit(git_futils_fsync_batch *batch)
+{
+	struct fsync_batch_entry *entry;
+	size_t i;
+	int error;
+
+	GIT_ASSERT_ARG(batch);
+
+	if ((error = git_mutex_lock(&batch->lock)) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock fsync batch");
+		return error;
+	}
+
+	if ((error = fsync_batch_barrier(batch, false)) < 0)
+		goto done;
+
+	git_vector_foreach(&batch->entries, i, entry) {
+		if (!entry->target)
+			continue;
+
+		if (p_rename(entry->path, entry->target) < 0) {
+			git_error_set(GIT_ERROR_OS, "failed to rename '%s' to '%s'",
+				entry->path, entry->target);
+			error = -1;
+			goto done;
+		}
+
+		entry->renamed = 1;
+	}
+
+	error = fsync_batch_barrier(batch, true);
+
+done:
+	fsync_batch_clear(batch);
+	git_mutex_unlock(&batch->lock);
+	return error;
+}
+
+void git_futils_fsync_batch_dispose(git_futils_fsync_batch *batch)
+{
+	if (!batch)
+		return;
+
+	fsync_batch_clear(batch);
+	git_vector_dispose(&batch->entries);
+	git_hashmap_str_dispose(&batch->targets);
+	git_mutex_free(&batch->lock);
+}
@@ -417,4 +417,79 @@ extern int git_futils_fsync_dir(const char *path);
  */
 extern int git_futils_fsync_parent(const char *path);
 
+/**
+ * A batch of files that are made durable together.
+ *
+ * Instead of synchronizing every file (and its parent directory) to
+ * disk as it is written, files are written to a temporary location and
+ * added to the batch.  When the batch is committed, a single barrier
+ * per filesystem (`syncfs` where it is available) makes their contents
+ * durable, the files are renamed into place, and a second barrier makes
+ * the renames durable.  On platforms without `syncfs`, each file is
+ * synchronized as it is added and only the directory synchronization is
+ * batched.
+ */
+typedef struct {
+	git_mutex lock;
+	git_vector entries;
+	git_hashmap_str targets;
+} git_futils_fsync_batch;
+
+extern int git_futils_fsync_batch_init(git_futils_fsync_batch *batch);
+
+/**
+ * Add a file to the batch.  `fd` is an open descriptor for the file at
+ * `path`; it is only used while adding the file and may be closed as
+ * soon as this returns.  When `target` is not NULL, the file is renamed
+ * to `target` once its contents are durable.
+ */
+extern int git_futils_fsync_batch_add(
+	git_futils_fsync_batch *batch,
+	int fd,
+	const char *path,
+	const char *target);
+
+/**
+ * Remove the file at `path` from the batch again, so that it is neither
+ * synchronized nor renamed; the file itself is left in place.
+ *
+ * @return 0 on success, GIT_ENOTFOUND if `path` is not in the batch
+ */
+extern int git_futils_fsync_batch_remove(
+	git_futils_fsync_batch *batch,
+	const char *path);
+
+/**
+ * Look up the temporary file that is pending a rename to `target`.
+ *
+ * @return 0 on success, GIT_ENOTFOUND if nothing is pending for `target`
+ */
+extern int git_futils_fsync_batch_lookup(
+	git_str *out,
+	git_futils_fsync_batch *batch,
+	const char *target);
+
+/**
+ * Make all files in the batch durable and rename them into place.
+ * The batch is empty afterwards and can be reused.
+ */
+extern int git_futils_fsync_batch_commit(git_futils_fsync_batch *batch);
+
+/**
+ * Free the batch, removing any temporary files that were not committed.
+ */
+extern void git_futils_fsync_batch_dispose(git_futils_fsync_batch *batch);
+
+/**
+ * Write a buffer to a file like `git_futils_writebuffer`; when `O_FSYNC`
+ * is given and `batch` is not NULL, the file is synchronized as part of
+ * the batch instead of immediately.
+ */
+extern int git_futils_writebuffer_batch(
+	const git_str *buf,
+	const char *path,
+	int open_flags,
+	mode_t mode,
+	git_futils_fsync_batch *batch);
+
 #endif
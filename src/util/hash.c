@@ -7,21 +7,40 @@
 
 #include "hash.h"
 
+#include "hash/sha256_accel.h"
+
 int git_hash_global_init(void)
 {
 	if (git_hash_sha1_global_init() < 0 ||
-	    git_hash_sha256_global_init() < 0)
+	    git_hash_sha256_global_init() < 0 ||
+	    git_hash_sha256_accel_global_init() < 0)
 		return -1;
 
 	return 0;
 }
 
 int git_hash_ctx_init(git_hash_ctx *ctx, git_hash_algorithm_t algorithm)
+{
+	return git_hash_ctx_init_ext(ctx, algorithm, 0);
+}
+
+int git_hash_ctx_init_ext(
+	git_hash_ctx *ctx,
+	git_hash_algorithm_t algorithm,
+	unsigned int flags)
 {
 	int error;
 
 	switch (algorithm) {
 	case GIT_HASH_ALGORITHM_SHA1:
+#ifdef GIT_SHA1_BUILTIN
+		if ((flags & GIT_HASH_TRUSTED) != 0) {
+			error = git_hash_sha1_ctx_init_trusted(&ctx->ctx.sha1);
+			break;
+		}
+#else
+		GIT_UNUSED(flags);
+#endif
 		error = git_hash_sha1_ctx_init(&ctx->ctx.sha1);
 		break;
 	case GIT_HASH_ALGORITHM_SHA256:
@@ -100,11 +119,21 @@ int git_hash_buf(
 	const void *data,
 	size_t len,
 	git_hash_algorithm_t algorithm)
+{
+	return git_hash_buf_ext(out, data, len, algorithm, 0);
+}
+
+int git_hash_buf_ext(
+	unsigned char *out,
+	const void *data,
+	size_t len,
+	git_hash_algorithm_t algorithm,
+	unsigned int flags)
 {
 	git_hash_ctx ctx;
 	int error = 0;
 
-	if (git_hash_ctx_init(&ctx, algorithm) < 0)
+	if (git_hash_ctx_init_ext(&ctx, algorithm, flags) < 0)
 		return -1;
 
 	if ((error = git_hash_update(&ctx, data, len)) >= 0)
@@ -120,12 +149,22 @@ int git_hash_vec(
 	git_str_vec *vec,
 	size_t n,
 	git_hash_algorithm_t algorithm)
+{
+	return git_hash_vec_ext(out, vec, n, algorithm, 0);
+}
+
+int git_hash_vec_ext(
+	unsigned char *out,
+	git_str_vec *vec,
+	size_t n,
+	git_hash_algorithm_t algorithm,
+	unsigned int flags)
 {
 	git_hash_ctx ctx;
 	size_t i;
 	int error = 0;
 
-	if (git_hash_ctx_init(&ctx, algorithm) < 0)
+	if (git_hash_ctx_init_ext(&ctx, algorithm, flags) < 0)
 		return -1;
 
 	for (i = 0; i < n; i++) {
@@ -141,6 +180,33 @@ done:
 	return error;
 }
 
+int git_hash_vec_multi(
+	unsigned char *out,
+	git_str_vec *vec,
+	size_t vec_per_hash,
+	size_t n,
+	git_hash_algorithm_t algorithm,
+	unsigned int flags)
+{
+	size_t hash_size = git_hash_size(algorithm), i;
+	int error;
+
+	if (algorithm == GIT_HASH_ALGORITHM_SHA256 && n > 1 &&
+	    git_hash_sha256_accel_multi_lanes() > 0) {
+		git_hash_sha256_accel_multi(out, vec, vec_per_hash, n);
+		return 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		if ((error = git_hash_vec_ext(out + (i * hash_size),
+				vec + (i * vec_per_hash), vec_per_hash,
+				algorithm, flags)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
 int git_hash_fmt(char *out, unsigned char *hash, size_t hash_len)
 {
 	static char hex[] = "0123456789abcdef";
@@ -12,11 +12,6 @@
 
 #include "hash/sha.h"
 
-typedef struct {
-	void *data;
-	size_t len;
-} git_str_vec;
-
 typedef enum {
 	GIT_HASH_ALGORITHM_NONE = 0,
 	GIT_HASH_ALGORITHM_SHA1,
@@ -25,6 +20,13 @@ typedef enum {
 
 #define GIT_HASH_MAX_SIZE GIT_HASH_SHA256_SIZE
 
+/*
+ * The data being hashed was produced locally (and is not received from
+ * a remote), so hashing may use a faster implementation that does not
+ * perform SHA1 collision detection.
+ */
+#define GIT_HASH_TRUSTED (1 << 0)
+
 typedef struct git_hash_ctx {
 	union {
 		git_hash_sha1_ctx sha1;
@@ -36,6 +38,7 @@ typedef struct git_hash_ctx {
 int git_hash_global_init(void);
 
 int git_hash_ctx_init(git_hash_ctx *ctx, git_hash_algorithm_t algorithm);
+int git_hash_ctx_init_ext(git_hash_ctx *ctx, git_hash_algorithm_t algorithm, unsigned int flags);
 void git_hash_ctx_cleanup(git_hash_ctx *ctx);
 
 int git_hash_init(git_hash_ctx *c);
@@ -45,6 +48,22 @@ int git_hash_final(unsigned char *out, git_hash_ctx *c);
 int git_hash_buf(unsigned char *out, const void *data, size_t len, git_hash_algorithm_t algorithm);
 int git_hash_vec(unsigned char *out, git_str_vec *vec, size_t n, git_hash_algorithm_t algorithm);
 
+int git_hash_buf_ext(unsigned char *out, const void *data, size_t len, git_hash_algorithm_t algorithm, unsigned int flags);
+int git_hash_vec_ext(unsigned char *out, git_str_vec *vec, size_t n, git_hash_algorithm_t algorithm, unsigned int flags);
+
+/*
+ * Compute `n` independent hashes, each over `vec_per_hash` consecutive
+ * entries of `vec`, writing the results consecutively to `out`.  Where
+ * supported, several small inputs are hashed at once.
+ */
+int git_hash_vec_multi(
+	unsigned char *out,
+	git_str_vec *vec,
+	size_t vec_per_hash,
+	size_t n,
+	git_hash_algorithm_t algorithm,
+	unsigned int flags);
+
 int git_hash_fmt(char *out, unsigned char *hash, size_t hash_len);
 
 GIT_INLINE(size_t) git_hash_size(git_hash_algorithm_t algorithm) {
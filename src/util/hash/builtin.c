@@ -25,7 +25,15 @@ void git_hash_sha256_ctx_cleanup(git_hash_sha256_ctx *ctx)
 int git_hash_sha256_init(git_hash_sha256_ctx *ctx)
 {
 	GIT_ASSERT_ARG(ctx);
-	if (SHA256Reset(&ctx->c)) {
+
+	ctx->accel = (git_hash_sha256_accel_impl() != GIT_HASH_SHA256_ACCEL_NONE);
+
+	if (ctx->accel) {
+		git_hash_sha256_accel_init(&ctx->c.accel);
+		return 0;
+	}
+
+	if (SHA256Reset(&ctx->c.rfc)) {
 		git_error_set(GIT_ERROR_SHA, "SHA256 error");
 		return -1;
 	}
@@ -37,10 +45,15 @@ int git_hash_sha256_update(git_hash_sha256_ctx *ctx, const void *_data, size_t l
 	const unsigned char *data = _data;
 	GIT_ASSERT_ARG(ctx);
 
+	if (ctx->accel) {
+		git_hash_sha256_accel_update(&ctx->c.accel, data, len);
+		return 0;
+	}
+
 	while (len > 0) {
 		unsigned int chunk = (len > UINT_MAX) ? UINT_MAX : (unsigned int)len;
 
-		if (SHA256Input(&ctx->c, data, chunk)) {
+		if (SHA256Input(&ctx->c.rfc, data, chunk)) {
 			git_error_set(GIT_ERROR_SHA, "SHA256 error");
 			return -1;
 		}
@@ -55,7 +68,13 @@ int git_hash_sha256_update(git_hash_sha256_ctx *ctx, const void *_data, size_t l
 int git_hash_sha256_final(unsigned char *out, git_hash_sha256_ctx *ctx)
 {
 	GIT_ASSERT_ARG(ctx);
-	if (SHA256Result(&ctx->c, out)) {
+
+	if (ctx->accel) {
+		git_hash_sha256_accel_final(out, &ctx->c.accel);
+		return 0;
+	}
+
+	if (SHA256Result(&ctx->c.rfc, out)) {
 		git_error_set(GIT_ERROR_SHA, "SHA256 error");
 		return -1;
 	}
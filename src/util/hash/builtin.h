@@ -11,9 +11,14 @@
 #include "hash/sha.h"
 
 #include "rfc6234/sha.h"
+#include "hash/sha256_accel.h"
 
 struct git_hash_sha256_ctx {
-	SHA256Context c;
+	union {
+		SHA256Context rfc;
+		git_hash_sha256_accel_ctx accel;
+	} c;
+	unsigned int accel : 1;
 };
 
 #endif
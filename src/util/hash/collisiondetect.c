@@ -9,11 +9,20 @@
 
 int git_hash_sha1_global_init(void)
 {
-	return 0;
+	return git_hash_sha1_accel_global_init();
 }
 
 int git_hash_sha1_ctx_init(git_hash_sha1_ctx *ctx)
 {
+	GIT_ASSERT_ARG(ctx);
+	ctx->trusted = 0;
+	return git_hash_sha1_init(ctx);
+}
+
+int git_hash_sha1_ctx_init_trusted(git_hash_sha1_ctx *ctx)
+{
+	GIT_ASSERT_ARG(ctx);
+	ctx->trusted = 1;
 	return git_hash_sha1_init(ctx);
 }
 
@@ -25,21 +34,47 @@ void git_hash_sha1_ctx_cleanup(git_hash_sha1_ctx *ctx)
 int git_hash_sha1_init(git_hash_sha1_ctx *ctx)
 {
 	GIT_ASSERT_ARG(ctx);
-	SHA1DCInit(&ctx->c);
+
+	ctx->accel = ctx->trusted &&
+		git_hash_sha1_accel_impl() != GIT_HASH_SHA1_ACCEL_NONE;
+
+	if (ctx->accel) {
+		git_hash_sha1_accel_init(&ctx->c.accel);
+		return 0;
+	}
+
+	SHA1DCInit(&ctx->c.dc);
+
+	if (ctx->trusted) {
+		SHA1DCSetSafeHash(&ctx->c.dc, 0);
+		SHA1DCSetUseDetectColl(&ctx->c.dc, 0);
+	}
+
 	return 0;
 }
 
 int git_hash_sha1_update(git_hash_sha1_ctx *ctx, const void *data, size_t len)
 {
 	GIT_ASSERT_ARG(ctx);
-	SHA1DCUpdate(&ctx->c, data, len);
+
+	if (ctx->accel)
+		git_hash_sha1_accel_update(&ctx->c.accel, data, len);
+	else
+		SHA1DCUpdate(&ctx->c.dc, data, len);
+
 	return 0;
 }
 
 int git_hash_sha1_final(unsigned char *out, git_hash_sha1_ctx *ctx)
 {
 	GIT_ASSERT_ARG(ctx);
-	if (SHA1DCFinal(out, &ctx->c)) {
+
+	if (ctx->accel) {
+		git_hash_sha1_accel_final(out, &ctx->c.accel);
+		return 0;
+	}
+
+	if (SHA1DCFinal(out, &ctx->c.dc)) {
 		git_error_set(GIT_ERROR_SHA, "SHA1 collision attack detected");
 		return -1;
 	}
@@ -11,9 +11,21 @@
 #include "hash/sha.h"
 
 #include "sha1dc/sha1.h"
+#include "hash/sha1_accel.h"
 
 struct git_hash_sha1_ctx {
-	SHA1_CTX c;
+	union {
+		SHA1_CTX dc;
+		git_hash_sha1_accel_ctx accel;
+	} c;
+	unsigned int trusted : 1,
+	             accel : 1;
 };
 
+/*
+ * Initialize a context for hashing trusted data; this skips collision
+ * detection and uses the processor's SHA1 instructions when available.
+ */
+int git_hash_sha1_ctx_init_trusted(git_hash_sha1_ctx *ctx);
+
 #endif
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#ifndef INCLUDE_hash_cpu_h__
+#define INCLUDE_hash_cpu_h__
+
+#include "git2_util.h"
+
+/*
+ * Detection of the processor features used by the accelerated hash
+ * implementations.  On x86, the instructions are compiled with a
+ * function-level target and selected at runtime.  The ARMv8
+ * instructions are only used when the compiler targets a processor
+ * that is known to support them (for example, all Apple silicon, or
+ * builds with `-march=armv8-a+crypto`).
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+# define GIT_HASH_X86
+# define GIT_HASH_X86_TARGET(features) __attribute__((target(features)))
+# include <cpuid.h>
+# include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# define GIT_HASH_X86
+# define GIT_HASH_X86_TARGET(features)
+# include <intrin.h>
+# include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && \
+    (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2))
+# define GIT_HASH_ARMV8
+# include <arm_neon.h>
+#endif
+
+#ifdef GIT_HASH_X86
+
+/* The SHA extensions (along with the SSSE3 and SSE4.1 they rely on) */
+# define GIT_HASH_X86_SHA  (1 << 0)
+/* AVX2, including operating system support for the YMM registers */
+# define GIT_HASH_X86_AVX2 (1 << 1)
+
+GIT_INLINE(void) git_hash_x86_cpuid(unsigned int info[4], unsigned int leaf)
+{
+# if defined(_MSC_VER)
+	__cpuidex((int *)info, (int)leaf, 0);
+# else
+	__cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+# endif
+}
+
+GIT_INLINE(uint64_t) git_hash_x86_xgetbv(void)
+{
+# if defined(_MSC_VER)
+	return _xgetbv(0);
+# else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+# endif
+}
+
+GIT_INLINE(unsigned int) git_hash_x86_features(void)
+{
+	unsigned int info[4] = { 0 }, ecx1, ebx7, features = 0;
+
+	git_hash_x86_cpuid(info, 0);
+
+	if (info[0] < 7)
+		return 0;
+
+	git_hash_x86_cpuid(info, 1);
+	ecx1 = info[2];
+
+	git_hash_x86_cpuid(info, 7);
+	ebx7 = info[1];
+
+	/* SSSE3, SSE4.1 and SHA */
+	if ((ecx1 & (1 << 9)) && (ecx1 & (1 << 19)) && (ebx7 & (1 << 29)))
+		features |= GIT_HASH_X86_SHA;
+
+	/* OSXSAVE, AVX, YMM state enabled and AVX2 */
+	if ((ecx1 & (1 << 27)) && (ecx1 & (1 << 28)) &&
+	    (git_hash_x86_xgetbv() & 0x6) == 0x6 &&
+	    (ebx7 & (1 << 5)))
+		features |= GIT_HASH_X86_AVX2;
+
+	return features;
+}
+
+#endif
+
+#endif
@@ -13,6 +13,11 @@
 typedef struct git_hash_sha1_ctx git_hash_sha1_ctx;
 typedef struct git_hash_sha256_ctx git_hash_sha256_ctx;
 
+typedef struct git_str_vec {
+	void *data;
+	size_t len;
+} git_str_vec;
+
 #if defined(GIT_SHA1_BUILTIN)
 # include "collisiondetect.h"
 #endif
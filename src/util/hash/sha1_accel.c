@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "sha1_accel.h"
+
+#include "hash/cpu.h"
+
+typedef void (*sha1_blocks_fn)(uint32_t state[5], const unsigned char *data, size_t blocks);
+
+static sha1_blocks_fn sha1_blocks;
+static git_hash_sha1_accel_impl_t sha1_impl;
+static bool sha1_selected;
+
+/* x86 SHA extensions */
+
+#ifdef GIT_HASH_X86
+
+static bool x86_has_shani(void)
+{
+	return (git_hash_x86_features() & GIT_HASH_X86_SHA) != 0;
+}
+
+/*
+ * Four rounds, while advancing the message schedule: `m0` holds the
+ * words for these rounds, `m1` is completed, `m2` is updated and `m3`
+ * is started for the rounds that follow.
+ */
+# define SHANI_ROUNDS(e_cur, e_next, m0, m1, m2, m3, f) \
+	e_cur = _mm_sha1nexte_epu32(e_cur, m0); \
+	e_next = abcd; \
+	m1 = _mm_sha1msg2_epu32(m1, m0); \
+	abcd = _mm_sha1rnds4_epu32(abcd, e_cur, f); \
+	m3 = _mm_sha1msg1_epu32(m3, m0); \
+	m2 = _mm_xor_si128(m2, m0);
+
+# define SHANI_LOAD(m, offset) \
+	m = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + offset)), mask);
+
+static GIT_HASH_X86_TARGET("sha,sse4.1") void sha1_blocks_shani(
+	uint32_t state[5],
+	const unsigned char *data,
+	size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_saved, e0, e0_saved, e1;
+	__m128i msg0, msg1, msg2, msg3;
+
+	abcd = _mm_loadu_si128((const __m128i *)state);
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	while (blocks--) {
+		abcd_saved = abcd;
+		e0_saved = e0;
+
+		/* rounds 0-3 */
+		SHANI_LOAD(msg0, 0);
+		e0 = _mm_add_epi32(e0, msg0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		/* rounds 4-7 */
+		SHANI_LOAD(msg1, 16);
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+		/* rounds 8-11 */
+		SHANI_LOAD(msg2, 32);
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		/* rounds 12-67 */
+		SHANI_LOAD(msg3, 48);
+		SHANI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 0);
+		SHANI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 0);
+		SHANI_ROUNDS(e1, e0, msg1, msg2, msg3, msg0, 1);
+		SHANI_ROUNDS(e0, e1, msg2, msg3, msg0, msg1, 1);
+		SHANI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 1);
+		SHANI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 1);
+		SHANI_ROUNDS(e1, e0, msg1, msg2, msg3, msg0, 1);
+		SHANI_ROUNDS(e0, e1, msg2, msg3, msg0, msg1, 2);
+		SHANI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 2);
+		SHANI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 2);
+		SHANI_ROUNDS(e1, e0, msg1, msg2, msg3, msg0, 2);
+		SHANI_ROUNDS(e0, e1, msg2, msg3, msg0, msg1, 2);
+		SHANI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 3);
+		SHANI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 3);
+
+		/* rounds 68-71 */
+		e1 = _mm_sha1nexte_epu32(e1, msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* rounds 72-75 */
+		e0 = _mm_sha1nexte_epu32(e0, msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+		/* rounds 76-79 */
+		e1 = _mm_sha1nexte_epu32(e1, msg3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_saved);
+		abcd = _mm_add_epi32(abcd, abcd_saved);
+
+		data += 64;
+	}
+
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	_mm_storeu_si128((__m128i *)state, abcd);
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#endif
+
+/* ARMv8 cryptography extensions */
+
+#ifdef GIT_HASH_ARMV8
+
+/* Four rounds using `op`, preparing the (pre-added) words for later rounds. */
+# define ARMV8_ROUNDS(op, e_cur, e_next, t) \
+	e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+	abcd = op(abcd, e_cur, t);
+
+# define ARMV8_SCHEDULE(m0, m1, m2, m3) \
+	m0 = vsha1su1q_u32(m0, m3); \
+	m1 = vsha1su0q_u32(m1, m2, m3);
+
+static void sha1_blocks_armv8(
+	uint32_t state[5],
+	const unsigned char *data,
+	size_t blocks)
+{
+	const uint32x4_t k0 = vdupq_n_u32(0x5a827999);
+	const uint32x4_t k1 = vdupq_n_u32(0x6ed9eba1);
+	const uint32x4_t k2 = vdupq_n_u32(0x8f1bbcdc);
+	const uint32x4_t k3 = vdupq_n_u32(0xca62c1d6);
+	uint32x4_t abcd, abcd_saved, msg0, msg1, msg2, msg3, t0, t1;
+	uint32_t e0, e1, e_saved;
+
+	abcd = vld1q_u32(state);
+	e0 = state[4];
+
+	while (blocks--) {
+		abcd_saved = abcd;
+		e_saved = e0;
+
+		msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+		msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+		msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+		msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+		t0 = vaddq_u32(msg0, k0);
+		t1 = vaddq_u32(msg1, k0);
+
+		/* rounds 0-19 */
+		ARMV8_ROUNDS(vsha1cq_u32, e0, e1, t0);
+		t0 = vaddq_u32(msg2, k0);
+		msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+		ARMV8_ROUNDS(vsha1cq_u32, e1, e0, t1);
+		t1 = vaddq_u32(msg3, k0);
+		ARMV8_SCHEDULE(msg0, msg1, msg2, msg3);
+
+		ARMV8_ROUNDS(vsha1cq_u32, e0, e1, t0);
+		t0 = vaddq_u32(msg0, k0);
+		ARMV8_SCHEDULE(msg1, msg2, msg3, msg0);
+
+		ARMV8_ROUNDS(vsha1cq_u32, e1, e0, t1);
+		t1 = vaddq_u32(msg1, k1);
+		ARMV8_SCHEDULE(msg2, msg3, msg0, msg1);
+
+		ARMV8_ROUNDS(vsha1cq_u32, e0, e1, t0);
+		t0 = vaddq_u32(msg2, k1);
+		ARMV8_SCHEDULE(msg3, msg0, msg1, msg2);
+
+		/* rounds 20-39 */
+		ARMV8_ROUNDS(vsha1pq_u32, e1, e0, t1);
+		t1 = vaddq_u32(msg3, k1);
+		ARMV8_SCHEDULE(msg0, msg1, msg2, msg3);
+
+		ARMV8_ROUNDS(vsha1pq_u32, e0, e1, t0);
+		t0 = vaddq_u32(msg0, k1);
+		ARMV8_SCHEDULE(msg1, msg2, msg3, msg0);
+
+		ARMV8_ROUNDS(vsha1pq_u32, e1, e0, t1);
+		t1 = vaddq_u32(msg1, k1);
+		ARMV8_SCHEDULE(msg2, msg3, msg0, msg1);
+
+		ARMV8_ROUNDS(vsha1pq_u32, e0, e1, t0);
+		t0 = vaddq_u32(msg2, k2);
+		ARMV8_SCHEDULE(msg3, msg0, msg1, msg2);
+
+		ARMV8_ROUNDS(vsha1pq_u32, e1, e0, t1);
+		t1 = vaddq_u32(msg3, k2);
+		ARMV8_SCHEDULE(msg0, msg1, msg2, msg3);
+
+		/* rounds 40-59 */
+		ARMV8_ROUNDS(vsha1mq_u32, e0, e1, t0);
+		t0 = vaddq_u32(msg0, k2);
+		ARMV8_SCHEDULE(msg1, msg2, msg3, msg0);
+
+		ARMV8_ROUNDS(vsha1mq_u32, e1, e0, t1);
+		t1 = vaddq_u32(msg1, k2);
+		ARMV8_SCHEDULE(msg2, msg3, msg0, msg1);
+
+		ARMV8_ROUNDS(vsha1mq_u32, e0, e1, t0);
+		t0 = vaddq_u32(msg2, k2);
+		ARMV8_SCHEDULE(msg3, msg0, msg1, msg2);
+
+		ARMV8_ROUNDS(vsha1mq_u32, e1, e0, t1);
+		t1 = vaddq_u32(msg3, k3);
+		ARMV8_SCHEDULE(msg0, msg1, msg2, msg3);
+
+		ARMV8_ROUNDS(vsha1mq_u32, e0, e1, t0);
+		t0 = vaddq_u32(msg0, k3);
+		ARMV8_SCHEDULE(msg1, msg2, msg3, msg0);
+
+		/* rounds 60-79 */
+		ARMV8_ROUNDS(vsha1pq_u32, e1, e0, t1);
+		t1 = vaddq_u32(msg1, k3);
+		ARMV8_SCHEDULE(msg2, msg3, msg0, msg1);
+
+		ARMV8_ROUNDS(vsha1pq_u32, e0, e1, t0);
+		t0 = vaddq_u32(msg2, k3);
+		msg3 = vsha1su1q_u32(msg3, msg2);
+
+		ARMV8_ROUNDS(vsha1pq_u32, e1, e0, t1);
+		t1 = vaddq_u32(msg3, k3);
+
+		ARMV8_ROUNDS(vsha1pq_u32, e0, e1, t0);
+
+		ARMV8_ROUNDS(vsha1pq_u32, e1, e0, t1);
+
+		e0 += e_saved;
+		abcd = vaddq_u32(abcd_saved, abcd);
+
+		data += 64;
+	}
+
+	vst1q_u32(state, abcd);
+	state[4] = e0;
+}
+
+#endif
+
+static void sha1_select_impl(void)
+{
+#if defined(GIT_HASH_ARMV8)
+	sha1_blocks = sha1_blocks_armv8;
+	sha1_impl = GIT_HASH_SHA1_ACCEL_ARMV8;
+#elif defined(GIT_HASH_X86)
+	if (x86_has_shani()) {
+		sha1_blocks = sha1_blocks_shani;
+		sha1_impl = GIT_HASH_SHA1_ACCEL_X86_SHANI;
+	}
+#endif
+
+	sha1_selected = true;
+}
+
+int git_hash_sha1_accel_global_init(void)
+{
+	if (!sha1_selected)
+		sha1_select_impl();
+
+	return 0;
+}
+
+git_hash_sha1_accel_impl_t git_hash_sha1_accel_impl(void)
+{
+	if (!sha1_selected)
+		sha1_select_impl();
+
+	return sha1_impl;
+}
+
+int git_hash_sha1_accel_set_impl(git_hash_sha1_accel_impl_t impl)
+{
+	switch (impl) {
+	case GIT_HASH_SHA1_ACCEL_NONE:
+		sha1_blocks = NULL;
+		break;
+#ifdef GIT_HASH_X86
+	case GIT_HASH_SHA1_ACCEL_X86_SHANI:
+		if (!x86_has_shani())
+			goto unsupported;
+
+		sha1_blocks = sha1_blocks_shani;
+		break;
+#endif
+#ifdef GIT_HASH_ARMV8
+	case GIT_HASH_SHA1_ACCEL_ARMV8:
+		sha1_blocks = sha1_blocks_armv8;
+		break;
+#endif
+	default:
+		goto unsupported;
+	}
+
+	sha1_impl = impl;
+	sha1_selected = true;
+	return 0;
+
+unsupported:
+	git_error_set(GIT_ERROR_SHA, "SHA1 implementation is not supported on this platform");
+	return -1;
+}
+
+void git_hash_sha1_accel_init(git_hash_sha1_accel_ctx *ctx)
+{
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xefcdab89;
+	ctx->state[2] = 0x98badcfe;
+	ctx->state[3] = 0x10325476;
+	ctx->state[4] = 0xc3d2e1f0;
+	ctx->size = 0;
+}
+void git_hash_sha1_accel_update(
+	git_hash_sha1_accel_ctx *ctx,
+	const void *_data,
+	size_t len)
+{
+	const unsigned char *data = _data;
+	size_t used = (size_t)(ctx->size & 63), blocks;
+
+	ctx->size += len;
+
+	if (used) {
+		size_t fill = min(64 - used, len);
+
+		memcpy(ctx->buf + used, data, fill);
+		data += fill;
+		len -= fill;
+
+		if (used + fill < 64)
+			return;
+
+		sha1_blocks(ctx->state, ctx->buf, 1);
+	}
+
+	if ((blocks = len / 64) > 0) {
+		sha1_blocks(ctx->state, data, blocks);
+		data += blocks * 64;
+		len -= blocks * 64;
+	}
+
+	if (len)
+		memcpy(ctx->buf, data, len);
+}
+
+void git_hash_sha1_accel_final(unsigned char *out, git_hash_sha1_accel_ctx *ctx)
+{
+	static const unsigned char pad[64] = { 0x80 };
+	unsigned char bits[8];
+	uint64_t size = ctx->size << 3;
+	size_t used = (size_t)(ctx->size & 63), i;
+
+	for (i = 0; i < 8; i++)
+		bits[i] = (unsigned char)(size >> (56 - (i * 8)));
+
+	git_hash_sha1_accel_update(ctx, pad, used < 56 ? 56 - used : 120 - used);
+	git_hash_sha1_accel_update(ctx, bits, 8);
+
+	for (i = 0; i < 5; i++) {
+		out[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+		out[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+		out[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+		out[i * 4 + 3] = (unsigned char)(ctx->state[i]);
+	}
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#ifndef INCLUDE_hash_sha1_accel_h__
+#define INCLUDE_hash_sha1_accel_h__
+
+#include "git2_util.h"
+
+/*
+ * A SHA1 implementation without collision detection, that uses the
+ * SHA extensions of x86 or ARMv8 processors.  This is only suitable
+ * for hashing data that is trusted, since it cannot detect a collision
+ * attack.  The hashing functions may only be used when an accelerated
+ * implementation is available (`git_hash_sha1_accel_impl` does not
+ * return `GIT_HASH_SHA1_ACCEL_NONE`).
+ */
+
+typedef enum {
+	GIT_HASH_SHA1_ACCEL_NONE = 0,
+	GIT_HASH_SHA1_ACCEL_X86_SHANI,
+	GIT_HASH_SHA1_ACCEL_ARMV8
+} git_hash_sha1_accel_impl_t;
+
+typedef struct {
+	uint32_t state[5];
+	uint64_t size;
+	unsigned char buf[64];
+} git_hash_sha1_accel_ctx;
+
+int git_hash_sha1_accel_global_init(void);
+
+void git_hash_sha1_accel_init(git_hash_sha1_accel_ctx *ctx);
+void git_hash_sha1_accel_update(git_hash_sha1_accel_ctx *ctx, const void *data, size_t len);
+void git_hash_sha1_accel_final(unsigned char *out, git_hash_sha1_accel_ctx *ctx);
+
+/* Query or override the implementation that is in use; for testing. */
+git_hash_sha1_accel_impl_t git_hash_sha1_accel_impl(void);
+int git_hash_sha1_accel_set_impl(git_hash_sha1_accel_impl_t impl);
+
+#endif
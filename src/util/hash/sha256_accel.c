@@ -0,0 +1,654 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "sha256_accel.h"
+
+#include "hash.h"
+#include "hash/cpu.h"
+
+typedef void (*sha256_blocks_fn)(uint32_t state[8], const unsigned char *data, size_t blocks);
+
+static sha256_blocks_fn sha256_blocks;
+static git_hash_sha256_accel_impl_t sha256_impl;
+static bool sha256_selected;
+
+#ifdef GIT_HASH_X86
+static bool sha256_multi;
+#endif
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#if defined(GIT_HASH_X86) || defined(GIT_HASH_ARMV8)
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+#endif
+
+GIT_INLINE(void) store_be32(unsigned char *out, uint32_t val)
+{
+	out[0] = (unsigned char)(val >> 24);
+	out[1] = (unsigned char)(val >> 16);
+	out[2] = (unsigned char)(val >> 8);
+	out[3] = (unsigned char)(val);
+}
+
+GIT_INLINE(void) store_be64(unsigned char *out, uint64_t val)
+{
+	store_be32(out, (uint32_t)(val >> 32));
+	store_be32(out + 4, (uint32_t)val);
+}
+
+/* x86 SHA extensions */
+
+#ifdef GIT_HASH_X86
+
+/*
+ * Four rounds using the words in `m0`, while completing the schedule
+ * for `m1` (with `m3`) and starting it for `m3`.
+ */
+# define SHANI_ROUNDS(g, m0, m1, m3) \
+	msg = _mm_add_epi32(m0, _mm_loadu_si128((const __m128i *)&sha256_k[(g) * 4])); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+	tmp = _mm_alignr_epi8(m0, m3, 4); \
+	m1 = _mm_add_epi32(m1, tmp); \
+	m1 = _mm_sha256msg2_epu32(m1, m0); \
+	msg = _mm_shuffle_epi32(msg, 0x0e); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+	m3 = _mm_sha256msg1_epu32(m3, m0);
+
+# define SHANI_LOAD(m, offset) \
+	m = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + offset)), mask);
+
+# define SHANI_ROUNDS_ONLY(g, m0) \
+	msg = _mm_add_epi32(m0, _mm_loadu_si128((const __m128i *)&sha256_k[(g) * 4])); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+	msg = _mm_shuffle_epi32(msg, 0x0e); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+static GIT_HASH_X86_TARGET("sha,sse4.1") void sha256_blocks_shani(
+	uint32_t state[8],
+	const unsigned char *data,
+	size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1, abef_saved, cdgh_saved;
+	__m128i msg, tmp, msg0, msg1, msg2, msg3;
+
+	/* the instructions operate on (a, b, e, f) and (c, d, g, h) */
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xb1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	while (blocks--) {
+		abef_saved = state0;
+		cdgh_saved = state1;
+
+		/* rounds 0-15 */
+		SHANI_LOAD(msg0, 0);
+		SHANI_ROUNDS_ONLY(0, msg0);
+
+		SHANI_LOAD(msg1, 16);
+		SHANI_ROUNDS_ONLY(1, msg1);
+		msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+		SHANI_LOAD(msg2, 32);
+		SHANI_ROUNDS_ONLY(2, msg2);
+		msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+		SHANI_LOAD(msg3, 48);
+		SHANI_ROUNDS(3, msg3, msg0, msg2);
+
+		/* rounds 16-51 */
+		SHANI_ROUNDS(4, msg0, msg1, msg3);
+		SHANI_ROUNDS(5, msg1, msg2, msg0);
+		SHANI_ROUNDS(6, msg2, msg3, msg1);
+		SHANI_ROUNDS(7, msg3, msg0, msg2);
+		SHANI_ROUNDS(8, msg0, msg1, msg3);
+		SHANI_ROUNDS(9, msg1, msg2, msg0);
+		SHANI_ROUNDS(10, msg2, msg3, msg1);
+		SHANI_ROUNDS(11, msg3, msg0, msg2);
+		SHANI_ROUNDS(12, msg0, msg1, msg3);
+
+		/* rounds 52-59 */
+		msg = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i *)&sha256_k[52]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+		tmp = _mm_alignr_epi8(msg1, msg0, 4);
+		msg2 = _mm_add_epi32(msg2, tmp);
+		msg2 = _mm_sha256msg2_epu32(msg2, msg1);
+		msg = _mm_shuffle_epi32(msg, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+		msg = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i *)&sha256_k[56]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+		tmp = _mm_alignr_epi8(msg2, msg1, 4);
+		msg3 = _mm_add_epi32(msg3, tmp);
+		msg3 = _mm_sha256msg2_epu32(msg3, msg2);
+		msg = _mm_shuffle_epi32(msg, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+		/* rounds 60-63 */
+		SHANI_ROUNDS_ONLY(15, msg3);
+
+		state0 = _mm_add_epi32(state0, abef_saved);
+		state1 = _mm_add_epi32(state1, cdgh_saved);
+
+		data += 64;
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+/* AVX2 multi-buffer: eight independent hashes, one in each lane */
+
+# define MULTI_LANES 8
+
+# define AVX2_ROTR(x, n) \
+	_mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+GIT_INLINE(uint32_t) load_u32(const unsigned char *p)
+{
+	uint32_t val;
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static GIT_HASH_X86_TARGET("avx2") void sha256_x8_avx2(
+	uint32_t state[8][MULTI_LANES],
+	const unsigned char *blocks[MULTI_LANES])
+{
+	const __m256i bswap = _mm256_set_epi8(
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	__m256i w[16], s[8], a, b, c, d, e, f, g, h, t1, t2, s0, s1;
+	size_t i;
+
+	for (i = 0; i < 8; i++)
+		s[i] = _mm256_loadu_si256((const __m256i *)state[i]);
+
+	a = s[0]; b = s[1]; c = s[2]; d = s[3];
+	e = s[4]; f = s[5]; g = s[6]; h = s[7];
+
+	for (i = 0; i < 64; i++) {
+		if (i < 16) {
+			w[i] = _mm256_shuffle_epi8(_mm256_set_epi32(
+				(int)load_u32(blocks[7] + i * 4),
+				(int)load_u32(blocks[6] + i * 4),
+				(int)load_u32(blocks[5] + i * 4),
+				(int)load_u32(blocks[4] + i * 4),
+				(int)load_u32(blocks[3] + i * 4),
+				(int)load_u32(blocks[2] + i * 4),
+				(int)load_u32(blocks[1] + i * 4),
+				(int)load_u32(blocks[0] + i * 4)), bswap);
+		} else {
+			__m256i w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+
+			s0 = _mm256_xor_si256(_mm256_xor_si256(
+				AVX2_ROTR(w15, 7), AVX2_ROTR(w15, 18)),
+				_mm256_srli_epi32(w15, 3));
+			s1 = _mm256_xor_si256(_mm256_xor_si256(
+				AVX2_ROTR(w2, 17), AVX2_ROTR(w2, 19)),
+				_mm256_srli_epi32(w2, 10));
+
+			w[i & 15] = _mm256_add_epi32(
+				_mm256_add_epi32(w[i & 15], s0),
+				_mm256_add_epi32(w[(i - 7) & 15], s1));
+		}
+
+		s1 = _mm256_xor_si256(_mm256_xor_si256(
+			AVX2_ROTR(e, 6), AVX2_ROTR(e, 11)), AVX2_ROTR(e, 25));
+		t1 = _mm256_add_epi32(
+			_mm256_add_epi32(h, s1),
+			_mm256_add_epi32(
+				_mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)),
+				_mm256_add_epi32(_mm256_set1_epi32((int)sha256_k[i]), w[i & 15])));
+
+		s0 = _mm256_xor_si256(_mm256_xor_si256(
+			AVX2_ROTR(a, 2), AVX2_ROTR(a, 13)), AVX2_ROTR(a, 22));
+		t2 = _mm256_add_epi32(s0, _mm256_or_si256(
+			_mm256_and_si256(a, b),
+			_mm256_and_si256(c, _mm256_or_si256(a, b))));
+
+		h = g; g = f; f = e;
+		e = _mm256_add_epi32(d, t1);
+		d = c; c = b; b = a;
+		a = _mm256_add_epi32(t1, t2);
+	}
+
+	s[0] = _mm256_add_epi32(s[0], a);
+	s[1] = _mm256_add_epi32(s[1], b);
+	s[2] = _mm256_add_epi32(s[2], c);
+	s[3] = _mm256_add_epi32(s[3], d);
+	s[4] = _mm256_add_epi32(s[4], e);
+	s[5] = _mm256_add_epi32(s[5], f);
+	s[6] = _mm256_add_epi32(s[6], g);
+	s[7] = _mm256_add_epi32(s[7], h);
+
+	for (i = 0; i < 8; i++)
+		_mm256_storeu_si256((__m256i *)state[i], s[i]);
+}
+
+/* The state of one lane: the message that it hashes and its progress. */
+typedef struct {
+	const git_str_vec *vec;
+	size_t vec_len;
+	size_t vec_idx;
+	size_t vec_off;
+	uint64_t size;
+	enum { LANE_DATA, LANE_LENGTH, LANE_DONE } stage;
+	unsigned char *out;
+	unsigned char buf[64];
+} sha256_lane;
+
+static void lane_start(
+	sha256_lane *lane,
+	const git_str_vec *vec,
+	size_t vec_len,
+	unsigned char *out)
+{
+	size_t i;
+
+	lane->vec = vec;
+	lane->vec_len = vec_len;
+	lane->vec_idx = 0;
+	lane->vec_off = 0;
+	lane->size = 0;
+	lane->stage = LANE_DATA;
+	lane->out = out;
+
+	for (i = 0; i < vec_len; i++)
+		lane->size += vec[i].len;
+}
+
+/* Returns the next (possibly padded) block of the lane's message. */
+static const unsigned char *lane_block(sha256_lane *lane)
+{
+	size_t have = 0, n;
+
+	if (lane->stage == LANE_LENGTH) {
+		memset(lane->buf, 0, 56);
+		store_be64(lane->buf + 56, lane->size << 3);
+		lane->stage = LANE_DONE;
+		return lane->buf;
+	}
+
+	while (lane->vec_idx < lane->vec_len &&
+	       lane->vec_off == lane->vec[lane->vec_idx].len) {
+		lane->vec_idx++;
+		lane->vec_off = 0;
+	}
+
+	/* hash directly from the caller's buffer when possible */
+	if (lane->vec_idx < lane->vec_len &&
+	    lane->vec[lane->vec_idx].len - lane->vec_off >= 64) {
+		const unsigned char *block =
+			(const unsigned char *)lane->vec[lane->vec_idx].data +
+			lane->vec_off;
+
+		lane->vec_off += 64;
+		return block;
+	}
+
+	while (have < 64 && lane->vec_idx < lane->vec_len) {
+		const git_str_vec *v = &lane->vec[lane->vec_idx];
+
+		n = min(64 - have, v->len - lane->vec_off);
+		memcpy(lane->buf + have, (const unsigned char *)v->data + lane->vec_off, n);
+
+		have += n;
+		lane->vec_off += n;
+
+		if (lane->vec_off == v->len) {
+			lane->vec_idx++;
+			lane->vec_off = 0;
+		}
+	}
+
+	if (have == 64)
+		return lane->buf;
+
+	lane->buf[have++] = 0x80;
+
+	if (have > 56) {
+		memset(lane->buf + have, 0, 64 - have);
+		lane->stage = LANE_LENGTH;
+	} else {
+		memset(lane->buf + have, 0, 56 - have);
+		store_be64(lane->buf + 56, lane->size << 3);
+		lane->stage = LANE_DONE;
+	}
+
+	return lane->buf;
+}
+
+static void multi_x86_avx2(
+	unsigned char *out,
+	const git_str_vec *vec,
+	size_t vec_per_hash,
+	size_t n)
+{
+	static const unsigned char idle_block[64];
+	sha256_lane lanes[MULTI_LANES];
+	const unsigned char *blocks[MULTI_LANES];
+	uint32_t state[8][MULTI_LANES];
+	bool active[MULTI_LANES];
+	size_t next = 0, running = 0, i, j;
+
+	for (i = 0; i < MULTI_LANES; i++) {
+		if ((active[i] = (next < n))) {
+			lane_start(&lanes[i], &vec[next * vec_per_hash],
+				vec_per_hash, &out[next * GIT_HASH_SHA256_SIZE]);
+			next++;
+			running++;
+		}
+
+		for (j = 0; j < 8; j++)
+			state[j][i] = sha256_iv[j];
+	}
+
+	while (running) {
+		for (i = 0; i < MULTI_LANES; i++)
+			blocks[i] = active[i] ? lane_block(&lanes[i]) : idle_block;
+
+		sha256_x8_avx2(state, blocks);
+
+		for (i = 0; i < MULTI_LANES; i++) {
+			if (!active[i] || lanes[i].stage != LANE_DONE)
+				continue;
+
+			for (j = 0; j < 8; j++) {
+				store_be32(lanes[i].out + (j * 4), state[j][i]);
+				state[j][i] = sha256_iv[j];
+			}
+
+			if ((active[i] = (next < n))) {
+				lane_start(&lanes[i], &vec[next * vec_per_hash],
+					vec_per_hash, &out[next * GIT_HASH_SHA256_SIZE]);
+				next++;
+			} else {
+				running--;
+			}
+		}
+	}
+}
+
+#endif
+
+/* ARMv8 cryptography extensions */
+
+#ifdef GIT_HASH_ARMV8
+
+/*
+ * Four rounds using the (pre-added) words in `t0`, while preparing
+ * `t1` from `m1` for the next four rounds.
+ */
+# define ARMV8_ROUNDS(g, t0, t1, m1) \
+	tmp = state0; \
+	t1 = vaddq_u32(m1, vld1q_u32(&sha256_k[((g) + 1) * 4])); \
+	state0 = vsha256hq_u32(state0, state1, t0); \
+	state1 = vsha256h2q_u32(state1, tmp, t0);
+
+# define ARMV8_SCHEDULE_ROUNDS(g, t0, t1, m0, m1, m2, m3) \
+	m0 = vsha256su0q_u32(m0, m1); \
+	ARMV8_ROUNDS(g, t0, t1, m1) \
+	m0 = vsha256su1q_u32(m0, m2, m3);
+
+static void sha256_blocks_armv8(
+	uint32_t state[8],
+	const unsigned char *data,
+	size_t blocks)
+{
+	uint32x4_t state0, state1, abcd_saved, efgh_saved, tmp;
+	uint32x4_t msg0, msg1, msg2, msg3, t0, t1;
+
+	state0 = vld1q_u32(&state[0]);
+	state1 = vld1q_u32(&state[4]);
+
+	while (blocks--) {
+		abcd_saved = state0;
+		efgh_saved = state1;
+
+		msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+		msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+		msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+		msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+		t0 = vaddq_u32(msg0, vld1q_u32(&sha256_k[0]));
+
+		/* rounds 0-47 */
+		ARMV8_SCHEDULE_ROUNDS(0, t0, t1, msg0, msg1, msg2, msg3);
+		ARMV8_SCHEDULE_ROUNDS(1, t1, t0, msg1, msg2, msg3, msg0);
+		ARMV8_SCHEDULE_ROUNDS(2, t0, t1, msg2, msg3, msg0, msg1);
+		ARMV8_SCHEDULE_ROUNDS(3, t1, t0, msg3, msg0, msg1, msg2);
+		ARMV8_SCHEDULE_ROUNDS(4, t0, t1, msg0, msg1, msg2, msg3);
+		ARMV8_SCHEDULE_ROUNDS(5, t1, t0, msg1, msg2, msg3, msg0);
+		ARMV8_SCHEDULE_ROUNDS(6, t0, t1, msg2, msg3, msg0, msg1);
+		ARMV8_SCHEDULE_ROUNDS(7, t1, t0, msg3, msg0, msg1, msg2);
+		ARMV8_SCHEDULE_ROUNDS(8, t0, t1, msg0, msg1, msg2, msg3);
+		ARMV8_SCHEDULE_ROUNDS(9, t1, t0, msg1, msg2, msg3, msg0);
+		ARMV8_SCHEDULE_ROUNDS(10, t0, t1, msg2, msg3, msg0, msg1);
+		ARMV8_SCHEDULE_ROUNDS(11, t1, t0, msg3, msg0, msg1, msg2);
+
+		/* rounds 48-63 */
+		ARMV8_ROUNDS(12, t0, t1, msg1);
+		ARMV8_ROUNDS(13, t1, t0, msg2);
+		ARMV8_ROUNDS(14, t0, t1, msg3);
+
+		tmp = state0;
+		state0 = vsha256hq_u32(state0, state1, t1);
+		state1 = vsha256h2q_u32(state1, tmp, t1);
+
+		state0 = vaddq_u32(state0, abcd_saved);
+		state1 = vaddq_u32(state1, efgh_saved);
+
+		data += 64;
+	}
+
+	vst1q_u32(&state[0], state0);
+	vst1q_u32(&state[4], state1);
+}
+
+#endif
+
+static void sha256_select_impl(void)
+{
+#if defined(GIT_HASH_ARMV8)
+	sha256_blocks = sha256_blocks_armv8;
+	sha256_impl = GIT_HASH_SHA256_ACCEL_ARMV8;
+#elif defined(GIT_HASH_X86)
+	unsigned int features = git_hash_x86_features();
+
+	if ((features & GIT_HASH_X86_SHA)) {
+		sha256_blocks = sha256_blocks_shani;
+		sha256_impl = GIT_HASH_SHA256_ACCEL_X86_SHANI;
+	}
+
+	/*
+	 * The SHA extensions outperform eight interleaved hashes in
+	 * AVX2 registers, so only use the latter without them.
+	 */
+	sha256_multi = !(features & GIT_HASH_X86_SHA) &&
+	               (features & GIT_HASH_X86_AVX2);
+#endif
+
+	sha256_selected = true;
+}
+
+int git_hash_sha256_accel_global_init(void)
+{
+	if (!sha256_selected)
+		sha256_select_impl();
+
+	return 0;
+}
+
+git_hash_sha256_accel_impl_t git_hash_sha256_accel_impl(void)
+{
+	if (!sha256_selected)
+		sha256_select_impl();
+
+	return sha256_impl;
+}
+
+int git_hash_sha256_accel_set_impl(git_hash_sha256_accel_impl_t impl)
+{
+	if (!sha256_selected)
+		sha256_select_impl();
+
+	switch (impl) {
+	case GIT_HASH_SHA256_ACCEL_NONE:
+		sha256_blocks = NULL;
+		break;
+#ifdef GIT_HASH_X86
+	case GIT_HASH_SHA256_ACCEL_X86_SHANI:
+		if (!(git_hash_x86_features() & GIT_HASH_X86_SHA))
+			goto unsupported;
+
+		sha256_blocks = sha256_blocks_shani;
+		break;
+#endif
+#ifdef GIT_HASH_ARMV8
+	case GIT_HASH_SHA256_ACCEL_ARMV8:
+		sha256_blocks = sha256_blocks_armv8;
+		break;
+#endif
+	default:
+		goto unsupported;
+	}
+
+	sha256_impl = impl;
+	return 0;
+
+unsupported:
+	git_error_set(GIT_ERROR_SHA, "SHA256 implementation is not supported on this platform");
+	return -1;
+}
+
+size_t git_hash_sha256_accel_multi_lanes(void)
+{
+	if (!sha256_selected)
+		sha256_select_impl();
+
+#ifdef GIT_HASH_X86
+	return sha256_multi ? MULTI_LANES : 0;
+#else
+	return 0;
+#endif
+}
+
+int git_hash_sha256_accel_set_multi(bool enabled)
+{
+	if (!sha256_selected)
+		sha256_select_impl();
+
+#ifdef GIT_HASH_X86
+	if (!enabled || (git_hash_x86_features() & GIT_HASH_X86_AVX2)) {
+		sha256_multi = enabled;
+		return 0;
+	}
+#else
+	if (!enabled)
+		return 0;
+#endif
+
+	git_error_set(GIT_ERROR_SHA, "SHA256 multi-buffer hashing is not supported on this platform");
+	return -1;
+}
+
+void git_hash_sha256_accel_multi(
+	unsigned char *out,
+	const git_str_vec *vec,
+	size_t vec_per_hash,
+	size_t n)
+{
+#ifdef GIT_HASH_X86
+	multi_x86_avx2(out, vec, vec_per_hash, n);
+#else
+	GIT_UNUSED(out);
+	GIT_UNUSED(vec);
+	GIT_UNUSED(vec_per_hash);
+	GIT_UNUSED(n);
+#endif
+}
+
+void git_hash_sha256_accel_init(git_hash_sha256_accel_ctx *ctx)
+{
+	memcpy(ctx->state, sha256_iv, sizeof(sha256_iv));
+	ctx->size = 0;
+}
+
+void git_hash_sha256_accel_update(
+	git_hash_sha256_accel_ctx *ctx,
+	const void *_data,
+	size_t len)
+{
+	const unsigned char *data = _data;
+	size_t used = (size_t)(ctx->size & 63), blocks;
+
+	ctx->size += len;
+
+	if (used) {
+		size_t fill = min(64 - used, len);
+
+		memcpy(ctx->buf + used, data, fill);
+		data += fill;
+		len -= fill;
+
+		if (used + fill < 64)
+			return;
+
+		sha256_blocks(ctx->state, ctx->buf, 1);
+	}
+
+	if ((blocks = len / 64) > 0) {
+		sha256_blocks(ctx->state, data, blocks);
+		data += blocks * 64;
+		len -= blocks * 64;
+	}
+
+	if (len)
+		memcpy(ctx->buf, data, len);
+}
+
+void git_hash_sha256_accel_final(unsigned char *out, git_hash_sha256_accel_ctx *ctx)
+{
+	static const unsigned char pad[64] = { 0x80 };
+	unsigned char bits[8];
+	size_t used = (size_t)(ctx->size & 63), i;
+
+	store_be64(bits, ctx->size << 3);
+
+	git_hash_sha256_accel_update(ctx, pad, used < 56 ? 56 - used : 120 - used);
+	git_hash_sha256_accel_update(ctx, bits, 8);
+
+	for (i = 0; i < 8; i++)
+		store_be32(out + (i * 4), ctx->state[i]);
+}
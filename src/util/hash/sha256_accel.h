@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#ifndef INCLUDE_hash_sha256_accel_h__
+#define INCLUDE_hash_sha256_accel_h__
+
+#include "git2_util.h"
+
+struct git_str_vec;
+
+/*
+ * A SHA256 implementation that uses the SHA extensions of x86 or ARMv8
+ * processors.  The hashing functions may only be used when an
+ * accelerated implementation is available (`git_hash_sha256_accel_impl`
+ * does not return `GIT_HASH_SHA256_ACCEL_NONE`).
+ */
+
+typedef enum {
+	GIT_HASH_SHA256_ACCEL_NONE = 0,
+	GIT_HASH_SHA256_ACCEL_X86_SHANI,
+	GIT_HASH_SHA256_ACCEL_ARMV8
+} git_hash_sha256_accel_impl_t;
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t size;
+	unsigned char buf[64];
+} git_hash_sha256_accel_ctx;
+
+int git_hash_sha256_accel_global_init(void);
+
+void git_hash_sha256_accel_init(git_hash_sha256_accel_ctx *ctx);
+void git_hash_sha256_accel_update(git_hash_sha256_accel_ctx *ctx, const void *data, size_t len);
+void git_hash_sha256_accel_final(unsigned char *out, git_hash_sha256_accel_ctx *ctx);
+
+/*
+ * Multi-buffer hashing: computes `n` independent hashes, interleaving
+ * them in the lanes of the AVX2 registers.  Each hash is computed over
+ * `vec_per_hash` consecutive entries of `vec`, and the results are
+ * written consecutively to `out`.  This may only be used when
+ * `git_hash_sha256_accel_multi_lanes` is non-zero.
+ */
+size_t git_hash_sha256_accel_multi_lanes(void);
+
+void git_hash_sha256_accel_multi(
+	unsigned char *out,
+	const struct git_str_vec *vec,
+	size_t vec_per_hash,
+	size_t n);
+
+/* Query or override the implementations that are in use; for testing. */
+git_hash_sha256_accel_impl_t git_hash_sha256_accel_impl(void);
+int git_hash_sha256_accel_set_impl(git_hash_sha256_accel_impl_t impl);
+int git_hash_sha256_accel_set_multi(bool enabled);
+
+#endif
@@ -9,7 +9,13 @@
 
 #include <zlib.h>
 
+#ifdef GIT_INFLATE_LIBDEFLATE
+# include <libdeflate.h>
+#endif
+
 #include "str.h"
+#include "runtime.h"
+#include "thread.h"
 
 #define ZSTREAM_BUFFER_SIZE (1024 * 1024)
 #define ZSTREAM_BUFFER_MIN_EXTRA 8
@@ -62,6 +68,7 @@ void git_zstream_reset(git_zstream *zstream)
 	zstream->in = NULL;
 	zstream->in_len = 0;
 	zstream->zerr = Z_STREAM_END;
+	zstream->partial = 0;
 }
 
 int git_zstream_set_input(git_zstream *zstream, const void *in, size_t in_len)
@@ -69,6 +76,14 @@ int git_zstream_set_input(git_zstream *zstream, const void *in, size_t in_len)
 	zstream->in = in;
 	zstream->in_len = in_len;
 	zstream->zerr = Z_OK;
+	zstream->partial = 0;
+	return 0;
+}
+
+int git_zstream_set_partial_input(git_zstream *zstream, const void *in, size_t in_len)
+{
+	git_zstream_set_input(zstream, in, in_len);
+	zstream->partial = 1;
 	return 0;
 }
 
@@ -104,6 +119,9 @@ int git_zstream_get_output_chunk(
 	if (zstream->in_len > UINT_MAX) {
 		zstream->z.avail_in = UINT_MAX;
 		zstream->flush = Z_NO_FLUSH;
+	} else if (zstream->partial) {
+		zstream->z.avail_in = (uInt)zstream->in_len;
+		zstream->flush = Z_NO_FLUSH;
 	} else {
 		zstream->z.avail_in = (uInt)zstream->in_len;
 		zstream->flush = Z_FINISH;
@@ -208,3 +226,133 @@ int git_zstream_inflatebuf(git_str *out, const void *in, size_t in_len)
 {
 	return zstream_buf(out, in, in_len, GIT_ZSTREAM_INFLATE);
 }
+
+#ifdef GIT_INFLATE_LIBDEFLATE
+
+/* Each thread keeps a decompressor, rather than allocating one per object. */
+static git_tlsdata_key decompressor_key;
+static git_atomic32 decompressor_key_valid;
+
+static void GIT_SYSTEM_CALL decompressor_free(void *decompressor)
+{
+	libdeflate_free_decompressor(decompressor);
+}
+
+static void git_zstream_global_shutdown(void)
+{
+	struct libdeflate_decompressor *decompressor;
+
+	git_atomic32_set(&decompressor_key_valid, 0);
+
+	decompressor = git_tlsdata_get(decompressor_key);
+	git_tlsdata_set(decompressor_key, NULL);
+
+	libdeflate_free_decompressor(decompressor);
+	git_tlsdata_dispose(decompressor_key);
+}
+
+int git_zstream_global_init(void)
+{
+	if (git_tlsdata_init(&decompressor_key, decompressor_free) != 0)
+		return -1;
+
+	git_atomic32_set(&decompressor_key_valid, 1);
+	return git_runtime_shutdown_register(git_zstream_global_shutdown);
+}
+
+int git_zstream_inflate_oneshot(
+	void *out, size_t *out_len, const void *in, size_t *in_len)
+{
+	struct libdeflate_decompressor *decompressor = NULL;
+	enum libdeflate_result result;
+	size_t in_used, out_used;
+	bool cached = git_atomic32_get(&decompressor_key_valid) != 0;
+
+	if (cached)
+		decompressor = git_tlsdata_get(decompressor_key);
+
+	if (!decompressor) {
+		if ((decompressor = libdeflate_alloc_decompressor()) == NULL) {
+			git_error_set_oom();
+			return -1;
+		}
+
+		if (cached && git_tlsdata_set(decompressor_key, decompressor) != 0)
+			cached = false;
+	}
+
+	result = libdeflate_zlib_decompress_ex(decompressor,
+		in, *in_len, out, *out_len, &in_used, &out_used);
+
+	if (!cached)
+		libdeflate_free_decompressor(decompressor);
+
+	switch (result) {
+	case LIBDEFLATE_SUCCESS:
+		break;
+	case LIBDEFLATE_INSUFFICIENT_SPACE:
+		git_error_set(GIT_ERROR_ZLIB, "zlib output was larger than expected");
+		return GIT_EBUFS;
+	default:
+		git_error_set(GIT_ERROR_ZLIB, "invalid or truncated zlib stream");
+		return -1;
+	}
+
+	*in_len = in_used;
+	*out_len = out_used;
+	return 0;
+}
+
+#else
+
+int git_zstream_inflate_oneshot(
+	void *out, size_t *out_len, const void *in, size_t *in_len)
+{
+	git_zstream zs = GIT_ZSTREAM_INIT;
+	size_t total = 0;
+	int error;
+
+	if ((error = git_zstream_init(&zs, GIT_ZSTREAM_INFLATE)) < 0 ||
+	    (error = git_zstream_set_input(&zs, in, *in_len)) < 0)
+		goto done;
+
+	/* more than one call is only needed for buffers over 4GB */
+	while (!git_zstream_eos(&zs)) {
+		size_t in_remain = zs.in_len, written = *out_len - total;
+
+		if ((error = git_zstream_get_output_chunk(
+				(char *)out + total, &written, &zs)) < 0)
+			goto done;
+
+		if (!written && in_remain == zs.in_len)
+			break;
+
+		total += written;
+	}
+
+	if (!git_zstream_eos(&zs)) {
+		if (total == *out_len) {
+			git_error_set(GIT_ERROR_ZLIB, "zlib output was larger than expected");
+			error = GIT_EBUFS;
+		} else {
+			git_error_set(GIT_ERROR_ZLIB, "invalid or truncated zlib stream");
+			error = -1;
+		}
+
+		goto done;
+	}
+
+	*in_len -= zs.in_len;
+	*out_len = total;
+
+done:
+	git_zstream_free(&zs);
+	return error;
+}
+
+int git_zstream_global_init(void)
+{
+	return 0;
+}
+
+#endif
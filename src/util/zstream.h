@@ -25,6 +25,7 @@ typedef struct {
 	size_t in_len;
 	int flush;
 	int zerr;
+	unsigned int partial : 1;
 } git_zstream;
 
 #define GIT_ZSTREAM_INIT {{0}}
@@ -34,6 +35,14 @@ void git_zstream_free(git_zstream *zstream);
 
 int git_zstream_set_input(git_zstream *zstream, const void *in, size_t in_len);
 
+/*
+ * Set the input to a stream that will be fed in several parts; the
+ * stream is only finished once a final part is given to
+ * `git_zstream_set_input`. Output for a partial input should be read
+ * with `git_zstream_get_output_chunk` until the input is consumed.
+ */
+int git_zstream_set_partial_input(git_zstream *zstream, const void *in, size_t in_len);
+
 size_t git_zstream_suggest_output_len(git_zstream *zstream);
 
 /* get as much output as is available in the input buffer */
@@ -51,4 +60,32 @@ void git_zstream_reset(git_zstream *zstream);
 int git_zstream_deflatebuf(git_str *out, const void *in, size_t in_len);
 int git_zstream_inflatebuf(git_str *out, const void *in, size_t in_len);
 
+/*
+ * Inflate an entire zlib stream with a single call, into an output
+ * buffer that is large enough to hold all of the inflated data (for
+ * example, because the size is recorded in an object header).  This
+ * is faster than streaming when a dedicated one-shot decompressor is
+ * available.
+ *
+ * On success, `out_len` is updated to the number of bytes that were
+ * written and `in_len` to the number of compressed bytes that were
+ * consumed, which may be less than the given input.  Returns
+ * GIT_EBUFS when the output buffer is too small.
+ */
+int git_zstream_inflate_oneshot(
+	void *out, size_t *out_len, const void *in, size_t *in_len);
+
+/* Set up the per-thread state of `git_zstream_inflate_oneshot`. */
+int git_zstream_global_init(void);
+
+/*
+ * Whether `git_zstream_inflate_oneshot` uses a dedicated decompressor
+ * that outperforms continuing an existing inflate stream.
+ */
+#ifdef GIT_INFLATE_LIBDEFLATE
+# define GIT_ZSTREAM_INFLATE_ONESHOT 1
+#else
+# define GIT_ZSTREAM_INFLATE_ONESHOT 0
+#endif
+
 #endif
@@ -6,6 +6,7 @@
 #include "repository.h"
 #include "index.h"
 #include "remote.h"
+#include "zstream.h"
 #include "repo/repo_helpers.h"
 
 static git_repository *g_repo;
@@ -377,6 +378,129 @@ void test_checkout_index__options_disable_filters(void)
 	check_file_contents("./testrepo/new.txt", "my new file\n");
 }
 
+void test_checkout_index__streams_large_files(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_index_entry entry = {{ 0 }};
+	git_index *index;
+	git_str content = GIT_STR_INIT, actual = GIT_STR_INIT;
+	size_t i;
+
+	/* larger than the threshold at which checkout streams blobs */
+	for (i = 0; i < (17 * 1024 * 1024) / 32; i++)
+		cl_git_pass(git_str_printf(&content, "%031u\n", (unsigned int)i));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	entry.path = "large.txt";
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_index_add_from_buffer(index, &entry, content.ptr, content.size));
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_checkout_index(g_repo, index, &opts));
+
+	cl_git_pass(git_futils_readbuffer(&actual, "./testrepo/large.txt"));
+	cl_assert_equal_sz(content.size, actual.size);
+	cl_assert(memcmp(content.ptr, actual.ptr, content.size) == 0);
+
+	git_str_dispose(&actual);
+	git_str_dispose(&content);
+	git_index_free(index);
+}
+
+void test_checkout_index__streams_large_packed_files(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_index_entry entry = {{ 0 }};
+	git_index *index;
+	git_odb *odb;
+	git_str content = GIT_STR_INIT, actual = GIT_STR_INIT,
+		loose = GIT_STR_INIT;
+	size_t i;
+
+	for (i = 0; i < (17 * 1024 * 1024) / 32; i++)
+		cl_git_pass(git_str_printf(&content, "%031u\n", (unsigned int)i));
+
+	/* write the blob into a packfile rather than as a loose object */
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+	cl_git_pass(git_odb_bulk_begin(odb));
+	cl_git_pass(git_blob_create_from_buffer(&entry.id, g_repo,
+		content.ptr, content.size));
+	cl_git_pass(git_odb_bulk_commit(odb));
+
+	cl_git_pass(git_str_printf(&loose, "./testrepo/.git/objects/%.2s/%s",
+		git_oid_tostr_s(&entry.id), git_oid_tostr_s(&entry.id) + 2));
+	cl_assert(!git_fs_path_exists(loose.ptr));
+
+	/* the size of the entry is unknown, so it is read from the pack */
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	entry.path = "large.txt";
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_index_add(index, &entry));
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_checkout_index(g_repo, index, &opts));
+
+	cl_git_pass(git_futils_readbuffer(&actual, "./testrepo/large.txt"));
+	cl_assert_equal_sz(content.size, actual.size);
+	cl_assert(memcmp(content.ptr, actual.ptr, content.size) == 0);
+
+	git_str_dispose(&loose);
+	git_str_dispose(&actual);
+	git_str_dispose(&content);
+	git_index_free(index);
+	git_odb_free(odb);
+}
+
+void test_checkout_index__verifies_streamed_files(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_object_id_options id_opts = GIT_OBJECT_ID_OPTIONS_INIT;
+	git_index_entry entry = {{ 0 }};
+	git_index *index;
+	git_str content = GIT_STR_INIT, object = GIT_STR_INIT,
+		deflated = GIT_STR_INIT, loose = GIT_STR_INIT;
+	size_t i;
+
+	for (i = 0; i < (17 * 1024 * 1024) / 32; i++)
+		cl_git_pass(git_str_printf(&content, "%031u\n", (unsigned int)i));
+
+	id_opts.object_type = GIT_OBJECT_BLOB;
+	cl_git_pass(git_object_id_from_buffer(&entry.id,
+		content.ptr, content.size, &id_opts));
+
+	/* store different contents of the same size under the blob's id */
+	content.ptr[0] = 'X';
+
+	cl_git_pass(git_str_printf(&object, "blob %" PRIuZ, content.size));
+	cl_git_pass(git_str_putc(&object, '\0'));
+	cl_git_pass(git_str_put(&object, content.ptr, content.size));
+	cl_git_pass(git_zstream_deflatebuf(&deflated, object.ptr, object.size));
+
+	cl_git_pass(git_str_printf(&loose, "./testrepo/.git/objects/%.2s",
+		git_oid_tostr_s(&entry.id)));
+	cl_git_pass(git_futils_mkdir(loose.ptr, 0777, 0));
+	cl_git_pass(git_str_printf(&loose, "/%s", git_oid_tostr_s(&entry.id) + 2));
+	cl_git_rewritefile(loose.ptr, "");
+	cl_git_pass(git_futils_writebuffer(&deflated, loose.ptr, 0, 0666));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	entry.path = "large.txt";
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_index_add(index, &entry));
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_fail_with(GIT_EMISMATCH, git_checkout_index(g_repo, index, &opts));
+
+	git_str_dispose(&loose);
+	git_str_dispose(&deflated);
+	git_str_dispose(&object);
+	git_str_dispose(&content);
+	git_index_free(index);
+}
+
 void test_checkout_index__options_dir_modes(void)
 {
 	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
@@ -0,0 +1,238 @@
+#include "clar_libgit2.h"
+
+#include "git2/checkout.h"
+#include "git2/sys/odb_backend.h"
+#include "futils.h"
+
+static git_repository *g_repo;
+static git_tree *g_tree;
+
+#define FILE_COUNT 250
+
+void test_checkout_parallel__initialize(void)
+{
+	git_index *index;
+	git_oid tree_id;
+	char path[64];
+	int i;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+	cl_repo_set_bool(g_repo, "core.autocrlf", true);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		p_snprintf(path, sizeof(path), "empty_standard_repo/dir%d", i % 10);
+		cl_git_pass(git_futils_mkdir_r(path, 0777));
+
+		p_snprintf(path, sizeof(path), "empty_standard_repo/dir%d/file%d.txt", i % 10, i);
+		cl_git_mkfile(path, "one line\nanother line\n");
+		cl_git_pass(git_index_add_bypath(index, path + strlen("empty_standard_repo/")));
+	}
+
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+	cl_git_pass(git_tree_lookup(&g_tree, g_repo, &tree_id));
+
+	git_index_free(index);
+}
+
+void test_checkout_parallel__cleanup(void)
+{
+	git_tree_free(g_tree);
+	cl_git_sandbox_cleanup();
+}
+
+static void checkout_progress(
+	const char *path, size_t cur, size_t tot, void *payload)
+{
+	git_str *out = payload;
+
+	if (path)
+		cl_git_pass(git_str_printf(out, "%s %d/%d\n", path, (int)cur, (int)tot));
+}
+
+static void remove_files(void)
+{
+	char path[64];
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		p_snprintf(path, sizeof(path), "empty_standard_repo/dir%d", i);
+		cl_git_pass(git_futils_rmdir_r(path, NULL, GIT_RMDIR_REMOVE_FILES));
+	}
+}
+
+/* Check out the files, recording the progress, contents and index. */
+static void checkout_files(git_str *out, int workers, unsigned int strategy)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_index *index;
+	git_str contents = GIT_STR_INIT;
+	git_str path = GIT_STR_INIT;
+	const git_index_entry *entry;
+	size_t i;
+
+	cl_repo_set_int(g_repo, "checkout.workers", workers);
+	cl_repo_set_int(g_repo, "checkout.thresholdForParallelism", 0);
+
+	git_str_clear(out);
+
+	opts.checkout_strategy = strategy;
+	opts.progress_cb = checkout_progress;
+	opts.progress_payload = out;
+	cl_git_pass(git_checkout_tree(g_repo, (git_object *)g_tree, &opts));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	for (i = 0; i < git_index_entrycount(index); i++) {
+		entry = git_index_get_byindex(index, i);
+
+		cl_git_pass(git_str_joinpath(&path, "empty_standard_repo", entry->path));
+
+		if (git_fs_path_isfile(path.ptr))
+			cl_git_pass(git_futils_readbuffer(&contents, path.ptr));
+		else
+			git_str_sets(&contents, "(missing)\n");
+
+		cl_git_pass(git_str_printf(out, "%s %o %d %s",
+			entry->path, entry->mode, (int)entry->file_size, contents.ptr));
+	}
+
+	git_index_free(index);
+	git_str_dispose(&contents);
+	git_str_dispose(&path);
+}
+
+void test_checkout_parallel__matches_serial_checkout(void)
+{
+	git_str expected = GIT_STR_INIT, actual = GIT_STR_INIT;
+
+	remove_files();
+	checkout_files(&expected, 1, GIT_CHECKOUT_FORCE);
+
+	/* the work is done in more than one round */
+	remove_files();
+	checkout_files(&actual, 2, GIT_CHECKOUT_FORCE);
+
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+	cl_assert(strstr(actual.ptr, "dir9/file99.txt 250/250\n") != NULL);
+	cl_assert(strstr(actual.ptr, "one line\r\nanother line\r\n") != NULL);
+
+	git_str_dispose(&expected);
+	git_str_dispose(&actual);
+}
+
+void test_checkout_parallel__updates_only_existing_files(void)
+{
+	git_str expected = GIT_STR_INIT, actual = GIT_STR_INIT;
+	unsigned int strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_UPDATE_ONLY;
+
+	cl_git_pass(git_futils_rmdir_r("empty_standard_repo/dir3",
+		NULL, GIT_RMDIR_REMOVE_FILES));
+	cl_git_rewritefile("empty_standard_repo/dir4/file4.txt", "modified\n");
+
+	checkout_files(&expected, 1, strategy);
+	cl_assert(!git_fs_path_exists("empty_standard_repo/dir3"));
+
+	cl_git_rewritefile("empty_standard_repo/dir4/file4.txt", "modified\n");
+	checkout_files(&actual, 4, strategy);
+
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+	cl_assert(!git_fs_path_exists("empty_standard_repo/dir3"));
+	cl_assert(strstr(actual.ptr,
+		"dir4/file4.txt 100644 24 one line\r\nanother line\r\n") != NULL);
+
+	git_str_dispose(&expected);
+	git_str_dispose(&actual);
+}
+
+/* An object database backend that records the reads, but finds nothing. */
+typedef struct {
+	git_odb_backend parent;
+	git_str reads;
+} read_recorder;
+
+static int read_recorder__read(
+	void **buffer,
+	size_t *len,
+	git_object_t *type,
+	git_odb_backend *backend,
+	const git_oid *oid)
+{
+	read_recorder *recorder = (read_recorder *)backend;
+
+	GIT_UNUSED(buffer);
+	GIT_UNUSED(len);
+	GIT_UNUSED(type);
+
+	cl_git_pass(git_str_printf(&recorder->reads, "%s\n", git_oid_tostr_s(oid)));
+	return GIT_ENOTFOUND;
+}
+
+static void read_recorder__free(git_odb_backend *backend)
+{
+	read_recorder *recorder = (read_recorder *)backend;
+
+	git_str_dispose(&recorder->reads);
+	git__free(recorder);
+}
+
+void test_checkout_parallel__reads_blobs_in_pack_order(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_treebuilder *builder;
+	git_odb *odb;
+	git_tree *tree;
+	read_recorder *recorder;
+	git_str expected = GIT_STR_INIT, name = GIT_STR_INIT;
+	git_oid ids[4], tree_id;
+	int i;
+
+	/* pack the blobs in the reverse of the order of their paths */
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+	cl_git_pass(git_odb_bulk_begin(odb));
+
+	for (i = ARRAY_SIZE(ids) - 1; i >= 0; i--) {
+		git_str_clear(&name);
+		cl_git_pass(git_str_printf(&name, "contents of file %d\n", i));
+		cl_git_pass(git_blob_create_from_buffer(&ids[i], g_repo, name.ptr, name.size));
+		cl_git_pass(git_str_printf(&expected, "%s\n", git_oid_tostr_s(&ids[i])));
+	}
+
+	cl_git_pass(git_odb_bulk_commit(odb));
+
+	cl_git_pass(git_treebuilder_new(&builder, g_repo, NULL));
+
+	for (i = 0; i < (int)ARRAY_SIZE(ids); i++) {
+		git_str_clear(&name);
+		cl_git_pass(git_str_printf(&name, "file%d.txt", i));
+		cl_git_pass(git_treebuilder_insert(NULL, builder, name.ptr,
+			&ids[i], GIT_FILEMODE_BLOB));
+	}
+
+	cl_git_pass(git_treebuilder_write(&tree_id, builder));
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &tree_id));
+
+	recorder = git__calloc(1, sizeof(read_recorder));
+	cl_assert(recorder);
+	cl_git_pass(git_odb_init_backend(&recorder->parent, GIT_ODB_BACKEND_VERSION));
+	recorder->parent.read = read_recorder__read;
+	recorder->parent.free = read_recorder__free;
+	cl_git_pass(git_odb_add_backend(odb, &recorder->parent, 1000));
+
+	cl_repo_set_int(g_repo, "checkout.workers", 1);
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_checkout_tree(g_repo, (git_object *)tree, &opts));
+
+	/* the blobs are read in pack order, not in path order */
+	cl_assert_equal_s(expected.ptr, recorder->reads.ptr);
+	cl_assert(git_fs_path_isfile("empty_standard_repo/file0.txt"));
+	cl_assert(!git_fs_path_exists("empty_standard_repo/dir0"));
+
+	git_str_dispose(&expected);
+	git_str_dispose(&name);
+	git_treebuilder_free(builder);
+	git_tree_free(tree);
+	git_odb_free(odb);
+}
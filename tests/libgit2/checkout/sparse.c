@@ -0,0 +1,233 @@
+#include "clar_libgit2.h"
+#include "checkout_helpers.h"
+
+#include "git2/checkout.h"
+#include "futils.h"
+#include "index.h"
+#include "repository.h"
+#include "sparse.h"
+
+static git_repository *g_repo;
+
+/* `ab/4.txt` and everything beneath `ab/c` are checked out */
+#define CONE_PATTERNS "/*\n!/*/\n/ab/\n!/ab/*/\n/ab/c/\n"
+
+void test_checkout_sparse__initialize(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_object *subtrees;
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_revparse_single(&subtrees, g_repo, "subtrees"));
+	reset_index_to_treeish(subtrees);
+	cl_git_pass(git_checkout_tree(g_repo, subtrees, &opts));
+	cl_git_pass(git_repository_set_head(g_repo, "refs/heads/subtrees"));
+	git_object_free(subtrees);
+}
+
+void test_checkout_sparse__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static void set_sparse(const char *patterns)
+{
+	cl_repo_set_bool(g_repo, "core.sparseCheckout", true);
+	cl_repo_set_bool(g_repo, "core.sparseCheckoutCone", true);
+
+	cl_git_pass(git_futils_mkdir_r("testrepo/.git/info", 0777));
+	cl_git_rewritefile("testrepo/.git/info/sparse-checkout", patterns);
+}
+
+static void checkout_sparse(const char *patterns)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+
+	set_sparse(patterns);
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+}
+
+static void assert_skip_worktree(git_index *index, const char *path, bool skip)
+{
+	const git_index_entry *entry;
+
+	cl_assert((entry = git_index_get_bypath(index, path, 0)) != NULL);
+	cl_assert_equal_b(skip,
+		(entry->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE) != 0);
+}
+
+void test_checkout_sparse__parses_cone_patterns(void)
+{
+	git_sparse *sparse;
+
+	set_sparse(CONE_PATTERNS);
+
+	cl_git_pass(git_sparse__load(&sparse, g_repo));
+	cl_assert(sparse != NULL);
+
+	cl_assert(git_sparse__includes(sparse, "README"));
+	cl_assert(git_sparse__includes(sparse, "ab/4.txt"));
+	cl_assert(git_sparse__includes(sparse, "ab/c/3.txt"));
+	cl_assert(git_sparse__includes(sparse, "ab/c/d/e.txt"));
+	cl_assert(!git_sparse__includes(sparse, "ab/de/2.txt"));
+	cl_assert(!git_sparse__includes(sparse, "other/file.txt"));
+
+	cl_assert_equal_i(GIT_SPARSE_PARENT, git_sparse__dir(sparse, "ab", 2));
+	cl_assert_equal_i(GIT_SPARSE_INCLUDED, git_sparse__dir(sparse, "ab/c", 4));
+	cl_assert_equal_i(GIT_SPARSE_EXCLUDED, git_sparse__dir(sparse, "ab/de", 5));
+
+	git_sparse__free(sparse);
+
+	/* patterns that git does not write in cone mode are not supported */
+	set_sparse("/*\n!/*/\n*.txt\n");
+	cl_git_pass(git_sparse__load(&sparse, g_repo));
+	cl_assert(sparse == NULL);
+}
+
+void test_checkout_sparse__skips_files_outside_of_the_cone(void)
+{
+	git_index *index;
+	git_status_list *status;
+
+	checkout_sparse(CONE_PATTERNS);
+
+	cl_assert(git_fs_path_isfile("testrepo/README"));
+	cl_assert(git_fs_path_isfile("testrepo/ab/4.txt"));
+	cl_assert(git_fs_path_isfile("testrepo/ab/c/3.txt"));
+	cl_assert(!git_fs_path_exists("testrepo/ab/de"));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	assert_skip_worktree(index, "ab/4.txt", false);
+	assert_skip_worktree(index, "ab/de/2.txt", true);
+	assert_skip_worktree(index, "ab/de/fgh/1.txt", true);
+	git_index_free(index);
+
+	cl_git_pass(git_status_list_new(&status, g_repo, NULL));
+	cl_assert_equal_i(0, git_status_list_entrycount(status));
+	git_status_list_free(status);
+}
+
+void test_checkout_sparse__widening_the_cone_checks_out_files(void)
+{
+	git_index *index;
+
+	checkout_sparse(CONE_PATTERNS);
+	checkout_sparse("/*\n!/*/\n/ab/\n");
+
+	cl_assert(git_fs_path_isfile("testrepo/ab/de/2.txt"));
+	cl_assert(git_fs_path_isfile("testrepo/ab/de/fgh/1.txt"));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	assert_skip_worktree(index, "ab/de/2.txt", false);
+	assert_skip_worktree(index, "ab/de/fgh/1.txt", false);
+	git_index_free(index);
+}
+
+void test_checkout_sparse__writes_a_sparse_index(void)
+{
+	git_index *index;
+	git_tree *head;
+	git_diff *diff;
+	git_status_list *status;
+	git_oid tree_id;
+	const git_index_entry *entry;
+
+	cl_repo_set_bool(g_repo, "index.sparse", true);
+	checkout_sparse(CONE_PATTERNS);
+
+	cl_git_pass(git_repository_head_tree(&head, g_repo));
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read(index, true));
+
+	/* the excluded directory is a single entry */
+	cl_assert(index->sparse);
+	cl_assert_equal_sz(6, index->entries.length);
+	cl_assert((entry = git_vector_get(&index->entries, 3)) != NULL);
+	cl_assert_equal_s("ab/de/", entry->path);
+	cl_assert(git_index_entry__is_sparse_dir(entry));
+
+	/* comparing it does not expand the index */
+	cl_git_pass(git_diff_tree_to_index(&diff, g_repo, head, index, NULL));
+	cl_assert_equal_i(0, git_diff_num_deltas(diff));
+	git_diff_free(diff);
+
+	cl_git_pass(git_status_list_new(&status, g_repo, NULL));
+	cl_assert_equal_i(0, git_status_list_entrycount(status));
+	git_status_list_free(status);
+
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+	cl_assert_equal_oid(git_tree_id(head), &tree_id);
+	cl_assert(index->sparse);
+
+	/* counting the entries does not expand it either */
+	cl_assert_equal_sz(6, git_index_entrycount(index));
+	cl_assert(index->sparse);
+
+	/* but looking up the files beneath it does */
+	assert_skip_worktree(index, "ab/de/fgh/1.txt", true);
+	cl_assert_equal_sz(7, git_index_entrycount(index));
+	cl_git_pass(git_index__ensure_full(index));
+	cl_assert(!index->sparse);
+
+	/* and it is collapsed when written again */
+	cl_git_pass(git_index_write(index));
+	cl_git_pass(git_index_read(index, true));
+	cl_assert(index->sparse);
+	cl_assert_equal_sz(6, index->entries.length);
+
+	git_index_free(index);
+	git_tree_free(head);
+}
+
+void test_checkout_sparse__fails_to_expand_a_missing_tree(void)
+{
+	git_index *index;
+	git_index_entry *entry;
+
+	cl_repo_set_bool(g_repo, "index.sparse", true);
+	checkout_sparse(CONE_PATTERNS);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read(index, true));
+	cl_assert(index->sparse);
+
+	/* point the sparse directory at a tree that doesn't exist */
+	cl_assert((entry = git_vector_get(&index->entries, 3)) != NULL);
+	cl_assert(git_index_entry__is_sparse_dir(entry));
+	cl_git_pass(git_oid_from_string(&entry->id,
+		"deadbeefdeadbeefdeadbeefdeadbeefdeadbeef", GIT_OID_SHA1));
+
+	cl_git_fail(git_index__ensure_full(index));
+	cl_assert(index->sparse);
+	cl_assert_equal_sz(6, git_index_entrycount(index));
+
+	git_index_free(index);
+}
+
+void test_checkout_sparse__widening_the_cone_expands_the_index(void)
+{
+	git_index *index;
+
+	cl_repo_set_bool(g_repo, "index.sparse", true);
+	checkout_sparse(CONE_PATTERNS);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read(index, true));
+	cl_assert(index->sparse);
+
+	/* the sparse directory is within the cone now */
+	set_sparse("/*\n!/*/\n/ab/\n");
+
+	cl_git_pass(git_index_write(index));
+	cl_git_pass(git_index_read(index, true));
+	cl_assert(!index->sparse);
+	cl_assert_equal_sz(7, git_index_entrycount(index));
+	cl_assert(git_index_get_bypath(index, "ab/de/", 0) == NULL);
+	cl_assert(git_index_get_bypath(index, "ab/de/fgh/1.txt", 0) != NULL);
+
+	git_index_free(index);
+}
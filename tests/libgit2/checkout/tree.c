@@ -4,6 +4,8 @@
 #include "git2/checkout.h"
 #include "repository.h"
 #include "futils.h"
+#include "index.h"
+#include "tree-cache.h"
 
 static git_repository *g_repo;
 static git_checkout_options g_opts;
@@ -1672,3 +1674,31 @@ void test_checkout_tree__dry_run(void)
 
 	git_object_free(obj);
 }
+
+void test_checkout_tree__fills_the_tree_cache(void)
+{
+	git_object *head, *tree;
+	git_index *index;
+	const git_tree_cache *cache;
+
+	cl_git_pass(git_revparse_single(&head, g_repo, "HEAD"));
+	reset_index_to_treeish(head);
+	git_object_free(head);
+
+	cl_git_pass(git_revparse_single(&g_object, g_repo, "subtrees"));
+	cl_git_pass(git_checkout_tree(g_repo, g_object, &g_opts));
+
+	cl_git_pass(git_object_peel(&tree, g_object, GIT_OBJECT_TREE));
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read(index, true));
+
+	cl_assert(index->tree != NULL);
+	cl_assert_equal_i(git_index_entrycount(index), index->tree->entry_count);
+	cl_assert_equal_oid(git_object_id(tree), &index->tree->oid);
+
+	cl_assert((cache = git_tree_cache_get(index->tree, "ab/de/fgh")) != NULL);
+	cl_assert_equal_i(1, cache->entry_count);
+
+	git_index_free(index);
+	git_object_free(tree);
+}
@@ -0,0 +1,111 @@
+#include "clar_libgit2.h"
+#include "ewah.h"
+
+static bool pick_none(size_t i)
+{
+	GIT_UNUSED(i);
+	return false;
+}
+
+static bool pick_all(size_t i)
+{
+	GIT_UNUSED(i);
+	return true;
+}
+
+static bool pick_some(size_t i)
+{
+	return (i % 3 == 0 || i % 7 == 0);
+}
+
+static bool pick_sparse(size_t i)
+{
+	return (i % 1000 == 999);
+}
+
+static void assert_roundtrip(size_t nbits, bool (*pick)(size_t))
+{
+	git_bitvec bits, read;
+	git_str buf = GIT_STR_INIT;
+	size_t i, read_len;
+
+	cl_git_pass(git_bitvec_init(&bits, nbits));
+
+	for (i = 0; i < nbits; i++)
+		git_bitvec_set(&bits, i, pick(i));
+
+	cl_git_pass(git_ewah_write(&buf, &bits, nbits));
+	cl_git_pass(git_ewah_read(&read, &read_len, buf.ptr, buf.size, nbits));
+	cl_assert_equal_sz(buf.size, read_len);
+
+	for (i = 0; i < nbits; i++)
+		cl_assert_equal_b(pick(i), git_bitvec_get(&read, i));
+
+	git_bitvec_free(&bits);
+	git_bitvec_free(&read);
+	git_str_dispose(&buf);
+}
+
+void test_core_ewah__roundtrip(void)
+{
+	assert_roundtrip(0, pick_none);
+	assert_roundtrip(10, pick_none);
+	assert_roundtrip(10, pick_all);
+	assert_roundtrip(64, pick_all);
+	assert_roundtrip(100, pick_some);
+	assert_roundtrip(5000, pick_sparse);
+	assert_roundtrip(5000, pick_some);
+}
+
+void test_core_ewah__write_format(void)
+{
+	git_bitvec bits;
+	git_str buf = GIT_STR_INIT;
+	const unsigned char expected[] = {
+		0x00, 0x00, 0x00, 0x47, /* 71 bits */
+		0x00, 0x00, 0x00, 0x03, /* 3 words */
+		0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, /* 2 literals */
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,
+		0x00, 0x00, 0x00, 0x00 /* last marker */
+	};
+
+	cl_git_pass(git_bitvec_init(&bits, 100));
+	git_bitvec_set(&bits, 0, true);
+	git_bitvec_set(&bits, 2, true);
+	git_bitvec_set(&bits, 70, true);
+
+	cl_git_pass(git_ewah_write(&buf, &bits, 100));
+	cl_assert_equal_sz(sizeof(expected), buf.size);
+	cl_assert(memcmp(expected, buf.ptr, buf.size) == 0);
+
+	git_bitvec_free(&bits);
+	git_str_dispose(&buf);
+}
+
+void test_core_ewah__read_runs(void)
+{
+	git_bitvec bits;
+	size_t read_len, i;
+	const unsigned char data[] = {
+		0x00, 0x00, 0x00, 0xc1, /* 193 bits */
+		0x00, 0x00, 0x00, 0x04, /* 4 words */
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, /* 1 empty word */
+		0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x03, /* 1 full word, 1 literal */
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* an empty marker */
+		0x00, 0x00, 0x00, 0x03
+	};
+
+	cl_git_pass(git_ewah_read(&bits, &read_len, (const char *)data, sizeof(data), 193));
+	cl_assert_equal_sz(sizeof(data), read_len);
+
+	for (i = 0; i < 193; i++)
+		cl_assert_equal_b(i >= 64 && i <= 128, git_bitvec_get(&bits, i));
+
+	git_bitvec_free(&bits);
+
+	/* the bits must fit in the given size */
+	cl_git_fail(git_ewah_read(&bits, &read_len, (const char *)data, sizeof(data), 128));
+	cl_git_fail(git_ewah_read(&bits, &read_len, (const char *)data, sizeof(data) - 1, 193));
+}
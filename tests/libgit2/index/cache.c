@@ -239,3 +239,114 @@ void test_index_cache__read_tree_children(void)
 
 	git_index_free(index);
 }
+
+static void add_blob_entry(git_index *index, const char *path, const char *id)
+{
+	git_index_entry entry;
+
+	memset(&entry, 0x0, sizeof(entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+	entry.path = path;
+	cl_git_pass(git_oid_from_string(&entry.id, id, GIT_OID_SHA1));
+	cl_git_pass(git_index_add(index, &entry));
+}
+
+void test_index_cache__write_tree_only_writes_invalidated_trees(void)
+{
+	git_index *index;
+	git_tree *tree;
+	git_tree_entry *tree_entry;
+	const git_tree_cache *subdir, *cache;
+	git_oid tree_id;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_clear(index));
+
+	add_blob_entry(index, "top-level.txt", "a8233120f6ad708f843d861ce2b7228ec4e3dec6");
+	add_blob_entry(index, "subdir/file.txt", "a8233120f6ad708f843d861ce2b7228ec4e3dec6");
+	add_blob_entry(index, "subdir/deeper/file.txt", "a8233120f6ad708f843d861ce2b7228ec4e3dec6");
+	add_blob_entry(index, "other/file.txt", "a8233120f6ad708f843d861ce2b7228ec4e3dec6");
+
+	/* writing the tree fills the tree cache */
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+
+	cl_assert(index->tree);
+	cl_assert_equal_i(4, index->tree->entry_count);
+	cl_assert_equal_i(2, index->tree->children_count);
+	cl_assert_equal_oid(&tree_id, &index->tree->oid);
+
+	cl_assert((subdir = git_tree_cache_get(index->tree, "subdir")) != NULL);
+	cl_assert_equal_i(2, subdir->entry_count);
+	cl_assert((cache = git_tree_cache_get(index->tree, "subdir/deeper")) != NULL);
+	cl_assert_equal_i(1, cache->entry_count);
+	cl_assert((cache = git_tree_cache_get(index->tree, "other")) != NULL);
+	cl_assert_equal_i(1, cache->entry_count);
+
+	/* only the directories leading to a change are invalidated... */
+	add_blob_entry(index, "other/file.txt", "3697d64be941a53d4ae8f6a271e4e3fa56b022cc");
+	cl_assert_equal_i(-1, index->tree->entry_count);
+	cl_assert_equal_i(-1, git_tree_cache_get(index->tree, "other")->entry_count);
+	cl_assert_equal_i(2, subdir->entry_count);
+
+	/* ...and the others are kept when the tree is written */
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+	cl_assert_equal_oid(&tree_id, &index->tree->oid);
+	cl_assert_equal_i(4, index->tree->entry_count);
+	cl_assert(git_tree_cache_get(index->tree, "subdir") == subdir);
+	cl_assert_equal_i(1, git_tree_cache_get(index->tree, "other")->entry_count);
+
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &tree_id));
+	cl_git_pass(git_tree_entry_bypath(&tree_entry, tree, "other/file.txt"));
+	cl_assert_equal_s("3697d64be941a53d4ae8f6a271e4e3fa56b022cc",
+		git_oid_tostr_s(git_tree_entry_id(tree_entry)));
+	git_tree_entry_free(tree_entry);
+	git_tree_free(tree);
+
+	/* a directory that is removed is removed from the cache */
+	cl_git_pass(git_index_remove_bypath(index, "other/file.txt"));
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+	cl_assert_equal_i(3, index->tree->entry_count);
+	cl_assert_equal_i(1, index->tree->children_count);
+	cl_assert(git_tree_cache_get(index->tree, "other") == NULL);
+
+	git_index_free(index);
+}
+
+void test_index_cache__write_tree_reuses_the_tree_pool(void)
+{
+/* the pages of the pool are only counted without GIT_DEBUG_POOL */
+#ifndef GIT_DEBUG_POOL
+	const char *ids[] = {
+		"a8233120f6ad708f843d861ce2b7228ec4e3dec6",
+		"3697d64be941a53d4ae8f6a271e4e3fa56b022cc"
+	};
+	git_index *index;
+	git_oid tree_id;
+	uint32_t pages;
+	size_t i;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_clear(index));
+
+	add_blob_entry(index, "top-level.txt", ids[0]);
+	add_blob_entry(index, "subdir/file.txt", ids[0]);
+	add_blob_entry(index, "subdir/deeper/file.txt", ids[0]);
+	add_blob_entry(index, "other/file.txt", ids[0]);
+
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+
+	pages = git_pool__open_pages(&index->tree_pool);
+
+	/* rewriting the same directories allocates nothing new */
+	for (i = 0; i < 1000; i++) {
+		add_blob_entry(index, "subdir/deeper/file.txt", ids[(i + 1) % 2]);
+		cl_git_pass(git_index_write_tree(&tree_id, index));
+	}
+
+	cl_assert_equal_i(pages, git_pool__open_pages(&index->tree_pool));
+
+	git_index_free(index);
+#else
+	cl_skip();
+#endif
+}
@@ -0,0 +1,139 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "git2/sys/index.h"
+
+#define OFFSETS_ENTRY_COUNT 10000
+
+static git_repository *g_repo;
+static git_index *g_index;
+
+void test_index_offsets__initialize(void)
+{
+	git_index_entry entry;
+	char path[64];
+	size_t i;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+	cl_git_pass(git_repository_index(&g_index, g_repo));
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_blob_create_from_buffer(&entry.id, g_repo, "hello\n", 6));
+
+	for (i = 0; i < OFFSETS_ENTRY_COUNT; i++) {
+		p_snprintf(path, sizeof(path), "dir-%02d/sub/file-%05d.c",
+			(int)(i % 37), (int)i);
+		entry.path = path;
+		entry.file_size = (uint32_t)i;
+		cl_git_pass(git_index_add(g_index, &entry));
+	}
+}
+
+void test_index_offsets__cleanup(void)
+{
+	git_index_free(g_index);
+	g_index = NULL;
+
+	cl_git_sandbox_cleanup();
+	g_repo = NULL;
+}
+
+static bool index_has_extension(const char *signature)
+{
+	git_str buf = GIT_STR_INIT;
+	bool found = false;
+	size_t i;
+
+	cl_git_pass(git_futils_readbuffer(&buf, git_index_path(g_index)));
+
+	for (i = 0; !found && i + 4 <= buf.size; i++)
+		found = (memcmp(buf.ptr + i, signature, 4) == 0);
+
+	git_str_dispose(&buf);
+	return found;
+}
+
+static void assert_reads_back(const char *threads)
+{
+	const git_index_entry *entry;
+	char path[64];
+	size_t i;
+
+	cl_repo_set_string(g_repo, "index.threads", threads);
+
+	cl_git_pass(git_index_clear(g_index));
+	cl_git_pass(git_index_read(g_index, true));
+	cl_assert_equal_sz(OFFSETS_ENTRY_COUNT, git_index_entrycount(g_index));
+
+	for (i = 0; i < OFFSETS_ENTRY_COUNT; i++) {
+		p_snprintf(path, sizeof(path), "dir-%02d/sub/file-%05d.c",
+			(int)(i % 37), (int)i);
+
+		cl_assert((entry = git_index_get_bypath(g_index, path, 0)));
+		cl_assert_equal_i(i, entry->file_size);
+	}
+}
+
+static void write_and_read_offsets(unsigned int version)
+{
+	cl_repo_set_bool(g_repo, "index.recordOffsetTable", true);
+	cl_git_pass(git_index_set_version(g_index, version));
+	cl_git_pass(git_index_write(g_index));
+
+	cl_assert(index_has_extension("IEOT"));
+	cl_assert(index_has_extension("EOIE"));
+
+	assert_reads_back("4");
+	assert_reads_back("3");
+	assert_reads_back("1");
+}
+
+void test_index_offsets__not_written_for_small_indexes(void)
+{
+	cl_git_pass(git_index_write(g_index));
+
+	cl_assert(!index_has_extension("IEOT"));
+	cl_assert(!index_has_extension("EOIE"));
+}
+
+void test_index_offsets__end_of_entries_only(void)
+{
+	cl_repo_set_bool(g_repo, "index.recordEndOfIndexEntries", true);
+	cl_git_pass(git_index_write(g_index));
+
+	cl_assert(!index_has_extension("IEOT"));
+	cl_assert(index_has_extension("EOIE"));
+
+	assert_reads_back("4");
+}
+
+void test_index_offsets__read_with_threads(void)
+{
+	write_and_read_offsets(2);
+}
+
+void test_index_offsets__read_v4_with_threads(void)
+{
+	write_and_read_offsets(4);
+}
+
+void test_index_offsets__read_with_extensions(void)
+{
+	git_tree *tree;
+	git_oid tree_id;
+
+	cl_git_pass(git_index_write_tree(&tree_id, g_index));
+	cl_assert(g_index->tree);
+	cl_git_pass(git_index_reuc_add(g_index, "dir-00/sub/file-00000.c",
+		GIT_FILEMODE_BLOB, &tree_id,
+		0, NULL,
+		0, NULL));
+
+	write_and_read_offsets(2);
+
+	cl_assert(g_index->tree);
+	cl_assert_equal_sz(1, git_index_reuc_entrycount(g_index));
+
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &tree_id));
+	git_tree_free(tree);
+}
@@ -1,11 +1,15 @@
 #include "clar_libgit2.h"
 #include "index.h"
 
+#define SPLITINDEX_ENTRY_COUNT 100
+
 static git_repository *g_repo;
+static git_oid g_blob_id;
 
 void test_index_splitindex__initialize(void)
 {
 	g_repo = cl_git_sandbox_init("splitindex");
+	cl_git_pass(git_blob_create_from_buffer(&g_blob_id, g_repo, "hello\n", 6));
 }
 
 void test_index_splitindex__cleanup(void)
@@ -13,9 +17,204 @@ void test_index_splitindex__cleanup(void)
 	cl_git_sandbox_cleanup();
 }
 
-void test_index_splitindex__fail_on_open(void)
+static void add_entry(git_index *index, const char *path, uint32_t size)
+{
+	git_index_entry entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+	entry.path = path;
+	entry.file_size = size;
+	git_oid_cpy(&entry.id, &g_blob_id);
+
+	cl_git_pass(git_index_add(index, &entry));
+}
+
+static git_index *populated_index(void)
+{
+	git_index *index;
+	char path[32];
+	size_t i;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	for (i = 0; i < SPLITINDEX_ENTRY_COUNT; i++) {
+		p_snprintf(path, sizeof(path), "dir/file-%03d", (int)i);
+		add_entry(index, path, (uint32_t)i);
+	}
+
+	cl_git_pass(git_index_write(index));
+	return index;
+}
+
+/* the number of entries that are stored in the index file itself */
+static size_t index_file_entrycount(git_index *index)
+{
+	git_str buf = GIT_STR_INIT;
+	uint32_t count;
+
+	cl_git_pass(git_futils_readbuffer(&buf, git_index_path(index)));
+	cl_assert(buf.size > 12);
+	memcpy(&count, buf.ptr + 8, sizeof(count));
+	git_str_dispose(&buf);
+
+	return ntohl(count);
+}
+
+static int age_shared_index(void *payload, git_str *path)
+{
+	time_t when = time(NULL) - (3 * 7 * 24 * 60 * 60);
+
+	GIT_UNUSED(payload);
+
+	if (strstr(path->ptr, "sharedindex.") != NULL)
+		cl_git_pass(git_futils_touch(path->ptr, &when));
+
+	return 0;
+}
+
+static int count_shared_index(void *payload, git_str *path)
+{
+	if (strstr(path->ptr, "sharedindex.") != NULL)
+		(*(size_t *)payload)++;
+
+	return 0;
+}
+
+static size_t foreach_shared_index(int (*cb)(void *, git_str *))
+{
+	git_str path = GIT_STR_INIT;
+	size_t count = 0;
+
+	cl_git_pass(git_str_sets(&path, git_repository_path(g_repo)));
+	cl_git_pass(git_fs_path_direach(&path, 0, cb, &count));
+	git_str_dispose(&path);
+
+	return count;
+}
+
+static void assert_reopened_entries(git_index *index, size_t expected)
+{
+	git_index *reopened;
+	const git_index_entry *entry, *reopened_entry;
+	size_t i;
+
+	cl_git_pass(git_index_open(&reopened, git_index_path(index)));
+	cl_assert_equal_sz(expected, git_index_entrycount(reopened));
+	cl_assert_equal_sz(expected, git_index_entrycount(index));
+
+	for (i = 0; i < expected; i++) {
+		entry = git_index_get_byindex(index, i);
+		cl_assert((reopened_entry = git_index_get_bypath(reopened, entry->path, 0)));
+		cl_assert_equal_i(entry->file_size, reopened_entry->file_size);
+		cl_assert_equal_oid(&entry->id, &reopened_entry->id);
+	}
+
+	git_index_free(reopened);
+}
+
+void test_index_splitindex__read(void)
 {
-	git_index *idx;
-	cl_git_fail_with(-1, git_repository_index(&idx, g_repo));
-	cl_assert_equal_s(git_error_last()->message, "unsupported mandatory extension: 'link'");
+	git_index *index;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_assert_equal_sz(0, git_index_entrycount(index));
+	cl_assert(index->shared);
+
+	git_index_free(index);
+}
+
+void test_index_splitindex__fails_without_shared_index(void)
+{
+	git_index *index;
+
+	cl_git_pass(p_unlink("splitindex/.git/sharedindex.39d890139ee5356c7ef572216cebcd27aa41f9df"));
+	cl_git_fail(git_repository_index(&index, g_repo));
+}
+
+void test_index_splitindex__writes_only_changes(void)
+{
+	git_index *index = populated_index();
+
+	cl_assert(index->shared);
+	cl_assert_equal_sz(0, index_file_entrycount(index));
+	assert_reopened_entries(index, SPLITINDEX_ENTRY_COUNT);
+
+	/* add, replace and remove one entry each */
+	add_entry(index, "dir/added", 1000);
+	add_entry(index, "dir/file-042", 1042);
+	cl_git_pass(git_index_remove(index, "dir/file-007", 0));
+	cl_git_pass(git_index_write(index));
+
+	cl_assert_equal_sz(2, index_file_entrycount(index));
+	assert_reopened_entries(index, SPLITINDEX_ENTRY_COUNT);
+
+	cl_git_pass(git_index_read(index, true));
+	cl_assert_equal_sz(SPLITINDEX_ENTRY_COUNT, git_index_entrycount(index));
+	cl_assert_equal_i(1042, git_index_get_bypath(index, "dir/file-042", 0)->file_size);
+	cl_assert_equal_i(1000, git_index_get_bypath(index, "dir/added", 0)->file_size);
+	cl_assert_equal_p(NULL, git_index_get_bypath(index, "dir/file-007", 0));
+
+	git_index_free(index);
+}
+
+void test_index_splitindex__resplits_after_too_many_changes(void)
+{
+	git_index *index = populated_index();
+	char path[32];
+	size_t i;
+
+	cl_repo_set_int(g_repo, "splitIndex.maxPercentChange", 10);
+
+	for (i = 0; i < 10; i++) {
+		p_snprintf(path, sizeof(path), "dir/file-%03d", (int)i);
+		add_entry(index, path, 2000);
+	}
+
+	cl_git_pass(git_index_write(index));
+	cl_assert_equal_sz(10, index_file_entrycount(index));
+
+	add_entry(index, "dir/file-099", 2000);
+	cl_git_pass(git_index_write(index));
+	cl_assert_equal_sz(0, index_file_entrycount(index));
+
+	assert_reopened_entries(index, SPLITINDEX_ENTRY_COUNT);
+	git_index_free(index);
+}
+
+void test_index_splitindex__expires_shared_indexes(void)
+{
+	git_index *index = populated_index();
+
+	cl_assert_equal_sz(2, foreach_shared_index(count_shared_index));
+
+	/* only shared indexes older than two weeks are removed */
+	cl_repo_set_int(g_repo, "splitIndex.maxPercentChange", 0);
+
+	add_entry(index, "dir/added", 1000);
+	cl_git_pass(git_index_write(index));
+	cl_assert_equal_sz(3, foreach_shared_index(count_shared_index));
+
+	foreach_shared_index(age_shared_index);
+
+	add_entry(index, "dir/added-again", 1000);
+	cl_git_pass(git_index_write(index));
+	cl_assert_equal_sz(1, foreach_shared_index(count_shared_index));
+	assert_reopened_entries(index, SPLITINDEX_ENTRY_COUNT + 2);
+
+	git_index_free(index);
+}
+
+void test_index_splitindex__unsplit(void)
+{
+	git_index *index = populated_index();
+
+	cl_repo_set_bool(g_repo, "core.splitIndex", false);
+	cl_git_pass(git_index_write(index));
+
+	cl_assert_equal_p(NULL, index->shared);
+	cl_assert_equal_sz(SPLITINDEX_ENTRY_COUNT, index_file_entrycount(index));
+	assert_reopened_entries(index, SPLITINDEX_ENTRY_COUNT);
+
+	git_index_free(index);
 }
@@ -100,6 +100,7 @@ void test_index_tests__default_test_index(void)
    cl_assert(index->on_disk);
 
    cl_assert(git_index_entrycount(index) == index_entry_count);
+   cl_git_pass(git_index__materialize(index));
    cl_assert(git_vector_is_sorted(&index->entries));
 
    entries = (git_index_entry **)index->entries.contents;
@@ -123,6 +124,7 @@ void test_index_tests__gitgit_index(void)
    cl_assert(index->on_disk);
 
    cl_assert(git_index_entrycount(index) == index_entry_count_2);
+   cl_git_pass(git_index__materialize(index));
    cl_assert(git_vector_is_sorted(&index->entries));
    cl_assert(index->tree != NULL);
 
@@ -146,6 +148,102 @@ void test_index_tests__find_in_existing(void)
    git_index_free(index);
 }
 
+void test_index_tests__get_bypath_builds_map_lazily(void)
+{
+	git_index *index;
+	git_index_entry entry;
+	const git_index_entry *found;
+	size_t i;
+
+	cl_git_pass(git_index_open(&index, TEST_INDEX_PATH));
+	cl_assert(index->entries_map_lazy);
+
+	/* a few lookups are answered without building the map */
+	for (i = 0; i < ARRAY_SIZE(test_entries); ++i) {
+		cl_assert((found = git_index_get_bypath(index, test_entries[i].path, 0)));
+		cl_assert_equal_s(test_entries[i].path, found->path);
+	}
+
+	cl_assert(index->entries_map_lazy);
+	cl_assert_equal_p(NULL, git_index_get_bypath(index, "src/nonexistent.c", 0));
+	cl_assert_equal_p(NULL, git_index_get_bypath(index, "Makefile", 1));
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+	entry.path = "src/added.c";
+	cl_git_pass(git_oid_from_string(&entry.id,
+		"a8233120f6ad708f843d861ce2b7228ec4e3dec6", GIT_OID_SHA1));
+	cl_git_pass(git_index_add(index, &entry));
+	cl_git_pass(git_index_remove(index, "Makefile", 0));
+
+	/* looking up every entry builds it */
+	for (i = 0; i < git_index_entrycount(index); i++) {
+		const git_index_entry *e = git_index_get_byindex(index, i);
+
+		cl_assert_equal_p(e, git_index_get_bypath(index, e->path, 0));
+	}
+
+	cl_assert(!index->entries_map_lazy);
+	cl_assert(git_index_get_bypath(index, "src/added.c", 0));
+	cl_assert_equal_p(NULL, git_index_get_bypath(index, "Makefile", 0));
+
+	git_index_free(index);
+}
+
+void test_index_tests__decodes_entries_on_access(void)
+{
+	git_index *index;
+	const git_index_entry *found[ARRAY_SIZE(test_entries)];
+	size_t i;
+
+	cl_git_pass(git_index_open(&index, TEST_INDEX_PATH));
+	cl_assert(index->lazy);
+	cl_assert_equal_sz(index_entry_count, git_index_entrycount(index));
+	cl_assert_equal_i(0, git_index_has_conflicts(index));
+
+	/* lookups by path search the mapped file */
+	for (i = 0; i < ARRAY_SIZE(test_entries); ++i) {
+		cl_assert((found[i] = git_index_get_bypath(index, test_entries[i].path, 0)));
+		cl_assert_equal_s(test_entries[i].path, found[i]->path);
+		cl_assert_equal_i(test_entries[i].mtime, found[i]->mtime.seconds);
+		cl_assert_equal_i(test_entries[i].file_size, found[i]->file_size);
+	}
+
+	cl_assert_equal_p(NULL, git_index_get_bypath(index, "src/nonexistent.c", 0));
+	cl_assert_equal_p(NULL, git_index_get_bypath(index, "Makefile", 1));
+	cl_assert(index->lazy);
+
+	/* walking the entries decodes the rest, keeping those looked up */
+	for (i = 0; i < ARRAY_SIZE(test_entries); ++i)
+		cl_assert_equal_p(found[i], git_index_get_byindex(index, test_entries[i].index));
+
+	cl_assert(!index->lazy);
+	cl_assert_equal_sz(index_entry_count, git_index_entrycount(index));
+
+	git_index_free(index);
+}
+
+void test_index_tests__decodes_compressed_entries_on_read(void)
+{
+	git_index *index;
+
+	copy_file(TEST_INDEX_PATH, "index_v4");
+
+	cl_git_pass(git_index_open(&index, "index_v4"));
+	cl_git_pass(git_index_set_version(index, 4));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	/* prefix-compressed paths can't be searched in place */
+	cl_git_pass(git_index_open(&index, "index_v4"));
+	cl_assert(!index->lazy);
+	cl_assert_equal_sz(index_entry_count, git_index_entrycount(index));
+	cl_assert(git_index_get_bypath(index, "src/index.c", 0));
+
+	git_index_free(index);
+	cl_git_pass(p_unlink("index_v4"));
+}
+
 void test_index_tests__find_in_empty(void)
 {
    git_index *index;
@@ -114,6 +114,7 @@ void test_index_tests256__default_test_index(void)
    cl_assert(index->on_disk);
 
    cl_assert_equal_sz(git_index_entrycount(index), index_entry_count);
+   cl_git_pass(git_index__materialize(index));
    cl_assert(git_vector_is_sorted(&index->entries));
 
    entries = (git_index_entry **)index->entries.contents;
@@ -1030,6 +1031,7 @@ void test_index_tests256__reload_while_ignoring_case(void)
 	index_opts.oid_type = GIT_OID_SHA256;
 
 	cl_git_pass(git_index_open_ext(&index, TEST_INDEX_PATH, &index_opts));
+	cl_git_pass(git_index__materialize(index));
 	cl_git_pass(git_vector_verify_sorted(&index->entries));
 
 	caps = git_index_caps(index);
@@ -1060,6 +1062,7 @@ void test_index_tests256__change_icase_on_instance(void)
 	index_opts.oid_type = GIT_OID_SHA256;
 
 	cl_git_pass(git_index_open_ext(&index, TEST_INDEX_PATH, &index_opts));
+	cl_git_pass(git_index__materialize(index));
 	cl_git_pass(git_vector_verify_sorted(&index->entries));
 
 	caps = git_index_caps(index);
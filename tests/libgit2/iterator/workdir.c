@@ -1053,6 +1053,24 @@ static void create_paths(const char *root, int depth)
 	git_str_dispose(&fullpath);
 }
 
+/* Whether the directory listing includes the types of its items. */
+static bool diriter_reports_types(const char *path)
+{
+	git_fs_path_diriter diriter = GIT_FS_PATH_DIRITER_INIT;
+	bool reported = true;
+	int error;
+
+	cl_git_pass(git_fs_path_diriter_init(&diriter, path, 0));
+
+	while ((error = git_fs_path_diriter_next(&diriter)) == 0)
+		reported &= (git_fs_path_diriter_type(&diriter) != 0);
+
+	cl_assert_equal_i(GIT_ITEROVER, error);
+	git_fs_path_diriter_free(&diriter);
+
+	return reported;
+}
+
 void test_iterator_workdir__pathlist_for_deeply_nested_item(void)
 {
 	git_iterator *i;
@@ -1178,7 +1196,14 @@ void test_iterator_workdir__pathlist_for_deeply_nested_item(void)
 
 		cl_git_pass(git_iterator_for_workdir(&i, g_repo, NULL, NULL, &i_opts));
 		expect_iterator_items(i, expected_len, expected, expected_len, expected);
-		cl_assert_equal_i(14, i->stat_calls);
+
+		/*
+		 * the files where a directory is expected are not examined
+		 * when the directory listing includes their type
+		 */
+		cl_assert_equal_i(
+			diriter_reports_types(git_repository_workdir(g_repo)) ? 12 : 14,
+			i->stat_calls);
 		git_iterator_free(i);
 	}
 
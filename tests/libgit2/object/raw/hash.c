@@ -179,3 +179,16 @@ void test_object_raw_hash__hash_multi_byte_object(void)
 	hash_object_pass(&id2, &some_obj);
 	cl_assert(git_oid_cmp(&id1, &id2) == 0);
 }
+
+void test_object_raw_hash__hash_trusted_object(void)
+{
+	git_object_id_options id_opts = GIT_OBJECT_ID_OPTIONS_INIT;
+	git_oid id1, id2;
+
+	id_opts.object_type = some_obj.type;
+	id_opts.flags = GIT_OBJECT_ID_TRUSTED;
+
+	cl_git_pass(git_oid_from_string(&id1, some_id, GIT_OID_SHA1));
+	cl_git_pass(git_object_id_from_buffer(&id2, some_obj.data, some_obj.len, &id_opts));
+	cl_assert(git_oid_cmp(&id1, &id2) == 0);
+}
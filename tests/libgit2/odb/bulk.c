@@ -0,0 +1,209 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+#include "futils.h"
+
+static git_repository *repo;
+static git_odb *odb;
+
+void test_odb_bulk__initialize(void)
+{
+	repo = cl_git_sandbox_init("testrepo.git");
+	cl_git_pass(git_repository_odb(&odb, repo));
+}
+
+void test_odb_bulk__cleanup(void)
+{
+	git_odb_free(odb);
+	cl_git_sandbox_cleanup();
+}
+
+static int count_pack_files(void *payload, git_str *path)
+{
+	size_t *count = payload;
+
+	if (git__suffixcmp(path->ptr, ".idx") == 0 ||
+	    git__suffixcmp(path->ptr, ".pack") == 0 ||
+	    git__prefixcmp(git_fs_path_basename(path->ptr), "pack_git2_") == 0)
+		(*count)++;
+
+	return 0;
+}
+
+static size_t pack_files(void)
+{
+	git_str path = GIT_STR_INIT;
+	size_t count = 0;
+
+	git_str_puts(&path, "testrepo.git/objects/pack");
+	cl_git_pass(git_fs_path_direach(&path, 0, count_pack_files, &count));
+	git_str_dispose(&path);
+
+	return count;
+}
+
+static void write_blobs(git_oid *ids, size_t count)
+{
+	char content[64];
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		p_snprintf(content, sizeof(content), "bulk object %" PRIuZ "\n", i);
+		cl_git_pass(git_odb_write(&ids[i], odb, content, strlen(content), GIT_OBJECT_BLOB));
+	}
+}
+
+static void assert_blobs(git_odb *db, git_oid *ids, size_t count)
+{
+	git_odb_object *obj;
+	char content[64];
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		p_snprintf(content, sizeof(content), "bulk object %" PRIuZ "\n", i);
+
+		cl_git_pass(git_odb_read(&obj, db, &ids[i]));
+		cl_assert_equal_i(GIT_OBJECT_BLOB, git_odb_object_type(obj));
+		cl_assert_equal_s(content, git_odb_object_data(obj));
+		git_odb_object_free(obj);
+	}
+}
+
+static void assert_not_loose(git_oid *ids, size_t count)
+{
+	git_str path = GIT_STR_INIT;
+	char hex[GIT_OID_SHA1_HEXSIZE + 1];
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		git_oid_tostr(hex, sizeof(hex), &ids[i]);
+
+		git_str_clear(&path);
+		git_str_printf(&path, "testrepo.git/objects/%.2s/%s", hex, hex + 2);
+		cl_assert(!git_fs_path_exists(path.ptr));
+	}
+
+	git_str_dispose(&path);
+}
+
+void test_odb_bulk__write_and_commit(void)
+{
+	git_oid ids[100], stream_id;
+	git_odb_stream *stream;
+	git_odb *reopened;
+	size_t before = pack_files();
+	size_t len, i;
+	git_object_t type;
+
+	cl_git_pass(git_odb_bulk_begin(odb));
+	write_blobs(ids, ARRAY_SIZE(ids));
+
+	cl_git_pass(git_odb_open_wstream(&stream, odb, 12, GIT_OBJECT_BLOB));
+	cl_git_pass(git_odb_stream_write(stream, "stream", 6));
+	cl_git_pass(git_odb_stream_write(stream, "ed!\n\n\n", 6));
+	cl_git_pass(git_odb_stream_finalize_write(&stream_id, stream));
+	git_odb_stream_free(stream);
+
+	/* objects can be read back while the session is in progress */
+	assert_blobs(odb, ids, ARRAY_SIZE(ids));
+	cl_git_pass(git_odb_read_header(&len, &type, odb, &stream_id));
+	cl_assert_equal_sz(12, len);
+	cl_assert_equal_i(GIT_OBJECT_BLOB, type);
+
+	/* writing an object twice is a no-op */
+	write_blobs(ids, 1);
+
+	cl_git_pass(git_odb_bulk_commit(odb));
+
+	cl_assert_equal_sz(before + 2, pack_files());
+	assert_not_loose(ids, ARRAY_SIZE(ids));
+	assert_not_loose(&stream_id, 1);
+	assert_blobs(odb, ids, ARRAY_SIZE(ids));
+
+	cl_git_pass(git_odb_open_ext(&reopened, "testrepo.git/objects", NULL));
+	assert_blobs(reopened, ids, ARRAY_SIZE(ids));
+
+	for (i = 0; i < ARRAY_SIZE(ids); i++)
+		cl_assert(git_odb_exists(reopened, &ids[i]));
+
+	cl_assert(git_odb_exists(reopened, &stream_id));
+	git_odb_free(reopened);
+}
+
+void test_odb_bulk__abort(void)
+{
+	git_oid ids[10];
+	size_t before = pack_files();
+
+	cl_git_pass(git_odb_bulk_begin(odb));
+	write_blobs(ids, ARRAY_SIZE(ids));
+	cl_assert(git_odb_exists(odb, &ids[0]));
+
+	cl_git_pass(git_odb_bulk_abort(odb));
+
+	cl_assert_equal_sz(before, pack_files());
+	cl_assert(!git_odb_exists(odb, &ids[0]));
+	assert_not_loose(ids, ARRAY_SIZE(ids));
+}
+
+void test_odb_bulk__empty_session(void)
+{
+	size_t before = pack_files();
+
+	cl_git_pass(git_odb_bulk_begin(odb));
+	cl_git_pass(git_odb_bulk_commit(odb));
+	cl_assert_equal_sz(before, pack_files());
+}
+
+void test_odb_bulk__only_one_session(void)
+{
+	cl_git_fail(git_odb_bulk_commit(odb));
+
+	cl_git_pass(git_odb_bulk_begin(odb));
+	cl_git_fail(git_odb_bulk_begin(odb));
+	cl_git_pass(git_odb_bulk_abort(odb));
+}
+
+struct foreach_write_data {
+	git_oid written[10];
+	size_t written_count;
+	size_t written_seen;
+};
+
+static int foreach_write_cb(const git_oid *id, void *payload)
+{
+	struct foreach_write_data *data = payload;
+	char content[64];
+	size_t i;
+
+	for (i = 0; i < data->written_count; i++) {
+		if (git_oid_equal(id, &data->written[i]))
+			data->written_seen++;
+	}
+
+	if (data->written_count < ARRAY_SIZE(data->written)) {
+		p_snprintf(content, sizeof(content), "written during foreach %" PRIuZ "\n",
+			data->written_count);
+		cl_git_pass(git_odb_write(&data->written[data->written_count++],
+			odb, content, strlen(content), GIT_OBJECT_BLOB));
+	}
+
+	return 0;
+}
+
+void test_odb_bulk__write_during_foreach(void)
+{
+	struct foreach_write_data data;
+	git_oid ids[10];
+
+	memset(&data, 0, sizeof(data));
+
+	cl_git_pass(git_odb_bulk_begin(odb));
+	write_blobs(ids, ARRAY_SIZE(ids));
+
+	/* the objects written by the callback are not visited */
+	cl_git_pass(git_odb_foreach(odb, foreach_write_cb, &data));
+	cl_assert_equal_sz(ARRAY_SIZE(data.written), data.written_count);
+	cl_assert_equal_sz(0, data.written_seen);
+
+	cl_git_pass(git_odb_bulk_commit(odb));
+}
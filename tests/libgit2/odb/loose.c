@@ -392,3 +392,53 @@ void test_odb_loose__fsync_obeys_repo_setting(void)
 	cl_assert(p_fsync__cnt > 0);
 	git_repository_free(repo);
 }
+
+void test_odb_loose__fsync_batch(void)
+{
+	git_odb *odb;
+	git_odb_object *obj;
+	git_oid oids[10];
+	git_str path = GIT_STR_INIT, content = GIT_STR_INIT;
+	char hex[GIT_OID_SHA1_HEXSIZE + 1];
+	size_t i;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_FSYNC_GITDIR, 1));
+	cl_git_pass(git_odb_open(&odb, "test-objects"));
+	cl_git_pass(git_odb_fsync_batch_begin(odb));
+
+	for (i = 0; i < ARRAY_SIZE(oids); i++) {
+		git_str_clear(&content);
+		git_str_printf(&content, "batched object %" PRIuZ "\n", i);
+		cl_git_pass(git_odb_write(&oids[i], odb, content.ptr, content.size, GIT_OBJECT_BLOB));
+	}
+
+	/* pending objects can be read, but are not in place yet */
+	git_oid_tostr(hex, sizeof(hex), &oids[0]);
+	git_str_printf(&path, "test-objects/%.2s/%s", hex, hex + 2);
+
+	cl_assert(!git_fs_path_exists(path.ptr));
+	cl_assert(git_odb_exists(odb, &oids[0]));
+	cl_git_pass(git_odb_read(&obj, odb, &oids[0]));
+	cl_assert_equal_s("batched object 0\n", git_odb_object_data(obj));
+	git_odb_object_free(obj);
+
+	/* writing an object twice doesn't add it to the batch again */
+	cl_git_pass(git_odb_write(&oids[0], odb, "batched object 0\n", 17, GIT_OBJECT_BLOB));
+
+#ifdef GIT_SYNCFS
+	cl_assert_equal_sz(0, p_fsync__cnt);
+#endif
+
+	cl_git_pass(git_odb_fsync_batch_commit(odb));
+	cl_assert(git_fs_path_exists(path.ptr));
+	git_odb_free(odb);
+
+	cl_git_pass(git_odb_open(&odb, "test-objects"));
+
+	for (i = 0; i < ARRAY_SIZE(oids); i++)
+		cl_assert(git_odb_exists(odb, &oids[i]));
+
+	git_odb_free(odb);
+	git_str_dispose(&content);
+	git_str_dispose(&path);
+}
@@ -77,3 +77,65 @@ void test_odb_packed__read_header_1(void)
 	}
 }
 
+void test_odb_packed__read_stream(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(packed_objects); ++i) {
+		git_oid id;
+		git_odb_object *obj;
+		git_odb_stream *stream;
+		git_str buf = GIT_STR_INIT;
+		char chunk[7];
+		size_t len;
+		git_object_t type;
+		int ret;
+
+		cl_git_pass(git_oid_from_string(&id, packed_objects[i], GIT_OID_SHA1));
+
+		cl_git_pass(git_odb_read(&obj, _odb, &id));
+		cl_git_pass(git_odb_open_rstream(&stream, &len, &type, _odb, &id));
+
+		cl_assert_equal_sz(obj->cached.size, len);
+		cl_assert_equal_i(obj->cached.type, type);
+
+		while ((ret = git_odb_stream_read(stream, chunk, sizeof(chunk))) > 0)
+			cl_git_pass(git_str_put(&buf, chunk, ret));
+
+		cl_git_pass(ret);
+		cl_assert_equal_sz(len, buf.size);
+		cl_assert(memcmp(obj->buffer, buf.ptr, len) == 0);
+
+		git_str_dispose(&buf);
+		git_odb_stream_free(stream);
+		git_odb_object_free(obj);
+	}
+}
+
+void test_odb_packed__pack_location(void)
+{
+	struct git_pack_file *pack;
+	off64_t offset;
+	size_t size, len;
+	git_object_t type;
+	unsigned int i;
+	git_oid id;
+
+	for (i = 0; i < ARRAY_SIZE(packed_objects); ++i) {
+		cl_git_pass(git_oid_from_string(&id, packed_objects[i], GIT_OID_SHA1));
+		cl_git_pass(git_odb__pack_location(&pack, &offset, &size, _odb, &id));
+
+		cl_assert(pack != NULL);
+		cl_assert(offset >= 12);
+
+		/* the size of deltas is the size of the object they produce */
+		cl_git_pass(git_odb_read_header(&len, &type, _odb, &id));
+		cl_assert_equal_sz(len, size);
+	}
+
+	/* a loose object is not in a pack */
+	cl_git_pass(git_oid_from_string(&id, "1385f264afb75a56a5bec74243be9b367ba4ca08", GIT_OID_SHA1));
+	cl_assert(git_odb_exists(_odb, &id));
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_odb__pack_location(&pack, &offset, &size, _odb, &id));
+}
@@ -120,6 +120,34 @@ void test_pack_packbuilder__create_pack(void)
 	git_str_dispose(&buf);
 }
 
+void test_pack_packbuilder__big_files_are_not_deltified(void)
+{
+	git_indexer_options opts = GIT_INDEXER_OPTIONS_INIT;
+	git_indexer_progress stats;
+
+	/* every object is over the threshold, and streamed into the pack */
+	cl_repo_set_int(_repo, "core.bigFileThreshold", 1);
+
+	git_packbuilder_free(_packbuilder);
+	cl_git_pass(git_packbuilder_new(&_packbuilder, _repo));
+
+	seed_packbuilder();
+
+	opts.verify = 1;
+
+#ifdef GIT_EXPERIMENTAL_SHA256
+	cl_git_pass(git_indexer_new(&_indexer, ".", &opts));
+#else
+	cl_git_pass(git_indexer_new(&_indexer, ".", 0, NULL, &opts));
+#endif
+
+	cl_git_pass(git_packbuilder_foreach(_packbuilder, feed_indexer, &stats));
+	cl_git_pass(git_indexer_commit(_indexer, &stats));
+
+	cl_assert_equal_i(git_packbuilder_object_count(_packbuilder), stats.indexed_objects);
+	cl_assert_equal_i(0, stats.indexed_deltas);
+}
+
 void test_pack_packbuilder__get_name(void)
 {
 	seed_packbuilder();
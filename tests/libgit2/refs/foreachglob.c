@@ -62,6 +62,14 @@ void test_refs_foreachglob__retrieve_nonexistant(void)
 	assert_retrieval("refs/nonexistent/*", 0);
 }
 
+void test_refs_foreachglob__retrieve_by_partial_prefix(void)
+{
+	/* refs/heads/packed, refs/heads/packed-test */
+	assert_retrieval("refs/heads/packed*", 2);
+	assert_retrieval("refs/heads/packed-*", 1);
+	assert_retrieval("refs/heads/zzz*", 0);
+}
+
 void test_refs_foreachglob__retrieve_partially_named_references(void)
 {
 	/*
@@ -93,3 +101,57 @@ void test_refs_foreachglob__can_cancel(void)
 
 	cl_assert_equal_i(11, count);
 }
+
+static int collect_cb(const char *reference_name, void *payload)
+{
+	git_str *names = (git_str *)payload;
+
+	return git_str_printf(names, "%s\n", reference_name);
+}
+
+static void assert_names(const char *glob, const char *expected)
+{
+	git_str names = GIT_STR_INIT;
+
+	cl_git_pass(git_reference_foreach_glob(repo, glob, collect_cb, &names));
+	cl_assert_equal_s(expected, names.ptr ? names.ptr : "");
+
+	git_str_dispose(&names);
+}
+
+void test_refs_foreachglob__retrieve_prefix_from_sorted_packed_refs(void)
+{
+	git_reference *ref;
+	git_oid id;
+
+	if (cl_repo_has_ref_format(repo, "reftable"))
+		cl_skip();
+
+	cl_git_rewritefile("testrepo.git/packed-refs",
+		"# pack-refs with: peeled fully-peeled sorted \n"
+		"be3563ae3f795b2b4353bcce3a527ad0a4f7f644 refs/prefix-a/one\n"
+		"be3563ae3f795b2b4353bcce3a527ad0a4f7f644 refs/prefix/a\n"
+		"be3563ae3f795b2b4353bcce3a527ad0a4f7f644 refs/prefix/b\n"
+		"be3563ae3f795b2b4353bcce3a527ad0a4f7f644 refs/prefix/c\n"
+		"be3563ae3f795b2b4353bcce3a527ad0a4f7f644 refs/prefix0/d\n");
+
+	assert_names("refs/prefix/*",
+		"refs/prefix/a\nrefs/prefix/b\nrefs/prefix/c\n");
+	assert_names("refs/prefix/[ab]", "refs/prefix/a\nrefs/prefix/b\n");
+	assert_names("refs/prefix0/*", "refs/prefix0/d\n");
+	assert_names("refs/nonexistent/*", "");
+
+	/* loose references shadow packed ones, and are listed first */
+	cl_git_pass(git_oid_fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"));
+	cl_git_pass(git_reference_create(&ref, repo, "refs/prefix/b", &id, 1, NULL));
+	git_reference_free(ref);
+	cl_git_pass(git_reference_create(&ref, repo, "refs/prefix/z", &id, 0, NULL));
+	git_reference_free(ref);
+
+	assert_names("refs/prefix/*",
+		"refs/prefix/b\nrefs/prefix/z\nrefs/prefix/a\nrefs/prefix/c\n");
+
+	cl_git_pass(git_reference_lookup(&ref, repo, "refs/prefix/b"));
+	cl_assert_equal_oid(&id, git_reference_target(ref));
+	git_reference_free(ref);
+}
@@ -19,6 +19,8 @@ void test_refs_pack__initialize(void)
 void test_refs_pack__cleanup(void)
 {
    cl_git_sandbox_cleanup();
+
+   cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_FSYNC_GITDIR, 0));
 }
 
 static void packall(void)
@@ -109,3 +111,162 @@ void test_refs_pack__symbolic(void)
 
 	packall();
 }
+
+static void pack_refs(uint32_t flags, char **prefixes, size_t prefixes_count)
+{
+	git_refdb_pack_options opts = GIT_REFDB_PACK_OPTIONS_INIT;
+	git_refdb *refdb;
+
+	opts.flags = flags;
+	opts.prefixes.strings = prefixes;
+	opts.prefixes.count = prefixes_count;
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_pack_refs(refdb, &opts));
+	git_refdb_free(refdb);
+}
+
+static void assert_packed(const char *name, bool packed, bool loose)
+{
+	git_reference *reference;
+	git_str path = GIT_STR_INIT;
+
+	cl_git_pass(git_reference_lookup(&reference, g_repo, name));
+	cl_assert_equal_i(packed && !loose, reference_is_packed(reference));
+	git_reference_free(reference);
+
+	cl_git_pass(git_str_joinpath(&path, git_repository_path(g_repo), name));
+	cl_assert_equal_b(loose, git_fs_path_exists(path.ptr));
+	git_str_dispose(&path);
+}
+
+void test_refs_pack__tags_by_default(void)
+{
+	if (!cl_repo_has_ref_format(g_repo, "files"))
+		cl_skip();
+
+	pack_refs(0, NULL, 0);
+
+	assert_packed(loose_tag_ref_name, true, false);
+	assert_packed("refs/tags/foo/foo/bar", true, false);
+	assert_packed("refs/heads/master", false, true);
+	assert_packed("refs/heads/br2", false, true);
+}
+
+void test_refs_pack__prefixes(void)
+{
+	char *prefixes[] = { "refs/heads/br", "refs/heads/sub" };
+
+	if (!cl_repo_has_ref_format(g_repo, "files"))
+		cl_skip();
+
+	pack_refs(0, prefixes, 2);
+
+	assert_packed(loose_tag_ref_name, true, false);
+	assert_packed("refs/heads/br2", true, false);
+	assert_packed("refs/heads/subtrees", true, false);
+	assert_packed("refs/heads/master", false, true);
+}
+
+void test_refs_pack__all(void)
+{
+	if (!cl_repo_has_ref_format(g_repo, "files"))
+		cl_skip();
+
+	pack_refs(GIT_REFDB_PACK_ALL, NULL, 0);
+
+	assert_packed(loose_tag_ref_name, true, false);
+	assert_packed("refs/heads/master", true, false);
+	assert_packed("refs/heads/packed-test", true, false);
+}
+
+void test_refs_pack__no_prune(void)
+{
+	git_str path = GIT_STR_INIT;
+
+	if (!cl_repo_has_ref_format(g_repo, "files"))
+		cl_skip();
+
+	pack_refs(GIT_REFDB_PACK_ALL | GIT_REFDB_PACK_NO_PRUNE, NULL, 0);
+
+	assert_packed(loose_tag_ref_name, true, true);
+	assert_packed("refs/heads/master", true, true);
+
+	/* The packed value is used once the loose file is gone */
+	cl_git_pass(git_str_joinpath(&path, git_repository_path(g_repo), "refs/heads/master"));
+	cl_must_pass(p_unlink(path.ptr));
+	git_str_dispose(&path);
+
+	assert_packed("refs/heads/master", true, false);
+}
+
+static void create_in_transaction(const char *fmt, int count)
+{
+	git_transaction *tx;
+	git_oid head;
+	char name[128];
+	int i;
+
+	cl_git_pass(git_reference_name_to_id(&head, g_repo, "HEAD"));
+	cl_git_pass(git_transaction_new(&tx, g_repo));
+
+	for (i = 0; i < count; i++) {
+		p_snprintf(name, sizeof(name), fmt, i);
+		cl_git_pass(git_transaction_lock_ref(tx, name));
+		cl_git_pass(git_transaction_set_target(tx, name, &head, NULL, NULL));
+	}
+
+	cl_git_pass(git_transaction_commit(tx));
+	git_transaction_free(tx);
+}
+
+void test_refs_pack__auto(void)
+{
+	if (!cl_repo_has_ref_format(g_repo, "files"))
+		cl_skip();
+
+	/* There are 17 loose references to begin with */
+	cl_repo_set_int(g_repo, "gc.autoPackRefs", 25);
+
+	create_in_transaction("refs/heads/auto-%03d", 5);
+	assert_packed("refs/heads/auto-000", false, true);
+	assert_packed("refs/heads/master", false, true);
+
+	create_in_transaction("refs/heads/more-%03d", 5);
+	assert_packed("refs/heads/auto-000", true, false);
+	assert_packed("refs/heads/more-004", true, false);
+	assert_packed("refs/heads/master", true, false);
+
+	/* Symbolic references stay loose */
+	assert_packed("refs/symref", false, true);
+}
+
+void test_refs_pack__auto_with_fsync(void)
+{
+	git_str packed_refs = GIT_STR_INIT;
+
+	if (!cl_repo_has_ref_format(g_repo, "files"))
+		cl_skip();
+
+	/* The loose references are only committed at the end */
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_FSYNC_GITDIR, 1));
+	cl_repo_set_int(g_repo, "gc.autoPackRefs", 20);
+
+	create_in_transaction("refs/heads/auto-%03d", 5);
+	assert_packed("refs/heads/auto-000", true, false);
+	assert_packed("refs/heads/auto-004", true, false);
+	assert_packed("refs/heads/master", true, false);
+
+	cl_git_pass(git_futils_readbuffer(&packed_refs, "testrepo/.git/packed-refs"));
+	cl_assert(strstr(packed_refs.ptr, " refs/heads/auto-004\n") != NULL);
+	git_str_dispose(&packed_refs);
+}
+
+void test_refs_pack__auto_is_disabled_by_default(void)
+{
+	if (!cl_repo_has_ref_format(g_repo, "files"))
+		cl_skip();
+
+	create_in_transaction("refs/heads/auto-%03d", 50);
+	assert_packed("refs/heads/auto-000", false, true);
+}
@@ -3,6 +3,7 @@
 #include "futils.h"
 #include "git2/reflog.h"
 #include "reflog.h"
+#include "repository.h"
 
 static const char *new_ref = "refs/heads/test-reflog";
 static const char *current_master_tip = "a65fedf39aefe402d3bb6e24df4d4f5fe4547750";
@@ -279,6 +280,80 @@ void test_refs_reflog_reflog__reading_a_reflog_with_invalid_format_succeeds(void
 	git_str_dispose(&logcontents);
 }
 
+static void assert_lookups_match_read(const char *refname)
+{
+	git_reflog *reflog;
+	git_refdb *refdb;
+	git_oid id;
+	git_time_t time;
+	size_t i, j, count, entries;
+
+	cl_git_pass(git_repository_refdb__weakptr(&refdb, g_repo));
+	cl_git_pass(git_reflog_read(&reflog, g_repo, refname));
+	count = git_reflog_entrycount(reflog);
+	cl_assert(count > 0);
+
+	for (i = 0; i < count; i++) {
+		const git_reflog_entry *entry = git_reflog_entry_byindex(reflog, i);
+
+		cl_git_pass(git_reflog__id_byindex(&id, NULL, refdb, refname, i));
+		cl_assert_equal_oid(git_reflog_entry_id_new(entry), &id);
+
+		/* The most recent entry that is not newer than this one */
+		time = git_reflog_entry_committer(entry)->when.time;
+		for (j = 0; git_reflog_entry_committer(git_reflog_entry_byindex(reflog, j))->when.time > time; j++)
+			;
+
+		cl_git_pass(git_reflog__id_bytime(&id, refdb, refname, time));
+		cl_assert_equal_oid(git_reflog_entry_id_new(git_reflog_entry_byindex(reflog, j)), &id);
+	}
+
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_reflog__id_byindex(&id, &entries, refdb, refname, count));
+	cl_assert_equal_sz(count, entries);
+
+	/* Older than every entry resolves to the oldest one */
+	cl_git_pass(git_reflog__id_bytime(&id, refdb, refname, 0));
+	cl_assert_equal_oid(git_reflog_entry_id_new(
+		git_reflog_entry_byindex(reflog, count - 1)), &id);
+
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_reflog__id_byindex(&id, &entries, refdb, "refs/heads/nope", 0));
+	cl_assert_equal_sz(0, entries);
+
+	git_reflog_free(reflog);
+}
+
+void test_refs_reflog_reflog__lookup_by_index_and_time(void)
+{
+	assert_lookups_match_read("HEAD");
+	assert_lookups_match_read("refs/heads/master");
+}
+
+void test_refs_reflog_reflog__lookup_without_trailing_newline(void)
+{
+	git_str logpath = GIT_STR_INIT, logcontents = GIT_STR_INIT;
+	git_str rewritten = GIT_STR_INIT;
+
+	if (!cl_repo_has_ref_format(g_repo, "files"))
+		cl_skip();
+
+	cl_git_pass(git_str_join_n(&logpath, '/', 3, git_repository_path(g_repo), GIT_REFLOG_DIR, "HEAD"));
+	cl_git_pass(git_futils_readbuffer(&logcontents, git_str_cstr(&logpath)));
+	git_str_rtrim(&logcontents);
+
+	/* Start with an invalid entry, which is skipped */
+	cl_git_pass(git_str_puts(&rewritten, "invalid\n\n"));
+	cl_git_pass(git_str_put(&rewritten, logcontents.ptr, logcontents.size));
+	cl_git_rewritefile(git_str_cstr(&logpath), git_str_cstr(&rewritten));
+
+	assert_lookups_match_read("HEAD");
+
+	git_str_dispose(&logpath);
+	git_str_dispose(&logcontents);
+	git_str_dispose(&rewritten);
+}
+
 void test_refs_reflog_reflog__cannot_write_a_moved_reflog(void)
 {
 	git_reference *master, *new_master;
@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "git2/transaction.h"
+#include "futils.h"
 
 static git_repository *g_repo;
 static git_transaction *g_tx;
@@ -8,14 +9,20 @@ void test_refs_transactions__initialize(void)
 {
    g_repo = cl_git_sandbox_init("testrepo");
    cl_git_pass(git_transaction_new(&g_tx, g_repo));
-   if (!cl_repo_has_ref_format(g_repo, "files"))
-      cl_skip();
+}
+
+static void skip_unless_files(void)
+{
+	if (!cl_repo_has_ref_format(g_repo, "files"))
+		cl_skip();
 }
 
 void test_refs_transactions__cleanup(void)
 {
 	git_transaction_free(g_tx);
 	cl_git_sandbox_cleanup();
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_FSYNC_GITDIR, 0));
 }
 
 void test_refs_transactions__single_ref_oid(void)
@@ -117,7 +124,9 @@ void test_refs_transactions__error_on_locking_locked_ref(void)
 	git_transaction *g_tx_with_lock;
 	git_repository *g_repo_with_locking_tx;
 	const char *g_repo_path = git_repository_path(g_repo);
-	
+
+	skip_unless_files();
+
 	/* prepare a separate transaction in another instance of testrepo and lock master */
 	cl_git_pass(git_repository_open(&g_repo_with_locking_tx, g_repo_path));
 	cl_git_pass(git_transaction_new(&g_tx_with_lock, g_repo_with_locking_tx));
@@ -132,6 +141,59 @@ void test_refs_transactions__error_on_locking_locked_ref(void)
 	git_repository_free(g_repo_with_locking_tx);
 }
 
+static void skip_unless_reftable(void)
+{
+	if (!cl_repo_has_ref_format(g_repo, "reftable"))
+		cl_skip();
+}
+
+void test_refs_transactions__error_on_committing_ref_modified_since_locking(void)
+{
+	git_reference *ref;
+	git_oid id, other_id;
+
+	/* reftable has no per-reference locks, so only the commit can fail */
+	skip_unless_reftable();
+
+	git_oid_from_string(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", GIT_OID_SHA1);
+	git_oid_from_string(&other_id, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644", GIT_OID_SHA1);
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/master", &id, NULL, NULL));
+
+	cl_git_pass(git_reference_create(&ref, g_repo, "refs/heads/master", &other_id, 1, NULL));
+	git_reference_free(ref);
+
+	cl_git_fail_with(GIT_EMODIFIED, git_transaction_commit(g_tx));
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/master"));
+	cl_assert(!git_oid_cmp(&other_id, git_reference_target(ref)));
+	git_reference_free(ref);
+}
+
+void test_refs_transactions__error_on_committing_ref_created_since_locking(void)
+{
+	git_reference *ref;
+	git_oid id, other_id;
+
+	skip_unless_reftable();
+
+	git_oid_from_string(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", GIT_OID_SHA1);
+	git_oid_from_string(&other_id, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644", GIT_OID_SHA1);
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/created"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/created", &id, NULL, NULL));
+
+	cl_git_pass(git_reference_create(&ref, g_repo, "refs/heads/created", &other_id, 0, NULL));
+	git_reference_free(ref);
+
+	cl_git_fail_with(GIT_EMODIFIED, git_transaction_commit(g_tx));
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/created"));
+	cl_assert(!git_oid_cmp(&other_id, git_reference_target(ref)));
+	git_reference_free(ref);
+}
+
 void test_refs_transactions__commit_unlocks_unmodified_ref(void)
 {
 	git_transaction *second_tx;
@@ -157,3 +219,116 @@ void test_refs_transactions__free_unlocks_unmodified_ref(void)
 	/* a transaction must now be able to get the lock */
 	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
 }
+
+void test_refs_transactions__fsync_is_batched(void)
+{
+	git_reference *ref;
+	git_oid id;
+
+	skip_unless_files();
+
+	git_oid_from_string(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", GIT_OID_SHA1);
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_FSYNC_GITDIR, 1));
+	p_fsync__cnt = 0;
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/batched-one"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/batched-two"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/master", &id, NULL, "batched"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/batched-one", &id, NULL, "batched"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/batched-two", &id, NULL, "batched"));
+	cl_git_pass(git_transaction_commit(g_tx));
+
+#ifdef GIT_SYNCFS
+	cl_assert_equal_sz(0, p_fsync__cnt);
+#endif
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/batched-two"));
+	cl_assert(!git_oid_cmp(&id, git_reference_target(ref)));
+	git_reference_free(ref);
+
+	cl_assert(!git_fs_path_exists("testrepo/.git/refs/heads/batched-one.lock"));
+}
+
+void test_refs_transactions__delete_many_refs(void)
+{
+	const char *deleted[] = {
+		"refs/heads/packed", "refs/heads/packed-test",
+		"refs/tags/packed-tag", "refs/heads/br2", "refs/tags/foo/bar"
+	};
+	git_reference *ref;
+	git_oid id;
+	size_t i;
+
+	git_oid_from_string(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", GIT_OID_SHA1);
+
+	for (i = 0; i < ARRAY_SIZE(deleted); i++) {
+		cl_git_pass(git_transaction_lock_ref(g_tx, deleted[i]));
+		cl_git_pass(git_transaction_remove(g_tx, deleted[i]));
+	}
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/master", &id, NULL, NULL));
+	cl_git_pass(git_transaction_commit(g_tx));
+
+	for (i = 0; i < ARRAY_SIZE(deleted); i++)
+		cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, deleted[i]));
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/master"));
+	cl_assert(!git_oid_cmp(&id, git_reference_target(ref)));
+	git_reference_free(ref);
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/subtrees"));
+	git_reference_free(ref);
+}
+
+void test_refs_transactions__delete_many_refs_rewrites_packed_refs(void)
+{
+	git_str packed_refs = GIT_STR_INIT;
+	git_reference *ref;
+
+	skip_unless_files();
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/packed"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/packed-test"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/br2"));
+	cl_git_pass(git_transaction_remove(g_tx, "refs/heads/packed"));
+	cl_git_pass(git_transaction_remove(g_tx, "refs/heads/packed-test"));
+	cl_git_pass(git_transaction_remove(g_tx, "refs/heads/br2"));
+	cl_git_pass(git_transaction_commit(g_tx));
+
+	cl_git_pass(git_futils_readbuffer(&packed_refs, "testrepo/.git/packed-refs"));
+	cl_assert(strstr(packed_refs.ptr, "refs/heads/packed\n") == NULL);
+	cl_assert(strstr(packed_refs.ptr, "refs/heads/packed-test\n") == NULL);
+	cl_assert(strstr(packed_refs.ptr, "refs/tags/packed-tag\n") != NULL);
+
+	cl_assert(!git_fs_path_exists("testrepo/.git/packed-refs.lock"));
+	cl_assert(!git_fs_path_exists("testrepo/.git/refs/heads/packed-test"));
+	cl_assert(!git_fs_path_exists("testrepo/.git/refs/heads/packed-test.lock"));
+	cl_assert(!git_fs_path_exists("testrepo/.git/refs/heads/br2"));
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/tags/packed-tag"));
+	git_reference_free(ref);
+
+	git_str_dispose(&packed_refs);
+}
+
+void test_refs_transactions__delete_fails_when_packed_refs_is_locked(void)
+{
+	git_reference *ref;
+
+	skip_unless_files();
+
+	cl_git_mkfile("testrepo/.git/packed-refs.lock", "");
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/packed-test"));
+	cl_git_pass(git_transaction_remove(g_tx, "refs/heads/packed-test"));
+	cl_git_fail(git_transaction_commit(g_tx));
+
+	/* neither the loose nor the packed reference has been removed */
+	cl_assert(git_fs_path_exists("testrepo/.git/refs/heads/packed-test"));
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/packed-test"));
+	git_reference_free(ref);
+
+	cl_must_pass(p_unlink("testrepo/.git/packed-refs.lock"));
+}
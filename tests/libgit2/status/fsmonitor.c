@@ -0,0 +1,510 @@
+#include "clar_libgit2.h"
+#include "futils.h"
+#include "fsmonitor_daemon.h"
+#include "index.h"
+#include "repository.h"
+#include "git2/sys/fsmonitor.h"
+
+#if defined(GIT_FSMONITOR_INOTIFY) && defined(GIT_THREADS)
+# define RUN_DAEMON
+#endif
+
+typedef struct {
+	git_fsmonitor parent;
+	int queries;
+	bool passthrough;
+	const char *changed[4];
+	char token[16];
+} test_fsmonitor;
+
+static git_repository *g_repo;
+static test_fsmonitor g_fsmonitor;
+
+#ifdef RUN_DAEMON
+static git_fsmonitor_daemon *g_daemon;
+static git_thread g_daemon_thread;
+static int g_daemon_result;
+
+static void *run_daemon(void *payload)
+{
+	GIT_UNUSED(payload);
+
+	g_daemon_result = git_fsmonitor_daemon_run(g_daemon);
+	return NULL;
+}
+
+static void start_daemon(void)
+{
+	cl_git_pass(git_fsmonitor_daemon_new(&g_daemon, g_repo));
+	cl_git_pass(git_thread_create(&g_daemon_thread, run_daemon, NULL));
+}
+
+static void stop_daemon(bool quit)
+{
+	git_str response = GIT_STR_INIT;
+
+	if (!g_daemon)
+		return;
+
+	if (quit)
+		cl_git_pass(git_fsmonitor_daemon__send(&response, g_repo, "quit"));
+	else
+		git_fsmonitor_daemon_stop(g_daemon);
+
+	cl_git_pass(git_thread_join(&g_daemon_thread, NULL));
+	cl_git_pass(g_daemon_result);
+
+	git_fsmonitor_daemon_free(g_daemon);
+	g_daemon = NULL;
+
+	git_str_dispose(&response);
+}
+
+static void query_daemon(git_str *response, const char *token)
+{
+	git_str_clear(response);
+	cl_git_pass(git_fsmonitor_daemon__send(response, g_repo, token));
+	cl_assert(git__prefixcmp(response->ptr, "builtin:") == 0);
+}
+
+/* whether the paths following the token in a response include `path` */
+static bool daemon_reports(git_str *response, const char *path)
+{
+	const char *p = response->ptr + strlen(response->ptr) + 1;
+	const char *end = response->ptr + response->size;
+
+	for (; p < end; p += strlen(p) + 1) {
+		if (!strcmp(p, path))
+			return true;
+	}
+
+	return false;
+}
+
+static size_t daemon_reported(git_str *response)
+{
+	const char *p = response->ptr + strlen(response->ptr) + 1;
+	const char *end = response->ptr + response->size;
+	size_t count = 0;
+
+	for (; p < end; p += strlen(p) + 1)
+		count++;
+
+	return count;
+}
+#endif
+
+static int test_fsmonitor_query(
+	git_fsmonitor *fsmonitor,
+	const char *token,
+	git_fsmonitor_changes *changes)
+{
+	test_fsmonitor *monitor = (test_fsmonitor *)fsmonitor;
+	size_t i;
+
+	GIT_UNUSED(token);
+
+	monitor->queries++;
+
+	if (monitor->passthrough)
+		return GIT_PASSTHROUGH;
+
+	for (i = 0; monitor->changed[i]; i++)
+		cl_git_pass(git_fsmonitor_changes_add(changes, monitor->changed[i]));
+
+	p_snprintf(monitor->token, sizeof(monitor->token), "%d", monitor->queries);
+	return git_fsmonitor_changes_set_token(changes, monitor->token);
+}
+
+void test_status_fsmonitor__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("status");
+
+	memset(&g_fsmonitor, 0, sizeof(g_fsmonitor));
+	cl_git_pass(git_fsmonitor_init(&g_fsmonitor.parent, GIT_FSMONITOR_VERSION));
+	g_fsmonitor.parent.query = test_fsmonitor_query;
+}
+
+void test_status_fsmonitor__cleanup(void)
+{
+#ifdef RUN_DAEMON
+	stop_daemon(false);
+#endif
+
+	cl_git_sandbox_cleanup();
+}
+
+static int age_path(void *payload, git_str *path)
+{
+	time_t when = time(NULL) - 60;
+
+	if (!git__suffixcmp(path->ptr, "/.git"))
+		return 0;
+
+	if (git_fs_path_isdir(path->ptr))
+		cl_git_pass(git_fs_path_direach(path, 0, age_path, payload));
+
+	cl_git_pass(git_futils_touch(path->ptr, &when));
+	return 0;
+}
+
+/* files that are newer than the index are always examined again */
+static void age_workdir(void)
+{
+	git_str path = GIT_STR_INIT;
+
+	cl_git_pass(git_str_sets(&path, git_repository_workdir(g_repo)));
+	git_str_rtrim(&path);
+	age_path(NULL, &path);
+	git_str_dispose(&path);
+}
+
+static void update_index(void)
+{
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+	git_status_list *status;
+
+	opts.flags = GIT_STATUS_OPT_DEFAULTS | GIT_STATUS_OPT_UPDATE_INDEX;
+
+	cl_git_pass(git_status_list_new(&status, g_repo, &opts));
+	git_status_list_free(status);
+}
+
+static git_index *repository_index(void)
+{
+	git_index *index;
+
+	cl_git_pass(git_repository_index__weakptr(&index, g_repo));
+	return index;
+}
+
+static bool entry_is_valid(git_index *index, const char *path)
+{
+	const git_index_entry *entry;
+
+	cl_assert((entry = git_index_get_bypath(index, path, 0)) != NULL);
+	return (entry->flags_extended & GIT_INDEX_ENTRY_FSMONITOR_VALID) != 0;
+}
+
+static unsigned int status_of(const char *path)
+{
+	unsigned int status;
+
+	cl_git_pass(git_status_file(&status, g_repo, path));
+	return status;
+}
+
+/* sets up an index where the unchanged entries are known to be valid */
+static void monitor_workdir(void)
+{
+	cl_git_pass(git_repository_set_fsmonitor(g_repo, &g_fsmonitor.parent));
+
+	age_workdir();
+
+	/* refresh the stat data in the index, then record what matches */
+	update_index();
+	update_index();
+}
+
+void test_status_fsmonitor__records_unchanged_entries(void)
+{
+	git_index *index;
+
+	monitor_workdir();
+
+	index = repository_index();
+	cl_assert_equal_s(g_fsmonitor.token, index->fsmonitor_token);
+	cl_assert(entry_is_valid(index, "current_file"));
+	cl_assert(entry_is_valid(index, "subdir/current_file"));
+	cl_assert(!entry_is_valid(index, "modified_file"));
+	cl_assert(!index->fsmonitor_changed);
+
+	/* the state was written with the index */
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert_equal_s(g_fsmonitor.token, index->fsmonitor_token);
+	cl_assert(entry_is_valid(index, "current_file"));
+	cl_assert(entry_is_valid(index, "subdir/current_file"));
+	cl_assert(!entry_is_valid(index, "modified_file"));
+	git_index_free(index);
+}
+
+void test_status_fsmonitor__skips_unreported_files(void)
+{
+	monitor_workdir();
+
+	/* a change that is not reported goes unnoticed */
+	cl_git_append2file("status/current_file", "changed\n");
+	cl_assert_equal_i(GIT_STATUS_CURRENT, status_of("current_file"));
+
+	g_fsmonitor.changed[0] = "current_file";
+	cl_assert_equal_i(GIT_STATUS_WT_MODIFIED, status_of("current_file"));
+	cl_assert(!entry_is_valid(repository_index(), "current_file"));
+}
+
+void test_status_fsmonitor__reports_directories(void)
+{
+	monitor_workdir();
+
+	cl_git_append2file("status/subdir/current_file", "changed\n");
+
+	g_fsmonitor.changed[0] = "subdir/";
+	cl_assert_equal_i(GIT_STATUS_WT_MODIFIED, status_of("subdir/current_file"));
+	cl_assert(!entry_is_valid(repository_index(), "subdir/current_file"));
+	cl_assert(entry_is_valid(repository_index(), "current_file"));
+}
+
+void test_status_fsmonitor__passthrough_examines_everything(void)
+{
+	git_index *index;
+
+	monitor_workdir();
+
+	cl_git_append2file("status/current_file", "changed\n");
+
+	g_fsmonitor.passthrough = true;
+	cl_assert_equal_i(GIT_STATUS_WT_MODIFIED, status_of("current_file"));
+
+	index = repository_index();
+	cl_assert_equal_p(NULL, index->fsmonitor_token);
+	cl_assert(!entry_is_valid(index, "subdir/current_file"));
+}
+
+void test_status_fsmonitor__new_entries_are_not_valid(void)
+{
+	git_index *index;
+
+	monitor_workdir();
+
+	index = repository_index();
+	cl_git_pass(git_index_add_bypath(index, "new_file"));
+	cl_assert(!entry_is_valid(index, "new_file"));
+	cl_git_pass(git_index_write(index));
+
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert(!entry_is_valid(index, "new_file"));
+	cl_assert(entry_is_valid(index, "current_file"));
+	git_index_free(index);
+}
+
+void test_status_fsmonitor__removed_without_monitor(void)
+{
+	git_index *index;
+
+	monitor_workdir();
+
+	cl_git_pass(git_repository_set_fsmonitor(g_repo, NULL));
+
+	index = repository_index();
+	index->dirty = 1;
+	cl_git_pass(git_index_write(index));
+	cl_assert_equal_p(NULL, index->fsmonitor_token);
+
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert_equal_p(NULL, index->fsmonitor_token);
+	cl_assert(!entry_is_valid(index, "current_file"));
+	git_index_free(index);
+}
+
+void test_status_fsmonitor__runs_hook(void)
+{
+#ifndef GIT_WIN32
+	git_str hook = GIT_STR_INIT;
+	git_index *index;
+
+	cl_git_pass(git_str_joinpath(&hook,
+		git_repository_path(g_repo), "fsmonitor-hook"));
+	cl_git_mkfile(hook.ptr,
+		"#!/bin/sh\n"
+		"test \"$1\" = 2 || exit 1\n"
+		"printf 'token-%s\\0current_file\\0' \"$1\"\n");
+	cl_must_pass(p_chmod(hook.ptr, 0755));
+
+	cl_repo_set_string(g_repo, "core.fsmonitor", hook.ptr);
+
+	age_workdir();
+	update_index();
+	update_index();
+
+	index = repository_index();
+	cl_assert_equal_s("token-2", index->fsmonitor_token);
+	cl_assert(entry_is_valid(index, "subdir/current_file"));
+
+	/* the reported file is examined again */
+	cl_git_append2file("status/current_file", "changed\n");
+	cl_assert_equal_i(GIT_STATUS_WT_MODIFIED, status_of("current_file"));
+
+	/* a boolean selects a builtin monitor, which is not the hook */
+	cl_repo_set_bool(g_repo, "core.fsmonitor", false);
+	update_index();
+	cl_assert_equal_p(NULL, repository_index()->fsmonitor_token);
+
+	git_str_dispose(&hook);
+#endif
+}
+
+void test_status_fsmonitor__without_daemon(void)
+{
+	git_str response = GIT_STR_INIT;
+
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_fsmonitor_daemon__send(&response, g_repo, "builtin:fake"));
+
+	/* everything is examined */
+	cl_repo_set_bool(g_repo, "core.fsmonitor", true);
+	cl_git_append2file("status/current_file", "changed\n");
+	update_index();
+
+	cl_assert_equal_i(GIT_STATUS_WT_MODIFIED, status_of("current_file"));
+	cl_assert_equal_p(NULL, repository_index()->fsmonitor_token);
+
+	git_str_dispose(&response);
+}
+
+void test_status_fsmonitor__daemon_reports_changes(void)
+{
+#ifndef RUN_DAEMON
+	cl_skip();
+#else
+	git_str response = GIT_STR_INIT, token = GIT_STR_INIT;
+
+	start_daemon();
+
+	/* a token that it did not hand out is answered with everything */
+	query_daemon(&response, "builtin:fake");
+	cl_assert(daemon_reports(&response, "/"));
+	cl_git_pass(git_str_sets(&token, response.ptr));
+
+	cl_git_append2file("status/current_file", "changed\n");
+	cl_must_pass(p_unlink("status/subdir/current_file"));
+	cl_must_pass(p_mkdir("status/new_dir", 0777));
+	cl_git_mkfile("status/new_dir/file", "new\n");
+
+	query_daemon(&response, token.ptr);
+	cl_assert(daemon_reports(&response, "current_file"));
+	cl_assert(daemon_reports(&response, "subdir/current_file"));
+	cl_assert(daemon_reports(&response, "new_dir/"));
+	cl_assert(!daemon_reports(&response, "modified_file"));
+	cl_git_pass(git_str_sets(&token, response.ptr));
+
+	/* nothing changed since */
+	query_daemon(&response, token.ptr);
+	cl_assert_equal_sz(0, daemon_reported(&response));
+
+	/* new directories are watched as well */
+	cl_git_mkfile("status/new_dir/other", "new\n");
+
+	query_daemon(&response, token.ptr);
+	cl_assert(daemon_reports(&response, "new_dir/other"));
+	cl_assert(!daemon_reports(&response, "current_file"));
+
+	/* the repository is not part of the working directory */
+	cl_git_mkfile("status/.git/scratch", "new\n");
+
+	query_daemon(&response, token.ptr);
+	cl_assert(!daemon_reports(&response, ".git/scratch"));
+
+	stop_daemon(true);
+
+	git_str_dispose(&response);
+	git_str_dispose(&token);
+#endif
+}
+
+void test_status_fsmonitor__daemon_flush_invalidates_tokens(void)
+{
+#ifndef RUN_DAEMON
+	cl_skip();
+#else
+	git_str response = GIT_STR_INIT, token = GIT_STR_INIT;
+
+	start_daemon();
+
+	query_daemon(&response, "builtin:fake");
+	cl_git_pass(git_str_sets(&token, response.ptr));
+
+	/* hook tokens cannot be answered */
+	query_daemon(&response, "1234567890");
+	cl_assert(daemon_reports(&response, "/"));
+
+	query_daemon(&response, "flush");
+	cl_assert(daemon_reports(&response, "/"));
+
+	query_daemon(&response, token.ptr);
+	cl_assert(daemon_reports(&response, "/"));
+
+	git_str_dispose(&response);
+	git_str_dispose(&token);
+#endif
+}
+
+void test_status_fsmonitor__daemon_rejects_large_requests(void)
+{
+#ifndef RUN_DAEMON
+	cl_skip();
+#else
+	git_str response = GIT_STR_INIT, request = GIT_STR_INIT;
+
+	start_daemon();
+
+	/* a request spans more than one pkt-line */
+	cl_git_pass(git_str_putcn(&request, 'x', 100000));
+	cl_git_fail(git_fsmonitor_daemon__send(&response, g_repo, request.ptr));
+
+	/* the daemon keeps serving */
+	query_daemon(&response, "builtin:fake");
+	cl_assert(daemon_reports(&response, "/"));
+
+	stop_daemon(true);
+
+	git_str_dispose(&response);
+	git_str_dispose(&request);
+#endif
+}
+
+void test_status_fsmonitor__daemon_runs_once(void)
+{
+#ifndef RUN_DAEMON
+	cl_skip();
+#else
+	git_fsmonitor_daemon *daemon;
+	git_str response = GIT_STR_INIT;
+
+	start_daemon();
+	cl_git_fail_with(GIT_EEXISTS, git_fsmonitor_daemon_new(&daemon, g_repo));
+
+	/* the socket is removed when it stops */
+	stop_daemon(true);
+	cl_assert(!git_fs_path_exists("status/.git/" GIT_FSMONITOR_DAEMON_SOCKET));
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_fsmonitor_daemon__send(&response, g_repo, "builtin:fake"));
+
+	git_str_dispose(&response);
+#endif
+}
+
+void test_status_fsmonitor__status_uses_daemon(void)
+{
+#ifndef RUN_DAEMON
+	cl_skip();
+#else
+	git_index *index;
+
+	cl_repo_set_bool(g_repo, "core.fsmonitor", true);
+
+	start_daemon();
+
+	age_workdir();
+	update_index();
+	update_index();
+
+	index = repository_index();
+	cl_assert(git__prefixcmp(index->fsmonitor_token, "builtin:") == 0);
+	cl_assert(entry_is_valid(index, "current_file"));
+	cl_assert(entry_is_valid(index, "subdir/current_file"));
+
+	cl_git_append2file("status/current_file", "changed\n");
+	cl_assert_equal_i(GIT_STATUS_WT_MODIFIED, status_of("current_file"));
+	cl_assert(!entry_is_valid(repository_index(), "current_file"));
+	cl_assert(entry_is_valid(repository_index(), "subdir/current_file"));
+#endif
+}
@@ -0,0 +1,75 @@
+#include "clar_libgit2.h"
+#include "futils.h"
+
+static git_repository *g_repo;
+
+void test_status_preload__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("status");
+}
+
+void test_status_preload__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static void status_to_str(git_str *out)
+{
+	git_status_list *status;
+	size_t i;
+
+	git_str_clear(out);
+
+	cl_git_pass(git_status_list_new(&status, g_repo, NULL));
+
+	for (i = 0; i < git_status_list_entrycount(status); i++) {
+		const git_status_entry *entry = git_status_byindex(status, i);
+		const git_diff_delta *delta = entry->index_to_workdir ?
+			entry->index_to_workdir : entry->head_to_index;
+
+		cl_git_pass(git_str_printf(out, "%s %x\n",
+			delta->old_file.path, entry->status));
+	}
+
+	git_status_list_free(status);
+}
+
+static void assert_preload_matches(void)
+{
+	git_str expected = GIT_STR_INIT, actual = GIT_STR_INIT;
+
+	cl_repo_set_bool(g_repo, "core.preloadIndex", false);
+	status_to_str(&expected);
+
+	cl_repo_set_bool(g_repo, "core.preloadIndex", true);
+	cl_repo_set_int(g_repo, "index.threads", 4);
+	status_to_str(&actual);
+
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+
+	git_str_dispose(&expected);
+	git_str_dispose(&actual);
+}
+
+void test_status_preload__matches_status_without_preload(void)
+{
+	assert_preload_matches();
+}
+
+void test_status_preload__finds_modified_files(void)
+{
+	git_str status = GIT_STR_INIT;
+
+	/* the same size, but a later modification time */
+	cl_git_rewritefile("status/current_file", "CURRENT_FILE\n");
+	cl_must_pass(p_unlink("status/subdir/current_file"));
+	cl_git_mkfile("status/subdir/current_file", "");
+
+	assert_preload_matches();
+
+	status_to_str(&status);
+	cl_assert(strstr(status.ptr, "current_file 100\n") != NULL);
+	cl_assert(strstr(status.ptr, "subdir/current_file 100\n") != NULL);
+
+	git_str_dispose(&status);
+}
@@ -0,0 +1,243 @@
+#include "clar_libgit2.h"
+#include "futils.h"
+#include "index.h"
+#include "repository.h"
+#include "untracked_cache.h"
+
+static git_repository *g_repo;
+
+void test_status_untrackedcache__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("status");
+
+	cl_git_mkfile("status/subdir/untracked_file", "untracked\n");
+	cl_must_pass(p_mkdir("status/untracked_dir", 0777));
+	cl_git_mkfile("status/untracked_dir/file", "untracked\n");
+}
+
+void test_status_untrackedcache__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static int age_directory(void *payload, git_str *path)
+{
+	time_t when = time(NULL) - 60;
+
+	if (!git_fs_path_isdir(path->ptr) || !git__suffixcmp(path->ptr, "/.git"))
+		return 0;
+
+	cl_git_pass(git_fs_path_direach(path, 0, age_directory, payload));
+	cl_git_pass(git_futils_touch(path->ptr, &when));
+	return 0;
+}
+
+/* directories are only recorded once their timestamp is in the past */
+static void age_workdir(void)
+{
+	git_str path = GIT_STR_INIT;
+
+	cl_git_pass(git_str_sets(&path, git_repository_workdir(g_repo)));
+	git_str_rtrim(&path);
+	age_directory(NULL, &path);
+	git_str_dispose(&path);
+}
+
+static int collect_status(const char *path, unsigned int status, void *payload)
+{
+	git_str_printf((git_str *)payload, "%s:%u\n", path, status);
+	return 0;
+}
+
+static void status_list(git_str *out)
+{
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+
+	opts.flags = GIT_STATUS_OPT_DEFAULTS | GIT_STATUS_OPT_UPDATE_INDEX;
+
+	git_str_clear(out);
+	cl_git_pass(git_status_foreach_ext(g_repo, &opts, collect_status, out));
+}
+
+/* the status with and without the untracked cache must be identical */
+static void assert_status_unchanged_by_cache(void)
+{
+	git_str expected = GIT_STR_INIT, actual = GIT_STR_INIT;
+
+	cl_repo_set_bool(g_repo, "core.untrackedCache", false);
+	status_list(&expected);
+
+	cl_repo_set_bool(g_repo, "core.untrackedCache", true);
+	status_list(&actual);
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+
+	status_list(&actual);
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+
+	git_str_dispose(&expected);
+	git_str_dispose(&actual);
+}
+
+static git_untracked_cache *repository_untracked_cache(void)
+{
+	git_index *index;
+
+	cl_git_pass(git_repository_index__weakptr(&index, g_repo));
+	return index->untracked;
+}
+
+static bool cached_in_dir(git_untracked_cache *cache, const char *dir, const char *name)
+{
+	git_untracked_cache_dir *cache_dir;
+	const char *cached;
+	size_t i;
+
+	cl_git_pass(git_untracked_cache_dir_lookup(&cache_dir, cache, dir));
+	cl_assert(cache_dir->valid);
+
+	git_vector_foreach(&cache_dir->untracked, i, cached) {
+		if (strcmp(cached, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+void test_status_untrackedcache__records_untracked_files(void)
+{
+	git_untracked_cache *cache;
+	git_index *index;
+
+	age_workdir();
+	assert_status_unchanged_by_cache();
+
+	cl_assert((cache = repository_untracked_cache()) != NULL);
+	cl_assert(cached_in_dir(cache, "", "new_file"));
+	cl_assert(cached_in_dir(cache, "", "ignored_file"));
+	cl_assert(cached_in_dir(cache, "", "untracked_dir/"));
+	cl_assert(cached_in_dir(cache, "subdir/", "untracked_file"));
+	cl_assert(!cached_in_dir(cache, "", "current_file"));
+	cl_assert(!cached_in_dir(cache, "", "subdir/"));
+	cl_assert(!cached_in_dir(cache, "", ".git/"));
+
+	/* the cache was written with the index */
+	cl_git_pass(git_index_open(&index, "status/.git/index"));
+	cl_assert(index->untracked != NULL);
+	cl_assert(cached_in_dir(index->untracked, "subdir/", "untracked_file"));
+	git_index_free(index);
+}
+
+void test_status_untrackedcache__skips_unchanged_directories(void)
+{
+	git_untracked_cache_dir *cache_dir;
+	git_str actual = GIT_STR_INIT;
+	char *name;
+	size_t i;
+
+	age_workdir();
+	assert_status_unchanged_by_cache();
+
+	/* forget a file; the directory is not read again while it's unchanged */
+	cl_git_pass(git_untracked_cache_dir_lookup(&cache_dir,
+		repository_untracked_cache(), "subdir/"));
+
+	git_vector_foreach(&cache_dir->untracked, i, name) {
+		if (strcmp(name, "untracked_file") == 0) {
+			git_vector_remove(&cache_dir->untracked, i);
+			git__free(name);
+			break;
+		}
+	}
+
+	status_list(&actual);
+	cl_assert(strstr(actual.ptr, "subdir/untracked_file") == NULL);
+
+	/* once the directory changes, it's read again */
+	cl_git_mkfile("status/subdir/another_file", "another\n");
+
+	status_list(&actual);
+	cl_assert(strstr(actual.ptr, "subdir/untracked_file") != NULL);
+	cl_assert(strstr(actual.ptr, "subdir/another_file") != NULL);
+
+	git_str_dispose(&actual);
+}
+
+void test_status_untrackedcache__follows_index_changes(void)
+{
+	git_index *index;
+
+	age_workdir();
+	assert_status_unchanged_by_cache();
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_bypath(index, "subdir/untracked_file"));
+	cl_git_pass(git_index_add_bypath(index, "untracked_dir/file"));
+	cl_git_pass(git_index_remove_bypath(index, "subdir/current_file"));
+	cl_git_pass(git_index_remove_bypath(index, "current_file"));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	assert_status_unchanged_by_cache();
+
+	cl_assert(cached_in_dir(repository_untracked_cache(), "", "current_file"));
+	cl_assert(!cached_in_dir(repository_untracked_cache(), "", "untracked_dir/"));
+}
+
+void test_status_untrackedcache__follows_workdir_changes(void)
+{
+	age_workdir();
+	assert_status_unchanged_by_cache();
+
+	cl_git_rmfile("status/new_file");
+	cl_git_rmfile("status/subdir/untracked_file");
+	cl_git_mkfile("status/untracked_dir/another_file", "another\n");
+	cl_must_pass(p_mkdir("status/subdir/nested", 0777));
+	cl_git_mkfile("status/subdir/nested/file", "nested\n");
+
+	assert_status_unchanged_by_cache();
+}
+
+void test_status_untrackedcache__can_be_disabled(void)
+{
+	git_index *index;
+
+	age_workdir();
+	assert_status_unchanged_by_cache();
+	cl_assert(repository_untracked_cache() != NULL);
+
+	cl_repo_set_bool(g_repo, "core.untrackedCache", false);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_write(index));
+	cl_assert_equal_p(NULL, index->untracked);
+	cl_git_pass(git_index_read(index, true));
+	cl_assert_equal_p(NULL, index->untracked);
+	git_index_free(index);
+}
+
+void test_status_untrackedcache__roundtrips(void)
+{
+	git_untracked_cache *cache, *read, *truncated;
+	git_str written = GIT_STR_INIT, rewritten = GIT_STR_INIT;
+
+	age_workdir();
+	assert_status_unchanged_by_cache();
+
+	cl_assert((cache = repository_untracked_cache()) != NULL);
+	cl_git_pass(git_untracked_cache_write(&written, cache));
+
+	cl_git_pass(git_untracked_cache_read(&read, written.ptr, written.size, GIT_OID_SHA1));
+	cl_assert(git_untracked_cache_usable(read, git_repository_workdir(g_repo)));
+	cl_assert(!git_untracked_cache_usable(read, "/some/other/workdir/"));
+
+	cl_git_pass(git_untracked_cache_write(&rewritten, read));
+	cl_assert_equal_sz(written.size, rewritten.size);
+	cl_assert(memcmp(written.ptr, rewritten.ptr, written.size) == 0);
+
+	/* truncated data is rejected */
+	cl_git_fail(git_untracked_cache_read(&truncated, written.ptr, written.size - 1, GIT_OID_SHA1));
+
+	git_untracked_cache_free(read);
+	git_str_dispose(&written);
+	git_str_dispose(&rewritten);
+}
@@ -304,3 +304,66 @@ void test_dirent__diriter_at_directory_root(void)
 	git_fs_path_diriter_free(&diriter);
 	git__free(root_path);
 }
+
+/* the directory is read in batches that hold about 1000 of these */
+#define DIRITER_TYPES_FILES 2500
+
+void test_dirent__diriter_type_and_stat(void)
+{
+	git_fs_path_diriter diriter = GIT_FS_PATH_DIRITER_INIT;
+	git_str path = GIT_STR_INIT;
+	struct stat st, expected;
+	const char *fullpath;
+	size_t fullpath_len, files = 0, dirs = 0, links = 0;
+	int i, type, error;
+
+	cl_must_pass(p_mkdir("types", 0777));
+	cl_must_pass(p_mkdir("types/dir", 0777));
+
+	for (i = 0; i < DIRITER_TYPES_FILES; i++) {
+		git_str_clear(&path);
+		cl_git_pass(git_str_printf(&path,
+			"types/a-file-with-a-rather-long-name-%04d", i));
+		cl_git_mkfile(path.ptr, "contents\n");
+	}
+
+#ifndef GIT_WIN32
+	cl_must_pass(p_symlink("dir", "types/link"));
+#endif
+
+	cl_git_pass(git_fs_path_diriter_init(&diriter, "types", 0));
+
+	while ((error = git_fs_path_diriter_next(&diriter)) == 0) {
+		cl_git_pass(git_fs_path_diriter_fullpath(&fullpath, &fullpath_len, &diriter));
+		cl_git_pass(git_fs_path_diriter_stat(&st, &diriter));
+		cl_must_pass(p_lstat(fullpath, &expected));
+
+		cl_assert_equal_i(expected.st_mode, st.st_mode);
+		cl_assert_equal_i(expected.st_size, st.st_size);
+
+		/* the type is either known from the listing or not at all */
+		type = git_fs_path_diriter_type(&diriter);
+		cl_assert(type == 0 || type == (int)(st.st_mode & S_IFMT));
+
+		if (S_ISDIR(st.st_mode))
+			dirs++;
+		else if (S_ISLNK(st.st_mode))
+			links++;
+		else if (S_ISREG(st.st_mode))
+			files++;
+	}
+
+	cl_assert_equal_i(error, GIT_ITEROVER);
+	cl_assert_equal_sz(DIRITER_TYPES_FILES, files);
+	cl_assert_equal_sz(1, dirs);
+#ifndef GIT_WIN32
+	cl_assert_equal_sz(1, links);
+#else
+	cl_assert_equal_sz(0, links);
+#endif
+
+	git_fs_path_diriter_free(&diriter);
+	git_str_dispose(&path);
+
+	cl_git_pass(git_futils_rmdir_r("types", NULL, GIT_RMDIR_REMOVE_FILES));
+}
@@ -113,3 +113,36 @@ void test_futils__mktmp_umask(void)
 	git_str_dispose(&path);
 #endif
 }
+
+void test_futils__fsync_batch_remove(void)
+{
+	git_futils_fsync_batch batch;
+	git_str path = GIT_STR_INIT;
+	int fd;
+
+	cl_git_pass(git_futils_fsync_batch_init(&batch));
+
+	cl_git_mkfile("futils/removed.lock", "removed\n");
+	cl_git_mkfile("futils/kept.lock", "kept\n");
+
+	cl_must_pass(fd = p_open("futils/removed.lock", O_RDONLY));
+	cl_git_pass(git_futils_fsync_batch_add(&batch, fd, "futils/removed.lock", "futils/removed"));
+	cl_must_pass(p_close(fd));
+
+	cl_must_pass(fd = p_open("futils/kept.lock", O_RDONLY));
+	cl_git_pass(git_futils_fsync_batch_add(&batch, fd, "futils/kept.lock", "futils/kept"));
+	cl_must_pass(p_close(fd));
+
+	cl_git_pass(git_futils_fsync_batch_remove(&batch, "futils/removed.lock"));
+	cl_git_fail_with(GIT_ENOTFOUND, git_futils_fsync_batch_remove(&batch, "futils/removed.lock"));
+	cl_git_fail_with(GIT_ENOTFOUND, git_futils_fsync_batch_lookup(&path, &batch, "futils/removed"));
+
+	/* the removed file is neither renamed nor deleted */
+	cl_git_pass(git_futils_fsync_batch_commit(&batch));
+	cl_assert(git_fs_path_exists("futils/removed.lock"));
+	cl_assert(!git_fs_path_exists("futils/removed"));
+	cl_assert(git_fs_path_exists("futils/kept"));
+
+	git_futils_fsync_batch_dispose(&batch);
+	git_str_dispose(&path);
+}
@@ -3,6 +3,7 @@
 #include "hashmap_str.h"
 
 GIT_HASHMAP_STR_SETUP(git_hashmap_test, char *);
+GIT_HASHSET_SETUP(git_hashset_test, const char *, git_hashmap_str_hash, git_hashmap_str_equal);
 
 static git_hashmap_test g_table;
 
@@ -225,3 +226,29 @@ void test_hashmap__iterating_empty_map_stops_immediately(void)
 
 	cl_git_fail_with(GIT_ITEROVER, git_hashmap_test_iterate(&iter, NULL, NULL, &g_table));
 }
+
+void test_hashmap__hashset_iteration(void)
+{
+	git_hashset_test set = {0};
+	const char *keys[] = { "foo", "bar", "gobble" }, *key;
+	int seen[ARRAY_SIZE(keys)] = {0};
+	git_hashmap_iter_t iter = GIT_HASHMAP_ITER_INIT;
+	size_t i, n = 0;
+
+	for (i = 0; i < ARRAY_SIZE(keys); i++)
+		cl_git_pass(git_hashset_test_add(&set, keys[i]));
+
+	while (git_hashset_test_iterate(&iter, &key, &set) == 0) {
+		for (i = 0; i < ARRAY_SIZE(keys); i++) {
+			if (!strcmp(keys[i], key))
+				seen[i]++;
+		}
+
+		cl_assert(++n <= ARRAY_SIZE(keys));
+	}
+
+	for (i = 0; i < ARRAY_SIZE(keys); i++)
+		cl_assert_equal_i(1, seen[i]);
+
+	git_hashset_test_dispose(&set);
+}
@@ -7,12 +7,20 @@
 static git_hash_win32_provider_t orig_provider;
 #endif
 
+#ifdef GIT_SHA1_BUILTIN
+static git_hash_sha1_accel_impl_t orig_accel_impl;
+#endif
+
 void test_sha1__initialize(void)
 {
 #ifdef GIT_SHA1_WIN32
 	orig_provider = git_hash_win32_provider();
 #endif
 
+#ifdef GIT_SHA1_BUILTIN
+	orig_accel_impl = git_hash_sha1_accel_impl();
+#endif
+
 	cl_fixture_sandbox(FIXTURE_DIR);
 }
 
@@ -22,10 +30,17 @@ void test_sha1__cleanup(void)
 	git_hash_win32_set_provider(orig_provider);
 #endif
 
+#ifdef GIT_SHA1_BUILTIN
+	cl_git_pass(git_hash_sha1_accel_set_impl(orig_accel_impl));
+#endif
+
 	cl_fixture_cleanup(FIXTURE_DIR);
 }
 
-static int sha1_file(unsigned char *out, const char *filename)
+static int sha1_file_ext(
+	unsigned char *out,
+	const char *filename,
+	unsigned int flags)
 {
 	git_hash_ctx ctx;
 	char buf[2048];
@@ -35,7 +50,7 @@ static int sha1_file(unsigned char *out, const char *filename)
 	fd = p_open(filename, O_RDONLY);
 	cl_assert(fd >= 0);
 
-	cl_git_pass(git_hash_ctx_init(&ctx, GIT_HASH_ALGORITHM_SHA1));
+	cl_git_pass(git_hash_ctx_init_ext(&ctx, GIT_HASH_ALGORITHM_SHA1, flags));
 
 	while ((read_len = p_read(fd, buf, 2048)) > 0)
 		cl_git_pass(git_hash_update(&ctx, buf, (size_t)read_len));
@@ -49,6 +64,11 @@ static int sha1_file(unsigned char *out, const char *filename)
 	return ret;
 }
 
+static int sha1_file(unsigned char *out, const char *filename)
+{
+	return sha1_file_ext(out, filename, 0);
+}
+
 void test_sha1__sum(void)
 {
 	unsigned char expected[GIT_HASH_SHA1_SIZE] = {
@@ -98,3 +118,62 @@ void test_sha1__win32_providers(void)
 	cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA1_SIZE));
 #endif
 }
+
+void test_sha1__trusted_skips_collision_detection(void)
+{
+	unsigned char expected[GIT_HASH_SHA1_SIZE] = {
+		0x38, 0x76, 0x2c, 0xf7, 0xf5, 0x59, 0x34, 0xb3, 0x4d, 0x17,
+		0x9a, 0xe6, 0xa4, 0xc8, 0x0c, 0xad, 0xcc, 0xbb, 0x7f, 0x0a
+	};
+	unsigned char actual[GIT_HASH_SHA1_SIZE];
+
+	cl_git_pass(sha1_file_ext(actual, FIXTURE_DIR "/shattered-1.pdf", GIT_HASH_TRUSTED));
+	cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA1_SIZE));
+}
+
+#ifdef GIT_SHA1_BUILTIN
+static void assert_accel_matches_dc(void)
+{
+	unsigned char data[1024], expected[GIT_HASH_SHA1_SIZE],
+		actual[GIT_HASH_SHA1_SIZE];
+	git_hash_ctx ctx;
+	size_t len, i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (unsigned char)(i * 31 + 7);
+
+	for (len = 0; len <= sizeof(data); len += (len < 160 ? 1 : 37)) {
+		cl_git_pass(git_hash_buf(expected, data, len, GIT_HASH_ALGORITHM_SHA1));
+		cl_git_pass(git_hash_buf_ext(actual, data, len, GIT_HASH_ALGORITHM_SHA1, GIT_HASH_TRUSTED));
+		cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA1_SIZE));
+
+		/* feed the data in uneven pieces */
+		cl_git_pass(git_hash_ctx_init_ext(&ctx, GIT_HASH_ALGORITHM_SHA1, GIT_HASH_TRUSTED));
+		for (i = 0; i < len; i += 13)
+			cl_git_pass(git_hash_update(&ctx, data + i, min(13, len - i)));
+		cl_git_pass(git_hash_final(actual, &ctx));
+		git_hash_ctx_cleanup(&ctx);
+
+		cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA1_SIZE));
+	}
+}
+#endif
+
+void test_sha1__accelerated_implementations(void)
+{
+#ifdef GIT_SHA1_BUILTIN
+	git_hash_sha1_accel_impl_t impls[] = {
+		GIT_HASH_SHA1_ACCEL_NONE,
+		GIT_HASH_SHA1_ACCEL_X86_SHANI,
+		GIT_HASH_SHA1_ACCEL_ARMV8
+	};
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(impls); i++) {
+		if (git_hash_sha1_accel_set_impl(impls[i]) < 0)
+			continue;
+
+		assert_accel_matches_dc();
+	}
+#endif
+}
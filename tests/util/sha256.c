@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "hash.h"
+#include "hash/sha256_accel.h"
 
 #define FIXTURE_DIR "sha1"
 
@@ -7,12 +8,24 @@
 static git_hash_win32_provider_t orig_provider;
 #endif
 
+#ifdef GIT_SHA256_BUILTIN
+static git_hash_sha256_accel_impl_t orig_accel_impl;
+#endif
+
+static bool orig_multi;
+
 void test_sha256__initialize(void)
 {
 #ifdef GIT_SHA256_WIN32
 	orig_provider = git_hash_win32_provider();
 #endif
 
+#ifdef GIT_SHA256_BUILTIN
+	orig_accel_impl = git_hash_sha256_accel_impl();
+#endif
+
+	orig_multi = git_hash_sha256_accel_multi_lanes() > 0;
+
 	cl_fixture_sandbox(FIXTURE_DIR);
 }
 
@@ -22,6 +35,12 @@ void test_sha256__cleanup(void)
 	git_hash_win32_set_provider(orig_provider);
 #endif
 
+#ifdef GIT_SHA256_BUILTIN
+	cl_git_pass(git_hash_sha256_accel_set_impl(orig_accel_impl));
+#endif
+
+	cl_git_pass(git_hash_sha256_accel_set_multi(orig_multi));
+
 	cl_fixture_cleanup(FIXTURE_DIR);
 }
 
@@ -111,3 +130,82 @@ void test_sha256__win32_providers(void)
 	cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA256_SIZE));
 #endif
 }
+
+#define MULTI_COUNT 67
+
+static void assert_multi_matches_single(void)
+{
+	unsigned char data[512], expected[GIT_HASH_SHA256_SIZE],
+		actual[MULTI_COUNT * GIT_HASH_SHA256_SIZE];
+	git_str_vec vec[MULTI_COUNT * 2];
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (unsigned char)(i * 17 + 3);
+
+	/* two-part messages of varying lengths, like an object header and its data */
+	for (i = 0; i < MULTI_COUNT; i++) {
+		vec[i * 2].data = data;
+		vec[i * 2].len = i % 9;
+		vec[i * 2 + 1].data = data + 9;
+		vec[i * 2 + 1].len = (i * 37) % (sizeof(data) - 9);
+	}
+
+	cl_git_pass(git_hash_vec_multi(actual, vec, 2, MULTI_COUNT,
+		GIT_HASH_ALGORITHM_SHA256, 0));
+
+	for (i = 0; i < MULTI_COUNT; i++) {
+		cl_git_pass(git_hash_vec(expected, &vec[i * 2], 2,
+			GIT_HASH_ALGORITHM_SHA256));
+		cl_assert_equal_i(0, memcmp(expected,
+			&actual[i * GIT_HASH_SHA256_SIZE], GIT_HASH_SHA256_SIZE));
+	}
+}
+
+void test_sha256__multi(void)
+{
+	cl_git_pass(git_hash_sha256_accel_set_multi(false));
+	assert_multi_matches_single();
+
+	if (git_hash_sha256_accel_set_multi(true) < 0)
+		cl_skip();
+
+	assert_multi_matches_single();
+}
+
+void test_sha256__accelerated_implementations(void)
+{
+#ifdef GIT_SHA256_BUILTIN
+	git_hash_sha256_accel_impl_t impls[] = {
+		GIT_HASH_SHA256_ACCEL_X86_SHANI,
+		GIT_HASH_SHA256_ACCEL_ARMV8
+	};
+	unsigned char data[1024], expected[GIT_HASH_SHA256_SIZE],
+		actual[GIT_HASH_SHA256_SIZE];
+	git_hash_ctx ctx;
+	size_t i, j, len;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (unsigned char)(i * 31 + 7);
+
+	for (i = 0; i < ARRAY_SIZE(impls); i++) {
+		for (len = 0; len <= sizeof(data); len += (len < 160 ? 1 : 37)) {
+			cl_git_pass(git_hash_sha256_accel_set_impl(GIT_HASH_SHA256_ACCEL_NONE));
+			cl_git_pass(git_hash_buf(expected, data, len, GIT_HASH_ALGORITHM_SHA256));
+
+			if (git_hash_sha256_accel_set_impl(impls[i]) < 0)
+				break;
+
+			cl_git_pass(git_hash_ctx_init(&ctx, GIT_HASH_ALGORITHM_SHA256));
+			for (j = 0; j < len; j += 13)
+				cl_git_pass(git_hash_update(&ctx, data + j, min(13, len - j)));
+			cl_git_pass(git_hash_final(actual, &ctx));
+			git_hash_ctx_cleanup(&ctx);
+
+			cl_assert_equal_i(0, memcmp(expected, actual, GIT_HASH_SHA256_SIZE));
+		}
+	}
+#else
+	cl_skip();
+#endif
+}
@@ -57,6 +57,39 @@ void test_zstream__basic(void)
 	assert_zlib_equal(data, strlen(data) + 1, out, outlen);
 }
 
+void test_zstream__partial_input(void)
+{
+	git_zstream z = GIT_ZSTREAM_INIT;
+	char out[128];
+	size_t outlen, total = 0, datalen = strlen(data) + 1, i;
+
+	cl_git_pass(git_zstream_init(&z, GIT_ZSTREAM_DEFLATE));
+
+	/* feed the input a few bytes at a time */
+	for (i = 0; i < datalen; i += 5) {
+		cl_git_pass(git_zstream_set_partial_input(&z, data + i, min(5, datalen - i)));
+
+		while (z.in_len) {
+			outlen = sizeof(out) - total;
+			cl_git_pass(git_zstream_get_output_chunk(out + total, &outlen, &z));
+			total += outlen;
+		}
+
+		cl_assert(!git_zstream_done(&z));
+	}
+
+	cl_git_pass(git_zstream_set_input(&z, NULL, 0));
+
+	outlen = sizeof(out) - total;
+	cl_git_pass(git_zstream_get_output(out + total, &outlen, &z));
+	total += outlen;
+
+	cl_assert(git_zstream_done(&z));
+	git_zstream_free(&z);
+
+	assert_zlib_equal(data, datalen, out, total);
+}
+
 void test_zstream__fails_on_trailing_garbage(void)
 {
 	git_str deflated = GIT_STR_INIT, inflated = GIT_STR_INIT;
@@ -84,6 +117,54 @@ void test_zstream__buffer(void)
 	git_str_dispose(&out);
 }
 
+void test_zstream__inflate_oneshot(void)
+{
+	git_str deflated = GIT_STR_INIT;
+	char out[128];
+	size_t out_len = sizeof(out), in_len, datalen = strlen(data) + 1;
+
+	cl_git_pass(git_zstream_deflatebuf(&deflated, data, datalen));
+
+	/* trailing data is left unconsumed */
+	in_len = deflated.size;
+	cl_git_pass(git_str_puts(&deflated, "trailing"));
+
+	cl_git_pass(git_zstream_inflate_oneshot(out, &out_len, deflated.ptr, &in_len));
+	cl_assert_equal_sz(datalen, out_len);
+	cl_assert_equal_sz(deflated.size - strlen("trailing"), in_len);
+	cl_assert_equal_s(data, out);
+
+	git_str_dispose(&deflated);
+}
+
+void test_zstream__inflate_oneshot_fails_on_short_output(void)
+{
+	git_str deflated = GIT_STR_INIT;
+	char out[128];
+	size_t out_len = strlen(data), in_len;
+
+	cl_git_pass(git_zstream_deflatebuf(&deflated, data, strlen(data) + 1));
+
+	in_len = deflated.size;
+	cl_git_fail(git_zstream_inflate_oneshot(out, &out_len, deflated.ptr, &in_len));
+
+	git_str_dispose(&deflated);
+}
+
+void test_zstream__inflate_oneshot_fails_on_truncated_input(void)
+{
+	git_str deflated = GIT_STR_INIT;
+	char out[128];
+	size_t out_len = sizeof(out), in_len;
+
+	cl_git_pass(git_zstream_deflatebuf(&deflated, data, strlen(data) + 1));
+
+	in_len = deflated.size - 6;
+	cl_git_fail(git_zstream_inflate_oneshot(out, &out_len, deflated.ptr, &in_len));
+
+	git_str_dispose(&deflated);
+}
+
 #define BIG_STRING_PART "Big Data IS Big - Long Data IS Long - We need a buffer larger than 1024 x 1024 to make sure we trigger chunked compression - Big Big Data IS Bigger than Big - Long Long Data IS Longer than Long"
 
 static void compress_and_decompress_input_various_ways(git_str *input)
@@ -135,6 +216,18 @@ static void compress_and_decompress_input_various_ways(git_str *input)
 	cl_assert_equal_i(input->size, inflated.size);
 	cl_assert(memcmp(input->ptr, inflated.ptr, inflated.size) == 0);
 
+	/* inflate with a single call into an exactly sized buffer */
+	{
+		size_t out_len = input->size, in_len = out1.size;
+
+		git_str_clear(&inflated);
+		cl_git_pass(git_str_grow(&inflated, input->size));
+		cl_git_pass(git_zstream_inflate_oneshot(inflated.ptr, &out_len, out1.ptr, &in_len));
+		cl_assert_equal_sz(input->size, out_len);
+		cl_assert_equal_sz(out1.size, in_len);
+		cl_assert(memcmp(input->ptr, inflated.ptr, out_len) == 0);
+	}
+
 	git_str_dispose(&out1);
 	git_str_dispose(&inflated);
 	git__free(fixed);